@@ -0,0 +1,152 @@
+/**
+ * @brief malloc vs. arena vs. pool: raw allocation, multi-threaded pools,
+ * deque push/pop and base64 round trips.
+ *
+ * Usage: alloc_bench [threads]
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "alloc.h"
+#include "base64.h"
+#include "deque.h"
+
+#define BATCH 1000
+#define ROUNDS 2000
+#define OBJ_SIZE 64
+#define DQ_ITEMS 1000000
+#define B64_ROUNDS 200000
+
+static volatile uintptr_t sink;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* allocate BATCH objects, touch them, free them; ROUNDS times */
+static double run_batches(allocator_t *a, arena_t *arena) {
+    void *objs[BATCH];
+    double t = now_sec();
+    size_t r, i;
+
+    for (r = 0; r < ROUNDS; r++) {
+        for (i = 0; i < BATCH; i++) {
+            objs[i] = al_alloc(a, OBJ_SIZE);
+            *(uintptr_t *)objs[i] = i;
+        }
+        for (i = 0; i < BATCH; i++) {
+            sink += *(uintptr_t *)objs[i];
+            al_free(a, objs[i], OBJ_SIZE);
+        }
+        if (arena) {
+            arena_reset(arena);
+        }
+    }
+    return (now_sec() - t) / ((double)ROUNDS * BATCH) * 1e9;
+}
+
+typedef struct {
+    allocator_t *a;
+    double ns;
+} thread_arg_t;
+
+static void *batch_thread(void *arg) {
+    thread_arg_t *t = arg;
+    t->ns = run_batches(t->a, NULL);
+    return NULL;
+}
+
+static double run_threads(allocator_t *a, size_t nthreads) {
+    pthread_t *threads = calloc(nthreads, sizeof(*threads));
+    thread_arg_t *args = calloc(nthreads, sizeof(*args));
+    double ns = 0;
+    size_t i;
+
+    for (i = 0; i < nthreads; i++) {
+        args[i].a = a;
+        pthread_create(&threads[i], NULL, batch_thread, &args[i]);
+    }
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+        ns += args[i].ns;
+    }
+    free(threads);
+    free(args);
+    return ns / nthreads;
+}
+
+static double run_deque(allocator_t *a) {
+    deque_t *dq = dq_create_with(a);
+    double t = now_sec();
+    long i;
+
+    for (i = 0; i < DQ_ITEMS; i++) {
+        dq_append(dq, (void *)i);
+    }
+    while (!dq_is_empty(dq)) {
+        sink += (uintptr_t)dq_pop(dq);
+    }
+    dq_destroy(dq, NULL);
+    return (now_sec() - t) / DQ_ITEMS * 1e9;
+}
+
+static double run_base64(allocator_t *a, arena_t *arena) {
+    static const char msg[] = "GET /index.html HTTP/1.1\r\nHost: example\r\n";
+    size_t enclen, declen, i;
+    char *enc, *dec;
+    double t = now_sec();
+
+    for (i = 0; i < B64_ROUNDS; i++) {
+        enc = b64encode_with(msg, sizeof(msg) - 1, B64_STANDARD, &enclen, a);
+        dec = b64decode_with(enc, enclen, B64_STANDARD, &declen, a);
+        sink += dec[0];
+        al_free(a, dec, declen + 1);
+        al_free(a, enc, enclen + 1);
+        if (arena) {
+            arena_reset(arena);
+        }
+    }
+    return (now_sec() - t) / B64_ROUNDS * 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t nthreads = argc > 1 ? strtoul(argv[1], NULL, 10) : (size_t)ncpu;
+    arena_t arena;
+    pool_t pool, shared, dqpool;
+
+    arena_init(&arena, 0);
+    pool_init(&pool, OBJ_SIZE, 0, false);
+    pool_init(&shared, OBJ_SIZE, 0, true);
+    pool_init(&dqpool, DQ_POOL_OBJ_SIZE, 0, true);
+
+    printf("%-24s %10s %10s %10s\n", "ns/op", "malloc", "arena", "pool");
+    printf("%-24s %10.1f %10.1f %10.1f\n", "alloc+free 64B",
+           run_batches(NULL, NULL),
+           run_batches(arena_allocator(&arena), &arena),
+           run_batches(pool_allocator(&pool), NULL));
+    printf("%-24s %10.1f %10s %10.1f\n", "alloc+free 64B, threads",
+           run_threads(NULL, nthreads), "-",
+           run_threads(pool_allocator(&shared), nthreads));
+    printf("%-24s %10.1f %10s %10.1f\n", "deque append+pop", run_deque(NULL),
+           "-", run_deque(pool_allocator(&dqpool)));
+    printf("%-24s %10.1f %10.1f %10s\n", "base64 round trip",
+           run_base64(NULL, NULL),
+           run_base64(arena_allocator(&arena), &arena), "-");
+    printf("(%zu threads)\n", nthreads);
+
+    arena_destroy(&arena);
+    pool_destroy(&pool);
+    pool_destroy(&shared);
+    pool_destroy(&dqpool);
+    return 0;
+}
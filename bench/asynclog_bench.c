@@ -0,0 +1,114 @@
+/**
+ * @brief Throughput and caller-side latency of log_info() with synchronous
+ * stderr writes vs. the asynchronous backend, under contention.
+ *
+ * Output goes to /dev/null (or the file named by the second argument).
+ * Usage: asynclog_bench [max_threads] [output_file]
+ */
+
+#define _GNU_SOURCE
+#define DBG_ASYNC
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "asynclog.h"
+#include "dbg.h"
+#include "instrument.h"
+
+#define CALLS 200000
+
+typedef struct {
+    inst_site_t *site;
+    long id;
+} thread_arg_t;
+
+static void *log_thread(void *arg) {
+    thread_arg_t *t = arg;
+    uint64_t start;
+    long i;
+
+    for (i = 0; i < CALLS; i++) {
+        start = inst_ticks();
+        log_info("thread %ld request %ld status %d", t->id, i, 200);
+        inst_record(t->site, inst_ticks() - start);
+    }
+    return NULL;
+}
+
+static void run(const char *name, size_t nthreads) {
+    pthread_t *threads = calloc(nthreads, sizeof(*threads));
+    thread_arg_t *args = calloc(nthreads, sizeof(*args));
+    inst_site_t site = {name, 0};
+    alog_stats_t stats = {0, 0, 0, 0};
+    inst_stats_t lat;
+    double t;
+    size_t i;
+
+    t = inst_now_ns();
+    for (i = 0; i < nthreads; i++) {
+        args[i].site = &site;
+        args[i].id = i;
+        pthread_create(&threads[i], NULL, log_thread, &args[i]);
+    }
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    t = (inst_now_ns() - t) / 1e9; /* callers done; excludes the final flush */
+    if (alog_active()) {
+        alog_flush();
+        alog_stats(&stats);
+    }
+    inst_region_stats(name, &lat);
+    printf("%-12s %7zu %12.0f %9.0f %9.0f %9.0f %10llu\n", name, nthreads,
+           nthreads * CALLS / t, lat.p50, lat.p99, lat.p999,
+           (unsigned long long)stats.dropped);
+    inst_reset();
+    free(threads);
+    free(args);
+}
+
+int main(int argc, char *argv[]) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = argc > 1 ? strtoul(argv[1], NULL, 10) : (size_t)ncpu;
+    const char *path = argc > 2 ? argv[2] : "/dev/null";
+    alog_config_t cfg;
+    size_t nthreads;
+    int fd, saved_stderr;
+
+    if (-1 == (fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644))) {
+        perror(path);
+        return 1;
+    }
+    saved_stderr = dup(STDERR_FILENO);
+    printf("%-12s %7s %12s %9s %9s %9s %10s\n", "mode", "threads", "calls/s",
+           "p50 ns", "p99 ns", "p999 ns", "dropped");
+    for (nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+        /* synchronous fprintf(stderr) */
+        dup2(fd, STDERR_FILENO);
+        run("sync", nthreads);
+        dup2(saved_stderr, STDERR_FILENO);
+
+        alog_config_init(&cfg);
+        alog_start(fd, &cfg);
+        run("async-drop", nthreads);
+        alog_stop();
+
+        cfg.policy = ALOG_BLOCK;
+        alog_start(fd, &cfg);
+        run("async-block", nthreads);
+        alog_stop();
+
+        if (nthreads == max_threads) {
+            break;
+        }
+        if (nthreads * 2 > max_threads) {
+            nthreads = max_threads / 2;
+        }
+    }
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,100 @@
+/**
+ * @brief base64 encode/decode throughput at several input sizes (see
+ * mubench.h for options).
+ */
+
+#include "mubench.h"
+
+#include "alloc.h"
+#include "base64.h"
+
+static char *random_bytes(size_t len) {
+    char *buf = malloc(len);
+    unsigned long x = 88172645463325252UL;
+    size_t i;
+
+    for (i = 0; buf && i < len; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buf[i] = (char)x;
+    }
+    return buf;
+}
+
+const char *bench_encode(mu_bench_t *b, size_t len) {
+    char *in = random_bytes(len), *out;
+    size_t outlen, i;
+
+    mu_assert(in, "Out of memory");
+    mu_bench_bytes(b, len);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        out = b64encode(in, len, B64_STANDARD, &outlen);
+        mu_do_not_optimize(out);
+        free(out);
+    }
+    mu_bench_pause(b);
+    free(in);
+    return NULL;
+}
+
+/* bytes/s is measured against the decoded size, like bench_encode() */
+const char *bench_decode(mu_bench_t *b, size_t len) {
+    char *raw = random_bytes(len), *in, *out;
+    size_t inlen, outlen, i;
+
+    mu_assert(raw, "Out of memory");
+    in = b64encode(raw, len, B64_STANDARD, &inlen);
+    mu_assert(in, "b64encode failed");
+    mu_bench_bytes(b, len);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        out = b64decode(in, inlen, B64_STANDARD, &outlen);
+        mu_do_not_optimize(out);
+        free(out);
+    }
+    mu_bench_pause(b);
+    free(raw);
+    free(in);
+    return NULL;
+}
+
+/* encode into an arena that is reset every iteration: no malloc/free */
+const char *bench_encode_arena(mu_bench_t *b, size_t len) {
+    char *in = random_bytes(len);
+    arena_t arena;
+    size_t outlen, i;
+
+    mu_assert(in, "Out of memory");
+    arena_init(&arena, 0);
+    mu_bench_bytes(b, len);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_do_not_optimize(
+            b64encode_with(in, len, B64_STANDARD, &outlen,
+                           arena_allocator(&arena)));
+        arena_reset(&arena);
+    }
+    mu_bench_pause(b);
+    arena_destroy(&arena);
+    free(in);
+    return NULL;
+}
+
+const char *all_benches() {
+    mu_suite_start();
+
+    mu_run_bench(bench_encode, 16);
+    mu_run_bench(bench_encode, 1024);
+    mu_run_bench(bench_encode, 1 << 20);
+    mu_run_bench(bench_encode_arena, 16);
+    mu_run_bench(bench_encode_arena, 1024);
+    mu_run_bench(bench_decode, 16);
+    mu_run_bench(bench_decode, 1024);
+    mu_run_bench(bench_decode, 1 << 20);
+
+    return NULL;
+}
+
+RUN_BENCHES(all_benches);
@@ -0,0 +1,286 @@
+/**
+ * @brief Compare two sets of mubench JSON results (see mubench.h) and fail
+ * if any benchmark got significantly slower.
+ *
+ * Usage: benchcmp [-t threshold_pct] [-a alpha] baseline.json current.json
+ *
+ * The samples of each benchmark are compared with a Mann-Whitney U test
+ * (normal approximation with tie correction, one-sided). A benchmark has
+ * regressed if its median is more than threshold_pct (default 5) percent
+ * slower and p < alpha (default 0.01). Exits 1 if any benchmark regressed.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_NAME 256
+
+typedef struct {
+    char name[MAX_NAME];
+    double *samples;
+    size_t n;
+    double median;
+} result_t;
+
+typedef struct {
+    result_t *items;
+    size_t n;
+} results_t;
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    char *buf = NULL;
+    size_t len = 0, cap = 0, n;
+
+    if (!f) {
+        return NULL;
+    }
+    do {
+        if (len + 4096 + 1 > cap) {
+            char *new = realloc(buf, cap = 2 * cap + 4096 + 1);
+            if (!new) {
+                free(buf);
+                fclose(f);
+                return NULL;
+            }
+            buf = new;
+        }
+        n = fread(buf + len, 1, 4096, f);
+        len += n;
+    } while (n > 0);
+    fclose(f);
+    buf[len] = '\0';
+    return buf;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(const double *v, size_t n) {
+    double *sorted = malloc(n * sizeof(double)), m;
+
+    memcpy(sorted, v, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), cmp_double);
+    m = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    free(sorted);
+    return m;
+}
+
+static void free_results(results_t *rs) {
+    size_t i;
+
+    for (i = 0; i < rs->n; i++) {
+        free(rs->items[i].samples);
+    }
+    free(rs->items);
+}
+
+/* Copy the JSON string starting after the opening quote at p into name.
+ * Returns a pointer past the closing quote, NULL if malformed. */
+static const char *parse_string(const char *p, char *name) {
+    size_t len = 0;
+
+    for (; *p && *p != '"'; p++) {
+        if (*p == '\\' && *++p == '\0') {
+            return NULL;
+        }
+        if (len < MAX_NAME - 1) {
+            name[len++] = *p;
+        }
+    }
+    name[len] = '\0';
+    return *p ? p + 1 : NULL;
+}
+
+/* Pull the name and samples_ns of every benchmark out of a mubench JSON
+ * file. Only the fields mubench writes are understood. */
+static int load(const char *path, results_t *out) {
+    char *json = read_file(path);
+    const char *p;
+    result_t *r;
+    char *end;
+    size_t cap = 0, scap;
+
+    out->items = NULL;
+    out->n = 0;
+    if (!json) {
+        return -1;
+    }
+    p = json;
+    while ((p = strstr(p, "\"name\": \""))) {
+        if (out->n == cap) {
+            result_t *new =
+                realloc(out->items, (cap = 2 * cap + 16) * sizeof(*r));
+            if (!new) {
+                goto error;
+            }
+            out->items = new;
+        }
+        r = &out->items[out->n];
+        r->samples = NULL;
+        r->n = 0;
+        if (!(p = parse_string(p + 9, r->name)) ||
+            !(p = strstr(p, "\"samples_ns\"")) || !(p = strchr(p, '['))) {
+            errno = EINVAL;
+            goto error;
+        }
+        p++;
+        scap = 0;
+        out->n++;
+        for (;;) {
+            double v;
+            while (isspace((unsigned char)*p) || *p == ',') {
+                p++;
+            }
+            if (*p == ']') {
+                break;
+            }
+            v = strtod(p, &end);
+            if (end == p) {
+                errno = EINVAL;
+                goto error;
+            }
+            if (r->n == scap) {
+                double *new = realloc(r->samples,
+                                      (scap = 2 * scap + 16) * sizeof(double));
+                if (!new) {
+                    goto error;
+                }
+                r->samples = new;
+            }
+            r->samples[r->n++] = v;
+            p = end;
+        }
+        if (r->n == 0) {
+            errno = EINVAL;
+            goto error;
+        }
+        r->median = median(r->samples, r->n);
+    }
+    free(json);
+    return 0;
+
+error:
+    free(json);
+    free_results(out);
+    return -1;
+}
+
+/* One-sided p-value for "b is slower than a" (larger values). */
+static double mann_whitney(const double *a, size_t na, const double *b,
+                           size_t nb) {
+    size_t n = na + nb, i, j;
+    double *all = malloc(n * sizeof(double));
+    double rank_b = 0, ties = 0, u, mean, var, z;
+
+    for (i = 0; i < na; i++) {
+        all[i] = a[i];
+    }
+    for (i = 0; i < nb; i++) {
+        all[na + i] = b[i];
+    }
+    qsort(all, n, sizeof(double), cmp_double);
+    /* midrank of each b sample: 1 + (# smaller) + (# equal - 1) / 2 */
+    for (j = 0; j < nb; j++) {
+        size_t less = 0, equal = 0;
+        for (i = 0; i < n; i++) {
+            less += all[i] < b[j];
+            equal += all[i] == b[j];
+        }
+        rank_b += 1 + less + (equal - 1) / 2.0;
+    }
+    for (i = 0; i < n; i = j) {
+        for (j = i; j < n && all[j] == all[i]; j++) {
+        }
+        ties += pow(j - i, 3) - (j - i);
+    }
+    free(all);
+
+    u = rank_b - nb * (nb + 1) / 2.0;
+    mean = na * nb / 2.0;
+    var = na * nb / 12.0 * ((n + 1) - ties / ((double)n * (n - 1)));
+    if (var <= 0) {
+        return 1;
+    }
+    z = (u - mean - 0.5) / sqrt(var); /* with continuity correction */
+    return 0.5 * erfc(z / sqrt(2));
+}
+
+int main(int argc, char *argv[]) {
+    double threshold = 5, alpha = 0.01, change, p;
+    results_t base, cur;
+    size_t i, j, regressed = 0, compared = 0;
+    int opt = 1;
+
+    for (; opt + 1 < argc && argv[opt][0] == '-'; opt += 2) {
+        if (!strcmp(argv[opt], "-t")) {
+            threshold = atof(argv[opt + 1]);
+        } else if (!strcmp(argv[opt], "-a")) {
+            alpha = atof(argv[opt + 1]);
+        } else {
+            break;
+        }
+    }
+    if (argc - opt != 2) {
+        fprintf(stderr, "usage: %s [-t threshold_pct] [-a alpha] "
+                "baseline.json current.json\n", argv[0]);
+        return 2;
+    }
+    if (load(argv[opt], &base) == -1) {
+        perror(argv[opt]);
+        return 2;
+    }
+    if (load(argv[opt + 1], &cur) == -1) {
+        perror(argv[opt + 1]);
+        free_results(&base);
+        return 2;
+    }
+
+    printf("%-40s %12s %12s %9s %8s\n", "benchmark", "base ns", "new ns",
+           "change", "p");
+    for (i = 0; i < cur.n; i++) {
+        result_t *c = &cur.items[i], *b = NULL;
+        for (j = 0; j < base.n && !b; j++) {
+            b = strcmp(base.items[j].name, c->name) ? NULL : &base.items[j];
+        }
+        if (!b) {
+            printf("%-40s %12s %12.1f %9s %8s  (new)\n", c->name, "-",
+                   c->median, "-", "-");
+            continue;
+        }
+        compared++;
+        change = 100 * (c->median - b->median) / b->median;
+        p = mann_whitney(b->samples, b->n, c->samples, c->n);
+        printf("%-40s %12.1f %12.1f %+8.1f%% %8.4f", c->name, b->median,
+               c->median, change, p);
+        if (change > threshold && p < alpha) {
+            printf("  REGRESSED\n");
+            regressed++;
+        } else {
+            printf("\n");
+        }
+    }
+    for (j = 0; j < base.n; j++) {
+        for (i = 0; i < cur.n && strcmp(base.items[j].name, cur.items[i].name);
+             i++) {
+        }
+        if (i == cur.n) {
+            printf("%-40s %12.1f %12s %9s %8s  (missing)\n",
+                   base.items[j].name, base.items[j].median, "-", "-", "-");
+        }
+    }
+    if (regressed) {
+        printf("%zu of %zu benchmarks regressed by more than %.1f%% "
+               "(p < %g)\n", regressed, compared, threshold, alpha);
+    }
+    free_results(&base);
+    free_results(&cur);
+    return regressed > 0;
+}
@@ -0,0 +1,187 @@
+/**
+ * @brief Bitset counting, bulk operations and scans against plain word loops
+ * (see mubench.h for options).
+ *
+ * Sizes are in bits: 2^19 bits is 64KB (in L2), 2^26 bits 8MB.
+ */
+
+#include "mubench.h"
+
+#include "bitset.h"
+#include "prng.h"
+
+static void fill_random(bitset_t *bs, uint64_t seed) {
+    prng_t r;
+
+    prng_seed(&r, seed);
+    prng_fill(&r, bs->words, bs->nwords);
+}
+
+const char *bench_count_loop(mu_bench_t *b, size_t nbits) {
+    bitset_t bs;
+    size_t i, j, c;
+
+    mu_assert(bs_init(&bs, nbits, NULL) == 0, "bs_init");
+    fill_random(&bs, 1);
+    mu_bench_bytes(b, nbits / 8);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        for (j = 0, c = 0; j < bs.nwords; j++) {
+            c += __builtin_popcountll(bs.words[j]);
+        }
+        mu_do_not_optimize(c);
+    }
+    mu_bench_pause(b);
+    bs_destroy(&bs);
+    return NULL;
+}
+
+const char *bench_count(mu_bench_t *b, size_t nbits) {
+    bitset_t bs;
+    size_t i;
+
+    mu_assert(bs_init(&bs, nbits, NULL) == 0, "bs_init");
+    fill_random(&bs, 1);
+    mu_bench_bytes(b, nbits / 8);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_do_not_optimize(bs_count(&bs));
+    }
+    mu_bench_pause(b);
+    bs_destroy(&bs);
+    return NULL;
+}
+
+const char *bench_or_loop(mu_bench_t *b, size_t nbits) {
+    bitset_t x, y;
+    size_t i, j;
+
+    mu_assert(bs_init(&x, nbits, NULL) == 0 && bs_init(&y, nbits, NULL) == 0,
+              "bs_init");
+    fill_random(&x, 1);
+    fill_random(&y, 2);
+    mu_bench_bytes(b, nbits / 8);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        for (j = 0; j < x.nwords; j++) {
+            x.words[j] |= y.words[j];
+        }
+        mu_clobber();
+    }
+    mu_bench_pause(b);
+    bs_destroy(&x);
+    bs_destroy(&y);
+    return NULL;
+}
+
+const char *bench_or(mu_bench_t *b, size_t nbits) {
+    bitset_t x, y;
+    size_t i;
+
+    mu_assert(bs_init(&x, nbits, NULL) == 0 && bs_init(&y, nbits, NULL) == 0,
+              "bs_init");
+    fill_random(&x, 1);
+    fill_random(&y, 2);
+    mu_bench_bytes(b, nbits / 8);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        bs_or(&x, &y);
+        mu_clobber();
+    }
+    mu_bench_pause(b);
+    bs_destroy(&x);
+    bs_destroy(&y);
+    return NULL;
+}
+
+/* visit every set bit of a bitset with one in every `sparsity` bits set */
+const char *bench_scan_test(mu_bench_t *b, size_t nbits, size_t sparsity) {
+    bitset_t bs;
+    size_t i, j, c;
+
+    mu_assert(bs_init(&bs, nbits, NULL) == 0, "bs_init");
+    for (j = 0; j < nbits; j += sparsity) {
+        bs_set(&bs, j);
+    }
+    mu_bench_bytes(b, nbits / 8);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        for (j = 0, c = 0; j < nbits; j++) {
+            if (bs_test(&bs, j)) {
+                c += j;
+            }
+        }
+        mu_do_not_optimize(c);
+    }
+    mu_bench_pause(b);
+    bs_destroy(&bs);
+    return NULL;
+}
+
+const char *bench_scan_next(mu_bench_t *b, size_t nbits, size_t sparsity) {
+    bitset_t bs;
+    size_t i, j, c;
+
+    mu_assert(bs_init(&bs, nbits, NULL) == 0, "bs_init");
+    for (j = 0; j < nbits; j += sparsity) {
+        bs_set(&bs, j);
+    }
+    mu_bench_bytes(b, nbits / 8);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        c = 0;
+        for (j = bs_next_set(&bs, 0); j != BS_NONE;
+             j = bs_next_set(&bs, j + 1)) {
+            c += j;
+        }
+        mu_do_not_optimize(c);
+    }
+    mu_bench_pause(b);
+    bs_destroy(&bs);
+    return NULL;
+}
+
+/* set random bits of a 64KB bitset, plainly or atomically */
+const char *bench_set(mu_bench_t *b, int atomic) {
+    size_t i, nbits = 1 << 19, mask = nbits - 1;
+    uint64_t x = 1;
+    bitset_t bs;
+
+    mu_assert(bs_init(&bs, nbits, NULL) == 0, "bs_init");
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        if (atomic) {
+            bs_set_atomic(&bs, (x >> 40) & mask);
+        } else {
+            bs_set(&bs, (x >> 40) & mask);
+        }
+    }
+    mu_bench_pause(b);
+    mu_do_not_optimize(bs.words[0]);
+    bs_destroy(&bs);
+    return NULL;
+}
+
+const char *all_benches() {
+    mu_suite_start();
+
+    mu_run_bench(bench_count_loop, 1 << 19);
+    mu_run_bench(bench_count, 1 << 19);
+    mu_run_bench(bench_count_loop, 1 << 26);
+    mu_run_bench(bench_count, 1 << 26);
+    mu_run_bench(bench_or_loop, 1 << 19);
+    mu_run_bench(bench_or, 1 << 19);
+    mu_run_bench(bench_or_loop, 1 << 26);
+    mu_run_bench(bench_or, 1 << 26);
+    mu_run_bench(bench_scan_test, 1 << 19, 1000);
+    mu_run_bench(bench_scan_next, 1 << 19, 1000);
+    mu_run_bench(bench_scan_test, 1 << 19, 10);
+    mu_run_bench(bench_scan_next, 1 << 19, 10);
+    mu_run_bench(bench_set, 0);
+    mu_run_bench(bench_set, 1);
+
+    return NULL;
+}
+
+RUN_BENCHES(all_benches);
@@ -0,0 +1,178 @@
+/**
+ * @brief Blocked Bloom filter lookups and adds against a hash set, for
+ * deduplicating 64-bit IDs (see mubench.h for options).
+ *
+ * Filters are sized for n IDs at the given false positive rate (in parts
+ * per 10000) and hold n IDs; half of the lookups are for IDs that are
+ * present. Each op is one lookup or add.
+ */
+
+#include "mubench.h"
+
+#include "bloom.h"
+#include "hashmap.h"
+
+HM_DEFINE(idset, uint64_t, char, hm_hash_u64, HM_EQ_VALUE)
+
+#define NPROBES (1 << 16)
+
+/* even probes were added, odd probes were not */
+static uint64_t *probes(size_t n) {
+    uint64_t *p = malloc(NPROBES * sizeof(*p));
+    size_t i;
+
+    for (i = 0; p && i < NPROBES; i++) {
+        p[i] = hm_hash_u64(i % 2 ? n + i : i * (n / NPROBES + 1) % n);
+    }
+    return p;
+}
+
+static const char *filled(bloom_t *bf, size_t n, unsigned rate) {
+    size_t i;
+
+    mu_assert(bloom_init(bf, n, rate / 10000.0, NULL) == 0, "bloom_init");
+    for (i = 0; i < n; i++) {
+        bloom_add(bf, hm_hash_u64(i));
+    }
+    return NULL;
+}
+
+const char *bench_contains(mu_bench_t *b, size_t n, unsigned rate) {
+    uint64_t *hashes = probes(n);
+    const char *err;
+    size_t i, c = 0;
+    bloom_t bf;
+
+    mu_assert(hashes, "Out of memory");
+    if ((err = filled(&bf, n, rate))) {
+        return err;
+    }
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        c += bloom_contains(&bf, hashes[i % NPROBES]);
+    }
+    mu_bench_pause(b);
+    mu_do_not_optimize(c);
+    bloom_destroy(&bf);
+    free(hashes);
+    return NULL;
+}
+
+const char *bench_contains_n(mu_bench_t *b, size_t n, unsigned rate) {
+    uint64_t *hashes = probes(n);
+    bool *found = malloc(NPROBES * sizeof(*found));
+    size_t i, len, c = 0;
+    const char *err;
+    bloom_t bf;
+
+    mu_assert(hashes && found, "Out of memory");
+    if ((err = filled(&bf, n, rate))) {
+        return err;
+    }
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i += len) {
+        len = MIN(b->iters - i, NPROBES);
+        c += bloom_contains_n(&bf, hashes, len, found);
+    }
+    mu_bench_pause(b);
+    mu_do_not_optimize(c);
+    bloom_destroy(&bf);
+    free(hashes);
+    free(found);
+    return NULL;
+}
+
+/* the dedupe step: add each ID, learning whether it was (probably) seen */
+const char *bench_add(mu_bench_t *b, size_t n, int atomic) {
+    size_t i, c = 0;
+    bloom_t bf;
+
+    mu_assert(bloom_init(&bf, n, 0.01, NULL) == 0, "bloom_init");
+    bs_set_all(&bf.bits); /* fault the pages in, untimed */
+    bloom_clear(&bf);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        if (i && i % n == 0) {
+            bloom_clear(&bf);
+        }
+        if (atomic) {
+            c += bloom_add_atomic(&bf, hm_hash_u64(i));
+        } else {
+            c += bloom_add(&bf, hm_hash_u64(i));
+        }
+    }
+    mu_bench_pause(b);
+    mu_do_not_optimize(c);
+    bloom_destroy(&bf);
+    return NULL;
+}
+
+/* what the filter replaces: an exact set of the IDs */
+const char *bench_set_contains(mu_bench_t *b, size_t n) {
+    size_t i, c = 0;
+    idset_t set;
+
+    idset_init(&set, NULL);
+    mu_assert(idset_reserve(&set, n) == 0, "Out of memory");
+    for (i = 0; i < n; i++) {
+        idset_put(&set, i, 1);
+    }
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        /* the same mix of present and absent IDs as the filter's probes */
+        c += idset_find(&set, i % 2 ? n + i % NPROBES
+                                    : i % NPROBES * (n / NPROBES + 1) % n) !=
+             NULL;
+    }
+    mu_bench_pause(b);
+    mu_do_not_optimize(c);
+    idset_destroy(&set);
+    return NULL;
+}
+
+const char *bench_set_add(mu_bench_t *b, size_t n) {
+    size_t i, c = 0;
+    bool inserted;
+    idset_t set;
+
+    idset_init(&set, NULL);
+    mu_assert(idset_reserve(&set, n) == 0, "Out of memory");
+    for (i = 0; i < n; i++) {
+        idset_put(&set, i, 1); /* fault the pages in, untimed */
+    }
+    idset_clear(&set);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        if (i && i % n == 0) {
+            idset_clear(&set);
+        }
+        idset_insert(&set, i, &inserted);
+        c += inserted;
+    }
+    mu_bench_pause(b);
+    mu_do_not_optimize(c);
+    idset_destroy(&set);
+    return NULL;
+}
+
+const char *all_benches() {
+    mu_suite_start();
+
+    mu_run_bench(bench_contains, 100000, 100);
+    mu_run_bench(bench_contains_n, 100000, 100);
+    mu_run_bench(bench_set_contains, 100000);
+    mu_run_bench(bench_contains, 10000000, 100);
+    mu_run_bench(bench_contains_n, 10000000, 100);
+    mu_run_bench(bench_contains, 10000000, 1);
+    mu_run_bench(bench_contains_n, 10000000, 1);
+    mu_run_bench(bench_set_contains, 10000000);
+    mu_run_bench(bench_add, 100000, 0);
+    mu_run_bench(bench_add, 100000, 1);
+    mu_run_bench(bench_set_add, 100000);
+    mu_run_bench(bench_add, 10000000, 0);
+    mu_run_bench(bench_set_add, 10000000);
+
+    return NULL;
+}
+
+RUN_BENCHES(all_benches);
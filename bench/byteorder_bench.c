@@ -0,0 +1,121 @@
+/**
+ * @brief Converting arrays of big-endian integers to host order: the byte
+ * reassembly loop utils.c used to provide, ntohl(), the bswap helpers and
+ * the bulk converters (see mubench.h for options).
+ */
+
+#define _GNU_SOURCE
+#include "mubench.h"
+
+#include <arpa/inet.h>
+#include "byteorder.h"
+
+/* 64 KiB: large enough for the loops to dominate, small enough for L2 */
+#define BUF_BYTES (64 * 1024)
+
+static uint8_t src[BUF_BYTES], dst[BUF_BYTES];
+
+/* the former src/utils.c ntohl(), which shadowed libc's */
+static uint32_t ntohl_bytes(uint32_t n) {
+    unsigned char *np = (unsigned char *)&n;
+
+    return ((uint32_t)np[0] << 24) | ((uint32_t)np[1] << 16) |
+           ((uint32_t)np[2] << 8) | (uint32_t)np[3];
+}
+
+const char *bench_loop_bytes(mu_bench_t *b) {
+    uint32_t *in = (uint32_t *)src, *out = (uint32_t *)dst;
+    size_t i, j;
+
+    mu_bench_bytes(b, BUF_BYTES);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        for (j = 0; j < BUF_BYTES / 4; j++) {
+            out[j] = ntohl_bytes(in[j]);
+        }
+        mu_clobber();
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_loop_ntohl(mu_bench_t *b) {
+    uint32_t *in = (uint32_t *)src, *out = (uint32_t *)dst;
+    size_t i, j;
+
+    mu_bench_bytes(b, BUF_BYTES);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        for (j = 0; j < BUF_BYTES / 4; j++) {
+            out[j] = ntohl(in[j]);
+        }
+        mu_clobber();
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_loop_load(mu_bench_t *b) {
+    uint32_t *out = (uint32_t *)dst;
+    size_t i, j;
+
+    mu_bench_bytes(b, BUF_BYTES);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        for (j = 0; j < BUF_BYTES / 4; j++) {
+            out[j] = bo_load_be32(src + 4 * j);
+        }
+        mu_clobber();
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_bulk(mu_bench_t *b, int width) {
+    void (*swap)(void *, const void *, size_t) =
+        width == 2 ? bo_be16_n : width == 4 ? bo_be32_n : bo_be64_n;
+    size_t i;
+
+    mu_bench_bytes(b, BUF_BYTES);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        swap(dst, src, BUF_BYTES / width);
+        mu_clobber();
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_bulk_inplace(mu_bench_t *b) {
+    size_t i;
+
+    mu_bench_bytes(b, BUF_BYTES);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        bo_be32_n(dst, dst, BUF_BYTES / 4);
+        mu_clobber();
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *all_benches() {
+    size_t i;
+
+    mu_suite_start();
+    for (i = 0; i < BUF_BYTES; i++) {
+        src[i] = (uint8_t)i;
+    }
+
+    mu_run_bench(bench_loop_bytes);
+    mu_run_bench(bench_loop_ntohl);
+    mu_run_bench(bench_loop_load);
+    mu_run_bench(bench_bulk, 2);
+    mu_run_bench(bench_bulk, 4);
+    mu_run_bench(bench_bulk, 8);
+    mu_run_bench(bench_bulk_inplace);
+
+    return NULL;
+}
+
+RUN_BENCHES(all_benches);
@@ -0,0 +1,94 @@
+/**
+ * @brief Deque operations with malloc'd vs. pooled nodes (see mubench.h for
+ * options).
+ */
+
+#include "mubench.h"
+
+#include "alloc.h"
+#include "deque.h"
+
+#define SORT_ITEMS 10000
+
+/* push then pop n items at the head: LIFO */
+const char *bench_push_pop(mu_bench_t *b, size_t n, bool pooled) {
+    pool_t pool;
+    deque_t *dq;
+    size_t i, j;
+
+    mu_assert(pool_init(&pool, DQ_POOL_OBJ_SIZE, 0, false) == 0, "pool_init failed");
+    dq = dq_create_with(pooled ? pool_allocator(&pool) : NULL);
+    mu_assert(dq, "dq_create_with failed");
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        for (j = 0; j < n; j++) {
+            dq_push(dq, (void *)j);
+        }
+        for (j = 0; j < n; j++) {
+            mu_do_not_optimize(dq_pop(dq));
+        }
+    }
+    mu_bench_pause(b);
+    dq_destroy(dq, NULL);
+    pool_destroy(&pool);
+    return NULL;
+}
+
+/* append at the tail, pop from the head: FIFO */
+const char *bench_append_pop(mu_bench_t *b, size_t n, bool pooled) {
+    pool_t pool;
+    deque_t *dq;
+    size_t i, j;
+
+    mu_assert(pool_init(&pool, DQ_POOL_OBJ_SIZE, 0, false) == 0, "pool_init failed");
+    dq = dq_create_with(pooled ? pool_allocator(&pool) : NULL);
+    mu_assert(dq, "dq_create_with failed");
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        for (j = 0; j < n; j++) {
+            dq_append(dq, (void *)j);
+        }
+        for (j = 0; j < n; j++) {
+            mu_do_not_optimize(dq_pop(dq));
+        }
+    }
+    mu_bench_pause(b);
+    dq_destroy(dq, NULL);
+    pool_destroy(&pool);
+    return NULL;
+}
+
+const char *bench_sorted(mu_bench_t *b) {
+    deque_t *dq = dq_create(), *sorted;
+    unsigned long x = 1;
+    size_t i;
+
+    mu_assert(dq, "dq_create failed");
+    for (i = 0; i < SORT_ITEMS; i++) {
+        x = x * 6364136223846793005UL + 1442695040888963407UL;
+        dq_append(dq, (void *)(x >> 33));
+    }
+    for (i = 0; i < b->iters; i++) {
+        mu_bench_resume(b);
+        sorted = dq_sorted(dq);
+        mu_bench_pause(b);
+        mu_assert(sorted, "dq_sorted failed");
+        dq_destroy(sorted, NULL);
+    }
+    dq_destroy(dq, NULL);
+    return NULL;
+}
+
+const char *all_benches() {
+    mu_suite_start();
+
+    mu_run_bench(bench_push_pop, 1000, false);
+    mu_run_bench(bench_push_pop, 1000, true);
+    mu_run_bench(bench_append_pop, 1000, false);
+    mu_run_bench(bench_append_pop, 1000, true);
+    mu_run_bench(bench_sorted);
+
+    return NULL;
+}
+
+RUN_BENCHES(all_benches);
@@ -0,0 +1,209 @@
+/**
+ * @brief Whole-file reads, line iteration and sequential writes through
+ * fileio against stdio (see mubench.h for options).
+ *
+ * Each iteration processes one file of FIO_BENCH_MB megabytes (default 2048)
+ * of 80-byte text lines, created in TMPDIR (default /tmp). Reads mostly hit
+ * the page cache once the file has been read; drop caches between runs to
+ * measure the disk instead.
+ */
+
+#define _GNU_SOURCE
+#include "mubench.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include "fileio.h"
+
+#define LINE_LEN 80
+#define CHUNK (1024 * 1024)
+
+static char in_path[256], out_path[256];
+static size_t file_size;
+
+/* a line of LINE_LEN bytes, '\n' included */
+static void make_line(char *line, size_t n) {
+    int len = snprintf(line, LINE_LEN, "%zu,", n);
+
+    memset(line + len, 'a' + n % 26, LINE_LEN - 1 - len);
+    line[LINE_LEN - 1] = '\n';
+}
+
+static const char *create_input(void) {
+    const char *dir = getenv("TMPDIR"), *mb = getenv("FIO_BENCH_MB");
+    char *buf = malloc(CHUNK);
+    size_t n = 0, off;
+    file_writer_t w;
+
+    mu_assert(buf, "Out of memory");
+    file_size = ROUNDUP((size_t)(mb ? atol(mb) : 2048) << 20, LINE_LEN);
+    snprintf(in_path, sizeof(in_path), "%s/fileio_bench.in", dir ? dir : "/tmp");
+    snprintf(out_path, sizeof(out_path), "%s/fileio_bench.out",
+             dir ? dir : "/tmp");
+    mu_assert(fio_writer_open(&w, in_path, 0, 0) == 0, "Cannot create %s",
+              in_path);
+    while (n < file_size / LINE_LEN) {
+        for (off = 0; off + LINE_LEN <= CHUNK && n < file_size / LINE_LEN;
+             off += LINE_LEN) {
+            make_line(buf + off, n++);
+        }
+        mu_assert(fio_write(&w, buf, off) == 0, "Write to %s failed", in_path);
+    }
+    mu_assert(fio_writer_close(&w) == 0, "Write to %s failed", in_path);
+    free(buf);
+    return NULL;
+}
+
+static size_t count_lines(const char *p, size_t len) {
+    const char *end = p + len;
+    size_t n = 0;
+
+    while ((p = memchr(p, '\n', end - p))) {
+        p++;
+        n++;
+    }
+    return n;
+}
+
+/* the usual way: fread() the whole file into a malloc()'d buffer */
+const char *bench_read_fread(mu_bench_t *b) {
+    size_t i, lines;
+    char *buf;
+    FILE *f;
+
+    mu_bench_bytes(b, file_size);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_assert((f = fopen(in_path, "r")), "fopen failed");
+        mu_assert((buf = malloc(file_size)), "Out of memory");
+        mu_assert(fread(buf, 1, file_size, f) == file_size, "Short read");
+        lines = count_lines(buf, file_size);
+        mu_assert(lines == file_size / LINE_LEN, "Counted %zu lines", lines);
+        free(buf);
+        fclose(f);
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_read_map(mu_bench_t *b, int flags) {
+    file_map_t m;
+    size_t i, lines;
+
+    mu_bench_bytes(b, file_size);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_assert(fio_map(&m, in_path, flags) == 0, "fio_map failed");
+        lines = count_lines(m.data, m.len);
+        mu_assert(lines == file_size / LINE_LEN, "Counted %zu lines", lines);
+        fio_unmap(&m);
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_lines_getline(mu_bench_t *b) {
+    size_t i, lines, cap = 0;
+    char *line = NULL;
+    FILE *f;
+
+    mu_bench_bytes(b, file_size);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_assert((f = fopen(in_path, "r")), "fopen failed");
+        for (lines = 0; getline(&line, &cap, f) > 0; lines++) {
+            mu_do_not_optimize(line[0]);
+        }
+        mu_assert(lines == file_size / LINE_LEN, "Read %zu lines", lines);
+        fclose(f);
+    }
+    mu_bench_pause(b);
+    free(line);
+    return NULL;
+}
+
+const char *bench_lines_reader(mu_bench_t *b) {
+    file_reader_t r;
+    size_t i, lines;
+    str_t line;
+
+    mu_bench_bytes(b, file_size);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_assert(fio_reader_open(&r, in_path, 0) == 0, "fio_reader_open failed");
+        for (lines = 0; fio_next_line(&r, &line) >= 0; lines++) {
+            mu_do_not_optimize(line.ptr[0]);
+        }
+        mu_assert(lines == file_size / LINE_LEN, "Read %zu lines", lines);
+        fio_reader_close(&r);
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+/* writes go out one line at a time, as a log or CSV export would */
+const char *bench_write_fwrite(mu_bench_t *b) {
+    char line[LINE_LEN];
+    size_t i, n;
+    FILE *f;
+
+    make_line(line, 0);
+    mu_bench_bytes(b, file_size);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_assert((f = fopen(out_path, "w")), "fopen failed");
+        for (n = 0; n < file_size / LINE_LEN; n++) {
+            fwrite(line, 1, LINE_LEN, f);
+        }
+        mu_assert(fclose(f) == 0, "fclose failed");
+    }
+    mu_bench_pause(b);
+    unlink(out_path);
+    return NULL;
+}
+
+const char *bench_write(mu_bench_t *b, int flags) {
+    char line[LINE_LEN];
+    file_writer_t w;
+    size_t i, n;
+
+    make_line(line, 0);
+    mu_bench_bytes(b, file_size);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_assert(fio_writer_open(&w, out_path, flags, 0) == 0,
+                  "fio_writer_open failed");
+        for (n = 0; n < file_size / LINE_LEN; n++) {
+            fio_write(&w, line, LINE_LEN);
+        }
+        mu_assert(fio_writer_close(&w) == 0, "fio_writer_close failed");
+    }
+    mu_bench_pause(b);
+    unlink(out_path);
+    return NULL;
+}
+
+const char *all_benches() {
+    const char *err;
+
+    mu_suite_start();
+    if ((err = create_input())) {
+        return err;
+    }
+
+    mu_run_bench(bench_read_fread);
+    mu_run_bench(bench_read_map, 0);
+    mu_run_bench(bench_read_map, FIO_SEQUENTIAL);
+    mu_run_bench(bench_read_map, FIO_POPULATE);
+    mu_run_bench(bench_read_map, FIO_HUGEPAGES | FIO_SEQUENTIAL);
+    mu_run_bench(bench_lines_getline);
+    mu_run_bench(bench_lines_reader);
+    mu_run_bench(bench_write_fwrite);
+    mu_run_bench(bench_write, 0);
+    mu_run_bench(bench_write, FIO_DIRECT);
+
+    unlink(in_path);
+    return NULL;
+}
+
+RUN_BENCHES(all_benches);
@@ -0,0 +1,291 @@
+/**
+ * @brief Swiss-table maps (generic hashmap_t and an HM_DEFINE() map) vs. a
+ * chained hash table with one malloc'd node per entry: insert, successful
+ * and failed lookup, and erase at sizes in and out of cache (see mubench.h
+ * for options).
+ */
+
+#include "mubench.h"
+
+#include <stdint.h>
+#include "hashmap.h"
+
+HM_DEFINE(u64map, uint64_t, uint64_t, hm_hash_u64, HM_EQ_VALUE)
+
+enum { CHAINED, GENERIC, TYPED };
+
+/*********************************************************************
+ * The baseline: what gets hand-rolled
+ *********************************************************************/
+
+typedef struct ChainNode {
+    struct ChainNode *next;
+    uint64_t key;
+    uint64_t val;
+} chain_node_t;
+
+typedef struct {
+    chain_node_t **buckets;
+    size_t nbuckets; /* power of two */
+    size_t size;
+} chained_t;
+
+static void chained_init(chained_t *t) {
+    t->nbuckets = 16;
+    t->buckets = calloc(t->nbuckets, sizeof(*t->buckets));
+    t->size = 0;
+}
+
+static void chained_destroy(chained_t *t) {
+    chain_node_t *n, *next;
+    size_t i;
+
+    for (i = 0; i < t->nbuckets; i++) {
+        for (n = t->buckets[i]; n; n = next) {
+            next = n->next;
+            free(n);
+        }
+    }
+    free(t->buckets);
+}
+
+static void chained_put(chained_t *t, uint64_t key, uint64_t val) {
+    chain_node_t **b, *n, *next;
+    size_t i;
+
+    if (t->size == t->nbuckets) {
+        chain_node_t **old = t->buckets;
+        size_t oldn = t->nbuckets;
+        t->nbuckets *= 2;
+        t->buckets = calloc(t->nbuckets, sizeof(*t->buckets));
+        for (i = 0; i < oldn; i++) {
+            for (n = old[i]; n; n = next) {
+                next = n->next;
+                b = &t->buckets[hm_hash_u64(n->key) & (t->nbuckets - 1)];
+                n->next = *b;
+                *b = n;
+            }
+        }
+        free(old);
+    }
+    b = &t->buckets[hm_hash_u64(key) & (t->nbuckets - 1)];
+    for (n = *b; n; n = n->next) {
+        if (n->key == key) {
+            n->val = val;
+            return;
+        }
+    }
+    n = malloc(sizeof(*n));
+    n->key = key;
+    n->val = val;
+    n->next = *b;
+    *b = n;
+    t->size++;
+}
+
+static uint64_t *chained_find(chained_t *t, uint64_t key) {
+    chain_node_t *n = t->buckets[hm_hash_u64(key) & (t->nbuckets - 1)];
+
+    for (; n; n = n->next) {
+        if (n->key == key) {
+            return &n->val;
+        }
+    }
+    return NULL;
+}
+
+static void chained_erase(chained_t *t, uint64_t key) {
+    chain_node_t **p = &t->buckets[hm_hash_u64(key) & (t->nbuckets - 1)], *n;
+
+    for (; (n = *p); p = &n->next) {
+        if (n->key == key) {
+            *p = n->next;
+            free(n);
+            t->size--;
+            return;
+        }
+    }
+}
+
+/*********************************************************************
+ * One interface over the three tables
+ *********************************************************************/
+
+typedef struct {
+    int kind;
+    chained_t chained;
+    hashmap_t *generic;
+    u64map_t typed;
+} table_t;
+
+static void table_init(table_t *t, int kind) {
+    t->kind = kind;
+    if (kind == CHAINED) {
+        chained_init(&t->chained);
+    } else if (kind == GENERIC) {
+        t->generic = hm_create(hm_hash_ptr, NULL);
+    } else {
+        u64map_init(&t->typed, NULL);
+    }
+}
+
+static void table_destroy(table_t *t) {
+    if (t->kind == CHAINED) {
+        chained_destroy(&t->chained);
+    } else if (t->kind == GENERIC) {
+        hm_destroy(t->generic, NULL, NULL);
+    } else {
+        u64map_destroy(&t->typed);
+    }
+}
+
+static inline void table_put(table_t *t, uint64_t key) {
+    if (t->kind == CHAINED) {
+        chained_put(&t->chained, key, key);
+    } else if (t->kind == GENERIC) {
+        hm_put(t->generic, (void *)(uintptr_t)key, (void *)(uintptr_t)key);
+    } else {
+        u64map_put(&t->typed, key, key);
+    }
+}
+
+static inline bool table_has(table_t *t, uint64_t key) {
+    if (t->kind == CHAINED) {
+        return chained_find(&t->chained, key) != NULL;
+    } else if (t->kind == GENERIC) {
+        return hm_find(t->generic, (void *)(uintptr_t)key) != NULL;
+    }
+    return u64map_find(&t->typed, key) != NULL;
+}
+
+static inline void table_erase(table_t *t, uint64_t key) {
+    if (t->kind == CHAINED) {
+        chained_erase(&t->chained, key);
+    } else if (t->kind == GENERIC) {
+        hm_erase(t->generic, (void *)(uintptr_t)key, NULL, NULL);
+    } else {
+        u64map_erase(&t->typed, key, NULL, NULL);
+    }
+}
+
+/* n distinct pseudo-random keys, none of them 0 */
+static uint64_t *make_keys(size_t n, uint64_t seed) {
+    uint64_t *keys = malloc(n * sizeof(*keys));
+    size_t i;
+
+    for (i = 0; keys && i < n; i++) {
+        keys[i] = hm_hash_u64(seed + i) | 1;
+    }
+    return keys;
+}
+
+static const char *kind_name(int kind) {
+    return kind == CHAINED ? "chained" : kind == GENERIC ? "generic" : "typed";
+}
+
+/*********************************************************************
+ * Benchmarks: one iteration is one operation
+ *********************************************************************/
+
+const char *bench_insert(mu_bench_t *b, int kind, size_t n) {
+    uint64_t *keys = make_keys(n, 1);
+    table_t t;
+    size_t i, j = 0;
+
+    mu_assert(keys, "Out of memory");
+    table_init(&t, kind);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        table_put(&t, keys[j]);
+        if (++j == n) { /* start over with an empty table */
+            mu_bench_pause(b);
+            table_destroy(&t);
+            table_init(&t, kind);
+            j = 0;
+            mu_bench_resume(b);
+        }
+    }
+    mu_bench_pause(b);
+    table_destroy(&t);
+    free(keys);
+    return NULL;
+}
+
+/* hit: look up keys that are present; otherwise keys that are not */
+const char *bench_lookup(mu_bench_t *b, int kind, size_t n, bool hit) {
+    uint64_t *keys = make_keys(n, 1), *probes = hit ? keys : make_keys(n, n + 1);
+    size_t i, j = 0, found = 0;
+    table_t t;
+
+    mu_assert(keys && probes, "Out of memory");
+    table_init(&t, kind);
+    for (i = 0; i < n; i++) {
+        table_put(&t, keys[i]);
+    }
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        found += table_has(&t, probes[j]);
+        j = j + 1 == n ? 0 : j + 1;
+    }
+    mu_bench_pause(b);
+    mu_assert(found == (hit ? b->iters : 0), "%s: %zu of %zu found",
+              kind_name(kind), found, b->iters);
+    table_destroy(&t);
+    if (probes != keys) {
+        free(probes);
+    }
+    free(keys);
+    return NULL;
+}
+
+/* erase keys from a full table, refilling it (untimed) when empty */
+const char *bench_erase(mu_bench_t *b, int kind, size_t n) {
+    uint64_t *keys = make_keys(n, 1);
+    table_t t;
+    size_t i = 0, j, batch;
+
+    mu_assert(keys, "Out of memory");
+    table_init(&t, kind);
+    while (i < b->iters) {
+        for (j = 0; j < n; j++) {
+            table_put(&t, keys[j]);
+        }
+        batch = MIN(n, b->iters - i);
+        mu_bench_resume(b);
+        for (j = 0; j < batch; j++) {
+            table_erase(&t, keys[j]);
+        }
+        mu_bench_pause(b);
+        i += batch;
+    }
+    table_destroy(&t);
+    free(keys);
+    return NULL;
+}
+
+const char *all_benches() {
+    mu_suite_start();
+
+    mu_run_bench(bench_insert, CHAINED, 1000);
+    mu_run_bench(bench_insert, GENERIC, 1000);
+    mu_run_bench(bench_insert, TYPED, 1000);
+    mu_run_bench(bench_insert, CHAINED, 1000000);
+    mu_run_bench(bench_insert, GENERIC, 1000000);
+    mu_run_bench(bench_insert, TYPED, 1000000);
+    mu_run_bench(bench_lookup, CHAINED, 1000, true);
+    mu_run_bench(bench_lookup, GENERIC, 1000, true);
+    mu_run_bench(bench_lookup, TYPED, 1000, true);
+    mu_run_bench(bench_lookup, CHAINED, 1000000, true);
+    mu_run_bench(bench_lookup, GENERIC, 1000000, true);
+    mu_run_bench(bench_lookup, TYPED, 1000000, true);
+    mu_run_bench(bench_lookup, CHAINED, 1000000, false);
+    mu_run_bench(bench_lookup, GENERIC, 1000000, false);
+    mu_run_bench(bench_lookup, TYPED, 1000000, false);
+    mu_run_bench(bench_erase, CHAINED, 100000);
+    mu_run_bench(bench_erase, GENERIC, 100000);
+    mu_run_bench(bench_erase, TYPED, 100000);
+
+    return NULL;
+}
+
+RUN_BENCHES(all_benches);
@@ -0,0 +1,186 @@
+/**
+ * @brief TCP over loopback: request/response round trips and one-way stream
+ * throughput through sendall()/recv_count() (see mubench.h for options).
+ *
+ * Round trips are timed three ways: blocking calls, blocking calls after
+ * setting SO_RCVTIMEO as recv_timeout() used to on every call, and the
+ * poll()-based *_deadline() calls. The drip benchmark receives with a 1 ms
+ * budget from a peer that sends a byte every 100 us, so each op should take
+ * just over 1 ms however long the peer keeps going.
+ */
+
+#define _GNU_SOURCE
+#include "mubench.h"
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "network.h"
+
+#define STREAM_CHUNK (64 * 1024)
+
+/* The first byte a client sends picks what the server does with the rest. */
+enum { ECHO = 'e', SINK = 's', DRIP = 'd' };
+
+/* How round trips send and receive */
+enum { BLOCKING, RCVTIMEO, DEADLINE };
+
+static int listener = -1;
+static char port[8];
+
+static void *serve(void *arg) {
+    int fd = (long)arg;
+    char buf[STREAM_CHUNK], mode;
+    size_t len;
+    ssize_t n;
+
+    if (recv(fd, &mode, 1, MSG_WAITALL) == 1 && mode == DRIP) {
+        while (send(fd, "", 1, 0) == 1) {
+            usleep(100);
+        }
+    } else if (mode == ECHO || mode == SINK) {
+        while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+            len = n;
+            if (mode == ECHO && sendall(fd, buf, &len) == -1) {
+                break;
+            }
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+static void *accept_loop(void *arg) {
+    pthread_t thread;
+    int fd;
+
+    (void)arg;
+    while ((fd = accept(listener, NULL, NULL)) != -1) {
+        pthread_create(&thread, NULL, serve, (void *)(long)fd);
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+static const char *start_server(void) {
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    pthread_t thread;
+
+    signal(SIGPIPE, SIG_IGN); /* DRIP sends until the client has gone */
+    listener = tcp_server_listen("0");
+    mu_assert(listener != -1, "tcp_server_listen failed");
+    mu_assert(getsockname(listener, (struct sockaddr *)&addr, &addrlen) == 0,
+              "getsockname failed");
+    /* sin_port and sin6_port are at the same offset */
+    snprintf(port, sizeof(port), "%u",
+             ntohs(((struct sockaddr_in *)&addr)->sin_port));
+    pthread_create(&thread, NULL, accept_loop, NULL);
+    pthread_detach(thread);
+    return NULL;
+}
+
+static int connect_as(char mode) {
+    int fd = tcp_client_connect("localhost", port);
+    size_t len = 1;
+
+    if (fd != -1 && sendall(fd, &mode, &len) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* send len bytes and wait for all of them to come back */
+const char *bench_round_trip(mu_bench_t *b, int how, size_t len) {
+    char *msg = calloc(1, len);
+    void *reply = NULL;
+    uint64_t deadline;
+    size_t n, i;
+    int fd = connect_as(ECHO);
+
+    mu_assert(msg && fd != -1, "Setup failed");
+    mu_assert((reply = malloc(len + 1)), "Out of memory");
+    mu_bench_bytes(b, 2 * len);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        n = len;
+        if (how == DEADLINE) {
+            deadline = net_deadline(1000);
+            mu_assert(sendall_deadline(fd, msg, &n, deadline) != -1,
+                      "sendall_deadline failed");
+            mu_assert(recvall_deadline(fd, reply, &n, deadline) == (ssize_t)len,
+                      "Short reply");
+            continue;
+        }
+        mu_assert(how != RCVTIMEO || setsockopt_rcvtimeo(fd, 1000) == 0,
+                  "setsockopt_rcvtimeo failed");
+        mu_assert(sendall(fd, msg, &n) != -1, "sendall failed");
+        mu_assert(recv_count_with(fd, &reply, len + 1, len, NULL) == (ssize_t)len,
+                  "Short reply");
+    }
+    mu_bench_pause(b);
+    close(fd);
+    free(msg);
+    free(reply);
+    return NULL;
+}
+
+const char *bench_drip(mu_bench_t *b) {
+    void *buf = NULL;
+    size_t len, i;
+    int fd = connect_as(DRIP);
+
+    mu_assert(fd != -1, "Setup failed");
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        len = 0;
+        mu_assert(recv_timeout(fd, &buf, &len, 1) != -1, "recv_timeout failed");
+        mu_assert(len > 0, "Nothing received");
+    }
+    mu_bench_pause(b);
+    close(fd);
+    free(buf);
+    return NULL;
+}
+
+const char *bench_stream(mu_bench_t *b) {
+    char *chunk = calloc(1, STREAM_CHUNK);
+    size_t n, i;
+    int fd = connect_as(SINK);
+
+    mu_assert(chunk && fd != -1, "Setup failed");
+    mu_bench_bytes(b, STREAM_CHUNK);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        n = STREAM_CHUNK;
+        mu_assert(sendall(fd, chunk, &n) != -1, "sendall failed");
+    }
+    mu_bench_pause(b);
+    close(fd);
+    free(chunk);
+    return NULL;
+}
+
+const char *all_benches() {
+    const char *err;
+    mu_suite_start();
+
+    if ((err = start_server())) {
+        return err;
+    }
+    mu_run_bench(bench_round_trip, BLOCKING, 64);
+    mu_run_bench(bench_round_trip, RCVTIMEO, 64);
+    mu_run_bench(bench_round_trip, DEADLINE, 64);
+    mu_run_bench(bench_round_trip, BLOCKING, 64 * 1024);
+    mu_run_bench(bench_round_trip, DEADLINE, 64 * 1024);
+    mu_run_bench(bench_drip);
+    mu_run_bench(bench_stream);
+
+    return NULL;
+}
+
+RUN_BENCHES(all_benches);
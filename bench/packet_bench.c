@@ -0,0 +1,106 @@
+/**
+ * @brief Parse/verify/build rates (Mpps) and checksum throughput.
+ *
+ * Usage: packet_bench [iterations]
+ */
+
+#define _GNU_SOURCE
+
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "packet.h"
+
+static volatile uint64_t sink;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* IPv4/UDP packet of the given total length */
+static void build_udp4(uint8_t *p, size_t len) {
+    memset(p, 0xab, len);
+    memset(p, 0, PKT_IPV4_HLEN + PKT_UDP_HLEN);
+    p[0] = 0x45;
+    p[2] = (uint8_t)(len >> 8);
+    p[3] = (uint8_t)len;
+    p[8] = 64;
+    p[9] = IPPROTO_UDP;
+    p[12] = 10, p[15] = 1;
+    p[16] = 10, p[19] = 2;
+    p[20] = 0x04, p[21] = 0xd2;
+    p[22] = 0x00, p[23] = 0x50;
+    p[24] = (uint8_t)((len - PKT_IPV4_HLEN) >> 8);
+    p[25] = (uint8_t)(len - PKT_IPV4_HLEN);
+    pkt_set_checksums(p, len);
+}
+
+static void report(const char *name, uint64_t n, double secs, size_t bytes) {
+    printf("%-28s %8.2f Mpps", name, n / secs / 1e6);
+    if (bytes) {
+        printf("  %7.2f Gbit/s", n * bytes * 8 / secs / 1e9);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t iters = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    static const size_t sizes[] = {64, 576, 1500, 9000};
+    uint8_t pkt[9000];
+    uint8_t addr[4] = {192, 168, 0, 1};
+    pkt_view_t v;
+    uint16_t csum;
+    uint64_t i, n;
+    size_t s;
+    double t;
+
+    for (s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+        build_udp4(pkt, sizes[s]);
+        /* keep roughly constant bytes per run */
+        n = iters * 64 / sizes[s];
+        printf("-- %zu byte IPv4/UDP packets\n", sizes[s]);
+
+        t = now_sec();
+        for (i = 0; i < n; i++) {
+            pkt_parse(&v, pkt, sizes[s]);
+            sink += v.dport;
+        }
+        report("parse", n, now_sec() - t, sizes[s]);
+
+        t = now_sec();
+        for (i = 0; i < n; i++) {
+            pkt_parse(&v, pkt, sizes[s]);
+            sink += pkt_verify(&v);
+        }
+        report("parse + verify", n, now_sec() - t, sizes[s]);
+
+        t = now_sec();
+        for (i = 0; i < n; i++) {
+            pkt[30] = (uint8_t)i;
+            sink += pkt_set_checksums(pkt, sizes[s]);
+        }
+        report("build (set checksums)", n, now_sec() - t, sizes[s]);
+    }
+
+    build_udp4(pkt, 64);
+    memcpy(&csum, pkt + 10, sizeof(csum));
+    t = now_sec();
+    for (i = 0; i < iters; i++) {
+        addr[3] = (uint8_t)i;
+        csum = pkt_csum_adjust(csum, pkt + 12, addr, sizeof(addr));
+    }
+    sink += csum;
+    report("incremental adjust (4B)", iters, now_sec() - t, 0);
+
+    t = now_sec();
+    for (i = 0; i < iters; i++) {
+        pkt[12] = (uint8_t)i;
+        sink += pkt_checksum(pkt, PKT_IPV4_HLEN);
+    }
+    report("full IPv4 header checksum", iters, now_sec() - t, 0);
+    return 0;
+}
@@ -0,0 +1,139 @@
+/**
+ * @brief Priority queue workloads on the d-ary heap against a sorted deque
+ * with linear insertion (see mubench.h for options).
+ *
+ * The "hold" workload is a scheduler's steady state: each op pops the
+ * earliest of n pending timers and reschedules it a random interval later.
+ * The decrease workload moves a random pending timer earlier.
+ */
+
+#include "mubench.h"
+
+#include "deque.h"
+#include "pqueue.h"
+#include "prng.h"
+
+typedef struct {
+    uint64_t when;
+    pq_handle_t handle;
+} timer_t_;
+
+static int cmp_when(const void *a, const void *b, void *ctx) {
+    const timer_t_ *x = a, *y = b;
+
+    (void)ctx;
+    return (x->when > y->when) - (x->when < y->when);
+}
+
+/* the makeshift queue: keys stored as data pointers, which is the order
+ * dq_sorted() and dq_merge() keep, inserted by walking from the head */
+static void sorted_insert(deque_t *dq, uint64_t when) {
+    node_t *next = dq->head, *node;
+
+    while (next && (uint64_t)next->data <= when) {
+        next = next->next;
+    }
+    if (!next) {
+        dq_append(dq, (void *)when);
+    } else if (next == dq->head) {
+        dq_push(dq, (void *)when);
+    } else {
+        node = al_calloc(dq->alloc, 1, sizeof(*node));
+        node->data = (void *)when;
+        node->prev = next->prev;
+        node->next = next;
+        next->prev->next = node;
+        next->prev = node;
+        dq->n_items++;
+    }
+}
+
+const char *bench_hold_deque(mu_bench_t *b, size_t n) {
+    deque_t *dq = dq_create();
+    uint64_t when;
+    prng_t r;
+    size_t i;
+
+    mu_assert(dq, "dq_create failed");
+    prng_seed(&r, 1);
+    for (i = 0; i < n; i++) {
+        sorted_insert(dq, prng_bounded(&r, 2 * n));
+    }
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        when = (uint64_t)dq_pop(dq);
+        sorted_insert(dq, when + 1 + prng_bounded(&r, 2 * n));
+    }
+    mu_bench_pause(b);
+    dq_destroy(dq, NULL);
+    return NULL;
+}
+
+const char *bench_hold_heap(mu_bench_t *b, size_t n, unsigned arity) {
+    timer_t_ *timers = malloc(n * sizeof(*timers)), *t;
+    pqueue_t *pq = pq_create(arity, cmp_when, NULL);
+    prng_t r;
+    size_t i;
+
+    mu_assert(timers && pq, "Out of memory");
+    prng_seed(&r, 1);
+    for (i = 0; i < n; i++) {
+        timers[i].when = prng_bounded(&r, 2 * n);
+        pq_push(pq, &timers[i]);
+    }
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        t = pq_pop(pq);
+        t->when += 1 + prng_bounded(&r, 2 * n);
+        pq_push(pq, t);
+    }
+    mu_bench_pause(b);
+    pq_destroy(pq, NULL);
+    free(timers);
+    return NULL;
+}
+
+const char *bench_decrease_heap(mu_bench_t *b, size_t n, unsigned arity) {
+    timer_t_ *timers = malloc(n * sizeof(*timers)), *t;
+    pqueue_t *pq = pq_create(arity, cmp_when, NULL);
+    prng_t r;
+    size_t i;
+
+    mu_assert(timers && pq, "Out of memory");
+    prng_seed(&r, 1);
+    for (i = 0; i < n; i++) {
+        /* start high, so keys have room to come down */
+        timers[i].when = (uint64_t)1 << 62 | prng_next(&r) >> 4;
+        timers[i].handle = pq_push(pq, &timers[i]);
+    }
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        t = &timers[prng_bounded(&r, n)];
+        t->when -= prng_bounded(&r, 1 << 20);
+        pq_decrease(pq, t->handle);
+    }
+    mu_bench_pause(b);
+    pq_destroy(pq, NULL);
+    free(timers);
+    return NULL;
+}
+
+const char *all_benches() {
+    mu_suite_start();
+
+    mu_run_bench(bench_hold_deque, 1000);
+    mu_run_bench(bench_hold_deque, 10000);
+    mu_run_bench(bench_hold_heap, 1000, 2);
+    mu_run_bench(bench_hold_heap, 1000, 4);
+    mu_run_bench(bench_hold_heap, 10000, 4);
+    mu_run_bench(bench_hold_heap, 1000000, 2);
+    mu_run_bench(bench_hold_heap, 1000000, 4);
+    mu_run_bench(bench_hold_heap, 1000000, 8);
+    mu_run_bench(bench_decrease_heap, 1000000, 2);
+    mu_run_bench(bench_decrease_heap, 1000000, 4);
+    mu_run_bench(bench_decrease_heap, 1000000, 8);
+
+    return NULL;
+}
+
+RUN_BENCHES(all_benches);
@@ -0,0 +1,198 @@
+/**
+ * @brief prng generators and helpers against random(), single-threaded and
+ * shared between threads (see mubench.h for options).
+ */
+
+#define _GNU_SOURCE
+#include "mubench.h"
+
+#include <pthread.h>
+#include "prng.h"
+
+#define FILL_LEN 4096
+
+/* the RAND_INT() this module replaced */
+#define OLD_RAND_INT(_min, _max) \
+    (int)(((_max) - (_min) + 1) * ((double)random() * (1.0 / (RAND_MAX + 1.0))))
+
+const char *bench_random(mu_bench_t *b) {
+    size_t i;
+
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_do_not_optimize(random());
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_xoshiro(mu_bench_t *b) {
+    prng_t r;
+    size_t i;
+
+    prng_seed(&r, 1);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_do_not_optimize(prng_next(&r));
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_pcg64(mu_bench_t *b) {
+    pcg64_t r;
+    size_t i;
+
+    pcg64_seed(&r, 1, 0);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_do_not_optimize(pcg64_next(&r));
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_rand_int_old(mu_bench_t *b) {
+    size_t i;
+
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_do_not_optimize(OLD_RAND_INT(0, 999));
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_rand_int(mu_bench_t *b) {
+    size_t i;
+
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_do_not_optimize(RAND_INT(0, 999));
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_bounded(mu_bench_t *b) {
+    prng_t r;
+    size_t i;
+
+    prng_seed(&r, 1);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_do_not_optimize(prng_bounded32(&r, 1000));
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_double(mu_bench_t *b) {
+    prng_t r;
+    size_t i;
+
+    prng_seed(&r, 1);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_do_not_optimize(prng_double(&r));
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+/* one iteration fills FILL_LEN values */
+const char *bench_fill_loop(mu_bench_t *b) {
+    uint64_t out[FILL_LEN];
+    prng_t r;
+    size_t i, j;
+
+    prng_seed(&r, 1);
+    mu_bench_bytes(b, sizeof(out));
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        for (j = 0; j < FILL_LEN; j++) {
+            out[j] = prng_next(&r);
+        }
+        mu_clobber();
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_fill(mu_bench_t *b) {
+    uint64_t out[FILL_LEN];
+    prng_t r;
+    size_t i;
+
+    prng_seed(&r, 1);
+    mu_bench_bytes(b, sizeof(out));
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        prng_fill(&r, out, FILL_LEN);
+        mu_clobber();
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+/*********************************************************************
+ * Threads sharing the generator: random() takes a global lock, while
+ * RAND_INT() draws from per-thread state. Iterations are split across
+ * the threads, so ns/op is wall time per value drawn by all of them.
+ *********************************************************************/
+
+typedef struct {
+    size_t iters;
+    bool use_random;
+} worker_arg_t;
+
+static void *draw(void *arg) {
+    worker_arg_t *w = arg;
+    size_t i;
+
+    for (i = 0; i < w->iters; i++) {
+        if (w->use_random) {
+            mu_do_not_optimize(random());
+        } else {
+            mu_do_not_optimize(RAND_INT(0, 999));
+        }
+    }
+    return NULL;
+}
+
+const char *bench_threads(mu_bench_t *b, bool use_random, int nthreads) {
+    pthread_t threads[16];
+    worker_arg_t arg = {b->iters / nthreads + 1, use_random};
+    int i;
+
+    mu_bench_resume(b);
+    for (i = 0; i < nthreads; i++) {
+        mu_assert(pthread_create(&threads[i], NULL, draw, &arg) == 0,
+                  "pthread_create failed");
+    }
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *all_benches() {
+    mu_suite_start();
+
+    mu_run_bench(bench_random);
+    mu_run_bench(bench_xoshiro);
+    mu_run_bench(bench_pcg64);
+    mu_run_bench(bench_rand_int_old);
+    mu_run_bench(bench_rand_int);
+    mu_run_bench(bench_bounded);
+    mu_run_bench(bench_double);
+    mu_run_bench(bench_fill_loop);
+    mu_run_bench(bench_fill);
+    mu_run_bench(bench_threads, true, 4);
+    mu_run_bench(bench_threads, false, 4);
+
+    return NULL;
+}
+
+RUN_BENCHES(all_benches);
@@ -0,0 +1,178 @@
+/**
+ * @brief Radix sorts against qsort() and dq_sorted() (see mubench.h for
+ * options).
+ *
+ * Every iteration sorts a fresh copy of the same random input; copying it is
+ * not timed. Bytes are those of the keys (or records) sorted.
+ */
+
+#include "mubench.h"
+
+#include <string.h>
+#include "prng.h"
+#include "radix.h"
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+typedef struct {
+    uint64_t key;
+    uint64_t value;
+} rec_t;
+
+static int cmp_rec(const void *a, const void *b) {
+    return cmp_u64(&((const rec_t *)a)->key, &((const rec_t *)b)->key);
+}
+
+static void *random_input(size_t n, size_t width, unsigned bits) {
+    uint64_t mask = bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+    char *p = malloc(n * width);
+    uint32_t v;
+    prng_t r;
+    size_t i;
+
+    prng_seed(&r, 1);
+    for (i = 0; p && i < n * width / 4; i++) {
+        v = (uint32_t)prng_next(&r);
+        memcpy(p + 4 * i, &v, 4);
+    }
+    for (i = 0; p && i < n; i++) {
+        if (width == 4) {
+            ((uint32_t *)p)[i] &= (uint32_t)mask;
+        } else {
+            ((uint64_t *)p)[i] &= mask;
+        }
+    }
+    return p;
+}
+
+/* kind: 0 qsort, 1 radix, 2 radix on a pool of 4 */
+static const char *sort_bench(mu_bench_t *b, size_t n, size_t width,
+                              unsigned bits, int kind) {
+    void *src = random_input(n, width, bits), *a = malloc(n * width);
+    tp_pool_t *pool = kind == 2 ? tp_create(4) : NULL;
+    size_t i;
+
+    mu_assert(src && a && (pool || kind != 2), "Out of memory");
+    for (i = 0; i < b->iters; i++) {
+        memcpy(a, src, n * width);
+        mu_bench_resume(b);
+        if (kind == 0) {
+            qsort(a, n, width, width == 4 ? cmp_u32 : cmp_u64);
+        } else if (width == 4) {
+            radix_sort_u32(a, n, pool);
+        } else {
+            radix_sort_u64(a, n, pool);
+        }
+        mu_bench_pause(b);
+        mu_clobber();
+    }
+    mu_bench_bytes(b, n * width);
+    tp_destroy(pool);
+    free(src);
+    free(a);
+    return NULL;
+}
+
+const char *bench_qsort(mu_bench_t *b, size_t n, size_t width) {
+    return sort_bench(b, n, width, 64, 0);
+}
+
+const char *bench_radix(mu_bench_t *b, size_t n, size_t width,
+                        unsigned bits) {
+    return sort_bench(b, n, width, bits, 1);
+}
+
+const char *bench_radix_pool(mu_bench_t *b, size_t n, size_t width) {
+    return sort_bench(b, n, width, 64, 2);
+}
+
+const char *bench_records(mu_bench_t *b, size_t n, int radix) {
+    rec_t *src = random_input(n, sizeof(rec_t), 64), *a = malloc(n * 16);
+    size_t i;
+
+    mu_assert(src && a, "Out of memory");
+    for (i = 0; i < b->iters; i++) {
+        memcpy(a, src, n * sizeof(rec_t));
+        mu_bench_resume(b);
+        if (radix) {
+            radix_sort_records(a, n, sizeof(rec_t), 0, 8, 0, NULL);
+        } else {
+            qsort(a, n, sizeof(rec_t), cmp_rec);
+        }
+        mu_bench_pause(b);
+        mu_clobber();
+    }
+    mu_bench_bytes(b, n * sizeof(rec_t));
+    free(src);
+    free(a);
+    return NULL;
+}
+
+/* the items deque_bench sorts: SORT_ITEMS values from a small LCG */
+const char *bench_deque(mu_bench_t *b, size_t n, int radix) {
+    deque_t *dq = dq_create(), *sorted;
+    uint32_t x = 1;
+    node_t *node;
+    size_t i;
+
+    mu_assert(dq, "dq_create failed");
+    for (i = 0; i < n; i++) {
+        x = x * 1103515245 + 12345;
+        dq_append(dq, (void *)(uintptr_t)(x >> 8));
+    }
+    for (i = 0; i < b->iters; i++) {
+        mu_bench_resume(b);
+        if (radix) {
+            radix_sort_deque(dq, NULL, NULL);
+        } else {
+            sorted = dq_sorted(dq);
+        }
+        mu_bench_pause(b);
+        if (radix) {
+            /* unsort it again, untimed, so every iteration does the work */
+            for (node = dq->head; node; node = node->next) {
+                x = x * 1103515245 + 12345;
+                node->data = (void *)(uintptr_t)(x >> 8);
+            }
+        } else {
+            dq_destroy(sorted, NULL);
+        }
+    }
+    dq_destroy(dq, NULL);
+    return NULL;
+}
+
+const char *all_benches() {
+    mu_suite_start();
+
+    mu_run_bench(bench_qsort, 1000, 4);
+    mu_run_bench(bench_radix, 1000, 4, 32);
+    mu_run_bench(bench_qsort, 1000000, 4);
+    mu_run_bench(bench_radix, 1000000, 4, 32);
+    mu_run_bench(bench_radix, 1000000, 4, 16);
+    mu_run_bench(bench_radix_pool, 1000000, 4);
+    mu_run_bench(bench_qsort, 1000000, 8);
+    mu_run_bench(bench_radix, 1000000, 8, 64);
+    mu_run_bench(bench_radix, 1000000, 8, 40);
+    mu_run_bench(bench_radix_pool, 1000000, 8);
+    mu_run_bench(bench_qsort, 10000000, 4);
+    mu_run_bench(bench_radix, 10000000, 4, 32);
+    mu_run_bench(bench_records, 1000000, 0);
+    mu_run_bench(bench_records, 1000000, 1);
+    mu_run_bench(bench_deque, 10000, 0);
+    mu_run_bench(bench_deque, 10000, 1);
+
+    return NULL;
+}
+
+RUN_BENCHES(all_benches);
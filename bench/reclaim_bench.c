@@ -0,0 +1,251 @@
+/**
+ * @brief Overhead of epoch-based reclamation and hazard pointers against
+ * locks and plain frees (see mubench.h for options).
+ *
+ * The read-side benchmarks time what a reader pays per access; the retire
+ * benchmarks allocate a node and retire it, batched frees included. The
+ * stack benchmarks time a push and a pop on a shared stack by each of n
+ * threads, so their ops are pairs.
+ */
+
+#define _GNU_SOURCE
+#include "mubench.h"
+
+#include <pthread.h>
+#include "reclaim.h"
+
+typedef struct Node {
+    reclaim_node_t reclaim;
+    struct Node *next;
+} node_t;
+
+static void free_node(reclaim_node_t *node) {
+    free(node);
+}
+
+const char *bench_ebr_enter(mu_bench_t *b) {
+    ebr_thread_t *t;
+    size_t i;
+    ebr_t d;
+
+    mu_assert(ebr_init(&d) == 0 && (t = ebr_register(&d)), "ebr_register");
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        ebr_enter(t);
+        mu_clobber();
+        ebr_exit(t);
+    }
+    mu_bench_pause(b);
+    ebr_destroy(&d);
+    return NULL;
+}
+
+const char *bench_hp_protect(mu_bench_t *b) {
+    void *shared = &shared;
+    hp_thread_t *t;
+    size_t i;
+    hp_t d;
+
+    mu_assert(hp_init(&d, 1) == 0 && (t = hp_register(&d)), "hp_register");
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_do_not_optimize(hp_protect(t, 0, &shared));
+        hp_clear(t, 0);
+    }
+    mu_bench_pause(b);
+    hp_destroy(&d);
+    return NULL;
+}
+
+/* what a reader pays to guard an access with a lock instead */
+const char *bench_rwlock(mu_bench_t *b) {
+    pthread_rwlock_t lock;
+    size_t i;
+
+    pthread_rwlock_init(&lock, NULL);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        pthread_rwlock_rdlock(&lock);
+        mu_clobber();
+        pthread_rwlock_unlock(&lock);
+    }
+    mu_bench_pause(b);
+    pthread_rwlock_destroy(&lock);
+    return NULL;
+}
+
+const char *bench_free(mu_bench_t *b) {
+    size_t i;
+
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        node_t *node = malloc(sizeof(*node));
+        mu_do_not_optimize(node);
+        free(node);
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_ebr_retire(mu_bench_t *b) {
+    ebr_thread_t *t;
+    size_t i;
+    ebr_t d;
+
+    mu_assert(ebr_init(&d) == 0 && (t = ebr_register(&d)), "ebr_register");
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        node_t *node = malloc(sizeof(*node));
+        ebr_retire(t, &node->reclaim, free_node);
+    }
+    mu_bench_pause(b);
+    ebr_destroy(&d);
+    return NULL;
+}
+
+const char *bench_hp_retire(mu_bench_t *b) {
+    hp_thread_t *t;
+    size_t i;
+    hp_t d;
+
+    mu_assert(hp_init(&d, 1) == 0 && (t = hp_register(&d)), "hp_register");
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        node_t *node = malloc(sizeof(*node));
+        hp_retire(t, &node->reclaim, free_node);
+    }
+    mu_bench_pause(b);
+    hp_destroy(&d);
+    return NULL;
+}
+
+/*********************************************************************
+ * A shared Treiber stack, or a locked one
+ *********************************************************************/
+
+enum { LOCKED, EBR, HP };
+
+typedef struct {
+    node_t *top;
+    pthread_mutex_t lock;
+    ebr_t ebr;
+    hp_t hp;
+    int scheme;
+    size_t ops;
+} stack_bench_t;
+
+static void push(stack_bench_t *s, node_t *node) {
+    node->next = __atomic_load_n(&s->top, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&s->top, &node->next, node, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+}
+
+static node_t *pop(stack_bench_t *s, ebr_thread_t *et, hp_thread_t *ht) {
+    node_t *top;
+
+    if (et) {
+        ebr_enter(et);
+        top = __atomic_load_n(&s->top, __ATOMIC_ACQUIRE);
+        while (top && !__atomic_compare_exchange_n(&s->top, &top, top->next,
+                                                   true, __ATOMIC_ACQ_REL,
+                                                   __ATOMIC_ACQUIRE)) {
+        }
+        ebr_exit(et);
+        return top;
+    }
+    while ((top = hp_protect(ht, 0, (void *const *)&s->top)) &&
+           !__atomic_compare_exchange_n(&s->top, &top, top->next, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+    }
+    hp_clear(ht, 0);
+    return top;
+}
+
+static void *stack_worker(void *arg) {
+    stack_bench_t *s = arg;
+    ebr_thread_t *et = s->scheme == EBR ? ebr_register(&s->ebr) : NULL;
+    hp_thread_t *ht = s->scheme == HP ? hp_register(&s->hp) : NULL;
+    node_t *node;
+    size_t i;
+
+    for (i = 0; i < s->ops; i++) {
+        node = malloc(sizeof(*node));
+        if (s->scheme == LOCKED) {
+            pthread_mutex_lock(&s->lock);
+            node->next = s->top;
+            s->top = node;
+            node = s->top;
+            s->top = node->next;
+            pthread_mutex_unlock(&s->lock);
+            free(node);
+            continue;
+        }
+        push(s, node);
+        if (!(node = pop(s, et, ht))) {
+            continue;
+        }
+        if (et) {
+            ebr_retire(et, &node->reclaim, free_node);
+        } else {
+            hp_retire(ht, &node->reclaim, free_node);
+        }
+    }
+    if (et) {
+        ebr_unregister(et);
+    } else if (ht) {
+        hp_unregister(ht);
+    }
+    return NULL;
+}
+
+const char *bench_stack(mu_bench_t *b, int scheme, size_t nthreads) {
+    stack_bench_t s = {0};
+    pthread_t threads[16];
+    node_t *node;
+    size_t i;
+
+    mu_assert(nthreads <= 16, "Too many threads");
+    mu_assert(pthread_mutex_init(&s.lock, NULL) == 0 && ebr_init(&s.ebr) == 0 &&
+                  hp_init(&s.hp, 1) == 0,
+              "init");
+    s.scheme = scheme;
+    s.ops = b->iters / nthreads + 1;
+    mu_bench_resume(b);
+    for (i = 0; i < nthreads; i++) {
+        pthread_create(&threads[i], NULL, stack_worker, &s);
+    }
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    mu_bench_pause(b);
+    while ((node = s.top)) {
+        s.top = node->next;
+        free(node);
+    }
+    ebr_destroy(&s.ebr);
+    hp_destroy(&s.hp);
+    pthread_mutex_destroy(&s.lock);
+    return NULL;
+}
+
+const char *all_benches() {
+    mu_suite_start();
+
+    mu_run_bench(bench_ebr_enter);
+    mu_run_bench(bench_hp_protect);
+    mu_run_bench(bench_rwlock);
+    mu_run_bench(bench_free);
+    mu_run_bench(bench_ebr_retire);
+    mu_run_bench(bench_hp_retire);
+    mu_run_bench(bench_stack, LOCKED, 1);
+    mu_run_bench(bench_stack, EBR, 1);
+    mu_run_bench(bench_stack, HP, 1);
+    mu_run_bench(bench_stack, LOCKED, 4);
+    mu_run_bench(bench_stack, EBR, 4);
+    mu_run_bench(bench_stack, HP, 4);
+
+    return NULL;
+}
+
+RUN_BENCHES(all_benches);
@@ -0,0 +1,183 @@
+/**
+ * @brief Throughput and CPU use of relaying a TCP stream over loopback.
+ *
+ * Usage: relay_bench [seconds]
+ *
+ * A sender streams into one loopback connection for the given time (default
+ * 2 s); a relay thread forwards it to a second connection, which the main
+ * thread drains. The relay is a blocking recv()/sendall() loop, a relay_t
+ * copying through its buffer, or a relay_t using splice(). CPU is the relay
+ * thread's CPU time over the elapsed time: on a machine with few cores the
+ * three threads share them, so compare it between modes.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "network.h"
+#include "relay.h"
+
+#define CHUNK (256 * 1024)
+
+enum { LOOP, COPY, SPLICE };
+static const char *mode_names[] = {"recv/sendall loop", "relay copy",
+                                   "relay splice"};
+
+typedef struct {
+    int mode;
+    int in, out;     /* the relay's two sockets, which it closes */
+    double cpu_sec;  /* relay thread CPU time */
+    bool spliced;
+    int failed;
+} relay_arg_t;
+
+static double now_sec(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* connect a new loopback TCP connection; fds[0] is the connecting end */
+static int tcp_pair(int listener, int fds[2]) {
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+
+    if (getsockname(listener, (struct sockaddr *)&addr, &addrlen) == -1 ||
+        (fds[0] = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+        connect(fds[0], (struct sockaddr *)&addr, addrlen) == -1 ||
+        (fds[1] = accept(listener, NULL, NULL)) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+static void *relay_thread(void *arg) {
+    relay_arg_t *a = arg;
+    char *buf;
+    size_t len;
+    ssize_t n;
+    relay_t r;
+
+    if (a->mode == LOOP) {
+        /* what a forwarding service does without this module */
+        buf = malloc(CHUNK);
+        while (buf && (n = recv(a->in, buf, CHUNK, 0)) > 0) {
+            len = n;
+            if (sendall(a->out, buf, &len) == -1) {
+                a->failed = 1;
+                break;
+            }
+        }
+        free(buf);
+        close(a->in);
+        close(a->out);
+    } else if (relay_init(&r, a->in, a->out, a->mode == COPY ? RELAY_COPY : 0) ==
+               -1) {
+        a->failed = 1;
+    } else {
+        a->spliced = relay_spliced(&r);
+        a->failed = relay_run(&r) == -1;
+        relay_destroy(&r);
+    }
+    a->cpu_sec = now_sec(CLOCK_THREAD_CPUTIME_ID);
+    return NULL;
+}
+
+typedef struct {
+    int fd;
+    double until;
+} sender_arg_t;
+
+static void *sender_thread(void *arg) {
+    sender_arg_t *s = arg;
+    char *chunk = calloc(1, CHUNK);
+    size_t len;
+
+    while (chunk && now_sec(CLOCK_MONOTONIC) < s->until) {
+        len = CHUNK;
+        if (sendall(s->fd, chunk, &len) == -1) {
+            break;
+        }
+    }
+    shutdown(s->fd, SHUT_WR);
+    free(chunk);
+    return NULL;
+}
+
+static int run(int listener, int mode, double seconds) {
+    int src[2], dst[2];
+    pthread_t relay, sender;
+    relay_arg_t a = {0};
+    sender_arg_t s;
+    char *buf = malloc(CHUNK);
+    double start, elapsed;
+    uint64_t total = 0;
+    ssize_t n;
+
+    if (!buf || tcp_pair(listener, src) == -1 || tcp_pair(listener, dst) == -1) {
+        perror("setup");
+        return -1;
+    }
+    /* nothing flows back: end that direction so relay_run() can finish */
+    shutdown(dst[1], SHUT_WR);
+    a.mode = mode;
+    a.in = src[1];
+    a.out = dst[0];
+    start = now_sec(CLOCK_MONOTONIC);
+    s.fd = src[0];
+    s.until = start + seconds;
+    pthread_create(&relay, NULL, relay_thread, &a);
+    pthread_create(&sender, NULL, sender_thread, &s);
+    while ((n = recv(dst[1], buf, CHUNK, 0)) > 0) {
+        total += n;
+    }
+    elapsed = now_sec(CLOCK_MONOTONIC) - start;
+    pthread_join(sender, NULL);
+    pthread_join(relay, NULL);
+    if (a.failed) {
+        fprintf(stderr, "%s failed\n", mode_names[mode]);
+    } else if (mode == SPLICE && !a.spliced) {
+        printf("%-20s %10s\n", mode_names[mode], "unavailable");
+    } else {
+        printf("%-20s %10.2f %9.1f%%\n", mode_names[mode],
+               total * 8 / elapsed / 1e9, 100 * a.cpu_sec / elapsed);
+    }
+    close(src[0]);
+    close(dst[1]);
+    free(buf);
+    return a.failed ? -1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : 2;
+    struct sockaddr_in addr;
+    int listener, mode;
+
+    signal(SIGPIPE, SIG_IGN);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((listener = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+        bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        listen(listener, SERVER_BACKLOG) == -1) {
+        perror("listen");
+        return 1;
+    }
+    printf("%-20s %10s %10s\n", "relay", "Gbit/s", "relay CPU");
+    for (mode = LOOP; mode <= SPLICE; mode++) {
+        if (run(listener, mode, seconds) == -1) {
+            return 1;
+        }
+    }
+    close(listener);
+    return 0;
+}
@@ -0,0 +1,155 @@
+/**
+ * @brief Varint encoding and decoding throughput (see mubench.h for options).
+ *
+ * One op is one integer, so ops/s reads as integers per second. Inputs are
+ * NVALUES integers drawn from three distributions: all below 128 (one byte
+ * each), up to 28 bits (one to four bytes), and up to 64 bits.
+ */
+
+#define _GNU_SOURCE
+#include "mubench.h"
+
+#include "prng.h"
+#include "serial.h"
+
+#define NVALUES 4096
+
+static uint64_t values[3][NVALUES], out[NVALUES];
+static uint8_t encoded[3][NVALUES * VARINT_MAXLEN];
+static size_t encoded_len[3];
+
+static const char *make_inputs(void) {
+    static const int max_bits[3] = {7, 28, 64};
+    prng_t r;
+    size_t i;
+    int d, bits;
+
+    prng_seed(&r, 1);
+    for (d = 0; d < 3; d++) {
+        for (i = 0; i < NVALUES; i++) {
+            bits = 1 + prng_bounded(&r, max_bits[d]);
+            values[d][i] = prng_next(&r) >> (64 - bits);
+        }
+        encoded_len[d] = varint_encode_n(values[d], NVALUES, encoded[d]);
+    }
+    return NULL;
+}
+
+/* one varint_decode() call per value, as framing.c used to */
+const char *bench_decode_loop(mu_bench_t *b, int dist) {
+    const uint8_t *p = encoded[dist];
+    size_t i, pos = 0, k = 0;
+    int rv;
+
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        rv = varint_decode(p + pos, encoded_len[dist] - pos, &out[k]);
+        pos += rv;
+        if (++k == NVALUES) {
+            mu_clobber();
+            pos = k = 0;
+        }
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_decode_n(mu_bench_t *b, int dist) {
+    size_t i, n, used;
+
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i += n) {
+        n = MIN(b->iters - i, NVALUES);
+        varint_decode_n(encoded[dist], encoded_len[dist], out, n, &used);
+        mu_clobber();
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_encode_loop(mu_bench_t *b, int dist) {
+    uint8_t *p = encoded[dist];
+    size_t i, k = 0;
+
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        p += varint_encode(values[dist][k], p);
+        if (++k == NVALUES) {
+            mu_clobber();
+            p = encoded[dist];
+            k = 0;
+        }
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_encode_n(mu_bench_t *b, int dist) {
+    size_t i, n;
+
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i += n) {
+        n = MIN(b->iters - i, NVALUES);
+        varint_encode_n(values[dist], n, encoded[dist]);
+        mu_clobber();
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+/* writing and reading back through the cursors, varints against fixed
+ * 8-byte fields */
+const char *bench_cursor(mu_bench_t *b, int dist, bool varint) {
+    ser_writer_t w;
+    ser_reader_t r;
+    uint64_t v = 0;
+    size_t i, k;
+
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i += k) {
+        ser_writer_init(&w, encoded[dist], sizeof(encoded[dist]));
+        for (k = 0; k < NVALUES && i + k < b->iters; k++) {
+            if (varint) {
+                ser_put_varint(&w, values[dist][k]);
+            } else {
+                ser_put_u64(&w, values[dist][k]);
+            }
+        }
+        ser_reader_init(&r, w.buf, w.len);
+        while (r.pos < r.len) {
+            if (varint) {
+                ser_get_varint(&r, &v);
+            } else {
+                ser_get_u64(&r, &v);
+            }
+            mu_do_not_optimize(v);
+        }
+    }
+    mu_bench_pause(b);
+    encoded_len[dist] = varint_encode_n(values[dist], NVALUES, encoded[dist]);
+    return NULL;
+}
+
+const char *all_benches() {
+    mu_suite_start();
+    make_inputs();
+
+    mu_run_bench(bench_decode_loop, 0);
+    mu_run_bench(bench_decode_n, 0);
+    mu_run_bench(bench_decode_loop, 1);
+    mu_run_bench(bench_decode_n, 1);
+    mu_run_bench(bench_decode_loop, 2);
+    mu_run_bench(bench_decode_n, 2);
+    mu_run_bench(bench_encode_loop, 0);
+    mu_run_bench(bench_encode_n, 0);
+    mu_run_bench(bench_encode_loop, 1);
+    mu_run_bench(bench_encode_n, 1);
+    mu_run_bench(bench_encode_loop, 2);
+    mu_run_bench(bench_encode_n, 2);
+    mu_run_bench(bench_cursor, 1, true);
+    mu_run_bench(bench_cursor, 1, false);
+
+    return NULL;
+}
+
+RUN_BENCHES(all_benches);
@@ -0,0 +1,207 @@
+/**
+ * @brief Messaging between two threads over loopback TCP, Unix domain
+ * stream and seqpacket sockets, and a shm_ring_t (see mubench.h for
+ * options).
+ *
+ * Ping-pong ops are a message sent and echoed back. Stream ops are one
+ * message sent one way, and the time includes the receiver draining the
+ * last of them. Messages are received one at a time on every transport.
+ */
+
+#define _GNU_SOURCE
+#include "mubench.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "network.h"
+#include "shm_ring.h"
+
+#define MAXMSG 4096
+#define RING_SIZE (1 << 20)
+
+enum { TCP, UDS_STREAM, UDS_SEQPACKET, SHM };
+
+/* Two ends of a channel: end 0 is the benchmark, end 1 the peer thread. */
+typedef struct {
+    int kind;
+    size_t len;
+    int fd[2];
+    shm_ring_t ring[2]; /* SHM: ring[i] carries messages from end i */
+} chan_t;
+
+static int tcp_connect(int fd[2]) {
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    int listener = socket(AF_INET, SOCK_STREAM, 0), rv = -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (listener != -1 &&
+        bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+        listen(listener, SERVER_BACKLOG) == 0 &&
+        getsockname(listener, (struct sockaddr *)&addr, &addrlen) == 0 &&
+        (fd[0] = socket(AF_INET, SOCK_STREAM, 0)) != -1 &&
+        connect(fd[0], (struct sockaddr *)&addr, addrlen) == 0 &&
+        (fd[1] = accept(listener, NULL, NULL)) != -1) {
+        rv = 0;
+    }
+    close(listener);
+    return rv;
+}
+
+static int unix_connect(int fd[2], int type) {
+    char path[64];
+    int listener, rv = -1;
+
+    snprintf(path, sizeof(path), "/tmp/shm_ring_bench.%d", (int)getpid());
+    if ((listener = unix_server_listen(path, type)) == -1) {
+        return -1;
+    }
+    if ((fd[0] = unix_client_connect(path, type)) != -1 &&
+        (fd[1] = accept(listener, NULL, NULL)) != -1) {
+        rv = 0;
+    }
+    close(listener);
+    unlink(path);
+    return rv;
+}
+
+static int chan_open(chan_t *c, int kind, size_t len) {
+    memset(c, 0, sizeof(*c));
+    c->kind = kind;
+    c->len = len;
+    switch (kind) {
+    case TCP:
+        return tcp_connect(c->fd);
+    case UDS_STREAM:
+        return unix_connect(c->fd, SOCK_STREAM);
+    case UDS_SEQPACKET:
+        return unix_connect(c->fd, SOCK_SEQPACKET);
+    }
+    if (shm_ring_create(&c->ring[0], RING_SIZE) == -1) {
+        return -1;
+    }
+    return shm_ring_create(&c->ring[1], RING_SIZE);
+}
+
+static void chan_close(chan_t *c) {
+    if (c->kind == SHM) {
+        shm_ring_close(&c->ring[0]);
+        shm_ring_close(&c->ring[1]);
+    } else {
+        close(c->fd[0]);
+        close(c->fd[1]);
+    }
+}
+
+static int chan_send(chan_t *c, int end, const void *buf) {
+    size_t len = c->len;
+
+    if (c->kind == SHM) {
+        return shm_ring_send(&c->ring[end], buf, len, -1);
+    }
+    return sendall(c->fd[end], (void *)buf, &len) == -1 ? -1 : 0;
+}
+
+/* a message, or 0 at end of file */
+static ssize_t chan_recv(chan_t *c, int end, void *buf) {
+    if (c->kind == SHM) {
+        return shm_ring_recv(&c->ring[!end], buf, MAXMSG, -1);
+    }
+    /* a stream has no message boundaries: wait for all of one */
+    return recv(c->fd[end], buf, c->len, c->kind == UDS_SEQPACKET ? 0 : MSG_WAITALL);
+}
+
+static void chan_shutdown(chan_t *c, int end) {
+    if (c->kind == SHM) {
+        shm_ring_shutdown(&c->ring[end]);
+    } else {
+        shutdown(c->fd[end], SHUT_WR);
+    }
+}
+
+static void *echo(void *arg) {
+    chan_t *c = arg;
+    char buf[MAXMSG];
+
+    while (chan_recv(c, 1, buf) > 0 && chan_send(c, 1, buf) == 0) {
+    }
+    chan_shutdown(c, 1);
+    return NULL;
+}
+
+static void *sink(void *arg) {
+    chan_t *c = arg;
+    char buf[MAXMSG];
+
+    while (chan_recv(c, 1, buf) > 0) {
+    }
+    return NULL;
+}
+
+const char *bench_ping_pong(mu_bench_t *b, int kind, size_t len) {
+    char msg[MAXMSG] = {0}, reply[MAXMSG];
+    pthread_t thread;
+    size_t i;
+    chan_t c;
+
+    mu_assert(chan_open(&c, kind, len) == 0, "chan_open");
+    pthread_create(&thread, NULL, echo, &c);
+    mu_bench_bytes(b, 2 * len);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_assert(chan_send(&c, 0, msg) == 0, "send failed");
+        mu_assert(chan_recv(&c, 0, reply) == (ssize_t)len, "Short reply");
+    }
+    mu_bench_pause(b);
+    chan_shutdown(&c, 0);
+    pthread_join(thread, NULL);
+    chan_close(&c);
+    return NULL;
+}
+
+const char *bench_stream(mu_bench_t *b, int kind, size_t len) {
+    char msg[MAXMSG] = {0};
+    pthread_t thread;
+    size_t i;
+    chan_t c;
+
+    mu_assert(chan_open(&c, kind, len) == 0, "chan_open");
+    pthread_create(&thread, NULL, sink, &c);
+    mu_bench_bytes(b, len);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_assert(chan_send(&c, 0, msg) == 0, "send failed");
+    }
+    chan_shutdown(&c, 0);
+    pthread_join(thread, NULL);
+    mu_bench_pause(b);
+    chan_close(&c);
+    return NULL;
+}
+
+const char *all_benches() {
+    mu_suite_start();
+
+    mu_run_bench(bench_ping_pong, TCP, 64);
+    mu_run_bench(bench_ping_pong, UDS_STREAM, 64);
+    mu_run_bench(bench_ping_pong, UDS_SEQPACKET, 64);
+    mu_run_bench(bench_ping_pong, SHM, 64);
+    mu_run_bench(bench_stream, TCP, 64);
+    mu_run_bench(bench_stream, UDS_STREAM, 64);
+    mu_run_bench(bench_stream, UDS_SEQPACKET, 64);
+    mu_run_bench(bench_stream, SHM, 64);
+    mu_run_bench(bench_stream, TCP, 4096);
+    mu_run_bench(bench_stream, UDS_STREAM, 4096);
+    mu_run_bench(bench_stream, UDS_SEQPACKET, 4096);
+    mu_run_bench(bench_stream, SHM, 4096);
+
+    return NULL;
+}
+
+RUN_BENCHES(all_benches);
@@ -0,0 +1,225 @@
+/**
+ * @brief HyperLogLog and Count-Min updates and merges against exact counting
+ * in a hash map (see mubench.h for options).
+ *
+ * Each add op is one update; merges are of whole sketches,
+ * as when combining per-thread sketches.
+ */
+
+#include "mubench.h"
+
+#include "hashmap.h"
+#include "sketch.h"
+
+HM_DEFINE(counts, uint64_t, uint64_t, hm_hash_u64, HM_EQ_VALUE)
+
+/* keys cycle through n distinct values: a sketch of 1000 stays sparse */
+const char *bench_hll_add(mu_bench_t *b, unsigned p, size_t n) {
+    size_t i;
+    hll_t h;
+
+    mu_assert(hll_init(&h, p, NULL) == 0, "hll_init");
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_assert(hll_add(&h, hm_hash_u64(i % n)) == 0, "hll_add");
+    }
+    mu_bench_pause(b);
+    mu_do_not_optimize(h.nsparse);
+    hll_destroy(&h);
+    return NULL;
+}
+
+const char *bench_hll_count(mu_bench_t *b, unsigned p) {
+    double c = 0;
+    size_t i;
+    hll_t h;
+
+    mu_assert(hll_init(&h, p, NULL) == 0, "hll_init");
+    for (i = 0; i < (size_t)8 << p; i++) {
+        hll_add(&h, hm_hash_u64(i));
+    }
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        c += hll_count(&h);
+    }
+    mu_bench_pause(b);
+    mu_do_not_optimize(c);
+    hll_destroy(&h);
+    return NULL;
+}
+
+static const char *dense_pair(hll_t *x, hll_t *y, unsigned p) {
+    size_t i;
+
+    mu_assert(hll_init(x, p, NULL) == 0 && hll_init(y, p, NULL) == 0,
+              "hll_init");
+    for (i = 0; i < (size_t)8 << p; i++) {
+        hll_add(x, hm_hash_u64(i));
+        hll_add(y, hm_hash_u64(i + ((size_t)4 << p)));
+    }
+    return NULL;
+}
+
+const char *bench_hll_merge_loop(mu_bench_t *b, unsigned p) {
+    size_t i, j;
+    const char *err;
+    hll_t x, y;
+
+    if ((err = dense_pair(&x, &y, p))) {
+        return err;
+    }
+    mu_bench_bytes(b, (size_t)1 << p);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        for (j = 0; j < (size_t)1 << p; j++) {
+            x.regs[j] = MAX(x.regs[j], y.regs[j]);
+        }
+        mu_clobber();
+    }
+    mu_bench_pause(b);
+    hll_destroy(&x);
+    hll_destroy(&y);
+    return NULL;
+}
+
+const char *bench_hll_merge(mu_bench_t *b, unsigned p) {
+    const char *err;
+    hll_t x, y;
+    size_t i;
+
+    if ((err = dense_pair(&x, &y, p))) {
+        return err;
+    }
+    mu_bench_bytes(b, (size_t)1 << p);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        hll_merge(&x, &y);
+        mu_clobber();
+    }
+    mu_bench_pause(b);
+    hll_destroy(&x);
+    hll_destroy(&y);
+    return NULL;
+}
+
+/* Zipf-ish keys: key k is drawn about 1 / (k + 1) as often as key 0 */
+static uint64_t *zipf_keys(size_t n) {
+    uint64_t *keys = malloc(n * sizeof(*keys)), x = 1;
+    double u;
+    size_t i;
+
+    for (i = 0; keys && i < n; i++) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        /* 1 / u for u uniform in (0, 1] has a 1 / k^2 density: close */
+        u = (double)((x >> 11) + 1) / (double)(1ULL << 53);
+        keys[i] = hm_hash_u64((uint64_t)(1 / u));
+    }
+    return keys;
+}
+
+#define NKEYS (1 << 16)
+
+const char *bench_cms_add(mu_bench_t *b, size_t width) {
+    uint64_t *keys = zipf_keys(NKEYS), c = 0;
+    cms_t cms;
+    size_t i;
+
+    mu_assert(keys, "Out of memory");
+    mu_assert(cms_init_size(&cms, width, 4, NULL) == 0, "cms_init_size");
+    cms_clear(&cms); /* fault the pages in, untimed */
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        c += cms_add(&cms, keys[i % NKEYS], 1);
+    }
+    mu_bench_pause(b);
+    mu_do_not_optimize(c);
+    cms_destroy(&cms);
+    free(keys);
+    return NULL;
+}
+
+/* what the sketch replaces: an exact count per key */
+const char *bench_exact_add(mu_bench_t *b) {
+    uint64_t *keys = zipf_keys(NKEYS), *v, c = 0;
+    counts_t map;
+    bool inserted;
+    size_t i;
+
+    mu_assert(keys, "Out of memory");
+    counts_init(&map, NULL);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        v = counts_insert(&map, keys[i % NKEYS], &inserted);
+        mu_assert(v, "Out of memory");
+        if (inserted) {
+            *v = 0;
+        }
+        c += ++*v;
+    }
+    mu_bench_pause(b);
+    mu_do_not_optimize(c);
+    counts_destroy(&map);
+    free(keys);
+    return NULL;
+}
+
+const char *bench_cms_merge_loop(mu_bench_t *b, size_t width) {
+    cms_t x, y;
+    size_t i, j;
+
+    mu_assert(cms_init_size(&x, width, 4, NULL) == 0 &&
+                  cms_init_size(&y, width, 4, NULL) == 0,
+              "cms_init_size");
+    mu_bench_bytes(b, width * 4 * sizeof(uint64_t));
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        for (j = 0; j < width * 4; j++) {
+            x.counts[j] += y.counts[j];
+        }
+        mu_clobber();
+    }
+    mu_bench_pause(b);
+    cms_destroy(&x);
+    cms_destroy(&y);
+    return NULL;
+}
+
+const char *bench_cms_merge(mu_bench_t *b, size_t width) {
+    cms_t x, y;
+    size_t i;
+
+    mu_assert(cms_init_size(&x, width, 4, NULL) == 0 &&
+                  cms_init_size(&y, width, 4, NULL) == 0,
+              "cms_init_size");
+    mu_bench_bytes(b, width * 4 * sizeof(uint64_t));
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        cms_merge(&x, &y);
+        mu_clobber();
+    }
+    mu_bench_pause(b);
+    cms_destroy(&x);
+    cms_destroy(&y);
+    return NULL;
+}
+
+const char *all_benches() {
+    mu_suite_start();
+
+    mu_run_bench(bench_hll_add, 14, 1000);
+    mu_run_bench(bench_hll_add, 14, 1000000);
+    mu_run_bench(bench_hll_count, 14);
+    mu_run_bench(bench_hll_merge_loop, 14);
+    mu_run_bench(bench_hll_merge, 14);
+    mu_run_bench(bench_hll_merge_loop, 18);
+    mu_run_bench(bench_hll_merge, 18);
+    mu_run_bench(bench_cms_add, 1 << 10);
+    mu_run_bench(bench_cms_add, 1 << 20);
+    mu_run_bench(bench_exact_add);
+    mu_run_bench(bench_cms_merge_loop, 1 << 12);
+    mu_run_bench(bench_cms_merge, 1 << 12);
+
+    return NULL;
+}
+
+RUN_BENCHES(all_benches);
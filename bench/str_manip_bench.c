@@ -0,0 +1,304 @@
+/**
+ * @brief str_manip functions against their libc counterparts (see mubench.h
+ * for options).
+ */
+
+#define _GNU_SOURCE
+#include "mubench.h"
+
+#include <ctype.h>
+#include <strings.h>
+#include "str_manip.h"
+
+#define NEEDLE "needle in a haystack"
+#define FIELD "field,"
+
+/* len bytes of lowercase words and spaces, NUL-terminated, ending in NEEDLE
+ * so searches scan the whole text */
+static char *text(size_t len) {
+    char *buf = malloc(len + 1);
+    unsigned long x = 88172645463325252UL;
+    size_t i;
+
+    if (!buf || len < sizeof(NEEDLE)) {
+        free(buf);
+        return NULL;
+    }
+    for (i = 0; i < len; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buf[i] = x % 7 ? 'a' + x % 26 : ' ';
+    }
+    memcpy(buf + len - strlen(NEEDLE), NEEDLE, strlen(NEEDLE) + 1);
+    return buf;
+}
+
+const char *bench_find_strstr(mu_bench_t *b, size_t len) {
+    char *hay = text(len);
+    size_t i;
+
+    mu_assert(hay, "Out of memory");
+    mu_bench_bytes(b, len);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_do_not_optimize(strstr(hay, NEEDLE));
+    }
+    mu_bench_pause(b);
+    free(hay);
+    return NULL;
+}
+
+const char *bench_find(mu_bench_t *b, size_t len) {
+    char *hay = text(len);
+    size_t i;
+
+    mu_assert(hay, "Out of memory");
+    mu_assert(str_find(str_make(hay, len), STR_LIT(NEEDLE)) ==
+              (ssize_t)(len - strlen(NEEDLE)), "str_find is wrong");
+    mu_bench_bytes(b, len);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_do_not_optimize(str_find(str_make(hay, len), STR_LIT(NEEDLE)));
+    }
+    mu_bench_pause(b);
+    free(hay);
+    return NULL;
+}
+
+/* strtok_r() writes into its input, so each iteration pays for a copy */
+const char *bench_split_strtok(mu_bench_t *b, size_t fields) {
+    size_t len = fields * strlen(FIELD), i, n;
+    char *line = malloc(len + 1), *copy = malloc(len + 1), *save, *tok;
+
+    mu_assert(line && copy, "Out of memory");
+    for (i = 0; i < fields; i++) {
+        memcpy(line + i * strlen(FIELD), FIELD, strlen(FIELD));
+    }
+    line[len] = '\0';
+    mu_bench_bytes(b, len);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        memcpy(copy, line, len + 1);
+        for (n = 0, tok = strtok_r(copy, ",", &save); tok;
+             tok = strtok_r(NULL, ",", &save)) {
+            n += tok[0];
+        }
+        mu_do_not_optimize(n);
+    }
+    mu_bench_pause(b);
+    free(line);
+    free(copy);
+    return NULL;
+}
+
+const char *bench_split(mu_bench_t *b, size_t fields) {
+    size_t len = fields * strlen(FIELD), i, n;
+    char *line = malloc(len);
+    str_t rest, tok;
+
+    mu_assert(line, "Out of memory");
+    for (i = 0; i < fields; i++) {
+        memcpy(line + i * strlen(FIELD), FIELD, strlen(FIELD));
+    }
+    mu_bench_bytes(b, len);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        rest = str_make(line, len);
+        for (n = 0; str_split_next(&rest, ',', &tok);) {
+            n += tok.len ? tok.ptr[0] : 0;
+        }
+        mu_do_not_optimize(n);
+    }
+    mu_bench_pause(b);
+    free(line);
+    return NULL;
+}
+
+const char *bench_tolower_ctype(mu_bench_t *b, size_t len) {
+    char *in = text(len), *out = malloc(len);
+    size_t i, j;
+
+    mu_assert(in && out, "Out of memory");
+    mu_bench_bytes(b, len);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        for (j = 0; j < len; j++) {
+            out[j] = tolower((unsigned char)in[j]);
+        }
+        mu_clobber();
+    }
+    mu_bench_pause(b);
+    free(in);
+    free(out);
+    return NULL;
+}
+
+const char *bench_tolower(mu_bench_t *b, size_t len) {
+    char *in = text(len), *out = malloc(len);
+    size_t i;
+
+    mu_assert(in && out, "Out of memory");
+    mu_bench_bytes(b, len);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        str_tolower(out, str_make(in, len));
+        mu_clobber();
+    }
+    mu_bench_pause(b);
+    free(in);
+    free(out);
+    return NULL;
+}
+
+/* equal strings, so both functions read everything */
+const char *bench_eq_strcasecmp(mu_bench_t *b, size_t len) {
+    char *x = text(len), *y = text(len);
+    size_t i;
+
+    mu_assert(x && y, "Out of memory");
+    str_toupper(y, str_make(y, len));
+    mu_bench_bytes(b, len);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_do_not_optimize(strcasecmp(x, y));
+    }
+    mu_bench_pause(b);
+    free(x);
+    free(y);
+    return NULL;
+}
+
+const char *bench_eq_nocase(mu_bench_t *b, size_t len) {
+    char *x = text(len), *y = text(len);
+    size_t i;
+
+    mu_assert(x && y, "Out of memory");
+    str_toupper(y, str_make(y, len));
+    mu_assert(str_eq_nocase(str_make(x, len), str_make(y, len)),
+              "str_eq_nocase is wrong");
+    mu_bench_bytes(b, len);
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        mu_do_not_optimize(str_eq_nocase(str_make(x, len), str_make(y, len)));
+    }
+    mu_bench_pause(b);
+    free(x);
+    free(y);
+    return NULL;
+}
+
+/* pad bytes of whitespace on each side of a short word */
+static char *padded(size_t pad) {
+    char *buf = malloc(2 * pad + 5);
+
+    if (buf) {
+        memset(buf, ' ', 2 * pad + 4);
+        memcpy(buf + pad, "word", 4);
+        buf[2 * pad + 4] = '\0';
+    }
+    return buf;
+}
+
+const char *bench_trim_isspace(mu_bench_t *b, size_t pad) {
+    char *buf = padded(pad), *start, *end;
+    size_t i;
+
+    mu_assert(buf, "Out of memory");
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        start = buf;
+        end = buf + 2 * pad + 4;
+        mu_do_not_optimize(start);
+        while (start < end && isspace((unsigned char)*start)) {
+            start++;
+        }
+        while (end > start && isspace((unsigned char)end[-1])) {
+            end--;
+        }
+        mu_do_not_optimize(end - start);
+    }
+    mu_bench_pause(b);
+    free(buf);
+    return NULL;
+}
+
+const char *bench_trim(mu_bench_t *b, size_t pad) {
+    char *buf = padded(pad);
+    str_t s;
+    size_t i;
+
+    mu_assert(buf, "Out of memory");
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        s = str_make(buf, 2 * pad + 4);
+        mu_do_not_optimize(s.ptr);
+        s = str_trim(s);
+        mu_do_not_optimize(s.len);
+    }
+    mu_bench_pause(b);
+    free(buf);
+    return NULL;
+}
+
+/* the usual hand-rolled builder: realloc() to the exact size each time */
+const char *bench_build_realloc(mu_bench_t *b, size_t pieces) {
+    char *buf;
+    size_t i, j, len;
+
+    mu_bench_bytes(b, pieces * strlen(FIELD));
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        buf = NULL;
+        for (j = len = 0; j < pieces; j++) {
+            buf = realloc(buf, len + strlen(FIELD) + 1);
+            memcpy(buf + len, FIELD, strlen(FIELD) + 1);
+            len += strlen(FIELD);
+        }
+        mu_do_not_optimize(buf);
+        free(buf);
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *bench_build(mu_bench_t *b, size_t pieces) {
+    strbuf_t sb;
+    size_t i, j;
+
+    mu_bench_bytes(b, pieces * strlen(FIELD));
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        sb_init(&sb, NULL);
+        for (j = 0; j < pieces; j++) {
+            sb_append(&sb, STR_LIT(FIELD));
+        }
+        mu_do_not_optimize(sb.data);
+        sb_free(&sb);
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *all_benches() {
+    mu_suite_start();
+
+    mu_run_bench(bench_find_strstr, 64);
+    mu_run_bench(bench_find, 64);
+    mu_run_bench(bench_find_strstr, 64 * 1024);
+    mu_run_bench(bench_find, 64 * 1024);
+    mu_run_bench(bench_split_strtok, 1000);
+    mu_run_bench(bench_split, 1000);
+    mu_run_bench(bench_tolower_ctype, 4096);
+    mu_run_bench(bench_tolower, 4096);
+    mu_run_bench(bench_eq_strcasecmp, 4096);
+    mu_run_bench(bench_eq_nocase, 4096);
+    mu_run_bench(bench_trim_isspace, 40);
+    mu_run_bench(bench_trim, 40);
+    mu_run_bench(bench_build_realloc, 10000);
+    mu_run_bench(bench_build, 10000);
+
+    return NULL;
+}
+
+RUN_BENCHES(all_benches);
@@ -0,0 +1,115 @@
+/**
+ * @brief Task spawn overhead and parallel_for scaling of the thread pool.
+ *
+ * Usage: threadpool_bench [max_threads]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "threadpool.h"
+
+#define SPAWN_TASKS 1000000
+#define TREE_DEPTH 18
+#define RANGE_LEN (1UL << 25)
+
+static tp_pool_t *pool;
+static volatile uint64_t sink;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void empty_task(void *arg) {
+    (void)arg;
+}
+
+static void tree_task(void *arg) {
+    long depth = (long)arg;
+    tp_waitgroup_t wg;
+
+    if (depth == 0) {
+        return;
+    }
+    tp_wg_init(&wg);
+    tp_submit(pool, tree_task, (void *)(depth - 1), &wg);
+    tp_submit(pool, tree_task, (void *)(depth - 1), &wg);
+    tp_wg_wait(pool, &wg);
+    tp_wg_destroy(&wg);
+}
+
+/* a few ns of integer work per index */
+static void hash_range(size_t begin, size_t end, void *arg) {
+    uint64_t h = 0, x;
+    size_t i;
+
+    (void)arg;
+    for (i = begin; i < end; i++) {
+        x = i * 0x9e3779b97f4a7c15ULL;
+        x ^= x >> 31;
+        h += x * 0xbf58476d1ce4e5b9ULL;
+    }
+    __atomic_add_fetch(&sink, h, __ATOMIC_RELAXED);
+}
+
+int main(int argc, char *argv[]) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = argc > 1 ? strtoul(argv[1], NULL, 10) : (size_t)ncpu;
+    size_t nthreads, i;
+    tp_waitgroup_t wg;
+    double t, base = 0;
+
+    printf("%-8s %14s %14s %14s %9s\n", "threads", "external ns/task",
+           "nested ns/task", "parfor ms", "speedup");
+    for (nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+        double ext, nested, pfor;
+
+        pool = tp_create(nthreads);
+        if (!pool) {
+            perror("tp_create");
+            return 1;
+        }
+
+        /* spawn from outside the pool: injection queue path */
+        tp_wg_init(&wg);
+        t = now_sec();
+        for (i = 0; i < SPAWN_TASKS; i++) {
+            tp_submit(pool, empty_task, NULL, &wg);
+        }
+        tp_wg_wait(pool, &wg);
+        ext = (now_sec() - t) / SPAWN_TASKS * 1e9;
+        tp_wg_destroy(&wg);
+
+        /* spawn from inside the pool: local deque + stealing path */
+        tp_wg_init(&wg);
+        t = now_sec();
+        tp_submit(pool, tree_task, (void *)(long)TREE_DEPTH, &wg);
+        tp_wg_wait(pool, &wg);
+        nested = (now_sec() - t) / ((2UL << TREE_DEPTH) - 1) * 1e9;
+        tp_wg_destroy(&wg);
+
+        t = now_sec();
+        tp_parallel_for(pool, 0, RANGE_LEN, 0, hash_range, NULL);
+        pfor = (now_sec() - t) * 1e3;
+        if (nthreads == 1) {
+            base = pfor;
+        }
+
+        printf("%-8zu %14.1f %14.1f %14.2f %8.2fx\n", nthreads, ext, nested,
+               pfor, base / pfor);
+        tp_destroy(pool);
+        if (nthreads == max_threads) {
+            break;
+        }
+        if (nthreads * 2 > max_threads) {
+            nthreads = max_threads / 2;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,188 @@
+/**
+ * @file alloc.h
+ * @brief Allocator handles, arena (bump) allocator and fixed-size pools.
+ *
+ * An allocator_t bundles alloc/realloc/free callbacks with their context, so
+ * containers and buffers can take their memory from somewhere other than
+ * malloc(). Every function that accepts an allocator_t pointer treats NULL as
+ * the standard malloc()/realloc()/free() allocator.
+ *
+ * - arena_t hands out memory by bumping a pointer through large chunks.
+ *   Individual frees are no-ops; arena_reset() releases everything at once,
+ *   which suits request-scoped work.
+ * - pool_t hands out objects of a single size from slabs, with optional
+ *   per-thread caches so threads rarely contend on the shared free list.
+ */
+
+#ifndef _alloc_h_
+#define _alloc_h_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ARENA_ALIGN 16                  /* default alignment of arena memory */
+#define ARENA_DEFAULT_CHUNK (64 * 1024) /* bytes per arena chunk */
+#define POOL_DEFAULT_SLAB 256           /* objects per pool slab */
+#define POOL_TLS_BATCH 32 /* objects moved between thread and pool at once */
+
+typedef struct Allocator {
+    void *(*alloc)(void *ctx, size_t size);
+    /* old_size is the size the block was allocated (or last resized) with */
+    void *(*realloc)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+    void (*free)(void *ctx, void *ptr, size_t size);
+    void *ctx;
+} allocator_t;
+
+/**
+ * @brief Allocate size bytes from a (NULL for malloc).
+ */
+void *al_alloc(allocator_t *a, size_t size);
+
+/**
+ * @brief Allocate n * size zeroed bytes from a (NULL for calloc).
+ */
+void *al_calloc(allocator_t *a, size_t n, size_t size);
+
+/**
+ * @brief Resize a block from a (NULL for realloc).
+ */
+void *al_realloc(allocator_t *a, void *ptr, size_t old_size, size_t new_size);
+
+/**
+ * @brief Return a block of size bytes to a (NULL for free).
+ */
+void al_free(allocator_t *a, void *ptr, size_t size);
+
+/*********************************************************************
+ * Arena
+ *********************************************************************/
+
+typedef struct ArenaChunk arena_chunk_t;
+
+typedef struct Arena {
+    arena_chunk_t *head;  /* chunk currently being carved up */
+    arena_chunk_t *base;  /* oldest chunk in use (end of the head chain) */
+    arena_chunk_t *spare; /* released chunks kept for reuse */
+    size_t chunk_size;
+    void *last;           /* most recent allocation, for in-place realloc */
+    allocator_t iface;
+} arena_t;
+
+/**
+ * @brief Position in an arena, to roll back to with arena_reset_to().
+ */
+typedef struct ArenaMark {
+    arena_chunk_t *chunk;
+    size_t used;
+} arena_mark_t;
+
+/**
+ * @brief Prepare an arena that grows in chunks of chunk_size bytes
+ * (ARENA_DEFAULT_CHUNK if 0). No memory is allocated until first use.
+ */
+void arena_init(arena_t *arena, size_t chunk_size);
+
+/**
+ * @brief Free every chunk owned by the arena.
+ */
+void arena_destroy(arena_t *arena);
+
+/**
+ * @brief Allocate size bytes aligned to ARENA_ALIGN.
+ * @returns Pointer to the memory, NULL if out of memory.
+ */
+void *arena_alloc(arena_t *arena, size_t size);
+
+/**
+ * @brief Allocate size bytes aligned to align (a power of two).
+ * @returns Pointer to the memory, NULL if out of memory.
+ */
+void *arena_alloc_aligned(arena_t *arena, size_t size, size_t align);
+
+/**
+ * @brief Record the current position of the arena.
+ */
+arena_mark_t arena_mark(arena_t *arena);
+
+/**
+ * @brief Release everything allocated since mark was taken.
+ *
+ * Chunks are kept for reuse rather than freed.
+ */
+void arena_reset_to(arena_t *arena, arena_mark_t mark);
+
+/**
+ * @brief Release everything allocated from the arena in O(1).
+ *
+ * Chunks are kept for reuse rather than freed.
+ */
+void arena_reset(arena_t *arena);
+
+/**
+ * @brief Return an allocator_t handle that allocates from arena.
+ *
+ * Frees through the handle are no-ops; realloc extends the most recent
+ * allocation in place when it can.
+ */
+allocator_t *arena_allocator(arena_t *arena);
+
+/*********************************************************************
+ * Fixed-size object pool
+ *********************************************************************/
+
+typedef struct PoolSlab pool_slab_t;
+
+typedef struct Pool {
+    size_t obj_size;
+    size_t objs_per_slab;
+    void *free_list;     /* shared free list, guarded by lock */
+    pool_slab_t *slabs;
+    pthread_mutex_t lock;
+    uint64_t id;         /* distinguishes pools in thread caches */
+    bool thread_cache;
+    struct Pool *next_live; /* live thread-caching pools, for cache flushes */
+    allocator_t iface;
+} pool_t;
+
+/**
+ * @brief Prepare a pool of obj_size-byte objects, allocated objs_per_slab at
+ * a time (POOL_DEFAULT_SLAB if 0).
+ *
+ * With thread_cache set, each thread keeps up to 2 * POOL_TLS_BATCH free
+ * objects for itself and only touches the shared free list once per batch.
+ * A thread hands its cached objects back when it exits, or when another
+ * pool needs its cache slot.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int pool_init(pool_t *pool, size_t obj_size, size_t objs_per_slab,
+              bool thread_cache);
+
+/**
+ * @brief Free every slab, and with them every object, of the pool.
+ *
+ * Objects cached by other threads are released too; their caches notice
+ * the pool is gone and drop them instead of handing them back.
+ */
+void pool_destroy(pool_t *pool);
+
+/**
+ * @brief Get an object from the pool.
+ * @returns Pointer to the object, NULL if out of memory.
+ */
+void *pool_alloc(pool_t *pool);
+
+/**
+ * @brief Return an object to the pool.
+ */
+void pool_free(pool_t *pool, void *obj);
+
+/**
+ * @brief Return an allocator_t handle backed by pool.
+ *
+ * Requests larger than the pool's object size fail with EINVAL.
+ */
+allocator_t *pool_allocator(pool_t *pool);
+
+#endif /* _alloc_h_ */
@@ -0,0 +1,104 @@
+/**
+ * @file asynclog.h
+ * @brief Asynchronous logging backend for the dbg.h macros.
+ *
+ * Once alog_start() has been called, log_err()/log_warn()/log_info()/debug()
+ * format the message on the calling thread and copy it into that thread's
+ * lock-free single-producer ring instead of calling fprintf(stderr). A
+ * background thread gathers records from every ring and writes them with
+ * writev() in batches, so logging threads never take the stdio lock or block
+ * on a slow terminal or pipe. Before alog_start() and after alog_stop() the
+ * macros write to stderr synchronously as before.
+ *
+ * Records from one thread are written in order; records from different
+ * threads may interleave in any order.
+ */
+
+#ifndef _asynclog_h_
+#define _asynclog_h_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ALOG_RING_SIZE (64 * 1024) /* default bytes per thread ring */
+#define ALOG_MAX_RECORD 1024       /* longer messages are truncated */
+#define ALOG_FLUSH_MS 10           /* default max delay before a write */
+
+/**
+ * @brief What a logging thread does when its ring is full.
+ */
+typedef enum {
+    ALOG_DROP,  /* discard the message and count it (never blocks) */
+    ALOG_BLOCK, /* wait for the flusher to make room (never loses data) */
+} alog_policy_t;
+
+typedef struct AlogConfig {
+    size_t ring_size; /* bytes per thread, a power of two */
+    alog_policy_t policy;
+    unsigned flush_ms; /* how long the flusher sleeps when idle */
+} alog_config_t;
+
+typedef struct AlogStats {
+    uint64_t records; /* records written to the fd */
+    uint64_t bytes;
+    uint64_t dropped; /* records discarded by ALOG_DROP */
+    uint64_t writes;  /* writev() calls */
+} alog_stats_t;
+
+extern int alog_running;
+
+/**
+ * @brief Fill cfg with the defaults (ALOG_RING_SIZE, ALOG_DROP,
+ * ALOG_FLUSH_MS).
+ */
+void alog_config_init(alog_config_t *cfg);
+
+/**
+ * @brief Start the flusher thread writing to fd (e.g. STDERR_FILENO).
+ *
+ * cfg may be NULL for the defaults.
+ * @returns @c 0 on success, @c -1 on error (EALREADY if already running).
+ */
+int alog_start(int fd, const alog_config_t *cfg);
+
+/**
+ * @brief Write everything still queued, stop the flusher and free the rings.
+ *
+ * Call once other threads have stopped logging; any that log afterwards fall
+ * back to synchronous writes to stderr.
+ */
+void alog_stop(void);
+
+/**
+ * @brief Return true between alog_start() and alog_stop().
+ */
+static inline bool alog_active(void) {
+    return __atomic_load_n(&alog_running, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Format a message and queue it on the calling thread's ring.
+ * @returns Number of bytes queued, @c -1 if the message was dropped.
+ */
+int alog_printf(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+
+/**
+ * @brief Queue len bytes of buf as one record.
+ * @returns Number of bytes queued, @c -1 if the record was dropped.
+ */
+int alog_write(const void *buf, size_t len);
+
+/**
+ * @brief Block until everything queued by any thread before the call has been
+ * written.
+ */
+void alog_flush(void);
+
+/**
+ * @brief Copy the running totals into stats.
+ */
+void alog_stats(alog_stats_t *stats);
+
+#endif /* _asynclog_h_ */
@@ -2,6 +2,7 @@
 #define _BASE64_H_
 
 #include <stdlib.h>
+#include "alloc.h"
 
 #ifndef BASE64_PAD
 #   define BASE64_PAD '='
@@ -15,4 +16,10 @@ typedef enum {
 char *b64encode(const char *in, const size_t inlen, const b64_encoding_t charset, size_t *outlen);
 char *b64decode(const char *in, const size_t inlen, const b64_encoding_t charset, size_t *outlen);
 
+/* Same as b64encode()/b64decode(), but the output buffer comes from alloc
+ * (NULL for malloc). It is at most ((inlen+2)/3)*4 + 1 bytes when encoding and
+ * ((inlen+3)/4)*3 + 1 bytes when decoding. */
+char *b64encode_with(const char *in, const size_t inlen, const b64_encoding_t charset, size_t *outlen, allocator_t *alloc);
+char *b64decode_with(const char *in, const size_t inlen, const b64_encoding_t charset, size_t *outlen, allocator_t *alloc);
+
 #endif /* _BASE64_H_ */
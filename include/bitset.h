@@ -0,0 +1,122 @@
+/**
+ * @file bitset.h
+ * @brief Fixed-size bitsets with bulk SIMD operations and atomic bit access.
+ *
+ * Bits live in 64-bit words, in cache-line (512-bit) aligned, cache-line
+ * sized groups, so bulk operations run whole vectors without a scalar tail
+ * and each line can serve as one block of a blocked Bloom filter (see
+ * bloom.h). Bits past nbits are always zero.
+ *
+ * Single bits are read and written inline, with bs_set()/bs_clear()/bs_test()
+ * for a bitset owned by one thread, and bs_*_atomic() for bits shared between
+ * threads. Counting uses popcnt or AVX2 when the CPU has them, and the bulk
+ * AND/OR/ANDNOT operations AVX2; every function is correct on any CPU.
+ */
+
+#ifndef _bitset_h_
+#define _bitset_h_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "alloc.h"
+
+#define BS_WORD_BITS 64
+#define BS_LINE_WORDS 8 /* 64-bit words per 64-byte cache line */
+#define BS_NONE SIZE_MAX /* bs_next_set()/bs_next_clear() found nothing */
+
+typedef struct Bitset {
+    uint64_t *words; /* nwords, cache-line aligned */
+    size_t nwords;   /* a multiple of BS_LINE_WORDS */
+    size_t nbits;
+    void *mem; /* the allocation words is aligned within */
+    allocator_t *alloc;
+} bitset_t;
+
+/**
+ * @brief Initialize bs to nbits clear bits, allocated from alloc (NULL for
+ * malloc).
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int bs_init(bitset_t *bs, size_t nbits, allocator_t *alloc);
+
+/**
+ * @brief Free the bits of bs.
+ */
+void bs_destroy(bitset_t *bs);
+
+/**
+ * @brief Clear, or set, every bit of bs.
+ */
+void bs_clear_all(bitset_t *bs);
+void bs_set_all(bitset_t *bs);
+
+/**
+ * @brief Return the number of set bits in bs.
+ */
+size_t bs_count(const bitset_t *bs);
+
+/**
+ * @brief Return the index of the first set (or clear) bit at or after from,
+ * or BS_NONE if there is none.
+ */
+size_t bs_next_set(const bitset_t *bs, size_t from);
+size_t bs_next_clear(const bitset_t *bs, size_t from);
+
+/**
+ * @brief In-place dst &= src, dst |= src and dst &= ~src.
+ * @returns @c 0 on success, @c -1 on error (EINVAL if the sizes differ).
+ */
+int bs_and(bitset_t *dst, const bitset_t *src);
+int bs_or(bitset_t *dst, const bitset_t *src);
+int bs_andnot(bitset_t *dst, const bitset_t *src);
+
+/*********************************************************************
+ * Single bits
+ *
+ * i must be below bs->nbits; it isn't checked.
+ *********************************************************************/
+
+static inline uint64_t bs_mask(size_t i) {
+    return (uint64_t)1 << (i % BS_WORD_BITS);
+}
+
+static inline void bs_set(bitset_t *bs, size_t i) {
+    bs->words[i / BS_WORD_BITS] |= bs_mask(i);
+}
+
+static inline void bs_clear(bitset_t *bs, size_t i) {
+    bs->words[i / BS_WORD_BITS] &= ~bs_mask(i);
+}
+
+static inline bool bs_test(const bitset_t *bs, size_t i) {
+    return (bs->words[i / BS_WORD_BITS] & bs_mask(i)) != 0;
+}
+
+/**
+ * @brief Atomically set bit i, and return its previous value.
+ *
+ * A thread that sees the bit set with bs_test_atomic() also sees what the
+ * setting thread wrote before setting it.
+ */
+static inline bool bs_set_atomic(bitset_t *bs, size_t i) {
+    return (__atomic_fetch_or(&bs->words[i / BS_WORD_BITS], bs_mask(i),
+                              __ATOMIC_ACQ_REL) &
+            bs_mask(i)) != 0;
+}
+
+/**
+ * @brief Atomically clear bit i, and return its previous value.
+ */
+static inline bool bs_clear_atomic(bitset_t *bs, size_t i) {
+    return (__atomic_fetch_and(&bs->words[i / BS_WORD_BITS], ~bs_mask(i),
+                               __ATOMIC_ACQ_REL) &
+            bs_mask(i)) != 0;
+}
+
+static inline bool bs_test_atomic(const bitset_t *bs, size_t i) {
+    return (__atomic_load_n(&bs->words[i / BS_WORD_BITS], __ATOMIC_ACQUIRE) &
+            bs_mask(i)) != 0;
+}
+
+#endif /* _bitset_h_ */
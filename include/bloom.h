@@ -0,0 +1,109 @@
+/**
+ * @file bloom.h
+ * @brief Blocked Bloom filters for approximate set membership.
+ *
+ * A Bloom filter answers "have I seen this key?" with no false negatives and
+ * a tunable rate of false positives, in a few bits per key instead of a hash
+ * table entry; deduplicating message IDs, say, costs about 10 bits per ID for
+ * a 1% false positive rate.
+ *
+ * The filter is blocked: a key's hash picks one 512-bit cache line (a block)
+ * of a bitset_t, and all k of its bits are set in that line, spread across
+ * its eight words. A lookup then costs one cache miss rather than k, for a
+ * slightly higher false positive rate at the same size, which bloom_init()
+ * makes up for with a few more bits.
+ *
+ * Filters take a 64-bit hash of the key, which must be well mixed (use
+ * hm_hash_u64() or hm_hash_bytes() from hashmap.h). bloom_add_atomic() may
+ * run concurrently with itself and with bloom_contains(); bloom_add() may
+ * not.
+ */
+
+#ifndef _bloom_h_
+#define _bloom_h_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "alloc.h"
+#include "bitset.h"
+
+#define BLOOM_BLOCK_BITS 512
+#define BLOOM_MAX_K 16 /* bits set per key, at most */
+
+typedef struct Bloom {
+    bitset_t bits;
+    size_t nblocks;
+    unsigned k; /* bits per key */
+} bloom_t;
+
+/**
+ * @brief Initialize bf to hold n keys with a false positive rate of at most
+ * fp_rate, choosing the size and number of bits per key that need the least
+ * memory.
+ * @returns @c 0 on success, @c -1 on error (EINVAL unless n > 0 and
+ * 0 < fp_rate < 1).
+ */
+int bloom_init(bloom_t *bf, size_t n, double fp_rate, allocator_t *alloc);
+
+/**
+ * @brief Initialize bf with nbits bits (rounded up to whole blocks) and k
+ * bits per key.
+ * @returns @c 0 on success, @c -1 on error (EINVAL unless 0 < k <=
+ * BLOOM_MAX_K).
+ */
+int bloom_init_size(bloom_t *bf, size_t nbits, unsigned k,
+                    allocator_t *alloc);
+
+/**
+ * @brief Free the bits of bf.
+ */
+void bloom_destroy(bloom_t *bf);
+
+/**
+ * @brief Remove every key from bf.
+ */
+void bloom_clear(bloom_t *bf);
+
+/**
+ * @brief Estimate the false positive rate of a blocked filter of nbits bits
+ * with k bits per key once it holds n keys.
+ */
+double bloom_fp_rate(size_t nbits, unsigned k, size_t n);
+
+/**
+ * @brief Add the key with the given hash to bf.
+ * @returns true if the key may have been present already (all its bits were
+ * set), false if it certainly was not.
+ */
+bool bloom_add(bloom_t *bf, uint64_t hash);
+
+/**
+ * @brief bloom_add(), for filters that several threads add to at once.
+ *
+ * Bits are set with atomic ORs, one per word of the block, so two threads
+ * adding the same new key at the same time may both get false.
+ */
+bool bloom_add_atomic(bloom_t *bf, uint64_t hash);
+
+/**
+ * @brief Return true if the key with the given hash may be in bf, false if
+ * it certainly is not.
+ */
+bool bloom_contains(const bloom_t *bf, uint64_t hash);
+
+/**
+ * @brief bloom_contains() for n hashes, storing the answers in found, with
+ * the blocks of later hashes prefetched while earlier ones are tested.
+ * @returns The number of hashes that may be present.
+ */
+size_t bloom_contains_n(const bloom_t *bf, const uint64_t *hashes, size_t n,
+                        bool *found);
+
+/**
+ * @brief Add the keys of src to dst, which must have the same size and k.
+ * @returns @c 0 on success, @c -1 on error (EINVAL if the filters differ).
+ */
+int bloom_union(bloom_t *dst, const bloom_t *src);
+
+#endif /* _bloom_h_ */
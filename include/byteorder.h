@@ -0,0 +1,155 @@
+/**
+ * @file byteorder.h
+ * @brief Compile-time endianness, byte swaps and bulk byte-order conversion.
+ *
+ * The single-value helpers compile to one bswap (or movbe) instruction, or
+ * to nothing when no swap is needed. bo_load_be32() and friends read from
+ * unaligned addresses, which makes them the usual way to pick fields out of
+ * a wire buffer:
+ * @code
+ * uint32_t len = bo_load_be32(hdr + 4);
+ * @endcode
+ *
+ * The array converters swap whole buffers with SSSE3/AVX2 byte shuffles
+ * where available (chosen at runtime), e.g. to turn a block of big-endian
+ * samples into host integers. dst and src may be the same buffer, but must
+ * not otherwise overlap.
+ */
+
+#ifndef _byteorder_h_
+#define _byteorder_h_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+#    define BO_LITTLE_ENDIAN (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#    define BO_BIG_ENDIAN (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#else
+#    error "byteorder.h: cannot determine the byte order at compile time"
+#endif
+
+static inline uint16_t bo_bswap16(uint16_t x) {
+    return __builtin_bswap16(x);
+}
+
+static inline uint32_t bo_bswap32(uint32_t x) {
+    return __builtin_bswap32(x);
+}
+
+static inline uint64_t bo_bswap64(uint64_t x) {
+    return __builtin_bswap64(x);
+}
+
+/**
+ * @brief Convert between host and big-endian (network) byte order. Each
+ * conversion is its own inverse, so the same functions go both ways.
+ */
+static inline uint16_t bo_be16(uint16_t x) {
+    return BO_LITTLE_ENDIAN ? bo_bswap16(x) : x;
+}
+
+static inline uint32_t bo_be32(uint32_t x) {
+    return BO_LITTLE_ENDIAN ? bo_bswap32(x) : x;
+}
+
+static inline uint64_t bo_be64(uint64_t x) {
+    return BO_LITTLE_ENDIAN ? bo_bswap64(x) : x;
+}
+
+/**
+ * @brief Convert between host and little-endian byte order.
+ */
+static inline uint16_t bo_le16(uint16_t x) {
+    return BO_BIG_ENDIAN ? bo_bswap16(x) : x;
+}
+
+static inline uint32_t bo_le32(uint32_t x) {
+    return BO_BIG_ENDIAN ? bo_bswap32(x) : x;
+}
+
+static inline uint64_t bo_le64(uint64_t x) {
+    return BO_BIG_ENDIAN ? bo_bswap64(x) : x;
+}
+
+/**
+ * @brief Read a big-endian value from a possibly unaligned address.
+ */
+static inline uint16_t bo_load_be16(const void *p) {
+    uint16_t x;
+
+    memcpy(&x, p, sizeof(x));
+    return bo_be16(x);
+}
+
+static inline uint32_t bo_load_be32(const void *p) {
+    uint32_t x;
+
+    memcpy(&x, p, sizeof(x));
+    return bo_be32(x);
+}
+
+static inline uint64_t bo_load_be64(const void *p) {
+    uint64_t x;
+
+    memcpy(&x, p, sizeof(x));
+    return bo_be64(x);
+}
+
+/**
+ * @brief Write a big-endian value to a possibly unaligned address.
+ */
+static inline void bo_store_be16(void *p, uint16_t x) {
+    x = bo_be16(x);
+    memcpy(p, &x, sizeof(x));
+}
+
+static inline void bo_store_be32(void *p, uint32_t x) {
+    x = bo_be32(x);
+    memcpy(p, &x, sizeof(x));
+}
+
+static inline void bo_store_be64(void *p, uint64_t x) {
+    x = bo_be64(x);
+    memcpy(p, &x, sizeof(x));
+}
+
+/**
+ * @brief Byte-swap n 16-, 32- or 64-bit values from src into dst.
+ *
+ * Neither buffer needs to be aligned.
+ */
+void bo_bswap16_n(void *dst, const void *src, size_t n);
+void bo_bswap32_n(void *dst, const void *src, size_t n);
+void bo_bswap64_n(void *dst, const void *src, size_t n);
+
+/**
+ * @brief Convert n big-endian values at src to host order in dst, or back;
+ * a copy on big-endian hosts.
+ */
+static inline void bo_be16_n(void *dst, const void *src, size_t n) {
+    if (BO_LITTLE_ENDIAN) {
+        bo_bswap16_n(dst, src, n);
+    } else if (dst != src) {
+        memcpy(dst, src, n * sizeof(uint16_t));
+    }
+}
+
+static inline void bo_be32_n(void *dst, const void *src, size_t n) {
+    if (BO_LITTLE_ENDIAN) {
+        bo_bswap32_n(dst, src, n);
+    } else if (dst != src) {
+        memcpy(dst, src, n * sizeof(uint32_t));
+    }
+}
+
+static inline void bo_be64_n(void *dst, const void *src, size_t n) {
+    if (BO_LITTLE_ENDIAN) {
+        bo_bswap64_n(dst, src, n);
+    } else if (dst != src) {
+        memcpy(dst, src, n * sizeof(uint64_t));
+    }
+}
+
+#endif /* _byteorder_h_ */
@@ -12,6 +12,14 @@
  * compile with -DNDEBUG flag (preferred)
  * -- or --
  * insert '#define NDEBUG' into source/header file
+ *
+ * To compile out every message below a level:
+ * compile with -DLOG_MIN_LEVEL=LOG_LEVEL_WARN (for example)
+ * To filter at runtime: log_set_level(LOG_LEVEL_WARN)
+ *
+ * To queue messages on the asynchronous backend once alog_start() has been
+ * called: compile with -DDBG_ASYNC and link asynclog.o (see asynclog.h).
+ * Without it, messages go straight to stderr and nothing needs linking.
  *************************************************/
 
 #ifndef __dbg_h__
@@ -20,10 +28,13 @@
 #include <stdio.h>  /* fprintf() */
 #include <errno.h>  /* errno */
 #include <string.h> /* strerror() */
-#include <time.h>   /* clock() */
-#include <stdlib.h> /* EXIT_SUCCESS, EXIT_FAILURE, random(), RAND_MAX */
+#include <stdlib.h> /* EXIT_SUCCESS, EXIT_FAILURE */
 #include <unistd.h> /* usleep() */
+#include <time.h>   /* clock_gettime(), clock() */
 #include "utils.h"	/* STR() macro */
+#ifdef DBG_ASYNC
+#include "asynclog.h"	/* alog_printf() */
+#endif
 
 
 /* trace format for debugging/logging
@@ -33,18 +44,127 @@
 /* safe, readable version of strerror(errno) */
 #define clean_strerror() (errno == 0 ? "None" : strerror(errno))
 
+/* write a formatted message to stderr, or with DBG_ASYNC queue it on the
+   asynchronous backend once alog_start() has been called */
+#ifdef DBG_ASYNC
+# define _LOG_WRITE(...) (alog_active() ? alog_printf(__VA_ARGS__) : fprintf(stderr, __VA_ARGS__))
+#else
+# define _LOG_WRITE(...) fprintf(stderr, __VA_ARGS__)
+#endif
+
+/* monotonic time in nanoseconds where POSIX clocks are available, else
+   processor time */
+static inline uint64_t _dbg_now_ns(void) {
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    return (uint64_t)((double)clock() * 1e9 / CLOCKS_PER_SEC);
+#endif
+}
+
+/* log levels, lowest to highest */
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERR   3
+#define LOG_LEVEL_NONE  4
+
+/* messages below LOG_MIN_LEVEL are removed at compile time */
+#ifndef LOG_MIN_LEVEL
+# ifdef NDEBUG
+#  define LOG_MIN_LEVEL LOG_LEVEL_INFO
+# else
+#  define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+# endif /* NDEBUG */
+#endif /* LOG_MIN_LEVEL */
+
+/* messages below log_level are skipped at runtime (one relaxed load); weak,
+   so every file that includes this header shares the one definition */
+__attribute__((weak)) int log_level = LOG_LEVEL_DEBUG;
+
+static inline void log_set_level(int level) {
+    __atomic_store_n(&log_level, level, __ATOMIC_RELAXED);
+}
+
+#define log_enabled(LEVEL) ((LEVEL) >= LOG_MIN_LEVEL && \
+    (LEVEL) >= __atomic_load_n(&log_level, __ATOMIC_RELAXED))
+#define _LOG_AT(LEVEL, ...) ((void)(log_enabled(LEVEL) ? _LOG_WRITE(__VA_ARGS__) : 0))
+
 /* logging macros: print formatted message to stderr, with trace to logging stmt */
-#define log_err(MSG, ...) fprintf(stderr, "[ERROR] (%s:%s:%d:%s) " MSG "\n", _TRACE_, clean_strerror(), ##__VA_ARGS__)
-#define log_warn(MSG, ...) fprintf(stderr, "[WARN] (%s:%s:%d:%s) " MSG "\n", _TRACE_, clean_strerror(), ##__VA_ARGS__)
-#define log_info(MSG, ...) fprintf(stderr, "[INFO] (%s:%s:%d) " MSG "\n", _TRACE_, ##__VA_ARGS__)
+#if LOG_MIN_LEVEL <= LOG_LEVEL_ERR
+# define log_err(MSG, ...) _LOG_AT(LOG_LEVEL_ERR, "[ERROR] (%s:%s:%d:%s) " MSG "\n", _TRACE_, clean_strerror(), ##__VA_ARGS__)
+#else
+# define log_err(MSG, ...) ((void)0)
+#endif
+#if LOG_MIN_LEVEL <= LOG_LEVEL_WARN
+# define log_warn(MSG, ...) _LOG_AT(LOG_LEVEL_WARN, "[WARN] (%s:%s:%d:%s) " MSG "\n", _TRACE_, clean_strerror(), ##__VA_ARGS__)
+#else
+# define log_warn(MSG, ...) ((void)0)
+#endif
+#if LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+# define log_info(MSG, ...) _LOG_AT(LOG_LEVEL_INFO, "[INFO] (%s:%s:%d) " MSG "\n", _TRACE_, ##__VA_ARGS__)
+#else
+# define log_info(MSG, ...) ((void)0)
+#endif
 
 /* print formatted debug messages to stderr only when NDEBUG is not defined */
-#ifdef NDEBUG
+#if defined(NDEBUG) || LOG_MIN_LEVEL > LOG_LEVEL_DEBUG
 # define debug(MSG, ...)
 #else
-# define debug(MSG, ...) fprintf(stderr, "[DEBUG] (%s:%s:%d) " MSG "\n", _TRACE_, ##__VA_ARGS__)
+# define debug(MSG, ...) _LOG_AT(LOG_LEVEL_DEBUG, "[DEBUG] (%s:%s:%d) " MSG "\n", _TRACE_, ##__VA_ARGS__)
 #endif /* NDEBUG */
 
+/* Rate-limited and sampled logging. LOG is one of the macros above, e.g.
+   log_every_n(1000, log_warn, "queue full"). All are thread-safe. */
+
+/* log the 1st, N+1th, 2N+1th, ... call */
+#define log_every_n(N, LOG, MSG, ...) do { \
+    static unsigned long _log_calls; \
+    if (__atomic_fetch_add(&_log_calls, 1, __ATOMIC_RELAXED) % (N) == 0) \
+        LOG(MSG, ##__VA_ARGS__); \
+    } while (0)
+
+/* log only the first call */
+#define log_once(LOG, MSG, ...) do { \
+    static int _log_done; \
+    if (!__atomic_load_n(&_log_done, __ATOMIC_RELAXED) && \
+        !__atomic_exchange_n(&_log_done, 1, __ATOMIC_RELAXED)) \
+        LOG(MSG, ##__VA_ARGS__); \
+    } while (0)
+
+/* log at most once per MILLIS milliseconds, noting how many were skipped */
+typedef struct LogRatelimit {
+    uint64_t next_ns;
+    unsigned long suppressed;
+} log_ratelimit_t;
+
+/* let one caller through per window of millis; count the rest and hand the
+   count to the next caller that gets through */
+static inline bool log_ratelimit_ok(log_ratelimit_t *rl, unsigned millis,
+                                    unsigned long *suppressed) {
+    uint64_t now = _dbg_now_ns();
+    uint64_t next = __atomic_load_n(&rl->next_ns, __ATOMIC_RELAXED);
+
+    if (now < next ||
+        !__atomic_compare_exchange_n(&rl->next_ns, &next,
+                                     now + (uint64_t)millis * 1000000, false,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(&rl->suppressed, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    *suppressed = __atomic_exchange_n(&rl->suppressed, 0, __ATOMIC_RELAXED);
+    return true;
+}
+
+#define log_ratelimited(MILLIS, LOG, MSG, ...) do { \
+    static log_ratelimit_t _log_rl; \
+    unsigned long _log_skipped; \
+    if (log_ratelimit_ok(&_log_rl, (MILLIS), &_log_skipped)) \
+        LOG(MSG " (%lu suppressed)", ##__VA_ARGS__, _log_skipped); \
+    } while (0)
+
 /* enhanced assert(); check that ASSERT_COND is true, otherwise log formatted
    error msg then "goto error" for cleanup/exit */
 #define check(ASSERT_COND, MSG, ...) if(!(ASSERT_COND)) { log_err(MSG, ##__VA_ARGS__); goto error; }
@@ -74,19 +194,21 @@
 #define DIE() do { log_err("EXIT_FAILURE for debugging"); exit(EXIT_FAILURE); } while (0)
 
 	
-/* computes how long a function takes to run (miliseconds) */
+/* computes how long a function takes to run (miliseconds, wall clock).
+   For repeated measurements with percentiles, see INST_TIME() in instrument.h */
 #define log_time(FUNC, ...) do {    \
-    clock_t start = clock();        \
+    uint64_t start = _dbg_now_ns(); \
     (*(FUNC))(__VA_ARGS__);         \
-    clock_t end = clock();          \
-    double elapsed = (double)(end - start) * 1000.0 / CLOCKS_PER_SEC;   \
-    log_info("%s took %.3f ms to run", STR(FUNC), elapsed);             \
+    uint64_t end = _dbg_now_ns();   \
+    double elapsed = (end - start) / 1e6;                   \
+    log_info("%s took %.3f ms to run", STR(FUNC), elapsed); \
     } while(0)
 /* ^^ useful resource I referenced to help build this:
    https://mikeash.com/pyblog/friday-qa-2010-12-31-c-macro-tips-and-tricks.html */
 
    
-/* Add random delay to program at this point (0-10ms). Useful for debugging race conditions */
+/* Add random delay to program at this point (0-10ms). Useful for debugging race conditions.
+   Uses RAND_INT(), so needs prng.o linked (see utils.h) */
 #define jitter() usleep(RAND_INT(0, 10000))
 
 
@@ -10,6 +10,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include "alloc.h"
 
 typedef struct Node {
     struct Node *next;
@@ -21,8 +22,16 @@ typedef struct Deque {
     struct Node *head;
     struct Node *tail;
     ssize_t n_items;
+    allocator_t *alloc; /* source of nodes and of the deque itself */
 } deque_t;
 
+/**
+ * @brief Object size to give pool_init() for a pool that backs deques: large
+ * enough for both nodes and deque_t.
+ */
+#define DQ_POOL_OBJ_SIZE \
+    (sizeof(node_t) > sizeof(deque_t) ? sizeof(node_t) : sizeof(deque_t))
+
 /**
  * @brief A function pointer whose signature matches free()
  */
@@ -37,6 +46,15 @@ typedef void (*freefunc_t)(void *);
  */
 deque_t *dq_create(void);
 
+/**
+ * @brief Like dq_create(), but the deque and all of its nodes are allocated
+ * from alloc (NULL for malloc).
+ *
+ * Deques derived from it (dq_copy(), dq_sorted(), dq_merge()) use the same
+ * allocator.
+ */
+deque_t *dq_create_with(allocator_t *alloc);
+
 /**
  * @brief Empties the deque of nodes, optionally calling free_func on the node
  * data.
@@ -77,7 +95,8 @@ node_t *dq_append(deque_t *dq, void *data);
 void *dq_dequeue(deque_t *dq);
 
 /* Joins A and B. Returns pointer to A on success, NULL on failure, with
- * errno set to EINVAL (i.e. A or B is NULL). Items from B are appended to the
+ * errno set to EINVAL (i.e. A or B is NULL, or they use different
+ * allocators). Items from B are appended to the
  * end of A (in order). B will be empty after calling. Result after execution: A
  * -> A + B; B -> <empty>. NOTE: this is faster than manually popping and
  * appending. */
@@ -0,0 +1,171 @@
+/**
+ * @file fileio.h
+ * @brief Whole-file memory maps, a buffered line reader and a batched writer.
+ *
+ * A file_map_t maps a file read-only in one call, with optional madvise()
+ * hints, so large inputs are parsed in place instead of copied into a
+ * malloc()'d buffer. A file_reader_t streams a file through one large buffer
+ * and hands out lines as slices of it, with no allocation per line. A
+ * file_writer_t gathers writes into a large buffer and issues them with
+ * pwritev(), passing big writes straight through, optionally with O_DIRECT
+ * to bypass the page cache.
+ */
+
+#ifndef _fileio_h_
+#define _fileio_h_
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "str_manip.h"
+
+/**
+ * @brief Default reader and writer buffer size.
+ */
+#define FIO_BUFSZ (1024 * 1024)
+
+/**
+ * @brief Alignment of O_DIRECT transfers (offsets, lengths and memory).
+ */
+#define FIO_DIRECT_ALIGN 4096
+
+/**
+ * @brief Returned by fio_next_line() once the file is exhausted.
+ */
+#define FIO_EOF (-2)
+
+/* fio_map() flags */
+#define FIO_SEQUENTIAL 0x01 /* madvise(MADV_SEQUENTIAL): aggressive readahead */
+#define FIO_WILLNEED 0x02   /* madvise(MADV_WILLNEED): start reading now */
+#define FIO_POPULATE 0x04   /* MAP_POPULATE: fault everything in up front */
+#define FIO_HUGEPAGES 0x08  /* 2 MiB-aligned mapping with MADV_HUGEPAGE */
+
+/* fio_writer_open() flags */
+#define FIO_DIRECT 0x10 /* O_DIRECT, if the file system supports it */
+
+typedef struct FileMap {
+    const char *data; /* NULL for an empty file */
+    size_t len;
+} file_map_t;
+
+typedef struct FileReader {
+    int fd;
+    char *buf;
+    size_t cap;     /* size of buf */
+    size_t start;   /* offset of first unconsumed byte */
+    size_t end;     /* offset one past the last byte read */
+    size_t scanned; /* bytes past start already searched for a newline */
+    bool eof;
+} file_reader_t;
+
+typedef struct FileWriter {
+    int fd;
+    char *buf;     /* FIO_DIRECT_ALIGN-aligned */
+    size_t cap;    /* size of buf */
+    size_t len;    /* bytes currently buffered */
+    off_t offset;  /* file offset of buf[0] */
+    bool direct;   /* fd is open with O_DIRECT */
+} file_writer_t;
+
+/**
+ * @brief Map the file at path read-only. flags is a combination of
+ * FIO_SEQUENTIAL, FIO_WILLNEED, FIO_POPULATE and FIO_HUGEPAGES; hints the
+ * kernel rejects are ignored.
+ *
+ * FIO_HUGEPAGES only pays off where the kernel can back file pages with huge
+ * pages (tmpfs with huge=, or CONFIG_READ_ONLY_THP_FOR_FS).
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int fio_map(file_map_t *m, const char *path, int flags);
+
+/**
+ * @brief Like fio_map(), for an open file. fd may be closed afterwards.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int fio_map_fd(file_map_t *m, int fd, int flags);
+
+/**
+ * @brief Unmap a file mapped by fio_map().
+ */
+void fio_unmap(file_map_t *m);
+
+/**
+ * @brief Return the mapped contents as a slice.
+ */
+static inline str_t fio_map_str(const file_map_t *m) {
+    return str_make(m->data, m->len);
+}
+
+/**
+ * @brief Open path for sequential reading through a buffer of cap bytes
+ * (FIO_BUFSZ if cap is 0).
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int fio_reader_open(file_reader_t *r, const char *path, size_t cap);
+
+/**
+ * @brief Close the reader's file and free its buffer.
+ */
+void fio_reader_close(file_reader_t *r);
+
+/**
+ * @brief Read the next line.
+ *
+ * On success, *line holds the line without its '\n' (a '\r' before it is
+ * kept) inside the reader's buffer, valid until the next call on this
+ * reader. The buffer grows to fit lines longer than it. A last line without
+ * a newline is returned as is.
+ * @returns Line length on success, @c FIO_EOF at the end of the file, @c -1
+ * on error.
+ */
+ssize_t fio_next_line(file_reader_t *r, str_t *line);
+
+/**
+ * @brief Read up to len bytes, continuing where fio_next_line() left off.
+ * Reads at least as large as the buffer bypass it.
+ * @returns Bytes read, @c 0 at the end of the file, @c -1 on error.
+ */
+ssize_t fio_read(file_reader_t *r, void *dst, size_t len);
+
+/**
+ * @brief Create or truncate path for writing through a buffer of cap bytes
+ * (FIO_BUFSZ if cap is 0). With FIO_DIRECT, cap is rounded up to a multiple
+ * of FIO_DIRECT_ALIGN and the file is opened with O_DIRECT, falling back to
+ * buffered I/O where the file system refuses it.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int fio_writer_open(file_writer_t *w, const char *path, int flags, size_t cap);
+
+/**
+ * @brief Append len bytes.
+ *
+ * Data is copied into the buffer, which is written once full. Without
+ * O_DIRECT, a write that would overflow the buffer is issued at once,
+ * together with the buffered data, in a single pwritev() and without being
+ * copied.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int fio_write(file_writer_t *w, const void *data, size_t len);
+
+/**
+ * @brief Append the contents of iovcnt buffers, buffered as in fio_write().
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int fio_writev(file_writer_t *w, const struct iovec *iov, int iovcnt);
+
+/**
+ * @brief Write out buffered data. With O_DIRECT, a trailing partial block
+ * stays buffered until more data or fio_writer_close().
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int fio_flush(file_writer_t *w);
+
+/**
+ * @brief Write out everything buffered, close the file and free the buffer.
+ * @returns @c 0 on success, @c -1 if anything failed (the file is closed
+ * regardless).
+ */
+int fio_writer_close(file_writer_t *w);
+
+#endif /* _fileio_h_ */
@@ -0,0 +1,159 @@
+/**
+ * @file framing.h
+ * @brief Buffered message framing on top of stream sockets.
+ *
+ * A frame_reader_t pulls bytes from a socket into one large buffer and parses
+ * whole messages out of it in place, so no memory is allocated per message.
+ * A frame_writer_t coalesces small messages into its buffer and hands them to
+ * the kernel in as few writev() calls as possible.
+ *
+ * Two framing styles are supported:
+ * - length-prefixed, with either a 4-byte big-endian length or an unsigned
+ *   LEB128 varint length in front of each message
+ * - delimiter-terminated, where each message ends with an arbitrary byte
+ *   sequence (e.g. "\r\n")
+ */
+
+#ifndef _framing_h_
+#define _framing_h_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+/**
+ * @brief Default buffer size used when the caller does not supply one.
+ */
+#define FRAME_BUFSZ (64 * 1024)
+
+/**
+ * @brief Returned by the fr_next_*() functions when the peer closed the
+ * connection cleanly on a message boundary.
+ */
+#define FRAME_EOF (-2)
+
+/**
+ * @brief Largest encoded size of a varint length prefix (64-bit value).
+ */
+#define FRAME_VARINT_MAXLEN 10 /* VARINT_MAXLEN in serial.h */
+
+typedef enum {
+    FRAME_LEN32,  /* 4-byte big-endian length prefix */
+    FRAME_VARINT  /* unsigned LEB128 varint length prefix */
+} frame_prefix_t;
+
+typedef struct FrameReader {
+    int fd;
+    char *buf;
+    size_t cap;     /* size of buf */
+    size_t start;   /* offset of first unconsumed byte */
+    size_t end;     /* offset one past the last received byte */
+    size_t scanned; /* bytes past start already searched for a delimiter */
+    bool owns_buf;
+} frame_reader_t;
+
+typedef struct FrameWriter {
+    int fd;
+    char *buf;
+    size_t cap; /* size of buf */
+    size_t len; /* bytes currently buffered */
+    char *pending;      /* unsent rest of a large frame, written before buf */
+    size_t pending_len; /* size of pending */
+    size_t pending_off; /* bytes of pending already written */
+    bool owns_buf;
+} frame_writer_t;
+
+/**
+ * @brief Prepare a reader for messages arriving on fd.
+ *
+ * If buf is NULL, a buffer of cap bytes (FRAME_BUFSZ if cap is 0) is allocated
+ * and released by fr_destroy(). The buffer size bounds the largest message
+ * that can be received, including its prefix or delimiter.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int fr_init(frame_reader_t *fr, int fd, void *buf, size_t cap);
+
+/**
+ * @brief Release the reader's buffer if it was allocated by fr_init().
+ *
+ * The socket itself is not closed.
+ */
+void fr_destroy(frame_reader_t *fr);
+
+/**
+ * @brief Receive the next length-prefixed message.
+ *
+ * On success, *msg points at the message payload inside the reader's buffer.
+ * The pointer stays valid until the next call on this reader.
+ * @returns Payload length on success, @c FRAME_EOF if the peer closed the
+ * connection between messages, @c -1 on error (errno is EMSGSIZE if the
+ * message cannot fit in the buffer, ECONNRESET if the peer closed mid-message).
+ */
+ssize_t fr_next_prefixed(frame_reader_t *fr, frame_prefix_t kind,
+                         const void **msg);
+
+/**
+ * @brief Receive the next message terminated by delim.
+ *
+ * On success, *msg points at the message inside the reader's buffer; the
+ * returned length does not include the delimiter. The pointer stays valid
+ * until the next call on this reader.
+ * @returns Message length on success, @c FRAME_EOF if the peer closed the
+ * connection between messages, @c -1 on error.
+ */
+ssize_t fr_next_delim(frame_reader_t *fr, const void *delim, size_t delim_len,
+                      const void **msg);
+
+/**
+ * @brief Prepare a coalescing writer for fd.
+ *
+ * If buf is NULL, a buffer of cap bytes (FRAME_BUFSZ if cap is 0) is allocated
+ * and released by fw_destroy().
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int fw_init(frame_writer_t *fw, int fd, void *buf, size_t cap);
+
+/**
+ * @brief Release the writer's buffer if it was allocated by fw_init().
+ *
+ * Any data still buffered is discarded; call fw_flush() first.
+ */
+void fw_destroy(frame_writer_t *fw);
+
+/**
+ * @brief Queue a length-prefixed message.
+ *
+ * Small messages are copied into the buffer and only written once it fills up
+ * or fw_flush() is called. Messages too large to buffer are written
+ * immediately, together with anything already buffered, in a single writev().
+ *
+ * On a non-blocking socket, a large message that was partly written when the
+ * socket filled up is still queued: the rest of it is kept (in an allocated
+ * copy if it doesn't fit the buffer) and goes out first on the next write or
+ * fw_flush(). Nothing blocks.
+ * @returns @c 0 once the message is queued, @c -1 on error. If none of the
+ * message was written, it is not queued and unsent buffered bytes are kept,
+ * so after EAGAIN retry once the socket is writable. Any other error after
+ * part of the message was written leaves the stream mid-frame.
+ */
+int fw_write_prefixed(frame_writer_t *fw, frame_prefix_t kind,
+                      const void *msg, size_t len);
+
+/**
+ * @brief Queue a message followed by delim. Buffering works as in
+ * fw_write_prefixed().
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int fw_write_delim(frame_writer_t *fw, const void *msg, size_t len,
+                   const void *delim, size_t delim_len);
+
+/**
+ * @brief Write out everything currently queued, including the rest of a
+ * partly written large message.
+ * @returns @c 0 on success, @c -1 on error, with the bytes not yet written
+ * still queued.
+ */
+int fw_flush(frame_writer_t *fw);
+
+#endif /* _framing_h_ */
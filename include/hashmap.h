@@ -0,0 +1,482 @@
+/**
+ * @file hashmap.h
+ * @brief Open-addressing hash maps in the style of Swiss tables.
+ *
+ * Each slot has a control byte: EMPTY, DELETED, or the low 7 bits of the
+ * key's hash (h2). Lookups hash once, then compare the h2 of 16 slots at a
+ * time with SSE2 (or a portable loop), so a probe touches one cache line of
+ * control bytes and only the keys whose h2 matches. The control array has 16
+ * extra bytes mirroring the first group, so any position can start a group.
+ * Deletion only leaves a tombstone when some probe sequence may have passed
+ * the slot while the map was full around it.
+ *
+ * Two flavours share the algorithm:
+ * - hashmap_t maps void * keys to void * values through caller-supplied hash
+ *   and equality functions, like deque_t stores void * data.
+ * - HM_DEFINE() generates a map specialized for concrete key and value types,
+ *   with entries stored inline and hash/equality calls inlined:
+ * @code
+ * HM_DEFINE(u64map, uint64_t, double, hm_hash_u64, HM_EQ_VALUE)
+ *
+ * u64map_t m;
+ * u64map_init(&m, NULL);
+ * u64map_put(&m, 42, 1.5);
+ * double *v = u64map_find(&m, 42);
+ * u64map_destroy(&m);
+ * @endcode
+ *
+ * Maps are not thread-safe. Any insert may move entries, invalidating
+ * pointers returned by find/insert/next.
+ */
+
+#ifndef _hashmap_h_
+#define _hashmap_h_
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "alloc.h"
+#include "utils.h"
+
+#ifdef __SSE2__
+#    include <emmintrin.h>
+#endif
+
+#define HM_GROUP 16          /* control bytes compared per probe step */
+#define HM_MIN_CAPACITY 16
+#define HM_EMPTY ((int8_t)-128)
+#define HM_DELETED ((int8_t)-2)
+
+/*********************************************************************
+ * Hash functions
+ *********************************************************************/
+
+typedef uint64_t (*hm_hash_fn)(const void *key);
+typedef bool (*hm_eq_fn)(const void *a, const void *b);
+
+/**
+ * @brief Mix the bits of an integer key (the MurmurHash3 finalizer).
+ *
+ * Hashes must be well mixed in both the high bits (which pick the start of
+ * the probe) and the low 7 bits (h2), so don't use an integer as its own hash.
+ */
+static inline uint64_t hm_hash_u64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/**
+ * @brief Hash a pointer by its address.
+ */
+static inline uint64_t hm_hash_ptr(const void *p) {
+    return hm_hash_u64((uintptr_t)p);
+}
+
+/**
+ * @brief Hash len bytes (a wyhash-like multiply-mix, 16 bytes per step).
+ */
+uint64_t hm_hash_bytes(const void *p, size_t len);
+
+/**
+ * @brief Hash and compare NUL-terminated strings, for hm_create().
+ */
+uint64_t hm_hash_str(const void *s);
+bool hm_eq_str(const void *a, const void *b);
+
+/**
+ * @brief Equality for HM_DEFINE() keys that compare with ==.
+ */
+#define HM_EQ_VALUE(A, B) ((A) == (B))
+
+/*********************************************************************
+ * Generic map of void * keys and values
+ *********************************************************************/
+
+typedef struct HashMapEntry {
+    void *key;
+    void *val;
+} hm_entry_t;
+
+/* fields shared by every map type; cap is 0 or a power of two >= HM_GROUP */
+#define HM_FIELDS(ENTRY_T)                                                  \
+    int8_t *ctrl;       /* cap + HM_GROUP control bytes */                  \
+    ENTRY_T *slots;                                                         \
+    size_t cap;                                                             \
+    size_t size;                                                            \
+    size_t growth_left; /* inserts into EMPTY slots before a rehash */      \
+    allocator_t *alloc
+
+typedef struct HashMap {
+    HM_FIELDS(hm_entry_t);
+    hm_hash_fn hash;
+    hm_eq_fn eq;
+} hashmap_t;
+
+/**
+ * @brief Return a new, empty map. With NULL hash and eq, keys are compared
+ * by address.
+ * @returns Pointer to the map, NULL if out of memory.
+ */
+hashmap_t *hm_create(hm_hash_fn hash, hm_eq_fn eq);
+
+/**
+ * @brief Like hm_create(), but the map and its tables come from alloc (NULL
+ * for malloc).
+ */
+hashmap_t *hm_create_with(hm_hash_fn hash, hm_eq_fn eq, allocator_t *alloc);
+
+/**
+ * @brief Free the map, first calling free_key and free_val (either may be
+ * NULL) on every entry.
+ */
+void hm_destroy(hashmap_t *hm, void (*free_key)(void *),
+                void (*free_val)(void *));
+
+/**
+ * @brief Return the number of entries in the map.
+ */
+size_t hm_len(const hashmap_t *hm);
+
+/**
+ * @brief Make room for n entries in total without rehashing.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int hm_reserve(hashmap_t *hm, size_t n);
+
+/**
+ * @brief Map key to val, replacing the value (not the key) if key is present.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int hm_put(hashmap_t *hm, void *key, void *val);
+
+/**
+ * @brief Return the value stored for key, or NULL if absent (use hm_find()
+ * to tell that apart from a stored NULL).
+ */
+void *hm_get(hashmap_t *hm, const void *key);
+
+/**
+ * @brief Return a pointer to the value stored for key, NULL if absent.
+ */
+void **hm_find(hashmap_t *hm, const void *key);
+
+/**
+ * @brief Return a pointer to the value for key, adding key with a NULL value
+ * first if absent. *inserted (if not NULL) tells which happened.
+ * @returns Pointer to the value, NULL on error.
+ */
+void **hm_insert(hashmap_t *hm, void *key, bool *inserted);
+
+/**
+ * @brief Remove key, handing back the stored key and value through old_key
+ * and old_val (either may be NULL) so the caller can free them.
+ * @returns @c 0 on success, @c -1 on error with errno set to ENOENT if key
+ * is absent.
+ */
+int hm_erase(hashmap_t *hm, const void *key, void **old_key, void **old_val);
+
+/**
+ * @brief Remove every entry, keeping the tables.
+ */
+void hm_clear(hashmap_t *hm);
+
+/**
+ * @brief Iterate over the entries: start with *iter = 0, and call until NULL
+ * is returned. Entries come in no particular order.
+ */
+hm_entry_t *hm_next(hashmap_t *hm, size_t *iter);
+
+/*********************************************************************
+ * Control byte groups (internal, shared by every map type)
+ *********************************************************************/
+
+/* bit i set if control byte i of the group equals h2 */
+static inline uint32_t hm__match(const int8_t *group, int8_t h2) {
+#ifdef __SSE2__
+    __m128i g = _mm_loadu_si128((const __m128i *)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(h2)));
+#else
+    uint32_t bits = 0;
+    int i;
+    for (i = 0; i < HM_GROUP; i++) {
+        bits |= (uint32_t)(group[i] == h2) << i;
+    }
+    return bits;
+#endif /* __SSE2__ */
+}
+
+static inline uint32_t hm__match_empty(const int8_t *group) {
+    return hm__match(group, HM_EMPTY);
+}
+
+/* EMPTY and DELETED are the only negative control bytes */
+static inline uint32_t hm__match_free(const int8_t *group) {
+#ifdef __SSE2__
+    return (uint32_t)_mm_movemask_epi8(
+        _mm_loadu_si128((const __m128i *)group));
+#else
+    uint32_t bits = 0;
+    int i;
+    for (i = 0; i < HM_GROUP; i++) {
+        bits |= (uint32_t)(group[i] < 0) << i;
+    }
+    return bits;
+#endif /* __SSE2__ */
+}
+
+static inline size_t hm__h1(uint64_t hash) {
+    return (size_t)(hash >> 7);
+}
+
+static inline int8_t hm__h2(uint64_t hash) {
+    return (int8_t)(hash & 0x7f);
+}
+
+/* set control byte i, and its mirror past the end if in the first group */
+static inline void hm__set_ctrl(int8_t *ctrl, size_t cap, size_t i, int8_t v) {
+    ctrl[i] = v;
+    if (i < HM_GROUP) {
+        ctrl[cap + i] = v;
+    }
+}
+
+/* Mark slot i free. It can go back to EMPTY (and be reused without a
+ * rehash) unless a window of HM_GROUP slots around it has no EMPTY slot: a
+ * probe may then have passed over it, and must still do so. */
+static inline bool hm__erase_ctrl(int8_t *ctrl, size_t cap, size_t i) {
+    size_t before = (i - HM_GROUP) & (cap - 1);
+    uint32_t empty_after = hm__match_empty(ctrl + i);
+    uint32_t empty_before = hm__match_empty(ctrl + before);
+    bool was_never_full =
+        empty_before && empty_after &&
+        (size_t)(__builtin_ctz(empty_after) +
+                 __builtin_clz(empty_before) - (32 - HM_GROUP)) < HM_GROUP;
+
+    hm__set_ctrl(ctrl, cap, i, was_never_full ? HM_EMPTY : HM_DELETED);
+    return was_never_full;
+}
+
+/* entries a table of cap slots may hold: a load factor of 7/8 */
+static inline size_t hm__max_load(size_t cap) {
+    return cap - cap / 8;
+}
+
+/* smallest capacity holding n entries */
+static inline size_t hm__capacity_for(size_t n) {
+    size_t cap = HM_MIN_CAPACITY;
+    while (hm__max_load(cap) < n) {
+        cap *= 2;
+    }
+    return cap;
+}
+
+/*********************************************************************
+ * Typed maps
+ *********************************************************************/
+
+/**
+ * @brief Define map type NAME_t from KEY_T to VAL_T, and its functions
+ * (see HM_IMPL()). HASH(key) must return a well-mixed uint64_t and EQ(a, b)
+ * compare two keys; both may be function-like macros.
+ */
+#define HM_DEFINE(NAME, KEY_T, VAL_T, HASH, EQ)                              \
+    typedef struct {                                                         \
+        KEY_T key;                                                           \
+        VAL_T val;                                                           \
+    } NAME##_entry_t;                                                        \
+    typedef struct {                                                         \
+        HM_FIELDS(NAME##_entry_t);                                           \
+    } NAME##_t;                                                              \
+    static inline uint64_t NAME##__hash(const NAME##_t *m, KEY_T k) {        \
+        (void)m;                                                             \
+        return HASH(k);                                                      \
+    }                                                                        \
+    static inline bool NAME##__eq(const NAME##_t *m, KEY_T a, KEY_T b) {     \
+        (void)m;                                                             \
+        return EQ(a, b);                                                     \
+    }                                                                        \
+    static inline void NAME##_init(NAME##_t *m, allocator_t *alloc) {        \
+        memset(m, 0, sizeof(*m));                                            \
+        m->alloc = alloc;                                                    \
+    }                                                                        \
+    HM_IMPL(NAME, NAME##_t, NAME##_entry_t, KEY_T, VAL_T, static inline)
+
+/**
+ * @brief Generate the functions of a map type: PREFIX_destroy, _len,
+ * _reserve, _find, _insert, _put, _erase, _clear and _next, with the same
+ * contracts as the hashmap_t functions. MAP_T must hold HM_FIELDS(ENTRY_T),
+ * and PREFIX__hash(map, key) and PREFIX__eq(map, a, b) must be defined.
+ */
+#define HM_IMPL(PREFIX, MAP_T, ENTRY_T, KEY_T, VAL_T, STORAGE)               \
+    STORAGE void PREFIX##_destroy(MAP_T *m) {                                \
+        al_free(m->alloc, m->ctrl, m->cap + HM_GROUP);                       \
+        al_free(m->alloc, m->slots, m->cap * sizeof(ENTRY_T));               \
+        m->ctrl = NULL;                                                      \
+        m->slots = NULL;                                                     \
+        m->cap = m->size = m->growth_left = 0;                               \
+    }                                                                        \
+                                                                             \
+    STORAGE size_t PREFIX##_len(const MAP_T *m) {                            \
+        return m->size;                                                      \
+    }                                                                        \
+                                                                             \
+    /* first EMPTY or DELETED slot on the probe sequence of hash */          \
+    STORAGE size_t PREFIX##__find_free(const MAP_T *m, uint64_t hash) {      \
+        size_t mask = m->cap - 1, pos = hm__h1(hash) & mask, step = 0;       \
+        uint32_t bits;                                                       \
+        while (!(bits = hm__match_free(m->ctrl + pos))) {                    \
+            step += HM_GROUP;                                                \
+            pos = (pos + step) & mask;                                       \
+        }                                                                    \
+        return (pos + __builtin_ctz(bits)) & mask;                           \
+    }                                                                        \
+                                                                             \
+    /* move every entry into fresh tables of new_cap slots */                \
+    STORAGE int PREFIX##__rehash(MAP_T *m, size_t new_cap) {                 \
+        int8_t *ctrl = al_alloc(m->alloc, new_cap + HM_GROUP);               \
+        ENTRY_T *slots = al_alloc(m->alloc, new_cap * sizeof(ENTRY_T));      \
+        MAP_T old = *m;                                                      \
+        size_t i, j;                                                         \
+        if (!ctrl || !slots) {                                               \
+            al_free(m->alloc, ctrl, new_cap + HM_GROUP);                     \
+            al_free(m->alloc, slots, new_cap * sizeof(ENTRY_T));             \
+            errno = ENOMEM;                                                  \
+            return -1;                                                       \
+        }                                                                    \
+        memset(ctrl, HM_EMPTY, new_cap + HM_GROUP);                          \
+        m->ctrl = ctrl;                                                      \
+        m->slots = slots;                                                    \
+        m->cap = new_cap;                                                    \
+        m->growth_left = hm__max_load(new_cap) - m->size;                    \
+        for (i = 0; i < old.cap; i++) {                                      \
+            if (old.ctrl[i] >= 0) {                                          \
+                uint64_t h = PREFIX##__hash(m, old.slots[i].key);            \
+                j = PREFIX##__find_free(m, h);                               \
+                hm__set_ctrl(ctrl, new_cap, j, hm__h2(h));                   \
+                slots[j] = old.slots[i];                                     \
+            }                                                                \
+        }                                                                    \
+        al_free(m->alloc, old.ctrl, old.cap + HM_GROUP);                     \
+        al_free(m->alloc, old.slots, old.cap * sizeof(ENTRY_T));             \
+        return 0;                                                            \
+    }                                                                        \
+                                                                             \
+    STORAGE int PREFIX##_reserve(MAP_T *m, size_t n) {                       \
+        if (n <= m->size + m->growth_left) {                                 \
+            return 0;                                                        \
+        }                                                                    \
+        return PREFIX##__rehash(m, hm__capacity_for(n));                     \
+    }                                                                        \
+                                                                             \
+    STORAGE ENTRY_T *PREFIX##__lookup(const MAP_T *m, KEY_T key,             \
+                                      uint64_t hash) {                       \
+        size_t mask = m->cap - 1, pos = hm__h1(hash) & mask, step = 0;       \
+        uint32_t bits;                                                       \
+        if (!m->cap) {                                                       \
+            return NULL;                                                     \
+        }                                                                    \
+        for (;;) {                                                           \
+            bits = hm__match(m->ctrl + pos, hm__h2(hash));                   \
+            while (bits) {                                                   \
+                size_t i = (pos + __builtin_ctz(bits)) & mask;               \
+                if (LIKELY(PREFIX##__eq(m, m->slots[i].key, key))) {         \
+                    return &m->slots[i];                                     \
+                }                                                            \
+                bits &= bits - 1;                                            \
+            }                                                                \
+            if (LIKELY(hm__match_empty(m->ctrl + pos))) {                    \
+                return NULL;                                                 \
+            }                                                                \
+            step += HM_GROUP;                                                \
+            pos = (pos + step) & mask;                                       \
+        }                                                                    \
+    }                                                                        \
+                                                                             \
+    STORAGE VAL_T *PREFIX##_find(const MAP_T *m, KEY_T key) {                \
+        ENTRY_T *e = PREFIX##__lookup(m, key, PREFIX##__hash(m, key));       \
+        return e ? &e->val : NULL;                                           \
+    }                                                                        \
+                                                                             \
+    STORAGE VAL_T *PREFIX##_insert(MAP_T *m, KEY_T key, bool *inserted) {    \
+        uint64_t hash = PREFIX##__hash(m, key);                              \
+        ENTRY_T *e = PREFIX##__lookup(m, key, hash);                         \
+        size_t i;                                                            \
+        if (inserted) {                                                      \
+            *inserted = !e;                                                  \
+        }                                                                    \
+        if (e) {                                                             \
+            return &e->val;                                                  \
+        }                                                                    \
+        i = m->cap ? PREFIX##__find_free(m, hash) : 0;                       \
+        if (!m->cap || (m->ctrl[i] == HM_EMPTY && !m->growth_left)) {        \
+            /* out of EMPTY slots: grow if at least half of the load is     \
+             * entries, else rehash in place to clear the tombstones */     \
+            size_t cap = m->cap ? m->cap : HM_MIN_CAPACITY;                  \
+            if (m->cap && m->size + 1 > hm__max_load(cap) / 2) {             \
+                cap *= 2;                                                    \
+            }                                                                \
+            if (PREFIX##__rehash(m, cap) == -1) {                            \
+                return NULL;                                                 \
+            }                                                                \
+            i = PREFIX##__find_free(m, hash);                                \
+        }                                                                    \
+        m->growth_left -= m->ctrl[i] == HM_EMPTY;                            \
+        hm__set_ctrl(m->ctrl, m->cap, i, hm__h2(hash));                      \
+        m->size++;                                                           \
+        e = &m->slots[i];                                                    \
+        e->key = key;                                                        \
+        memset(&e->val, 0, sizeof(e->val));                                  \
+        return &e->val;                                                      \
+    }                                                                        \
+                                                                             \
+    STORAGE int PREFIX##_put(MAP_T *m, KEY_T key, VAL_T val) {               \
+        VAL_T *v = PREFIX##_insert(m, key, NULL);                            \
+        if (!v) {                                                            \
+            return -1;                                                       \
+        }                                                                    \
+        *v = val;                                                            \
+        return 0;                                                            \
+    }                                                                        \
+                                                                             \
+    STORAGE int PREFIX##_erase(MAP_T *m, KEY_T key, KEY_T *old_key,          \
+                               VAL_T *old_val) {                             \
+        ENTRY_T *e = PREFIX##__lookup(m, key, PREFIX##__hash(m, key));       \
+        if (!e) {                                                            \
+            errno = ENOENT;                                                  \
+            return -1;                                                       \
+        }                                                                    \
+        if (old_key) {                                                       \
+            *old_key = e->key;                                               \
+        }                                                                    \
+        if (old_val) {                                                       \
+            *old_val = e->val;                                               \
+        }                                                                    \
+        m->growth_left += hm__erase_ctrl(m->ctrl, m->cap, e - m->slots);     \
+        m->size--;                                                           \
+        return 0;                                                            \
+    }                                                                        \
+                                                                             \
+    STORAGE void PREFIX##_clear(MAP_T *m) {                                  \
+        if (m->cap) {                                                        \
+            memset(m->ctrl, HM_EMPTY, m->cap + HM_GROUP);                    \
+            m->size = 0;                                                     \
+            m->growth_left = hm__max_load(m->cap);                           \
+        }                                                                    \
+    }                                                                        \
+                                                                             \
+    STORAGE ENTRY_T *PREFIX##_next(MAP_T *m, size_t *iter) {                 \
+        for (; *iter < m->cap; (*iter)++) {                                  \
+            if (m->ctrl[*iter] >= 0) {                                       \
+                return &m->slots[(*iter)++];                                 \
+            }                                                                \
+        }                                                                    \
+        return NULL;                                                         \
+    }
+
+#endif /* _hashmap_h_ */
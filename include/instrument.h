@@ -0,0 +1,207 @@
+/**
+ * @file instrument.h
+ * @brief High-resolution timers, latency histograms and counters for hot
+ * paths.
+ *
+ * The INST_* macros compile to nothing unless INSTRUMENT is defined, so
+ * instrumentation can stay in production code. When compiled in, each macro
+ * costs one load and branch while instrumentation is disabled at runtime
+ * (see inst_enable()), and a TSC read plus a few thread-local stores while it
+ * is enabled.
+ *
+ * Samples go into per-thread log-linear (HDR-style) histograms, so recording
+ * never takes a lock or contends on a shared cache line. inst_report() and
+ * inst_region_stats() merge every thread's data, including threads that have
+ * exited: when a thread exits its data is added to a shared total and its
+ * histograms are handed to the next thread that records.
+ *
+ * Example:
+ * @code
+ * void handle(request_t *req) {
+ *     INST_SCOPE("handle");          // times until the end of the block
+ *     INST_COUNT("handle.bytes", req->len);
+ *     ...
+ * }
+ * ...
+ * inst_report(stderr);
+ * @endcode
+ */
+
+#ifndef _instrument_h_
+#define _instrument_h_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "utils.h"
+
+#define INST_MAX_REGIONS 64  /* distinct region names */
+#define INST_MAX_COUNTERS 64 /* distinct counter names */
+#define INST_SUB_BITS 5      /* 2^5 sub-buckets per power of two: ~3% error */
+#define INST_SUB_BUCKETS (1 << INST_SUB_BITS)
+#define INST_BUCKETS ((64 - INST_SUB_BITS + 1) * INST_SUB_BUCKETS)
+
+/**
+ * @brief A named timing region or counter. Call sites with the same name
+ * share one id, assigned on first use.
+ */
+typedef struct InstSite {
+    const char *name;
+    int id; /* id + 1, or 0 if not registered yet */
+} inst_site_t;
+
+/**
+ * @brief An open timing region, closed by inst_scope_end().
+ */
+typedef struct InstScope {
+    inst_site_t *site; /* NULL if instrumentation was off at the start */
+    uint64_t start;
+} inst_scope_t;
+
+/**
+ * @brief Summary of a region's samples across all threads, in nanoseconds.
+ */
+typedef struct InstStats {
+    uint64_t count;
+    double min, max, mean;
+    double p50, p90, p99, p999;
+} inst_stats_t;
+
+extern int inst_on;
+
+/**
+ * @brief Nanoseconds from CLOCK_MONOTONIC.
+ */
+uint64_t inst_now_ns(void);
+
+/**
+ * @brief Read the CPU timestamp counter (or the monotonic clock on CPUs
+ * without one). Convert differences with inst_ticks_to_ns().
+ */
+static inline uint64_t inst_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t v;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    return inst_now_ns();
+#endif
+}
+
+/**
+ * @brief Convert a difference of inst_ticks() values to nanoseconds.
+ *
+ * The tick rate is calibrated against CLOCK_MONOTONIC on first use, which
+ * takes about 10 ms.
+ */
+double inst_ticks_to_ns(uint64_t ticks);
+
+/**
+ * @brief Turn recording on or off at runtime. It starts on.
+ */
+void inst_enable(bool on);
+
+static inline bool inst_enabled(void) {
+    return LIKELY(__atomic_load_n(&inst_on, __ATOMIC_RELAXED));
+}
+
+/**
+ * @brief Record one sample of ticks for site in the calling thread's
+ * histogram.
+ */
+void inst_record(inst_site_t *site, uint64_t ticks);
+
+/**
+ * @brief Add n to site's counter for the calling thread.
+ */
+void inst_count(inst_site_t *site, uint64_t n);
+
+static inline inst_scope_t inst_scope_begin(inst_site_t *site) {
+    inst_scope_t scope = {NULL, 0};
+
+    if (inst_enabled()) {
+        scope.site = site;
+        scope.start = inst_ticks();
+    }
+    return scope;
+}
+
+static inline void inst_scope_end(inst_scope_t *scope) {
+    if (scope->site) {
+        inst_record(scope->site, inst_ticks() - scope->start);
+    }
+}
+
+/**
+ * @brief Merge every thread's samples for the region called name.
+ * @returns @c 0 on success, @c -1 if no such region was recorded.
+ */
+int inst_region_stats(const char *name, inst_stats_t *stats);
+
+/**
+ * @brief Sum every thread's counts for the counter called name.
+ */
+uint64_t inst_counter_value(const char *name);
+
+/**
+ * @brief Print a table of every region's latency percentiles and every
+ * counter's total to out.
+ */
+void inst_report(FILE *out);
+
+/**
+ * @brief Print every region and counter to out as CSV rows:
+ * kind,name,count,min_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,mean_ns
+ */
+void inst_dump_csv(FILE *out);
+
+/**
+ * @brief Clear all samples and counters. Samples recorded concurrently may be
+ * lost.
+ */
+void inst_reset(void);
+
+#ifdef INSTRUMENT
+#    define _INST_SITE(NAME)                                          \
+        static inst_site_t XCONC(_inst_site_, __LINE__) = {(NAME), 0}
+/**
+ * @brief Time from here to the end of the enclosing block (GCC/Clang).
+ */
+#    define INST_SCOPE(NAME)                                                \
+        _INST_SITE(NAME);                                                   \
+        inst_scope_t XCONC(_inst_scope_, __LINE__)                          \
+            __attribute__((cleanup(inst_scope_end))) =                      \
+                inst_scope_begin(&XCONC(_inst_site_, __LINE__))
+/**
+ * @brief Time the statement(s) after NAME as the region NAME.
+ */
+#    define INST_TIME(NAME, ...)                                         \
+        do {                                                             \
+            _INST_SITE(NAME);                                            \
+            inst_scope_t _inst_scope =                                   \
+                inst_scope_begin(&XCONC(_inst_site_, __LINE__));         \
+            __VA_ARGS__;                                                 \
+            inst_scope_end(&_inst_scope);                                \
+        } while (0)
+/**
+ * @brief Add N to the counter NAME.
+ */
+#    define INST_COUNT(NAME, N)                                 \
+        do {                                                    \
+            _INST_SITE(NAME);                                   \
+            if (inst_enabled()) {                               \
+                inst_count(&XCONC(_inst_site_, __LINE__), (N)); \
+            }                                                   \
+        } while (0)
+#else
+#    define INST_SCOPE(NAME) ((void)0)
+#    define INST_TIME(NAME, ...) \
+        do {                     \
+            __VA_ARGS__;         \
+        } while (0)
+#    define INST_COUNT(NAME, N) ((void)0)
+#endif /* INSTRUMENT */
+
+#endif /* _instrument_h_ */
@@ -48,6 +48,18 @@ RUN_TESTS(all_tests);
  * Test functions return NULL to indicate success. You normally don't
  * need to explicity return an error message on failure because mu_assert()
  * handles that for you.
+ *
+ * Command line of a test binary:
+ * [-j jobs] [-t timeout_s] [-f text|tap|junit] [filter]
+ *
+ * Only tests whose name (e.g. "test_submit(10000)") contains filter are run.
+ * With -j, each test runs in a forked child, up to jobs at a time: a crash
+ * or hang fails that test alone, and all tests run even after a failure.
+ * A suite whose tests share state or threads (e.g. a pool created in
+ * all_tests()) should define MU_NO_FORK before including minunit.h; it then
+ * ignores -j. -t fails any test that runs longer than timeout_s seconds.
+ * Every test is timed; -f tap and -f junit print the results to stdout in
+ * those formats.
  ****************************************************/
 
 #ifndef _minunit_h
@@ -62,9 +74,15 @@ RUN_TESTS(all_tests);
 #    define DEBUG
 #endif /* DEBUG */
 
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 #include "dbg.h"
 
 /**
@@ -104,13 +122,13 @@ RUN_TESTS(all_tests);
  * @param ... [optional] Arguments to pass to the test function. This
  * allows for parameterized testing.
  */
-#define mu_run_test(TEST, ...)                                      \
-    do {                                                            \
-        fprintf(stderr, "[minunit] %s(%s)\n", #TEST, #__VA_ARGS__); \
-        message = TEST(__VA_ARGS__);                                \
-        __mu_tests_run++;                                           \
-        if (message)                                                \
-            return message;                                         \
+#define mu_run_test(TEST, ...)                                    \
+    do {                                                          \
+        if (__mu_begin(#TEST "(" #__VA_ARGS__ ")")) {             \
+            message = __mu_end(TEST(__VA_ARGS__));                \
+            if (message)                                          \
+                return message;                                   \
+        }                                                         \
     } while (0)
 
 /**
@@ -124,22 +142,290 @@ RUN_TESTS(all_tests);
  */
 #define RUN_TESTS(ALL_TESTS)                                            \
     int main(int argc, const char *argv[]) {                            \
-        (void)argc;                                                     \
+        if (__mu_parse_args(argc, argv) == -1) {                        \
+            fprintf(stderr, "usage: %s [-j jobs] [-t timeout_s] "       \
+                    "[-f text|tap|junit] [filter]\n", argv[0]);         \
+            return 2;                                                   \
+        }                                                               \
         fprintf(stderr, "[minunit] RUNNING: %s >>>>>>>>>>\n", argv[0]); \
-        printf("[minunit] RUNNING: %s\n", argv[0]);                     \
-        const char *result = ALL_TESTS();                               \
-        if (result != 0) {                                              \
-            printf("[minunit] FAILED: %s\n", result);                   \
+        if (__mu_format == MU_TEXT) {                                   \
+            printf("[minunit] RUNNING: %s\n", argv[0]);                 \
+        }                                                               \
+        const char *result = __mu_finish(ALL_TESTS());                  \
+        if (__mu_format == MU_TEXT) {                                   \
+            if (result != 0) {                                          \
+                printf("[minunit] FAILED: %s\n", result);               \
+            } else {                                                    \
+                printf("[minunit] All tests PASSED\n");                 \
+            }                                                           \
+            printf("[minunit] Tests run: %d\n", __mu_tests_run);        \
         } else {                                                        \
-            printf("[minunit] All tests PASSED\n");                     \
+            __mu_report(argv[0]);                                       \
         }                                                               \
-        printf("[minunit] Tests run: %d\n", __mu_tests_run);            \
         exit(result != 0);                                              \
     }
 
 /* These are for internal use of the test suite */
 #define MAX_MSG_LEN 512
+#define MU_MAX_JOBS 64
 char __mu_msg_buf[MAX_MSG_LEN + 1];
 int __mu_tests_run = 0;
 
+enum { MU_TEXT, MU_TAP, MU_JUNIT };
+int __mu_format = MU_TEXT;
+int __mu_jobs = 0;       /* 0: run tests in this process */
+unsigned __mu_timeout = 0;
+const char *__mu_filter = NULL;
+
+typedef struct {
+    const char *name;
+    double secs;
+    char *failure;       /* NULL if the test passed */
+} mu_result_t;
+
+mu_result_t *__mu_results = NULL;
+int __mu_nresults = 0, __mu_nfailed = 0;
+uint64_t __mu_started = 0;
+const char *__mu_current = NULL;
+
+/* forked tests still running */
+struct {
+    pid_t pid;
+    int fd;              /* read end of the pipe carrying the failure */
+    const char *name;
+    uint64_t started;
+} __mu_running[MU_MAX_JOBS];
+int __mu_nrunning = 0;
+bool __mu_in_child = false;
+
+/* test timing clock, kept here so tests link nothing extra */
+static inline uint64_t __mu_now_ns(void) {
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    return (uint64_t)((double)clock() * 1e9 / CLOCKS_PER_SEC);
+#endif
+}
+
+int __mu_parse_args(int argc, const char *argv[]) {
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            __mu_jobs = atoi(argv[++i]);
+            if (__mu_jobs < 1 || __mu_jobs > MU_MAX_JOBS) {
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            __mu_timeout = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "tap")) {
+                __mu_format = MU_TAP;
+            } else if (!strcmp(argv[i], "junit")) {
+                __mu_format = MU_JUNIT;
+            } else if (!strcmp(argv[i], "text")) {
+                __mu_format = MU_TEXT;
+            } else {
+                return -1;
+            }
+        } else if (argv[i][0] == '-') {
+            return -1;
+        } else {
+            __mu_filter = argv[i];
+        }
+    }
+#ifdef MU_NO_FORK
+    __mu_jobs = 0;
+#endif /* MU_NO_FORK */
+    return 0;
+}
+
+/* Record a finished test and print it as TAP if asked to. */
+void __mu_record(const char *name, uint64_t started, const char *failure) {
+    mu_result_t *r;
+
+    __mu_results = realloc(__mu_results,
+                           (__mu_nresults + 1) * sizeof(*__mu_results));
+    if (!__mu_results) {
+        perror("[minunit] realloc");
+        exit(1);
+    }
+    r = &__mu_results[__mu_nresults++];
+    r->name = name;
+    r->secs = (__mu_now_ns() - started) / 1e9;
+    r->failure = NULL;
+    if (failure && (r->failure = malloc(strlen(failure) + 1))) {
+        strcpy(r->failure, failure);
+    }
+    __mu_tests_run++;
+    __mu_nfailed += failure != NULL;
+    fprintf(stderr, "[minunit] %s %s in %.3f s\n", name,
+            failure ? "FAILED" : "passed", r->secs);
+    if (__mu_format == MU_TAP) {
+        printf("%s %d - %s # time=%.3fs\n", failure ? "not ok" : "ok",
+               __mu_nresults, name, r->secs);
+        if (failure) {
+            printf("# %s\n", failure);
+        }
+        fflush(stdout);
+    }
+}
+
+/* Reap a finished child, blocking for one if wait is set. Returns false if
+ * none was reaped. */
+bool __mu_reap(bool wait) {
+    char buf[MAX_MSG_LEN + 1];
+    ssize_t len;
+    pid_t pid;
+    int status, i;
+
+    pid = waitpid(-1, &status, wait ? 0 : WNOHANG);
+    if (pid <= 0) {
+        return false;
+    }
+    for (i = 0; i < __mu_nrunning && __mu_running[i].pid != pid; i++) {
+    }
+    if (i == __mu_nrunning) {
+        return true; /* not ours, e.g. a test's own child */
+    }
+    len = read(__mu_running[i].fd, buf, MAX_MSG_LEN);
+    buf[len > 0 ? len : 0] = '\0';
+    close(__mu_running[i].fd);
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM) {
+        snprintf(buf, sizeof(buf), "timed out after %u s", __mu_timeout);
+    } else if (WIFSIGNALED(status)) {
+        snprintf(buf, sizeof(buf), "killed by signal %d", WTERMSIG(status));
+    } else if (WEXITSTATUS(status) != 0 && len <= 0) {
+        snprintf(buf, sizeof(buf), "exited with status %d",
+                 WEXITSTATUS(status));
+    }
+    __mu_record(__mu_running[i].name, __mu_running[i].started,
+                buf[0] ? buf : NULL);
+    __mu_running[i] = __mu_running[--__mu_nrunning];
+    return true;
+}
+
+/* SIGALRM handler for tests run in this process */
+void __mu_alarm(int sig) {
+    static const char msg[] = "[minunit] FAILED: timed out\n";
+    ssize_t rc = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+
+    (void)sig;
+    (void)rc;
+    _exit(1);
+}
+
+/* Decide whether the caller should run test name now. In fork mode the
+ * child runs it and the parent moves on to the next test. */
+bool __mu_begin(const char *name) {
+    int fds[2];
+    pid_t pid;
+
+    if (__mu_filter && !strstr(name, __mu_filter)) {
+        return false;
+    }
+    fprintf(stderr, "[minunit] %s\n", name);
+    __mu_current = name;
+    if (!__mu_jobs) {
+        signal(SIGALRM, __mu_alarm);
+        alarm(__mu_timeout);
+        __mu_started = __mu_now_ns();
+        return true;
+    }
+    while (__mu_nrunning == __mu_jobs) {
+        __mu_reap(true);
+    }
+    fflush(NULL); /* or the child would print buffered output again */
+    if (pipe(fds) == -1 || (pid = fork()) == -1) {
+        perror("[minunit] fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        __mu_running[0].fd = fds[1];
+        __mu_in_child = true;
+        alarm(__mu_timeout);
+        return true;
+    }
+    close(fds[1]);
+    __mu_running[__mu_nrunning].pid = pid;
+    __mu_running[__mu_nrunning].fd = fds[0];
+    __mu_running[__mu_nrunning].name = name;
+    __mu_running[__mu_nrunning].started = __mu_now_ns();
+    __mu_nrunning++;
+    return false;
+}
+
+/* Called with the result of the test __mu_begin() let through. */
+const char *__mu_end(const char *failure) {
+    alarm(0);
+    if (__mu_in_child) {
+        if (failure) {
+            ssize_t rc = write(__mu_running[0].fd, failure, strlen(failure));
+            (void)rc;
+        }
+        exit(failure != NULL);
+    }
+    __mu_record(__mu_current, __mu_started, failure);
+    return failure;
+}
+
+/* Wait for forked tests; the suite fails if any of them did. */
+const char *__mu_finish(const char *result) {
+    while (__mu_nrunning) {
+        __mu_reap(true);
+    }
+    if (!result && __mu_nfailed) {
+        snprintf(__mu_msg_buf, MAX_MSG_LEN, "%d of %d tests failed",
+                 __mu_nfailed, __mu_nresults);
+        result = __mu_msg_buf;
+    }
+    return result;
+}
+
+void __mu_print_xml(const char *s) {
+    for (; *s; s++) {
+        switch (*s) {
+        case '&': fputs("&amp;", stdout); break;
+        case '<': fputs("&lt;", stdout); break;
+        case '>': fputs("&gt;", stdout); break;
+        case '"': fputs("&quot;", stdout); break;
+        default: putchar(*s);
+        }
+    }
+}
+
+/* TAP plan or JUnit testsuite for everything recorded. */
+void __mu_report(const char *suite) {
+    const char *base = strrchr(suite, '/') ? strrchr(suite, '/') + 1 : suite;
+    double total = 0;
+    int i;
+
+    if (__mu_format == MU_TAP) {
+        printf("1..%d\n", __mu_nresults);
+        return;
+    }
+    for (i = 0; i < __mu_nresults; i++) {
+        total += __mu_results[i].secs;
+    }
+    printf("<testsuite name=\"%s\" tests=\"%d\" failures=\"%d\" "
+           "time=\"%.3f\">\n", base, __mu_nresults, __mu_nfailed, total);
+    for (i = 0; i < __mu_nresults; i++) {
+        printf("  <testcase classname=\"%s\" name=\"", base);
+        __mu_print_xml(__mu_results[i].name);
+        printf("\" time=\"%.3f\"", __mu_results[i].secs);
+        if (__mu_results[i].failure) {
+            printf(">\n    <failure message=\"");
+            __mu_print_xml(__mu_results[i].failure);
+            printf("\"/>\n  </testcase>\n");
+        } else {
+            printf("/>\n");
+        }
+    }
+    printf("</testsuite>\n");
+}
+
 #endif /* _minunit_h */
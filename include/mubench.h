@@ -0,0 +1,322 @@
+/*************************************************************
+ * @brief MINIMAL MICRO-BENCHMARK MACROS
+ * @file mubench.h
+ *
+ * Companion to minunit.h: benchmarks are written and registered like tests,
+ * and mu_assert() works inside them.
+ *
+ * General layout of a benchmark file:
+@code
+
+#include "mubench.h"
+
+const char *bench_something(mu_bench_t *b, size_t len) {
+    // untimed setup goes here
+    mu_bench_bytes(b, len);      // optional: report bytes/sec
+    mu_bench_resume(b);
+    for (size_t i = 0; i < b->iters; i++) {
+        mu_do_not_optimize(work(len));
+    }
+    mu_bench_pause(b);
+    // untimed cleanup goes here
+    return NULL; // indicates success
+}
+
+const char *all_benches() {
+    mu_suite_start();
+
+    mu_run_bench(bench_something, 64);
+    mu_run_bench(bench_something, 4096);
+
+    return NULL;
+}
+
+RUN_BENCHES(all_benches);
+
+@endcode
+ *
+ * The timer is paused when the function is called, so it must call
+ * mu_bench_resume() before the timed loop. Each benchmark is first
+ * calibrated: b->iters grows until one run takes at least the sample time.
+ * That run doubles as warmup; then MB_DEFAULT_REPS samples of b->iters
+ * iterations each are taken.
+ *
+ * Command line: [-f text|csv|json] [-r repetitions] [-t sample_ms] [-o file]
+ * [filter]
+ * Only benchmarks whose name contains filter are run. Results go to stdout,
+ * or to file with -o, which keeps them apart from anything the code under
+ * test prints. JSON output includes every sample so results can be compared
+ * statistically later.
+ ****************************************************/
+
+#ifndef _mubench_h
+#define _mubench_h
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "instrument.h"
+#include "minunit.h"
+
+#define MB_DEFAULT_REPS 10
+#define MB_MAX_REPS 100
+#define MB_DEFAULT_SAMPLE_MS 10
+#define MB_MAX_ITERS ((size_t)1 << 40)
+
+typedef struct MuBench {
+    size_t iters;        /* iterations the benchmark must run this call */
+    size_t bytes;        /* bytes processed per iteration, 0 if unset */
+    uint64_t started;    /* inst_now_ns() at last resume, 0 if paused */
+    uint64_t elapsed;    /* ns timed during this call */
+    /* internal */
+    const char *name;
+    int phase;           /* 0: calibrating, 1: sampling, 2: done */
+    int nsamples;
+    double samples[MB_MAX_REPS]; /* ns per iteration */
+} mu_bench_t;
+
+/**
+ * @brief Keep the compiler from optimizing away VALUE or the work that
+ * produced it.
+ */
+#define mu_do_not_optimize(VALUE) __asm__ __volatile__("" : : "g"(VALUE) : "memory")
+
+/**
+ * @brief Force pending writes to memory to be treated as observable.
+ */
+#define mu_clobber() __asm__ __volatile__("" : : : "memory")
+
+static inline void mu_bench_resume(mu_bench_t *b) {
+    b->started = inst_now_ns();
+}
+
+static inline void mu_bench_pause(mu_bench_t *b) {
+    if (b->started) {
+        b->elapsed += inst_now_ns() - b->started;
+        b->started = 0;
+    }
+}
+
+/**
+ * @brief Report throughput assuming each iteration processes bytes bytes.
+ */
+static inline void mu_bench_bytes(mu_bench_t *b, size_t bytes) {
+    b->bytes = bytes;
+}
+
+/**
+ * @brief Run a benchmark function, along with any args to pass it, until
+ * enough samples are collected, then print its statistics.
+ */
+#define mu_run_bench(BENCH, ...)                                     \
+    do {                                                             \
+        mu_bench_t _mb;                                              \
+        if (__mb_begin(&_mb, #BENCH "(" #__VA_ARGS__ ")")) {         \
+            while (__mb_next(&_mb)) {                                \
+                message = BENCH(&_mb, ##__VA_ARGS__);                \
+                mu_bench_pause(&_mb);                                \
+                if (message)                                         \
+                    return message;                                  \
+            }                                                        \
+            __mb_report(&_mb);                                       \
+            __mu_tests_run++;                                        \
+        }                                                            \
+    } while (0)
+
+/**
+ * @brief Like RUN_TESTS(), but parses the benchmark options first.
+ */
+#define RUN_BENCHES(ALL_BENCHES)                                      \
+    int main(int argc, const char *argv[]) {                          \
+        const char *result;                                           \
+        if (__mb_parse_args(argc, argv) == -1) {                      \
+            fprintf(stderr, "usage: %s [-f text|csv|json] "           \
+                    "[-r repetitions] [-t sample_ms] [-o file] [filter]\n",     \
+                    argv[0]);                                         \
+            return 2;                                                 \
+        }                                                             \
+        fprintf(stderr, "[mubench] RUNNING: %s\n", argv[0]);          \
+        __mb_header();                                                \
+        result = ALL_BENCHES();                                       \
+        __mb_footer();                                                \
+        if (result) {                                                 \
+            fprintf(stderr, "[mubench] FAILED: %s\n", result);        \
+        }                                                             \
+        fprintf(stderr, "[mubench] Benchmarks run: %d\n",             \
+                __mu_tests_run);                                      \
+        return result != NULL;                                        \
+    }
+
+/* These are for internal use of the benchmark harness */
+enum { MB_TEXT, MB_CSV, MB_JSON };
+static int __mb_format = MB_TEXT;
+static int __mb_reps = MB_DEFAULT_REPS;
+static uint64_t __mb_sample_ns = MB_DEFAULT_SAMPLE_MS * 1000000ULL;
+static const char *__mb_filter;
+static int __mb_reported;
+static FILE *__mb_out;
+
+static inline int __mb_parse_args(int argc, const char *argv[]) {
+    int i;
+
+    __mb_out = stdout;
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "csv")) {
+                __mb_format = MB_CSV;
+            } else if (!strcmp(argv[i], "json")) {
+                __mb_format = MB_JSON;
+            } else if (!strcmp(argv[i], "text")) {
+                __mb_format = MB_TEXT;
+            } else {
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            __mb_reps = atoi(argv[++i]);
+            if (__mb_reps < 1 || __mb_reps > MB_MAX_REPS) {
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            __mb_sample_ns = strtoull(argv[++i], NULL, 10) * 1000000ULL;
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            if (!(__mb_out = fopen(argv[++i], "w"))) {
+                perror(argv[i]);
+                return -1;
+            }
+        } else if (argv[i][0] == '-') {
+            return -1;
+        } else {
+            __mb_filter = argv[i];
+        }
+    }
+    return 0;
+}
+
+static inline void __mb_header(void) {
+    if (__mb_format == MB_TEXT) {
+        fprintf(__mb_out, "%-40s %12s %10s %10s %8s %14s %10s\n",
+                "benchmark", "iters", "min ns", "median ns", "stddev",
+                "ops/s", "MB/s");
+    } else if (__mb_format == MB_CSV) {
+        fprintf(__mb_out, "name,iterations,samples,min_ns,median_ns,mean_ns,"
+                "stddev_ns,ops_per_sec,bytes_per_sec\n");
+    } else {
+        fprintf(__mb_out, "[");
+    }
+}
+
+static inline void __mb_footer(void) {
+    if (__mb_format == MB_JSON) {
+        fprintf(__mb_out, "\n]\n");
+    }
+    if (__mb_out != stdout) {
+        fclose(__mb_out);
+    } else {
+        fflush(__mb_out);
+    }
+}
+
+static inline bool __mb_begin(mu_bench_t *b, const char *name) {
+    if (__mb_filter && !strstr(name, __mb_filter)) {
+        return false;
+    }
+    memset(b, 0, sizeof(*b));
+    b->name = name;
+    return true;
+}
+
+/* Record the run that just finished (if any) and set up the next one.
+ * Returns false once all samples are in. */
+static inline bool __mb_next(mu_bench_t *b) {
+    uint64_t elapsed = b->elapsed;
+    double grow;
+
+    if (b->iters == 0) {
+        b->iters = 1;
+    } else if (b->phase == 0) {
+        if (elapsed >= __mb_sample_ns || b->iters >= MB_MAX_ITERS) {
+            b->phase = 1; /* that run was long enough: it was the warmup */
+        } else {
+            /* aim 20% past the target, growing at most 100x per step */
+            grow = elapsed ? 1.2 * __mb_sample_ns / elapsed : 100;
+            grow = grow > 100 ? 100 : grow < 1.5 ? 1.5 : grow;
+            b->iters = (size_t)(b->iters * grow);
+        }
+    } else {
+        b->samples[b->nsamples++] = (double)elapsed / b->iters;
+        if (b->nsamples == __mb_reps) {
+            b->phase = 2;
+            return false;
+        }
+    }
+    b->elapsed = 0;
+    b->started = 0;
+    return true;
+}
+
+/* print s as the body of a JSON/CSV string literal */
+static inline void __mb_print_escaped(const char *s) {
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc(__mb_format == MB_CSV ? '"' : '\\', __mb_out);
+        }
+        fputc(*s, __mb_out);
+    }
+}
+
+static inline int __mb_cmp(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static inline void __mb_report(mu_bench_t *b) {
+    double sorted[MB_MAX_REPS], mean = 0, var = 0, median, ops, bps;
+    int i, n = b->nsamples;
+
+    memcpy(sorted, b->samples, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), __mb_cmp);
+    median = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    for (i = 0; i < n; i++) {
+        mean += sorted[i];
+    }
+    mean /= n;
+    for (i = 0; i < n; i++) {
+        var += (sorted[i] - mean) * (sorted[i] - mean);
+    }
+    var = n > 1 ? var / (n - 1) : 0;
+    ops = median > 0 ? 1e9 / median : 0;
+    bps = ops * b->bytes;
+
+    if (__mb_format == MB_TEXT) {
+        fprintf(__mb_out, "%-40s %12zu %10.1f %10.1f %7.1f%% %14.0f ",
+                b->name, b->iters, sorted[0], median,
+                mean > 0 ? 100 * sqrt(var) / mean : 0, ops);
+        if (b->bytes) {
+            fprintf(__mb_out, "%10.1f\n", bps / 1e6);
+        } else {
+            fprintf(__mb_out, "%10s\n", "-");
+        }
+    } else if (__mb_format == MB_CSV) {
+        fputc('"', __mb_out);
+        __mb_print_escaped(b->name);
+        fprintf(__mb_out, "\",%zu,%d,%.2f,%.2f,%.2f,%.2f,%.1f,%.1f\n",
+                b->iters, n, sorted[0], median, mean, sqrt(var), ops, bps);
+    } else {
+        fprintf(__mb_out, "%s\n  {\"name\": \"", __mb_reported ? "," : "");
+        __mb_print_escaped(b->name);
+        fprintf(__mb_out, "\", \"iterations\": %zu, \"min_ns\": %.2f, "
+                "\"median_ns\": %.2f, \"mean_ns\": %.2f, \"stddev_ns\": %.2f, "
+                "\"ops_per_sec\": %.1f, \"bytes_per_sec\": %.1f, "
+                "\"samples_ns\": [",
+                b->iters, sorted[0], median, mean, sqrt(var), ops, bps);
+        for (i = 0; i < n; i++) {
+            fprintf(__mb_out, "%s%.2f", i ? ", " : "", b->samples[i]);
+        }
+        fprintf(__mb_out, "]}");
+    }
+    __mb_reported++;
+    fflush(__mb_out);
+}
+
+#endif /* _mubench_h */
@@ -2,10 +2,15 @@
 #define _network_h_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/socket.h>
+#include <sys/types.h>
+#include "alloc.h"
 
 #define SERVER_BACKLOG 5
 #define RECVBUFSZ 1024
+#define NET_NO_DEADLINE UINT64_MAX
+#define NET_MAX_FDS 16 /* descriptors send_fds()/recv_fds() pass at once */
 
 /**
  * @brief Get sockaddr, IPv4 or IPv6.
@@ -30,6 +35,94 @@ int setsockopt_reuseaddr(int sockfd, bool val);
  */
 ssize_t sendall(int sockfd, void *buf, size_t *len);
 
+/**
+ * @brief Receives all data through sockfd until the connection closes or
+ * timeout_millis have passed in all (no limit if <= 0).
+ *
+ * The timeout is a deadline for the whole receive, so a peer sending a
+ * byte at a time can't hold the caller past it.
+ *
+ * *buf is grown with realloc() as needed (it may start out NULL) and is
+ * NUL-terminated. On entry *len is the size of *buf, or of the first buffer
+ * to allocate if 0 (RECVBUFSZ); on return it is the number of bytes received.
+ * @returns Bytes received on success, -1 on error.
+ */
+ssize_t recv_timeout(int sockfd, void **buf, size_t *len, int timeout_millis);
+
+/**
+ * @brief Receive bytes until delim is found. *buf and *len work as in
+ * recv_timeout().
+ * @returns Bytes received on success, @c -1 on error
+ */
+ssize_t recv_delim(int sockfd, void **buf, size_t *len, void *delim,
+                   size_t delim_len);
+
+/**
+ * @brief Receive a given count of bytes into *buf, which is resized to
+ * count + 1 bytes with realloc().
+ * @returns Bytes received, @c -1 on error. Note: bytes received could be less
+ * than count if the socket is closed normally while receiving.
+ */
+ssize_t recv_count(int sockfd, void **buf, size_t count);
+
+/**
+ * @brief recv_timeout(), recv_delim() and recv_count() with the buffer
+ * managed by alloc (NULL for malloc).
+ *
+ * Growing a buffer that is the most recent arena allocation happens in place,
+ * so an arena suits request-scoped receives. For recv_count_with(), bufsize
+ * is the current size of *buf; it is only resized if smaller than count + 1.
+ */
+ssize_t recv_timeout_with(int sockfd, void **buf, size_t *len,
+                          int timeout_millis, allocator_t *alloc);
+ssize_t recv_delim_with(int sockfd, void **buf, size_t *len, void *delim,
+                        size_t delim_len, allocator_t *alloc);
+ssize_t recv_count_with(int sockfd, void **buf, size_t bufsize, size_t count,
+                        allocator_t *alloc);
+
+/**
+ * @brief The deadline timeout_millis from now, for the *_deadline()
+ * functions: CLOCK_MONOTONIC nanoseconds, or NET_NO_DEADLINE if
+ * timeout_millis < 0. Work out one deadline per request and pass it to each
+ * call, so they share the budget.
+ */
+uint64_t net_deadline(int timeout_millis);
+
+/**
+ * @brief Set or clear O_NONBLOCK on fd.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int set_nonblocking(int fd, bool val);
+
+/*
+ * The *_deadline() functions try the socket call first without blocking
+ * (MSG_DONTWAIT, so sockfd may be blocking or not), and only poll() for the
+ * rest of the budget when it would block: when data is ready a receive costs
+ * the one recv(). They fail with ETIMEDOUT once deadline passes.
+ */
+
+/**
+ * @brief Receive up to len bytes into buf, waiting until deadline for some.
+ * @returns Bytes received, @c 0 if the peer closed, @c -1 on error.
+ */
+ssize_t recv_deadline(int sockfd, void *buf, size_t len, uint64_t deadline);
+
+/**
+ * @brief Receive *len bytes into buf by deadline. On return *len is the
+ * number of bytes received, which is short if the peer closed first.
+ * @returns Bytes received, @c -1 on error or timeout (with *len received).
+ */
+ssize_t recvall_deadline(int sockfd, void *buf, size_t *len,
+                         uint64_t deadline);
+
+/**
+ * @brief Send the *len bytes in buf by deadline. On return *len is the
+ * number of bytes sent.
+ * @returns Bytes sent, @c -1 on error or timeout (with *len sent).
+ */
+ssize_t sendall_deadline(int sockfd, const void *buf, size_t *len,
+                         uint64_t deadline);
+
 /**
  * @brief Opens a TCP socket and connects to server (host:port).
  * @returns Socket descriptor connected to server:port, @c -1 on error
@@ -42,4 +135,38 @@ int tcp_client_connect(const char *host, const char *port);
  */
 int tcp_server_listen(const char *port);
 
+/**
+ * @brief Opens an AF_UNIX socket of the given type (SOCK_STREAM or
+ * SOCK_SEQPACKET), binds it to path and listens. A socket file left at path
+ * by an earlier server that refuses connections is removed first.
+ * @returns Socket descriptor listening on path, @c -1 on error (EADDRINUSE
+ * if a server is listening on path)
+ */
+int unix_server_listen(const char *path, int type);
+
+/**
+ * @brief Opens an AF_UNIX socket of the given type and connects to path.
+ * @returns Socket descriptor connected to path, @c -1 on error
+ */
+int unix_client_connect(const char *path, int type);
+
+/**
+ * @brief Send len bytes of buf (at least one) through the AF_UNIX socket
+ * sockfd, with nfds descriptors (at most NET_MAX_FDS) attached. The peer
+ * gets its own copies of them, which stay open whatever the sender does
+ * with its own.
+ * @returns Bytes sent, @c -1 on error
+ */
+ssize_t send_fds(int sockfd, const void *buf, size_t len, const int *fds,
+                 size_t nfds);
+
+/**
+ * @brief Receive up to len bytes into buf, and the descriptors that came
+ * with them into fds, which has room for *nfds (set to the number received).
+ * If more came than fit, all of them are closed and the call fails with
+ * EMSGSIZE.
+ * @returns Bytes received, @c 0 if the peer closed, @c -1 on error
+ */
+ssize_t recv_fds(int sockfd, void *buf, size_t len, int *fds, size_t *nfds);
+
 #endif /* _network_h_ */
@@ -0,0 +1,154 @@
+/**
+ * @file packet.h
+ * @brief Zero-copy IPv4/IPv6/TCP/UDP header parsing and Internet checksums.
+ *
+ * pkt_parse() validates a packet in place and fills a pkt_view_t with
+ * pointers into the caller's buffer plus the handful of fields that are
+ * needed on nearly every packet (addresses, protocol, ports). Nothing is
+ * copied, and buffers need not be aligned.
+ *
+ * Checksums follow RFC 1071 and are computed with SSE2/AVX2 when available.
+ * All 16-bit checksum values taken and returned by this module are in
+ * network byte order, i.e. exactly the bytes that go in the header:
+ * @code
+ * uint16_t csum = pkt_checksum(hdr, hdrlen);
+ * memcpy(hdr + 10, &csum, sizeof(csum));
+ * @endcode
+ */
+
+#ifndef _packet_h_
+#define _packet_h_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "byteorder.h"
+
+#define PKT_ETH_HLEN 14
+#define PKT_IPV4_HLEN 20 /* without options */
+#define PKT_IPV6_HLEN 40
+#define PKT_TCP_HLEN 20 /* without options */
+#define PKT_UDP_HLEN 8
+
+#define PKT_ETHERTYPE_IPV4 0x0800
+#define PKT_ETHERTYPE_IPV6 0x86dd
+#define PKT_ETHERTYPE_VLAN 0x8100
+#define PKT_ETHERTYPE_QINQ 0x88a8
+
+/* TCP flags, as found in pkt_view_t.tcp_flags */
+#define PKT_TCP_FIN 0x01
+#define PKT_TCP_SYN 0x02
+#define PKT_TCP_RST 0x04
+#define PKT_TCP_PSH 0x08
+#define PKT_TCP_ACK 0x10
+#define PKT_TCP_URG 0x20
+
+typedef struct PacketView {
+    const uint8_t *l2;      /* Ethernet header, NULL if parsed from L3 */
+    const uint8_t *l3;      /* IPv4/IPv6 header */
+    const uint8_t *l4;      /* TCP/UDP header, NULL if absent */
+    const uint8_t *payload; /* data after the last parsed header */
+    const uint8_t *src;     /* source address, 4 or 16 bytes */
+    const uint8_t *dst;     /* destination address, 4 or 16 bytes */
+    size_t len;             /* IP datagram length, link padding excluded */
+    size_t l3_len;          /* IP header incl. options/extension headers */
+    size_t l4_len;          /* TCP/UDP header incl. options */
+    size_t payload_len;
+    uint16_t sport;         /* host byte order; 0 without l4 */
+    uint16_t dport;         /* host byte order; 0 without l4 */
+    uint8_t version;        /* 4 or 6 */
+    uint8_t proto;          /* IPPROTO_TCP, IPPROTO_UDP, ... */
+    uint8_t ttl;            /* TTL or hop limit */
+    uint8_t tcp_flags;      /* PKT_TCP_* flags; 0 if not TCP */
+    bool fragment;          /* part of a fragmented datagram */
+} pkt_view_t;
+
+/**
+ * @brief Read a big-endian 16-bit field from an unaligned address.
+ */
+static inline uint16_t pkt_get16(const uint8_t *p) {
+    return bo_load_be16(p);
+}
+
+/**
+ * @brief Read a big-endian 32-bit field from an unaligned address.
+ */
+static inline uint32_t pkt_get32(const uint8_t *p) {
+    return bo_load_be32(p);
+}
+
+/**
+ * @brief Parse an IPv4 or IPv6 packet (starting at the IP header) in place.
+ *
+ * IPv6 extension headers are skipped. The L4 header is only parsed for TCP
+ * and UDP, and only in the first fragment of a fragmented datagram.
+ * @returns @c 0 on success, @c -1 on error (errno is EBADMSG for truncated or
+ * malformed headers, EPROTONOSUPPORT for an unknown IP version).
+ */
+int pkt_parse(pkt_view_t *v, const void *buf, size_t len);
+
+/**
+ * @brief Parse an Ethernet frame carrying IPv4 or IPv6, skipping up to two
+ * VLAN tags.
+ * @returns @c 0 on success, @c -1 on error (see pkt_parse()).
+ */
+int pkt_parse_eth(pkt_view_t *v, const void *frame, size_t len);
+
+/**
+ * @brief Add buf to a running ones-complement sum.
+ *
+ * Start with sum = 0. When chaining calls, every buffer except the last
+ * must have an even length.
+ * @returns The new (unfolded) running sum.
+ */
+uint64_t pkt_csum_partial(const void *buf, size_t len, uint64_t sum);
+
+/**
+ * @brief Fold a running sum into a final checksum (network byte order).
+ */
+uint16_t pkt_csum_finish(uint64_t sum);
+
+/**
+ * @brief Internet checksum of buf (network byte order).
+ *
+ * Over a header that already holds its checksum, the result is 0 if valid.
+ */
+uint16_t pkt_checksum(const void *buf, size_t len);
+
+/**
+ * @brief Incrementally update a checksum after a field changes (RFC 1624).
+ *
+ * old_val and new_val are the field contents before and after the change, as
+ * found in the packet; len must be even (e.g. 2 for a port, 4 for an IPv4
+ * address, 16 for an IPv6 address).
+ * @returns The updated checksum (network byte order).
+ */
+uint16_t pkt_csum_adjust(uint16_t csum, const void *old_val,
+                         const void *new_val, size_t len);
+
+/**
+ * @brief Checksum of the TCP/UDP segment in v, including the pseudo-header.
+ *
+ * The checksum field is summed as it currently is, so a valid segment yields
+ * 0 (see pkt_verify()).
+ * @returns The checksum (network byte order), @c 0 if v has no TCP/UDP header.
+ */
+uint16_t pkt_l4_checksum(const pkt_view_t *v);
+
+/**
+ * @brief Validate the IPv4 header checksum and the TCP/UDP checksum.
+ *
+ * A zero UDP checksum over IPv4 means "no checksum" and is accepted.
+ * Fragmented segments are not checked at L4.
+ * @returns true if all checksums present are valid.
+ */
+bool pkt_verify(const pkt_view_t *v);
+
+/**
+ * @brief Compute and store the IPv4 header and TCP/UDP checksums of the
+ * packet in buf (starting at the IP header).
+ * @returns @c 0 on success, @c -1 if the packet does not parse.
+ */
+int pkt_set_checksums(void *buf, size_t len);
+
+#endif /* _packet_h_ */
@@ -0,0 +1,132 @@
+/**
+ * @file packet_ring.h
+ * @brief Zero-copy packet capture and injection with AF_PACKET mmap rings.
+ *
+ * Receive rings use TPACKET_V3: the kernel fills whole blocks of packets and
+ * hands each block to user space at once, so the per-packet cost is a pointer
+ * bump instead of a recv() call. Several receive rings can join the same
+ * PACKET_FANOUT group to spread traffic across threads (one ring per thread).
+ *
+ * Transmit rings use TPACKET_V2 frames: packets are written straight into the
+ * shared ring and a single send() kicks off transmission of every queued
+ * frame.
+ *
+ * @note Linux only. Opening a ring requires CAP_NET_RAW.
+ */
+
+#ifndef _packet_ring_h_
+#define _packet_ring_h_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define PR_DEFAULT_BLOCK_SIZE (1 << 20) /* 1 MiB */
+#define PR_DEFAULT_BLOCK_COUNT 32
+#define PR_DEFAULT_FRAME_SIZE 2048
+#define PR_DEFAULT_RETIRE_TOV 60 /* ms before a partly filled block is handed over */
+
+typedef struct PacketRingConfig {
+    const char *ifname;         /* interface to bind; NULL binds all (rx only) */
+    unsigned int block_size;    /* bytes per block; multiple of the page size */
+    unsigned int block_count;   /* number of blocks in the ring */
+    unsigned int frame_size;    /* tx frame size; multiple of TPACKET_ALIGNMENT */
+    unsigned int retire_tov_ms; /* rx block retire timeout */
+    uint16_t fanout_group;      /* 0 for no fanout */
+    uint16_t fanout_mode;       /* PACKET_FANOUT_HASH, PACKET_FANOUT_CPU, ... */
+    bool ignore_outgoing;       /* rx: skip own tx (not honored with fanout) */
+    bool qdisc_bypass;          /* tx: skip the qdisc layer */
+} pr_config_t;
+
+typedef struct PacketRing {
+    int fd;
+    uint8_t *map;
+    size_t map_len;
+    unsigned int block_size;
+    unsigned int block_count;
+    unsigned int frame_size;
+    unsigned int frame_count;
+    unsigned int cur;       /* current rx block or tx frame */
+    void *pkt;              /* rx: next packet header in the current block */
+    uint32_t pkts_left;     /* rx: packets not yet returned from the block */
+    unsigned int tx_queued; /* tx: frames committed since last flush */
+} pr_ring_t;
+
+typedef struct PacketRingPacket {
+    const uint8_t *data; /* start of the link-layer header */
+    uint32_t caplen;     /* bytes available at data */
+    uint32_t len;        /* original length on the wire */
+    uint32_t sec;        /* capture timestamp */
+    uint32_t nsec;
+    uint32_t rxhash;     /* kernel flow hash */
+    int ifindex;
+    uint8_t pkttype;     /* PACKET_HOST, PACKET_OUTGOING, ... */
+} pr_packet_t;
+
+/**
+ * @brief Fill cfg with sensible defaults and the given interface name.
+ */
+void pr_config_init(pr_config_t *cfg, const char *ifname);
+
+/**
+ * @brief Open a TPACKET_V3 receive ring, optionally joining a fanout group.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int pr_rx_open(pr_ring_t *ring, const pr_config_t *cfg);
+
+/**
+ * @brief Get the next captured packet, waiting up to timeout_ms (-1 waits
+ * forever).
+ *
+ * pkt->data points directly into the ring. It stays valid until the call that
+ * moves past the last packet of its block, at which point the block is
+ * returned to the kernel; copy anything that must live longer.
+ * @returns @c 1 if a packet was returned, @c 0 on timeout, @c -1 on error.
+ */
+int pr_rx_next(pr_ring_t *ring, pr_packet_t *pkt, int timeout_ms);
+
+/**
+ * @brief Get (packets received, packets dropped) since the last call.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int pr_rx_stats(pr_ring_t *ring, uint64_t *packets, uint64_t *drops);
+
+/**
+ * @brief Open a TPACKET_V2 transmit ring bound to cfg->ifname.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int pr_tx_open(pr_ring_t *ring, const pr_config_t *cfg);
+
+/**
+ * @brief Reserve the next free transmit frame.
+ *
+ * Write the packet (starting with its link-layer header) into the returned
+ * buffer, then call pr_tx_commit().
+ * @returns Pointer to frame payload, or NULL if the ring is full (call
+ * pr_tx_flush() and retry).
+ */
+void *pr_tx_frame(pr_ring_t *ring, size_t *maxlen);
+
+/**
+ * @brief Mark the frame reserved by pr_tx_frame() as ready to send.
+ *
+ * Transmission starts on the next pr_tx_flush().
+ * @returns @c 0 on success, @c -1 if len does not fit in a frame.
+ */
+int pr_tx_commit(pr_ring_t *ring, size_t len);
+
+/**
+ * @brief Ask the kernel to transmit all committed frames.
+ *
+ * If wait is true, blocks until the kernel has consumed them.
+ * @returns @c 0 on success, @c -1 on error (EAGAIN or ENOBUFS if the kernel
+ * could not take them yet; they stay queued for the next flush).
+ */
+int pr_tx_flush(pr_ring_t *ring, bool wait);
+
+/**
+ * @brief Unmap the ring and close its socket.
+ */
+void pr_close(pr_ring_t *ring);
+
+#endif /* _packet_ring_h_ */
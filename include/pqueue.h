@@ -0,0 +1,151 @@
+/**
+ * @file pqueue.h
+ * @brief Array-backed d-ary heap priority queue with decrease-key.
+ *
+ * Items are void * pointers ordered by a caller-supplied comparator, which
+ * gets a context pointer so one function can serve several orderings. The
+ * item that compares lowest comes out first.
+ *
+ * The heap is a single array in which node i has children d * i + 1 ...
+ * d * i + d. A larger arity d makes the tree shallower, so pushes and
+ * priority changes compare fewer times, while each pop compares against all
+ * d children of each level; those children are adjacent in memory, so a
+ * level costs roughly one cache miss. 4 is a good default, 8 suits queues
+ * that see many more pushes and decrease-keys than pops.
+ *
+ * pq_push() returns a handle for the item, which stays valid until the item
+ * leaves the queue. After changing an item's priority, pass its handle to
+ * pq_update() (or pq_decrease() when it can only have moved forward) to
+ * restore the heap order; pq_remove() takes an item out from anywhere.
+ * Handles of removed items are reused.
+ *
+ * Queues are not thread-safe.
+ */
+
+#ifndef _pqueue_h_
+#define _pqueue_h_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "alloc.h"
+
+#define PQ_DEFAULT_ARITY 4
+#define PQ_MAX_ARITY 64
+
+/**
+ * @brief Returned by pq_push() on error.
+ */
+#define PQ_INVALID ((pq_handle_t)-1)
+
+/**
+ * @brief Return <0 if a comes out before b, >0 if after, 0 if either may.
+ */
+typedef int (*pq_cmp_fn)(const void *a, const void *b, void *ctx);
+
+typedef size_t pq_handle_t;
+
+typedef struct PqNode {
+    void *item;
+    pq_handle_t handle;
+} pq_node_t;
+
+typedef struct PriorityQueue {
+    pq_node_t *heap;
+    size_t len;
+    size_t cap;       /* size of heap and of pos */
+    size_t *pos;      /* index in heap of each live handle, or the next
+                         free handle after a free one */
+    size_t npos;      /* handles handed out so far, live or free */
+    size_t free_head; /* first free handle, or PQ_INVALID */
+    unsigned arity;
+    pq_cmp_fn cmp;
+    void *ctx;
+    allocator_t *alloc;
+} pqueue_t;
+
+/**
+ * @brief Return a new, empty queue of the given arity (2 to PQ_MAX_ARITY;
+ * 0 for PQ_DEFAULT_ARITY). ctx is passed to every cmp call.
+ * @returns Pointer to the queue, NULL on error.
+ */
+pqueue_t *pq_create(unsigned arity, pq_cmp_fn cmp, void *ctx);
+
+/**
+ * @brief Like pq_create(), but the queue and its arrays come from alloc
+ * (NULL for malloc).
+ */
+pqueue_t *pq_create_with(unsigned arity, pq_cmp_fn cmp, void *ctx,
+                         allocator_t *alloc);
+
+/**
+ * @brief Free the queue, first calling free_func (if not NULL) on every item
+ * still in it.
+ */
+void pq_destroy(pqueue_t *pq, void (*free_func)(void *));
+
+/**
+ * @brief Make room for n items in total without reallocating.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int pq_reserve(pqueue_t *pq, size_t n);
+
+/**
+ * @brief Add item to the queue.
+ * @returns The item's handle, PQ_INVALID on error.
+ */
+pq_handle_t pq_push(pqueue_t *pq, void *item);
+
+/**
+ * @brief Remove and return the first item, or NULL if the queue is empty.
+ */
+void *pq_pop(pqueue_t *pq);
+
+/**
+ * @brief Restore the order after the priority of h's item changed in either
+ * direction.
+ * @returns @c 0 on success, @c -1 on error (errno is EINVAL if h is not in
+ * the queue).
+ */
+int pq_update(pqueue_t *pq, pq_handle_t h);
+
+/**
+ * @brief Like pq_update(), for an item that can only have moved forward.
+ */
+int pq_decrease(pqueue_t *pq, pq_handle_t h);
+
+/**
+ * @brief Remove h's item from the queue.
+ * @returns The item, NULL on error (errno is EINVAL if h is not in the
+ * queue).
+ */
+void *pq_remove(pqueue_t *pq, pq_handle_t h);
+
+/**
+ * @brief Return true if h is the handle of an item in the queue.
+ */
+static inline bool pq_contains(const pqueue_t *pq, pq_handle_t h) {
+    return h < pq->npos && pq->pos[h] < pq->len &&
+           pq->heap[pq->pos[h]].handle == h;
+}
+
+/**
+ * @brief Return h's item, or NULL if h is not in the queue.
+ */
+static inline void *pq_get(const pqueue_t *pq, pq_handle_t h) {
+    return pq_contains(pq, h) ? pq->heap[pq->pos[h]].item : NULL;
+}
+
+/**
+ * @brief Return the first item without removing it, or NULL if the queue
+ * is empty.
+ */
+static inline void *pq_peek(const pqueue_t *pq) {
+    return pq->len ? pq->heap[0].item : NULL;
+}
+
+static inline size_t pq_len(const pqueue_t *pq) {
+    return pq->len;
+}
+
+#endif /* _pqueue_h_ */
@@ -0,0 +1,213 @@
+/**
+ * @file prng.h
+ * @brief Fast non-cryptographic pseudo-random numbers.
+ *
+ * prng_t is xoshiro256** (Blackman and Vigna): 256 bits of state, period
+ * 2^256 - 1, and about a nanosecond per 64-bit output. pcg64_t (PCG XSL-RR
+ * 128/64) is an alternative with a different structure, for cross-checking
+ * results that might depend on the generator.
+ *
+ * Generators are plain structs with no locking; give each thread its own,
+ * or use prng_thread(), which returns a lazily seeded per-thread generator.
+ * Bounded integers use Lemire's multiply-shift method, which is unbiased and
+ * almost never needs a division.
+ *
+ * @warning
+ * None of this is cryptographically secure!
+ */
+
+#ifndef _prng_h_
+#define _prng_h_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct Prng {
+    uint64_t s[4];
+} prng_t;
+
+#ifdef __SIZEOF_INT128__
+typedef __uint128_t prng_u128_t;
+#else
+/* where the compiler has no 128-bit integers, their two halves */
+typedef struct PrngU128 {
+    uint64_t hi, lo;
+} prng_u128_t;
+#endif /* __SIZEOF_INT128__ */
+
+typedef struct Pcg64 {
+    prng_u128_t state;
+    prng_u128_t inc; /* stream selector, always odd */
+} pcg64_t;
+
+/* the PCG64 multiplier, 2549297995355413924 * 2^64 + 4865540595714422341 */
+#define PCG64_MULT_HI 2549297995355413924ULL
+#define PCG64_MULT_LO 4865540595714422341ULL
+
+/**
+ * @brief Seed r from a 64-bit value. Equal seeds give equal sequences.
+ */
+void prng_seed(prng_t *r, uint64_t seed);
+
+/**
+ * @brief Advance r by 2^128 outputs. Jumping copies of one generator 0, 1,
+ * 2, ... times gives streams that will not overlap in practice.
+ */
+void prng_jump(prng_t *r);
+
+/**
+ * @brief Return this thread's generator, seeded on first use from the clock,
+ * the thread and a global counter, so no two threads share a sequence.
+ */
+prng_t *prng_thread(void);
+
+/**
+ * @brief Fill out with n 64-bit random values.
+ *
+ * Large fills run four interleaved xoshiro256** streams seeded from r, with
+ * AVX2 where available. The output is the same on every CPU but is not the
+ * sequence repeated prng_next() calls would give.
+ */
+void prng_fill(prng_t *r, uint64_t *out, size_t n);
+
+/**
+ * @brief Fill out with n doubles uniform in [0, 1), as prng_fill() does.
+ */
+void prng_fill_double(prng_t *r, double *out, size_t n);
+
+static inline uint64_t prng_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * @brief Return the high 64 bits of the 128-bit product a * b, and store the
+ * low 64 bits in *lo.
+ */
+static inline uint64_t prng_mul128(uint64_t a, uint64_t b, uint64_t *lo) {
+#ifdef __SIZEOF_INT128__
+    __uint128_t m = (__uint128_t)a * b;
+
+    *lo = (uint64_t)m;
+    return m >> 64;
+#else
+    uint64_t ll = (a & 0xffffffff) * (b & 0xffffffff);
+    uint64_t lh = (a & 0xffffffff) * (b >> 32);
+    uint64_t hl = (a >> 32) * (b & 0xffffffff);
+    uint64_t mid = (ll >> 32) + (lh & 0xffffffff) + (hl & 0xffffffff);
+
+    *lo = mid << 32 | (ll & 0xffffffff);
+    return (a >> 32) * (b >> 32) + (lh >> 32) + (hl >> 32) + (mid >> 32);
+#endif /* __SIZEOF_INT128__ */
+}
+
+/**
+ * @brief Return the next 64 random bits.
+ */
+static inline uint64_t prng_next(prng_t *r) {
+    uint64_t *s = r->s;
+    uint64_t result = prng_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = prng_rotl(s[3], 45);
+    return result;
+}
+
+/**
+ * @brief Return a uniform integer in [0, bound), or 0 if bound is 0.
+ *
+ * The high half of random * bound is uniform except for the bound % 2^64
+ * products whose low half falls below that threshold, which are redrawn.
+ * The threshold needs a division, but only when the low half is small
+ * enough to possibly be biased.
+ */
+static inline uint64_t prng_bounded(prng_t *r, uint64_t bound) {
+    uint64_t low, threshold, high = prng_mul128(prng_next(r), bound, &low);
+
+    if (__builtin_expect(low < bound, 0)) {
+        threshold = -bound % bound;
+        while (low < threshold) {
+            high = prng_mul128(prng_next(r), bound, &low);
+        }
+    }
+    return high;
+}
+
+/**
+ * @brief Like prng_bounded() for 32-bit bounds, with a 64-bit multiply.
+ */
+static inline uint32_t prng_bounded32(prng_t *r, uint32_t bound) {
+    uint64_t m = (prng_next(r) >> 32) * bound;
+    uint32_t low = (uint32_t)m, threshold;
+
+    if (__builtin_expect(low < bound, 0)) {
+        threshold = -bound % bound;
+        while (low < threshold) {
+            m = (prng_next(r) >> 32) * bound;
+            low = (uint32_t)m;
+        }
+    }
+    return m >> 32;
+}
+
+/**
+ * @brief Return a uniform integer in [min, max].
+ */
+static inline int64_t prng_range(prng_t *r, int64_t min, int64_t max) {
+    uint64_t span = (uint64_t)max - (uint64_t)min + 1;
+
+    /* span wraps to 0 for the full 64-bit range */
+    return (int64_t)((uint64_t)min + (span ? prng_bounded(r, span)
+                                           : prng_next(r)));
+}
+
+/**
+ * @brief Return a double uniform in [0, 1), using 53 random bits.
+ */
+static inline double prng_double(prng_t *r) {
+    return (prng_next(r) >> 11) * 0x1.0p-53;
+}
+
+/**
+ * @brief Return a float uniform in [0, 1), using 24 random bits.
+ */
+static inline float prng_float(prng_t *r) {
+    return (prng_next(r) >> 40) * 0x1.0p-24f;
+}
+
+/**
+ * @brief Seed r from a 64-bit seed and a stream number; different streams
+ * give independent sequences for the same seed.
+ */
+void pcg64_seed(pcg64_t *r, uint64_t seed, uint64_t stream);
+
+/**
+ * @brief Return the next 64 random bits from a PCG64 generator.
+ */
+static inline uint64_t pcg64_next(pcg64_t *r) {
+    uint64_t xored;
+    int rot;
+#ifdef __SIZEOF_INT128__
+    const __uint128_t mult = (__uint128_t)PCG64_MULT_HI << 64 | PCG64_MULT_LO;
+
+    r->state = r->state * mult + r->inc;
+    xored = (uint64_t)(r->state >> 64) ^ (uint64_t)r->state;
+    rot = r->state >> 122;
+#else
+    uint64_t lo, hi = prng_mul128(r->state.lo, PCG64_MULT_LO, &lo);
+
+    /* state * mult + inc, mod 2^128 */
+    hi += r->state.hi * PCG64_MULT_LO + r->state.lo * PCG64_MULT_HI;
+    r->state.lo = lo + r->inc.lo;
+    r->state.hi = hi + r->inc.hi + (r->state.lo < lo);
+    xored = r->state.hi ^ r->state.lo;
+    rot = r->state.hi >> 58;
+#endif /* __SIZEOF_INT128__ */
+    return (xored >> rot) | (xored << ((-rot) & 63));
+}
+
+#endif /* _prng_h_ */
@@ -0,0 +1,72 @@
+/**
+ * @file radix.h
+ * @brief Radix sorts for integer keys, records keyed by integers, and deques.
+ *
+ * Keys are sorted a byte (8-bit digit) at a time, so sorting n keys of w
+ * bytes costs at most w passes over the data whatever the key values, instead
+ * of the n log n comparisons of qsort(). Histograms for every digit are
+ * counted in one read of the input, and digits on which all keys agree (the
+ * high bytes of small values, say) are skipped.
+ *
+ * Small arrays are sorted least significant digit first (LSD). Large ones,
+ * and all sorts given a thread pool, first split the keys on their most
+ * significant varying digit (MSD) into up to 256 buckets, then sort each
+ * bucket LSD while it is still in cache; with a pool, the split is counted
+ * and scattered in parallel and buckets are sorted concurrently.
+ *
+ * All sorts are stable and need a scratch buffer as large as the input.
+ */
+
+#ifndef _radix_h_
+#define _radix_h_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "deque.h"
+#include "threadpool.h"
+
+/**
+ * @brief radix_sort_records() flag: the key is a two's complement signed
+ * integer.
+ */
+#define RADIX_SIGNED 1
+
+/**
+ * @brief Sort n keys in ascending order, using pool's workers if pool is not
+ * NULL.
+ * @returns @c 0 on success, @c -1 on error (ENOMEM for the scratch buffer).
+ */
+int radix_sort_u32(uint32_t *keys, size_t n, tp_pool_t *pool);
+int radix_sort_u64(uint64_t *keys, size_t n, tp_pool_t *pool);
+int radix_sort_i32(int32_t *keys, size_t n, tp_pool_t *pool);
+int radix_sort_i64(int64_t *keys, size_t n, tp_pool_t *pool);
+
+/**
+ * @brief Sort n records of size bytes each by the 1-, 2-, 4- or 8-byte
+ * native-endian integer at key_off within every record.
+ *
+ * Records move as a whole, so keep them small (or sort an array of
+ * key/pointer pairs instead).
+ * @param flags 0 for an unsigned key, or RADIX_SIGNED.
+ * @returns @c 0 on success, @c -1 on error (EINVAL for a bad key size or
+ * offset, ENOMEM for the scratch buffer).
+ */
+int radix_sort_records(void *base, size_t n, size_t size, size_t key_off,
+                       size_t key_size, int flags, tp_pool_t *pool);
+
+/**
+ * @brief Return the sort key of an item stored in a deque.
+ */
+typedef uint64_t (*radix_key_fn)(const void *data);
+
+/**
+ * @brief Reorder the items of dq by ascending key(data), or by the data
+ * pointers themselves if key is NULL (the order dq_sorted() produces).
+ *
+ * Unlike dq_sorted(), dq is sorted in place: its nodes stay where they are
+ * and the items are rearranged among them.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int radix_sort_deque(deque_t *dq, radix_key_fn key, tp_pool_t *pool);
+
+#endif /* _radix_h_ */
@@ -0,0 +1,200 @@
+/**
+ * @file reclaim.h
+ * @brief Safe memory reclamation for lock-free structures: epoch-based
+ * reclamation (EBR) and hazard pointers.
+ *
+ * A node unlinked from a lock-free structure can't be freed straight away, as
+ * another thread may have loaded a pointer to it just before and still be
+ * reading it. Instead it is retired, and freed once no thread can hold it.
+ * Objects to retire embed a reclaim_node_t (first, or found again from the
+ * node with offsetof()), and are freed by the function given to retire them.
+ *
+ * Each thread that reads or retires nodes registers with a domain (ebr_t or
+ * hp_t) and gets a handle of its own. Retired nodes go on the handle's retire
+ * list and are freed in batches, so the cost of working out what is safe to
+ * free is spread over many retires.
+ *
+ * - EBR: threads bracket every access with ebr_enter()/ebr_exit(). A node is
+ *   freed once every thread has been seen outside, or in a later critical
+ *   section than, the one it was retired in. Entering costs one fence, and
+ *   nodes need no per-pointer protection, but one thread stalled inside a
+ *   critical section holds back every retired node.
+ * - Hazard pointers: threads publish each pointer they are about to use in a
+ *   slot with hp_protect(), and a node is freed once no slot holds it. Each
+ *   protect costs a fence, but a stalled thread only holds back the nodes its
+ *   slots point to.
+ *
+ * Domains are thread-safe; a handle belongs to the thread that registered it.
+ */
+
+#ifndef _reclaim_h_
+#define _reclaim_h_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#define EBR_BATCH 64 /* retired nodes a thread collects before sealing them */
+#define HP_BATCH 64  /* retired nodes beyond 2 per hazard before a scan */
+
+typedef struct ReclaimNode reclaim_node_t;
+typedef void (*reclaim_fn_t)(reclaim_node_t *node);
+
+struct ReclaimNode {
+    reclaim_node_t *next;
+    reclaim_fn_t free_fn;
+    uint64_t epoch; /* EBR: the epoch it was sealed in */
+};
+
+/*********************************************************************
+ * Epoch-based reclamation
+ *********************************************************************/
+
+typedef struct EbrThread ebr_thread_t;
+
+typedef struct Ebr {
+    uint64_t epoch;
+    ebr_thread_t *threads;   /* every handle ever registered, some free */
+    reclaim_node_t *orphans; /* left behind by unregistered threads */
+    pthread_mutex_t lock;    /* guards adding handles, and orphans */
+} ebr_t;
+
+/**
+ * @brief Initialize an EBR domain.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int ebr_init(ebr_t *d);
+
+/**
+ * @brief Free every node still retired in d, and the handles of d.
+ *
+ * Call once no thread uses d any more.
+ */
+void ebr_destroy(ebr_t *d);
+
+/**
+ * @brief Register the calling thread with d.
+ * @returns The thread's handle, or NULL on error (ENOMEM).
+ */
+ebr_thread_t *ebr_register(ebr_t *d);
+
+/**
+ * @brief Give up the handle t, outside any critical section.
+ *
+ * Nodes t retired that are not yet safe to free are left to the domain, and
+ * freed by another thread's collection or by ebr_destroy().
+ */
+void ebr_unregister(ebr_thread_t *t);
+
+/**
+ * @brief Start a critical section: pointers loaded from shared structures
+ * stay valid until the matching ebr_exit(). Sections nest.
+ */
+void ebr_enter(ebr_thread_t *t);
+
+/**
+ * @brief End the critical section started by the matching ebr_enter().
+ */
+void ebr_exit(ebr_thread_t *t);
+
+/**
+ * @brief Retire node, already unlinked from every shared structure, to be
+ * passed to free_fn once no thread can still hold it.
+ *
+ * Every EBR_BATCH retires, the retired nodes are sealed and t tries to free
+ * older ones, as ebr_collect() does.
+ */
+void ebr_retire(ebr_thread_t *t, reclaim_node_t *node, reclaim_fn_t free_fn);
+
+/**
+ * @brief Seal the nodes t retired, try to advance the epoch, and free those
+ * that are safe to free.
+ * @returns The number of nodes freed.
+ */
+size_t ebr_collect(ebr_thread_t *t);
+
+/**
+ * @brief Wait until every node t retired so far has been freed.
+ *
+ * Call outside a critical section; it waits for other threads to leave
+ * theirs.
+ */
+void ebr_synchronize(ebr_thread_t *t);
+
+/*********************************************************************
+ * Hazard pointers
+ *********************************************************************/
+
+typedef struct HpThread hp_thread_t;
+
+typedef struct Hp {
+    hp_thread_t *threads;    /* every handle ever registered, some free */
+    unsigned slots;          /* hazard pointers per thread */
+    unsigned nthreads;       /* handles, for the scan threshold */
+    reclaim_node_t *orphans; /* left behind by unregistered threads */
+    pthread_mutex_t lock;    /* guards adding handles, and orphans */
+} hp_t;
+
+/**
+ * @brief Initialize a hazard pointer domain giving each thread the given
+ * number of slots.
+ * @returns @c 0 on success, @c -1 on error (EINVAL for no slots).
+ */
+int hp_init(hp_t *d, unsigned slots);
+
+/**
+ * @brief Free every node still retired in d, and the handles of d.
+ *
+ * Call once no thread uses d any more.
+ */
+void hp_destroy(hp_t *d);
+
+/**
+ * @brief Register the calling thread with d.
+ * @returns The thread's handle, or NULL on error (ENOMEM).
+ */
+hp_thread_t *hp_register(hp_t *d);
+
+/**
+ * @brief Clear the slots of t and give it up. Nodes that are not yet safe
+ * to free are left to the domain.
+ */
+void hp_unregister(hp_thread_t *t);
+
+/**
+ * @brief Load the pointer at src and protect it in slot: it stays valid,
+ * if it has not been retired already, until the slot is cleared or reused.
+ *
+ * The pointer is published, then src is loaded again to check that it still
+ * holds it, as a node unlinked in between may already have been freed.
+ * @returns The protected pointer, which may be NULL.
+ */
+void *hp_protect(hp_thread_t *t, unsigned slot, void *const *src);
+
+/**
+ * @brief Publish ptr, which the caller knows is not yet retired, in slot.
+ */
+void hp_set(hp_thread_t *t, unsigned slot, void *ptr);
+
+/**
+ * @brief Clear slot, releasing the pointer it protected.
+ */
+void hp_clear(hp_thread_t *t, unsigned slot);
+
+/**
+ * @brief Retire node, already unlinked from every shared structure, to be
+ * passed to free_fn once no slot holds it.
+ *
+ * Once t has HP_BATCH more retired nodes than twice the hazard pointers in
+ * d, it scans the slots and frees the nodes none hold, as hp_collect() does.
+ */
+void hp_retire(hp_thread_t *t, reclaim_node_t *node, reclaim_fn_t free_fn);
+
+/**
+ * @brief Free the nodes t retired that no slot holds.
+ * @returns The number of nodes freed, or @c -1 on error (ENOMEM).
+ */
+ssize_t hp_collect(hp_thread_t *t);
+
+#endif /* _reclaim_h_ */
@@ -0,0 +1,102 @@
+/**
+ * @file relay.h
+ * @brief Forward bytes both ways between two connected sockets, as a proxy
+ * does, without copying them through user space where possible.
+ *
+ * On Linux each direction moves data socket -> pipe -> socket with splice():
+ * the bytes stay in kernel pages, where a recv()/send() loop copies each one
+ * out and back in. Where splice() is unavailable, or its pipes can't be
+ * made, or with RELAY_COPY, each direction copies through one buffer
+ * allocated up front and reused for the whole connection.
+ *
+ * A relay_t never blocks: relay_pump() moves what it can in both directions
+ * until the sockets would block, so one thread can drive many relays from an
+ * event loop. Call relay_epoll_add() to register both sockets edge-triggered
+ * with the relay as their data.ptr, then call relay_pump() on the relay of
+ * every event, and relay_destroy() once it fails or relay_done() is true.
+ * relay_run() drives a single relay with poll() instead, for a thread per
+ * connection.
+ *
+ * Half-closes are forwarded: once one socket reaches end of file and what it
+ * sent has been written out, the other is shut down for writing, and the
+ * other direction keeps going until it ends too.
+ *
+ * Writing to a socket whose peer has gone raises SIGPIPE, as splice() can't
+ * be told not to, so a process that relays should ignore SIGPIPE.
+ */
+
+#ifndef _relay_h_
+#define _relay_h_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#define RELAY_BUFSZ (64 * 1024) /* per direction: pipe capacity or buffer */
+
+/* relay_init() flags */
+#define RELAY_COPY 0x01 /* copy through a buffer even where splice() works */
+
+typedef struct RelayHalf {
+    int from, to;
+    int pipe[2];     /* splice: read and write ends, or -1 */
+    char *buf;       /* copy: the buffer, or NULL */
+    size_t off;      /* copy: start of the bytes not yet written */
+    size_t pending;  /* bytes read from "from" not yet written to "to" */
+    uint64_t bytes;  /* bytes forwarded in all */
+    bool eof;        /* "from" has reached end of file */
+    bool done;       /* eof, everything written, and "to" shut down */
+} relay_half_t;
+
+typedef struct Relay {
+    relay_half_t half[2]; /* a -> b, and b -> a */
+    int a, b;
+} relay_t;
+
+/**
+ * @brief Set up a relay between the connected sockets a and b, which are
+ * made non-blocking. Flags are RELAY_COPY or 0.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int relay_init(relay_t *r, int a, int b, int flags);
+
+/**
+ * @brief Free what r uses and close both of its sockets.
+ */
+void relay_destroy(relay_t *r);
+
+/**
+ * @brief Whether r moves data with splice(), rather than by copying.
+ */
+bool relay_spliced(const relay_t *r);
+
+/**
+ * @brief Forward what can be forwarded in both directions without blocking,
+ * and forward half-closes.
+ * @returns Bytes forwarded, @c -1 on error (the relay is then unusable).
+ */
+ssize_t relay_pump(relay_t *r);
+
+/**
+ * @brief Whether both directions have ended and been forwarded.
+ */
+bool relay_done(const relay_t *r);
+
+/**
+ * @brief Register both sockets of r with the epoll instance epfd,
+ * edge-triggered for input and output, with r as data.ptr. relay_pump()
+ * always continues until the sockets would block, so edge-triggered events
+ * are never missed.
+ * @returns @c 0 on success, @c -1 on error (ENOSYS without epoll).
+ */
+int relay_epoll_add(relay_t *r, int epfd);
+
+/**
+ * @brief Pump r, waiting with poll() whenever it would block, until both
+ * directions are done.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int relay_run(relay_t *r);
+
+#endif /* _relay_h_ */
@@ -0,0 +1,306 @@
+/**
+ * @file serial.h
+ * @brief Varint/zigzag integer coding and bounds-checked binary cursors.
+ *
+ * Varints are unsigned LEB128: 7 bits per byte, least significant group
+ * first, with the high bit set on every byte but the last. Small values take
+ * one byte instead of a fixed 4 or 8. Signed values go through zigzag coding
+ * first (0, -1, 1, -2, ... map to 0, 1, 2, 3, ...) so that small negative
+ * numbers stay short too.
+ *
+ * varint_decode_n() decodes whole streams of varints, finding value
+ * boundaries 16 or 32 bytes at a time with SSE2/AVX2 (chosen at runtime).
+ *
+ * ser_writer_t and ser_reader_t walk a caller's buffer, writing or reading
+ * fixed-width big-endian fields, varints and raw bytes. Every call is bounds
+ * checked. The first failure is also remembered in the cursor's err field,
+ * and every call after it fails too, so a whole message can be written or
+ * parsed with a single check at the end:
+ * @code
+ * ser_reader_t r;
+ * uint64_t id;
+ * uint16_t kind;
+ *
+ * ser_reader_init(&r, buf, len);
+ * ser_get_varint(&r, &id);
+ * ser_get_u16(&r, &kind);
+ * if (r.err) {
+ *     // truncated or malformed message
+ * }
+ * @endcode
+ */
+
+#ifndef _serial_h_
+#define _serial_h_
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "byteorder.h"
+
+/**
+ * @brief Largest encoded size of a varint (64-bit value).
+ */
+#define VARINT_MAXLEN 10
+
+static inline uint64_t zigzag_encode(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t zigzag_decode(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/**
+ * @brief Return the encoded size of value in bytes (1 to VARINT_MAXLEN).
+ */
+static inline size_t varint_len(uint64_t value) {
+    /* 9 * bits / 64 approximates bits / 7 exactly for 1..64 bits */
+    return (9 * (64 - __builtin_clzll(value | 1)) + 64) / 64;
+}
+
+/**
+ * @brief Encode value at out, which must have room for VARINT_MAXLEN bytes.
+ * @returns Number of bytes written.
+ */
+static inline size_t varint_encode(uint64_t value, uint8_t *out) {
+    size_t i = 0;
+
+    while (value >= 0x80) {
+        out[i++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[i++] = (uint8_t)value;
+    return i;
+}
+
+/**
+ * @brief Decode one varint from at most avail bytes at p.
+ * @returns Encoded length in bytes, @c 0 if more bytes are needed, @c -1 if
+ * the encoding is longer than VARINT_MAXLEN (errno is EBADMSG).
+ */
+static inline int varint_decode(const uint8_t *p, size_t avail,
+                                uint64_t *value) {
+    uint64_t v = 0;
+    size_t i;
+
+    for (i = 0; i < avail && i < VARINT_MAXLEN; i++) {
+        v |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+        if (!(p[i] & 0x80)) {
+            *value = v;
+            return i + 1;
+        }
+    }
+    if (i == VARINT_MAXLEN) {
+        errno = EBADMSG;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Encode n values back to back at out, which must have room for
+ * n * VARINT_MAXLEN bytes (bytes past the returned length may be
+ * overwritten).
+ * @returns Number of bytes written.
+ */
+size_t varint_encode_n(const uint64_t *values, size_t n, uint8_t *out);
+
+/**
+ * @brief Decode up to n varints from the len bytes at buf into values.
+ *
+ * Decoding stops after n values or at the first value that is not complete
+ * within len bytes, which is left for the next call.
+ * @param used Set to the number of bytes consumed.
+ * @returns Number of values decoded, @c -1 on an encoding longer than
+ * VARINT_MAXLEN (errno is EBADMSG; used and values cover the values
+ * decoded before it).
+ */
+ssize_t varint_decode_n(const void *buf, size_t len, uint64_t *values,
+                        size_t n, size_t *used);
+
+/*********************************************************************
+ * Cursors
+ *********************************************************************/
+
+typedef struct SerWriter {
+    uint8_t *buf;
+    size_t cap; /* size of buf */
+    size_t len; /* bytes written so far */
+    int err;    /* errno of the first failed call, or 0 */
+} ser_writer_t;
+
+typedef struct SerReader {
+    const uint8_t *buf;
+    size_t len; /* size of buf */
+    size_t pos; /* bytes read so far */
+    int err;    /* errno of the first failed call, or 0 */
+} ser_reader_t;
+
+static inline void ser_writer_init(ser_writer_t *w, void *buf, size_t cap) {
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->err = 0;
+}
+
+static inline void ser_reader_init(ser_reader_t *r, const void *buf,
+                                   size_t len) {
+    r->buf = buf;
+    r->len = len;
+    r->pos = 0;
+    r->err = 0;
+}
+
+/**
+ * @brief Reserve len bytes in w and return a pointer to them.
+ * @returns @c NULL if they do not fit (errno is EMSGSIZE) or w already
+ * failed.
+ */
+static inline uint8_t *ser_reserve(ser_writer_t *w, size_t len) {
+    uint8_t *p;
+
+    if (w->err || len > w->cap - w->len) {
+        errno = w->err = w->err ? w->err : EMSGSIZE;
+        return NULL;
+    }
+    p = w->buf + w->len;
+    w->len += len;
+    return p;
+}
+
+/**
+ * @brief Consume len bytes from r and return a pointer to them in place.
+ * @returns @c NULL if fewer remain (errno is EBADMSG) or r already failed.
+ */
+static inline const uint8_t *ser_get_view(ser_reader_t *r, size_t len) {
+    const uint8_t *p;
+
+    if (r->err || len > r->len - r->pos) {
+        errno = r->err = r->err ? r->err : EBADMSG;
+        return NULL;
+    }
+    p = r->buf + r->pos;
+    r->pos += len;
+    return p;
+}
+
+/**
+ * @brief Append one value to w: fixed-width values in big-endian order,
+ * varints, zigzag varints (svarint) or raw bytes.
+ * @returns @c 0 on success, @c -1 if it does not fit (errno is EMSGSIZE) or
+ * w already failed.
+ */
+static inline int ser_put_u8(ser_writer_t *w, uint8_t v) {
+    uint8_t *p = ser_reserve(w, 1);
+
+    return p ? (*p = v, 0) : -1;
+}
+
+static inline int ser_put_u16(ser_writer_t *w, uint16_t v) {
+    uint8_t *p = ser_reserve(w, sizeof(v));
+
+    return p ? (bo_store_be16(p, v), 0) : -1;
+}
+
+static inline int ser_put_u32(ser_writer_t *w, uint32_t v) {
+    uint8_t *p = ser_reserve(w, sizeof(v));
+
+    return p ? (bo_store_be32(p, v), 0) : -1;
+}
+
+static inline int ser_put_u64(ser_writer_t *w, uint64_t v) {
+    uint8_t *p = ser_reserve(w, sizeof(v));
+
+    return p ? (bo_store_be64(p, v), 0) : -1;
+}
+
+static inline int ser_put_varint(ser_writer_t *w, uint64_t v) {
+    uint8_t *p;
+
+    /* encode in place when the worst case fits, as it nearly always does */
+    if (!w->err && w->cap - w->len >= VARINT_MAXLEN) {
+        w->len += varint_encode(v, w->buf + w->len);
+        return 0;
+    }
+    p = ser_reserve(w, varint_len(v));
+    return p ? (varint_encode(v, p), 0) : -1;
+}
+
+static inline int ser_put_svarint(ser_writer_t *w, int64_t v) {
+    return ser_put_varint(w, zigzag_encode(v));
+}
+
+static inline int ser_put_bytes(ser_writer_t *w, const void *data,
+                                size_t len) {
+    uint8_t *p = ser_reserve(w, len);
+
+    return p ? (memcpy(p, data, len), 0) : -1;
+}
+
+/**
+ * @brief Read one value from r, as written by the matching ser_put_*().
+ * @returns @c 0 on success, @c -1 if r is truncated or the varint is
+ * malformed (errno is EBADMSG) or r already failed. *v is unchanged on
+ * failure.
+ */
+static inline int ser_get_u8(ser_reader_t *r, uint8_t *v) {
+    const uint8_t *p = ser_get_view(r, 1);
+
+    return p ? (*v = *p, 0) : -1;
+}
+
+static inline int ser_get_u16(ser_reader_t *r, uint16_t *v) {
+    const uint8_t *p = ser_get_view(r, sizeof(*v));
+
+    return p ? (*v = bo_load_be16(p), 0) : -1;
+}
+
+static inline int ser_get_u32(ser_reader_t *r, uint32_t *v) {
+    const uint8_t *p = ser_get_view(r, sizeof(*v));
+
+    return p ? (*v = bo_load_be32(p), 0) : -1;
+}
+
+static inline int ser_get_u64(ser_reader_t *r, uint64_t *v) {
+    const uint8_t *p = ser_get_view(r, sizeof(*v));
+
+    return p ? (*v = bo_load_be64(p), 0) : -1;
+}
+
+static inline int ser_get_varint(ser_reader_t *r, uint64_t *v) {
+    int n;
+
+    if (r->err) {
+        errno = r->err;
+        return -1;
+    }
+    n = varint_decode(r->buf + r->pos, r->len - r->pos, v);
+    if (n <= 0) {
+        errno = r->err = EBADMSG;
+        return -1;
+    }
+    r->pos += n;
+    return 0;
+}
+
+static inline int ser_get_svarint(ser_reader_t *r, int64_t *v) {
+    uint64_t u;
+
+    if (ser_get_varint(r, &u) == -1) {
+        return -1;
+    }
+    *v = zigzag_decode(u);
+    return 0;
+}
+
+static inline int ser_get_bytes(ser_reader_t *r, void *out, size_t len) {
+    const uint8_t *p = ser_get_view(r, len);
+
+    return p ? (memcpy(out, p, len), 0) : -1;
+}
+
+#endif /* _serial_h_ */
@@ -0,0 +1,89 @@
+/**
+ * @file shm_ring.h
+ * @brief A shared-memory message channel between two processes on one host.
+ *
+ * A shm_ring_t is a single-producer single-consumer ring of variable-length
+ * messages in a memfd mapped by both sides. One side creates it and passes
+ * r->fd to the other, for example with send_fds() over an AF_UNIX socket
+ * (see network.h), which attaches to it. A message is copied into the ring
+ * and out again, with no system call while the consumer keeps up: a side
+ * that has to wait spins briefly, yielding, then sleeps on a futex, and the
+ * other side only makes the futex_wake() call when it sees a sleeper.
+ *
+ * One thread (or process) sends and one receives at a time; the mapping
+ * can be shared by threads of one process too. The producer ends the
+ * stream with shm_ring_shutdown(), after which the consumer reads what is
+ * left and then gets end of file.
+ *
+ * @note Linux only (memfd_create() and futexes): elsewhere shm_ring_create()
+ * and shm_ring_attach() fail with ENOSYS.
+ */
+
+#ifndef _shm_ring_h_
+#define _shm_ring_h_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#define SHM_RING_SPIN 16 /* sched_yield() rounds before sleeping */
+
+typedef struct ShmRingHeader shm_ring_header_t;
+
+typedef struct ShmRing {
+    shm_ring_header_t *hdr; /* shared: positions, futexes, then the data */
+    unsigned char *data;
+    size_t size;            /* data bytes, a power of two */
+    size_t map_len;
+    int fd;                 /* the memfd, to pass to the peer */
+} shm_ring_t;
+
+/**
+ * @brief Create a ring with room for at least size bytes of messages (and
+ * their 8-byte aligned length headers) in a new memfd.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int shm_ring_create(shm_ring_t *r, size_t size);
+
+/**
+ * @brief Map the ring in the memfd fd, created by shm_ring_create(), which r
+ * then owns.
+ * @returns @c 0 on success, @c -1 on error (EINVAL if fd holds no ring).
+ */
+int shm_ring_attach(shm_ring_t *r, int fd);
+
+/**
+ * @brief Unmap r and close its memfd. The ring lives on while the other
+ * side has it mapped.
+ */
+void shm_ring_close(shm_ring_t *r);
+
+/**
+ * @brief The largest message r takes: half its size, less a header.
+ */
+size_t shm_ring_max_msg(const shm_ring_t *r);
+
+/**
+ * @brief Copy the len bytes (at least one) of msg into r as one message,
+ * waiting up to timeout_ms (-1 waits forever) for room.
+ * @returns @c 0 on success, @c -1 on error (ETIMEDOUT, EPIPE after
+ * shm_ring_shutdown(), EMSGSIZE beyond shm_ring_max_msg()).
+ */
+int shm_ring_send(shm_ring_t *r, const void *msg, size_t len, int timeout_ms);
+
+/**
+ * @brief Copy the next message in r into buf, which holds len bytes,
+ * waiting up to timeout_ms (-1 waits forever) for one.
+ * @returns The message length, @c 0 once the producer has shut down and
+ * every message has been read, @c -1 on error (ETIMEDOUT, EMSGSIZE if the
+ * message doesn't fit in len, which leaves it in the ring, or EBADMSG if
+ * the ring is corrupt).
+ */
+ssize_t shm_ring_recv(shm_ring_t *r, void *buf, size_t len, int timeout_ms);
+
+/**
+ * @brief Tell the consumer no more messages will come.
+ */
+void shm_ring_shutdown(shm_ring_t *r);
+
+#endif /* _shm_ring_h_ */
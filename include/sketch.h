@@ -0,0 +1,153 @@
+/**
+ * @file sketch.h
+ * @brief Streaming sketches: HyperLogLog cardinality and Count-Min frequency
+ * estimates.
+ *
+ * Both take a 64-bit hash of each item, which must be well mixed (use
+ * hm_hash_u64() or hm_hash_bytes() from hashmap.h), and both merge: sketches
+ * built separately, by one thread each, say, combine into the sketch of the
+ * whole stream.
+ *
+ * hll_t estimates the number of distinct items in 2^p bytes, with a relative
+ * standard error of about 1.04 / sqrt(2^p) (0.8% for p = 14, in 16KB). Small
+ * sketches start sparse: a sorted list of register updates at precision 25,
+ * which costs 4 bytes per distinct item and counts small sets almost
+ * exactly, converted to dense registers once that would be smaller. The
+ * estimate is Ertl's improved raw estimator, which needs no empirical bias
+ * correction tables.
+ *
+ * cms_t estimates how many times each item occurred, never underestimating,
+ * and with probability 1 - delta overestimating by at most epsilon times
+ * the total count. Updates are conservative: only the counters that hold
+ * the current minimum are raised, which makes overestimates much smaller.
+ * To track heavy hitters, compare the estimate cms_add() returns against a
+ * threshold, or keep the largest in a pqueue_t.
+ *
+ * Sketches are not thread-safe; give each thread its own and merge them.
+ */
+
+#ifndef _sketch_h_
+#define _sketch_h_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "alloc.h"
+
+#define HLL_MIN_PRECISION 4
+#define HLL_MAX_PRECISION 18
+#define HLL_SPARSE_PRECISION 25
+
+/*********************************************************************
+ * HyperLogLog
+ *********************************************************************/
+
+typedef struct Hll {
+    uint8_t *regs;    /* 2^p registers once dense, NULL while sparse */
+    uint32_t *sparse; /* index << 6 | rank entries: sorted, then unsorted */
+    size_t nsparse;   /* entries in sparse */
+    size_t nsorted;   /* the first nsorted are sorted and unique by index */
+    size_t sparse_cap;
+    unsigned p;
+    allocator_t *alloc;
+} hll_t;
+
+/**
+ * @brief Initialize h as an empty sketch with 2^p registers, allocated from
+ * alloc (NULL for malloc).
+ * @returns @c 0 on success, @c -1 on error (EINVAL unless HLL_MIN_PRECISION
+ * <= p <= HLL_MAX_PRECISION).
+ */
+int hll_init(hll_t *h, unsigned p, allocator_t *alloc);
+
+/**
+ * @brief Free the memory of h.
+ */
+void hll_destroy(hll_t *h);
+
+/**
+ * @brief Make h empty again. A dense h stays dense, as a sketch that filled
+ * its registers once (over the last time window, say) is likely to again.
+ */
+void hll_clear(hll_t *h);
+
+/**
+ * @brief Add the item with the given hash to h.
+ * @returns @c 0 on success, @c -1 on error (ENOMEM growing the sparse list
+ * or converting to dense registers, leaving h unchanged).
+ */
+int hll_add(hll_t *h, uint64_t hash);
+
+/**
+ * @brief Estimate the number of distinct items added to h.
+ *
+ * A sparse h sorts its pending entries first, and may convert to dense.
+ * @returns The estimate, or @c -1 on error (ENOMEM).
+ */
+double hll_count(hll_t *h);
+
+/**
+ * @brief Add the items of src to dst, which must have the same precision.
+ * @returns @c 0 on success, @c -1 on error (EINVAL for a different
+ * precision, ENOMEM).
+ */
+int hll_merge(hll_t *dst, const hll_t *src);
+
+/*********************************************************************
+ * Count-Min
+ *********************************************************************/
+
+typedef struct CountMin {
+    uint64_t *counts; /* depth rows of width counters */
+    size_t width;     /* a power of two */
+    unsigned depth;
+    uint64_t total; /* of all counts added */
+    allocator_t *alloc;
+} cms_t;
+
+/**
+ * @brief Initialize c to overestimate by at most epsilon * total with
+ * probability 1 - delta: e / epsilon counters (rounded up to a power of two)
+ * in each of ln(1 / delta) rows.
+ * @returns @c 0 on success, @c -1 on error (EINVAL unless 0 < epsilon < 1
+ * and 0 < delta < 1).
+ */
+int cms_init(cms_t *c, double epsilon, double delta, allocator_t *alloc);
+
+/**
+ * @brief Initialize c with depth rows of width counters (rounded up to a
+ * power of two).
+ * @returns @c 0 on success, @c -1 on error (EINVAL for a zero size).
+ */
+int cms_init_size(cms_t *c, size_t width, unsigned depth, allocator_t *alloc);
+
+/**
+ * @brief Free the counters of c.
+ */
+void cms_destroy(cms_t *c);
+
+/**
+ * @brief Zero every counter of c.
+ */
+void cms_clear(cms_t *c);
+
+/**
+ * @brief Add count occurrences of the item with the given hash to c.
+ * @returns The item's new estimated count.
+ */
+uint64_t cms_add(cms_t *c, uint64_t hash, uint64_t count);
+
+/**
+ * @brief Return the estimated count of the item with the given hash.
+ */
+uint64_t cms_estimate(const cms_t *c, uint64_t hash);
+
+/**
+ * @brief Add the counts of src to dst, which must have the same size.
+ *
+ * The merge of conservatively updated sketches still never underestimates,
+ * but may overestimate more than one sketch of the whole stream would.
+ * @returns @c 0 on success, @c -1 on error (EINVAL if the sizes differ).
+ */
+int cms_merge(cms_t *dst, const cms_t *src);
+
+#endif /* _sketch_h_ */
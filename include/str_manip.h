@@ -0,0 +1,209 @@
+/**
+ * @file str_manip.h
+ * @brief String slices, SIMD-accelerated searching and case folding, and a
+ * growable string builder.
+ *
+ * A str_t is a pointer and a length into someone else's memory: slicing,
+ * trimming and splitting never copy or allocate, and strings need not be
+ * NUL-terminated. Substring search, ASCII case conversion and
+ * case-insensitive comparison use AVX2 or SSE2 on x86, chosen at run time
+ * from what the CPU supports, with a scalar fallback; trimming uses SSE2
+ * where the compiler targets it. strbuf_t owns a NUL-terminated buffer that
+ * grows geometrically.
+ *
+ * Example: split a line into trimmed fields without copying
+ * @code
+ * str_t rest = str_from(line), field;
+ * while (str_split_next(&rest, ',', &field)) {
+ *     field = str_trim(field);
+ *     printf("%.*s\n", STR_FMT(field));
+ * }
+ * @endcode
+ */
+
+#ifndef _str_manip_h_
+#define _str_manip_h_
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "alloc.h"
+
+typedef struct StrSlice {
+    const char *ptr;
+    size_t len;
+} str_t;
+
+/**
+ * @brief Slice of a string literal, without a call to strlen().
+ */
+#define STR_LIT(LIT) ((str_t){(LIT), sizeof(LIT) - 1})
+
+/**
+ * @brief printf() arguments for a "%.*s" conversion of a slice.
+ */
+#define STR_FMT(S) (int)(S).len, (S).ptr
+
+static inline str_t str_make(const char *ptr, size_t len) {
+    str_t s = {ptr, len};
+    return s;
+}
+
+/**
+ * @brief Slice of a NUL-terminated string (an empty slice for NULL).
+ */
+static inline str_t str_from(const char *cstr) {
+    return str_make(cstr, cstr ? strlen(cstr) : 0);
+}
+
+/**
+ * @brief Return len bytes of s from start, clamped to the end of s.
+ */
+static inline str_t str_sub(str_t s, size_t start, size_t len) {
+    start = start < s.len ? start : s.len;
+    len = len < s.len - start ? len : s.len - start;
+    return str_make(s.ptr + start, len);
+}
+
+static inline bool str_eq(str_t a, str_t b) {
+    return a.len == b.len && (a.ptr == b.ptr || !memcmp(a.ptr, b.ptr, a.len));
+}
+
+static inline bool str_starts_with(str_t s, str_t prefix) {
+    return s.len >= prefix.len && !memcmp(s.ptr, prefix.ptr, prefix.len);
+}
+
+static inline bool str_ends_with(str_t s, str_t suffix) {
+    return s.len >= suffix.len &&
+           !memcmp(s.ptr + s.len - suffix.len, suffix.ptr, suffix.len);
+}
+
+/**
+ * @brief Compare like strcmp(): bytewise, a shorter prefix sorting first.
+ */
+int str_cmp(str_t a, str_t b);
+
+/**
+ * @brief Compare for equality, ignoring ASCII case.
+ */
+bool str_eq_nocase(str_t a, str_t b);
+
+/**
+ * @brief Return the offset of the first c in s, @c -1 if absent.
+ */
+ssize_t str_find_char(str_t s, char c);
+
+/**
+ * @brief Return the offset of the first occurrence of needle in s, @c -1 if
+ * absent. An empty needle is found at 0.
+ */
+ssize_t str_find(str_t s, str_t needle);
+
+/**
+ * @brief Return the number of non-overlapping occurrences of needle in s
+ * (0 for an empty needle).
+ */
+size_t str_count(str_t s, str_t needle);
+
+/**
+ * @brief Strip ASCII whitespace (" \t\n\v\f\r") from either or both ends.
+ */
+str_t str_ltrim(str_t s);
+str_t str_rtrim(str_t s);
+str_t str_trim(str_t s);
+
+/**
+ * @brief Split off the next token of *rest up to delim.
+ *
+ * The token goes in *tok (without the delimiter) and *rest moves past it.
+ * Every delimiter ends a token, so "a,,b" gives "a", "", "b", "a," gives
+ * "a", "" and "" gives one empty token. After the last token rest->ptr is
+ * NULL; a slice with a NULL pointer has no tokens.
+ * @returns false once *rest is exhausted.
+ */
+bool str_split_next(str_t *rest, char delim, str_t *tok);
+
+/**
+ * @brief Like str_split_next(), with a multi-byte delimiter. An empty delim
+ * matches nowhere.
+ */
+bool str_split_next_str(str_t *rest, str_t delim, str_t *tok);
+
+/**
+ * @brief Write the ASCII lower- or upper-case version of src to dst, which
+ * has room for src.len bytes and may be src.ptr itself. Other bytes are
+ * copied unchanged.
+ */
+void str_tolower(char *dst, str_t src);
+void str_toupper(char *dst, str_t src);
+
+/*********************************************************************
+ * String builder
+ *********************************************************************/
+
+typedef struct StrBuf {
+    char *data;         /* NUL-terminated once anything is appended */
+    size_t len;
+    size_t cap;
+    allocator_t *alloc;
+} strbuf_t;
+
+/**
+ * @brief Prepare an empty builder drawing memory from alloc (NULL for
+ * malloc). Nothing is allocated until first use.
+ */
+void sb_init(strbuf_t *sb, allocator_t *alloc);
+
+/**
+ * @brief Free the builder's buffer.
+ */
+void sb_free(strbuf_t *sb);
+
+/**
+ * @brief Make room for n more bytes (plus the NUL) without reallocating.
+ * The buffer at least doubles whenever it grows.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int sb_reserve(strbuf_t *sb, size_t n);
+
+/**
+ * @brief Append a slice, a C string, a byte, or printf()-formatted text.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int sb_append(strbuf_t *sb, str_t s);
+int sb_append_cstr(strbuf_t *sb, const char *cstr);
+int sb_append_char(strbuf_t *sb, char c);
+int sb_printf(strbuf_t *sb, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+int sb_vprintf(strbuf_t *sb, const char *fmt, va_list ap);
+
+/**
+ * @brief Append s with every occurrence of from replaced by to.
+ * @returns Number of replacements, @c -1 on error (errno set to EINVAL if
+ * from is empty).
+ */
+ssize_t sb_append_replace(strbuf_t *sb, str_t s, str_t from, str_t to);
+
+/**
+ * @brief Empty the builder, keeping its buffer.
+ */
+void sb_clear(strbuf_t *sb);
+
+/**
+ * @brief Return the contents as a slice (valid until the next append).
+ */
+static inline str_t sb_str(const strbuf_t *sb) {
+    return str_make(sb->data ? sb->data : "", sb->len);
+}
+
+/**
+ * @brief Hand the NUL-terminated buffer to the caller, who frees it with
+ * al_free(alloc, buf, *cap), and leave the builder empty. *cap (if not NULL)
+ * receives the buffer size.
+ * @returns The buffer, NULL on error.
+ */
+char *sb_detach(strbuf_t *sb, size_t *cap);
+
+#endif /* _str_manip_h_ */
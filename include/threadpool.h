@@ -0,0 +1,111 @@
+/**
+ * @file threadpool.h
+ * @brief Work-stealing thread pool with wait groups and parallel_for.
+ *
+ * Every worker owns a Chase-Lev deque. Tasks submitted from inside a worker go
+ * on the bottom of that worker's deque, where the owner pops them LIFO (good
+ * cache locality). Idle workers steal FIFO from the top of other workers'
+ * deques. Tasks submitted from outside the pool go through a shared injection
+ * queue.
+ *
+ * Example:
+ * @code
+ * tp_pool_t *pool = tp_create(0);
+ * tp_waitgroup_t wg;
+ * tp_wg_init(&wg);
+ * tp_submit(pool, work, arg, &wg);
+ * tp_wg_wait(pool, &wg);
+ * tp_wg_destroy(&wg);
+ * tp_destroy(pool);
+ * @endcode
+ */
+
+#ifndef _threadpool_h_
+#define _threadpool_h_
+
+#include <pthread.h>
+#include <stdlib.h>
+
+typedef struct ThreadPool tp_pool_t;
+
+typedef void (*tp_task_fn_t)(void *arg);
+
+/**
+ * @brief Body of a parallel_for: process indices [begin, end).
+ */
+typedef void (*tp_range_fn_t)(size_t begin, size_t end, void *arg);
+
+/**
+ * @brief Counts outstanding tasks so a caller can wait for all of them.
+ */
+typedef struct WaitGroup {
+    long count;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} tp_waitgroup_t;
+
+/**
+ * @brief Start a pool of nthreads workers (0 means one per online CPU).
+ * @returns Pointer to the new pool, NULL on error.
+ */
+tp_pool_t *tp_create(size_t nthreads);
+
+/**
+ * @brief Run every task still queued, then stop and free the pool.
+ */
+void tp_destroy(tp_pool_t *pool);
+
+/**
+ * @brief Return the number of worker threads.
+ */
+size_t tp_size(tp_pool_t *pool);
+
+/**
+ * @brief Return the calling thread's worker index in pool, or @c -1 if it is
+ * not one of pool's workers.
+ */
+int tp_worker_id(tp_pool_t *pool);
+
+/**
+ * @brief Queue fn(arg) to run on the pool.
+ *
+ * If wg is not NULL, it is incremented now and decremented once fn returns.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int tp_submit(tp_pool_t *pool, tp_task_fn_t fn, void *arg,
+              tp_waitgroup_t *wg);
+
+/**
+ * @brief Call fn over [begin, end) split into chunks of about grain indices,
+ * and wait for all of them.
+ *
+ * Ranges are split in halves recursively, so idle workers steal large chunks
+ * first. A grain of 0 picks one based on the pool size.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int tp_parallel_for(tp_pool_t *pool, size_t begin, size_t end, size_t grain,
+                    tp_range_fn_t fn, void *arg);
+
+void tp_wg_init(tp_waitgroup_t *wg);
+void tp_wg_destroy(tp_waitgroup_t *wg);
+
+/**
+ * @brief Add n (which may be negative) to the wait group's count.
+ */
+void tp_wg_add(tp_waitgroup_t *wg, long n);
+
+/**
+ * @brief Decrement the count, waking waiters when it reaches zero.
+ */
+void tp_wg_done(tp_waitgroup_t *wg);
+
+/**
+ * @brief Block until the count reaches zero.
+ *
+ * If the caller is one of pool's workers, it runs queued tasks while it
+ * waits, so tasks can wait on tasks they spawned without deadlocking the
+ * pool. Other threads simply block; pool may be NULL for them.
+ */
+void tp_wg_wait(tp_pool_t *pool, tp_waitgroup_t *wg);
+
+#endif /* _threadpool_h_ */
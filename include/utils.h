@@ -10,6 +10,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include "byteorder.h"
+#include "prng.h"
 
 
 /**
@@ -145,18 +147,11 @@
 typedef void (*sig_handler_t)(int signo);
 
 /**
- * @brief Return a compile-time constant indicating whether a system uses
- * Big Endian byte order.
- * @returns @c 1 if big endian, @c 0 if little endian
- * @see https://stackoverflow.com/questions/8978935/detecting-endianness
- * @see https://godbolt.org/g/DAafKo
+ * @brief Compile-time constant indicating whether the system uses little
+ * endian byte order (see byteorder.h).
+ * @returns @c 1 if little endian, @c 0 if big endian
  */
-#define is_little_endian() (__endian_u.val)
-
-static const union {
-    uint16_t u16;
-    uint8_t val;
-} __endian_u = {.u16 = 1};
+#define is_little_endian() (BO_LITTLE_ENDIAN)
 
 
 /**
@@ -195,13 +190,14 @@ static const union {
  * @brief Perform CODE only once, even after successive calls to containing function
  *
  * @warning
- * This is not intended to be thread-safe!
+ * CODE runs once even if several threads get here at the same time, but the
+ * others do not wait for it to finish; use pthread_once() for initialization.
  */
 #define DO_ONCE(CODE) \
     do { \
         static bool _was_done_already = false; \
-        if (UNLIKELY(!_was_done_already)) { \
-            _was_done_already = true; \
+        if (UNLIKELY(!__atomic_load_n(&_was_done_already, __ATOMIC_RELAXED)) && \
+            !__atomic_exchange_n(&_was_done_already, true, __ATOMIC_ACQ_REL)) { \
             CODE; \
         } \
     } while (0)
@@ -251,13 +247,15 @@ static const union {
 
 /**
  * @brief Return a random integer in range [min..max].
- * This implementation ensures the distribution of random numbers is even, avoiding modulo bias.
+ * Draws from the calling thread's generator (see prng.h), so threads never
+ * contend, and avoids modulo bias. The generator lives in prng.c: code that
+ * uses RAND_INT() (or jitter() in dbg.h) links prng.o. The rest of this
+ * header needs nothing linked.
  * 
  * @warning
  * This is NOT cryptographically secure!
  */
-#define _RAND_RATIO (1.0 / (RAND_MAX + 1.0))
-#define RAND_INT(_min, _max) (int)(((_max) - (_min) + 1) * ((double)random() * (_RAND_RATIO)))
+#define RAND_INT(_min, _max) ((int)prng_range(prng_thread(), (_min), (_max)))
   
 
 #endif /* __util_macros_h__ */
@@ -0,0 +1,506 @@
+/**
+ * @brief Allocator handles, arena (bump) allocator and fixed-size pools
+ * @file alloc.c
+ */
+
+#include "alloc.h"
+
+#include <errno.h>
+#include <string.h>
+#include "utils.h"
+
+/*********************************************************************
+ * Allocator handles
+ *********************************************************************/
+
+void *al_alloc(allocator_t *a, size_t size) {
+    return a ? a->alloc(a->ctx, size) : malloc(size);
+}
+
+void *al_calloc(allocator_t *a, size_t n, size_t size) {
+    void *p;
+
+    if (!a) {
+        return calloc(n, size);
+    }
+    if (size && n > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    p = a->alloc(a->ctx, n * size);
+    if (p) {
+        memset(p, 0, n * size);
+    }
+    return p;
+}
+
+void *al_realloc(allocator_t *a, void *ptr, size_t old_size, size_t new_size) {
+    return a ? a->realloc(a->ctx, ptr, old_size, new_size)
+             : realloc(ptr, new_size);
+}
+
+void al_free(allocator_t *a, void *ptr, size_t size) {
+    if (!ptr) {
+        return;
+    }
+    if (a) {
+        a->free(a->ctx, ptr, size);
+    } else {
+        free(ptr);
+    }
+}
+
+/*********************************************************************
+ * Arena
+ *********************************************************************/
+
+struct ArenaChunk {
+    arena_chunk_t *prev; /* next older chunk */
+    size_t size;         /* usable bytes in data */
+    size_t used;
+    unsigned char data[];
+};
+
+static inline size_t align_offset(const arena_chunk_t *c, size_t align) {
+    uintptr_t p = (uintptr_t)(c->data + c->used);
+    return c->used + (((p + align - 1) & ~(uintptr_t)(align - 1)) - p);
+}
+
+void arena_init(arena_t *arena, size_t chunk_size) {
+    memset(arena, 0, sizeof(*arena));
+    arena->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK;
+}
+
+static void free_chain(arena_chunk_t *c) {
+    arena_chunk_t *prev;
+
+    for (; c; c = prev) {
+        prev = c->prev;
+        free(c);
+    }
+}
+
+void arena_destroy(arena_t *arena) {
+    if (!arena) {
+        return;
+    }
+    free_chain(arena->head);
+    free_chain(arena->spare);
+    arena->head = arena->base = arena->spare = NULL;
+    arena->last = NULL;
+}
+
+/* Start a new chunk with room for need bytes, reusing a spare if possible. */
+static arena_chunk_t *arena_grow(arena_t *arena, size_t need) {
+    arena_chunk_t *c;
+    size_t size;
+
+    while ((c = arena->spare)) {
+        arena->spare = c->prev;
+        if (c->size >= need) {
+            break;
+        }
+        free(c); /* too small for this request; don't keep it around */
+    }
+    if (!c) {
+        size = MAX(arena->chunk_size, need);
+        c = malloc(sizeof(*c) + size);
+        if (!c) {
+            return NULL;
+        }
+        c->size = size;
+    }
+    c->used = 0;
+    c->prev = arena->head;
+    if (!arena->head) {
+        arena->base = c;
+    }
+    arena->head = c;
+    return c;
+}
+
+void *arena_alloc_aligned(arena_t *arena, size_t size, size_t align) {
+    arena_chunk_t *c = arena->head;
+    size_t off;
+
+    if (!align || (align & (align - 1))) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!c || (off = align_offset(c, align)) > c->size ||
+        size > c->size - off) {
+        if (size > SIZE_MAX - align) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        if (!(c = arena_grow(arena, size + align))) {
+            return NULL;
+        }
+        off = align_offset(c, align);
+    }
+    c->used = off + size;
+    arena->last = c->data + off;
+    return arena->last;
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    return arena_alloc_aligned(arena, size, ARENA_ALIGN);
+}
+
+arena_mark_t arena_mark(arena_t *arena) {
+    arena_mark_t mark;
+
+    mark.chunk = arena->head;
+    mark.used = arena->head ? arena->head->used : 0;
+    return mark;
+}
+
+void arena_reset_to(arena_t *arena, arena_mark_t mark) {
+    arena_chunk_t *c;
+
+    while (arena->head && arena->head != mark.chunk) {
+        c = arena->head;
+        arena->head = c->prev;
+        c->prev = arena->spare;
+        arena->spare = c;
+    }
+    if (arena->head) {
+        arena->head->used = mark.used;
+    } else {
+        arena->base = NULL;
+    }
+    arena->last = NULL;
+}
+
+void arena_reset(arena_t *arena) {
+    if (arena->head) {
+        /* splice the whole chain onto the spare list */
+        arena->base->prev = arena->spare;
+        arena->spare = arena->head;
+        arena->head = arena->base = NULL;
+    }
+    arena->last = NULL;
+}
+
+static void *arena_iface_alloc(void *ctx, size_t size) {
+    return arena_alloc(ctx, size);
+}
+
+static void *arena_iface_realloc(void *ctx, void *ptr, size_t old_size,
+                                 size_t new_size) {
+    arena_t *arena = ctx;
+    arena_chunk_t *c = arena->head;
+    size_t off;
+    void *p;
+
+    if (ptr && ptr == arena->last) {
+        off = (unsigned char *)ptr - c->data;
+        if (new_size <= c->size - off) {
+            c->used = off + new_size; /* grow or shrink in place */
+            return ptr;
+        }
+    }
+    p = arena_alloc(arena, new_size);
+    if (p && ptr) {
+        memcpy(p, ptr, MIN(old_size, new_size));
+    }
+    return p;
+}
+
+static void arena_iface_free(void *ctx, void *ptr, size_t size) {
+    arena_t *arena = ctx;
+
+    (void)size;
+    if (ptr == arena->last) {
+        /* undo the most recent allocation */
+        arena->head->used = (unsigned char *)ptr - arena->head->data;
+        arena->last = NULL;
+    }
+}
+
+allocator_t *arena_allocator(arena_t *arena) {
+    arena->iface.alloc = arena_iface_alloc;
+    arena->iface.realloc = arena_iface_realloc;
+    arena->iface.free = arena_iface_free;
+    arena->iface.ctx = arena;
+    return &arena->iface;
+}
+
+/*********************************************************************
+ * Fixed-size object pool
+ *********************************************************************/
+
+#define POOL_TLS_SLOTS 8 /* pools one thread can cache for at once */
+
+struct PoolSlab {
+    pool_slab_t *next;
+    size_t pad; /* keep objects 16-byte aligned */
+    unsigned char objs[];
+};
+
+typedef struct PoolCache {
+    uint64_t id;  /* owning pool's id; 0 if unused */
+    pool_t *pool; /* the owner, if it is still live */
+    void *head;
+    size_t count;
+} pool_cache_t;
+
+static uint64_t next_pool_id = 1;
+static __thread pool_cache_t tls_caches[POOL_TLS_SLOTS];
+
+/*
+ * Thread-caching pools that have not been destroyed. A cache flush looks its
+ * pool up here, so objects of a destroyed pool are dropped, not written to.
+ */
+static pthread_mutex_t live_lock = PTHREAD_MUTEX_INITIALIZER;
+static pool_t *live_pools;
+
+/* flushes a thread's caches when it exits */
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cache_key;
+static bool have_cache_key;
+
+/* free objects are linked through their first word */
+#define NEXT_FREE(OBJ) (*(void **)(OBJ))
+
+int pool_init(pool_t *pool, size_t obj_size, size_t objs_per_slab,
+              bool thread_cache) {
+    if (!pool || !obj_size) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(pool, 0, sizeof(*pool));
+    pool->obj_size = ROUNDUP(MAX(obj_size, sizeof(void *)), sizeof(void *));
+    pool->objs_per_slab = objs_per_slab ? objs_per_slab : POOL_DEFAULT_SLAB;
+    pool->thread_cache = thread_cache;
+    pool->id = __atomic_fetch_add(&next_pool_id, 1, __ATOMIC_RELAXED);
+    if (pthread_mutex_init(&pool->lock, NULL)) {
+        return -1;
+    }
+    if (thread_cache) {
+        pthread_mutex_lock(&live_lock);
+        pool->next_live = live_pools;
+        live_pools = pool;
+        pthread_mutex_unlock(&live_lock);
+    }
+    return 0;
+}
+
+void pool_destroy(pool_t *pool) {
+    pool_slab_t *slab, *next;
+    pool_t **pp;
+
+    if (!pool) {
+        return;
+    }
+    if (pool->thread_cache) {
+        pthread_mutex_lock(&live_lock);
+        for (pp = &live_pools; *pp && *pp != pool; pp = &(*pp)->next_live) {
+        }
+        if (*pp) {
+            *pp = pool->next_live;
+        }
+        pthread_mutex_unlock(&live_lock);
+    }
+    for (slab = pool->slabs; slab; slab = next) {
+        next = slab->next;
+        free(slab);
+    }
+    pool->slabs = NULL;
+    pool->free_list = NULL;
+    pthread_mutex_destroy(&pool->lock);
+}
+
+/* Carve a new slab into the shared free list. Call with lock held. */
+static int pool_add_slab(pool_t *pool) {
+    pool_slab_t *slab;
+    unsigned char *obj;
+    size_t i;
+
+    slab = malloc(sizeof(*slab) + pool->objs_per_slab * pool->obj_size);
+    if (!slab) {
+        return -1;
+    }
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    for (i = pool->objs_per_slab; i > 0; i--) {
+        obj = slab->objs + (i - 1) * pool->obj_size;
+        NEXT_FREE(obj) = pool->free_list;
+        pool->free_list = obj;
+    }
+    return 0;
+}
+
+/* Detach up to max objects from the shared free list. Call with lock held. */
+static void *pool_take_batch(pool_t *pool, size_t max, size_t *taken) {
+    void *head = pool->free_list, *tail = head;
+    size_t n = 1;
+
+    if (!head) {
+        *taken = 0;
+        return NULL;
+    }
+    while (n < max && NEXT_FREE(tail)) {
+        tail = NEXT_FREE(tail);
+        n++;
+    }
+    pool->free_list = NEXT_FREE(tail);
+    NEXT_FREE(tail) = NULL;
+    *taken = n;
+    return head;
+}
+
+/* Hand a thread's cached objects back to their pool, if it is still live. */
+static void pool_cache_flush(pool_cache_t *c) {
+    pool_t *pool;
+    void *tail;
+
+    if (c->head) {
+        pthread_mutex_lock(&live_lock);
+        for (pool = live_pools; pool && (pool != c->pool || pool->id != c->id);
+             pool = pool->next_live) {
+        }
+        if (pool) {
+            for (tail = c->head; NEXT_FREE(tail); tail = NEXT_FREE(tail)) {
+            }
+            pthread_mutex_lock(&pool->lock);
+            NEXT_FREE(tail) = pool->free_list;
+            pool->free_list = c->head;
+            pthread_mutex_unlock(&pool->lock);
+        }
+        pthread_mutex_unlock(&live_lock);
+    }
+    memset(c, 0, sizeof(*c));
+}
+
+static void pool_thread_exit(void *arg) {
+    pool_cache_t *caches = arg;
+    size_t i;
+
+    for (i = 0; i < POOL_TLS_SLOTS; i++) {
+        pool_cache_flush(&caches[i]);
+    }
+}
+
+static void make_cache_key(void) {
+    have_cache_key = pthread_key_create(&cache_key, pool_thread_exit) == 0;
+}
+
+static pool_cache_t *pool_cache(pool_t *pool) {
+    pool_cache_t *c = &tls_caches[pool->id % POOL_TLS_SLOTS];
+
+    if (UNLIKELY(c->id != pool->id)) {
+        /* slot held by another pool: give its objects back first */
+        pool_cache_flush(c);
+        c->id = pool->id;
+        c->pool = pool;
+        pthread_once(&cache_key_once, make_cache_key);
+        if (have_cache_key) {
+            pthread_setspecific(cache_key, tls_caches);
+        }
+    }
+    return c;
+}
+
+void *pool_alloc(pool_t *pool) {
+    pool_cache_t *c;
+    void *obj;
+    size_t n;
+
+    if (!pool->thread_cache) {
+        pthread_mutex_lock(&pool->lock);
+        if (!pool->free_list && pool_add_slab(pool) == -1) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        obj = pool->free_list;
+        pool->free_list = NEXT_FREE(obj);
+        pthread_mutex_unlock(&pool->lock);
+        return obj;
+    }
+
+    c = pool_cache(pool);
+    if (UNLIKELY(!c->head)) {
+        pthread_mutex_lock(&pool->lock);
+        if (!pool->free_list && pool_add_slab(pool) == -1) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        c->head = pool_take_batch(pool, POOL_TLS_BATCH, &n);
+        c->count = n;
+        pthread_mutex_unlock(&pool->lock);
+    }
+    obj = c->head;
+    c->head = NEXT_FREE(obj);
+    c->count--;
+    return obj;
+}
+
+void pool_free(pool_t *pool, void *obj) {
+    pool_cache_t *c;
+    void *batch, *tail;
+    size_t i;
+
+    if (!obj) {
+        return;
+    }
+    if (!pool->thread_cache) {
+        pthread_mutex_lock(&pool->lock);
+        NEXT_FREE(obj) = pool->free_list;
+        pool->free_list = obj;
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+
+    c = pool_cache(pool);
+    NEXT_FREE(obj) = c->head;
+    c->head = obj;
+    if (UNLIKELY(++c->count >= 2 * POOL_TLS_BATCH)) {
+        /* hand a batch back so other threads can use it */
+        batch = tail = c->head;
+        for (i = 1; i < POOL_TLS_BATCH; i++) {
+            tail = NEXT_FREE(tail);
+        }
+        c->head = NEXT_FREE(tail);
+        c->count -= POOL_TLS_BATCH;
+        pthread_mutex_lock(&pool->lock);
+        NEXT_FREE(tail) = pool->free_list;
+        pool->free_list = batch;
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static void *pool_iface_alloc(void *ctx, size_t size) {
+    pool_t *pool = ctx;
+
+    if (size > pool->obj_size) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return pool_alloc(pool);
+}
+
+static void *pool_iface_realloc(void *ctx, void *ptr, size_t old_size,
+                                size_t new_size) {
+    pool_t *pool = ctx;
+
+    (void)old_size;
+    if (new_size > pool->obj_size) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return ptr ? ptr : pool_alloc(pool);
+}
+
+static void pool_iface_free(void *ctx, void *ptr, size_t size) {
+    (void)size;
+    pool_free(ctx, ptr);
+}
+
+allocator_t *pool_allocator(pool_t *pool) {
+    pool->iface.alloc = pool_iface_alloc;
+    pool->iface.realloc = pool_iface_realloc;
+    pool->iface.free = pool_iface_free;
+    pool->iface.ctx = pool;
+    return &pool->iface;
+}
@@ -0,0 +1,374 @@
+/**
+ * @brief Asynchronous logging backend: per-thread rings and a writev flusher
+ * @file asynclog.c
+ */
+
+#define _GNU_SOURCE
+
+#include "asynclog.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#include "utils.h"
+
+#define REC_HDR sizeof(uint32_t) /* length prefix of every record */
+#define REC_ALIGN 8
+#define REC_WRAP UINT32_MAX /* "skip to the start of the ring" marker */
+#define REC_SIZE(LEN) ROUNDUP(REC_HDR + (LEN), REC_ALIGN)
+#define MAX_IOV 1024
+
+/* Single-producer (the owning thread), single-consumer (the flusher) byte
+ * ring. head and tail only grow; the offset into buf is pos & mask. */
+typedef struct AlogRing {
+    struct AlogRing *next;
+    size_t mask;
+    int closed;       /* owning thread has exited */
+    uint64_t pending; /* flusher only: tail once the current batch is out */
+    uint64_t head ALIGNED(64);
+    uint64_t tail ALIGNED(64);
+    unsigned char buf[] ALIGNED(REC_ALIGN);
+} alog_ring_t;
+
+int alog_running;
+
+static alog_config_t config;
+static int out_fd = -1;
+static unsigned gen; /* bumped by every alog_start() */
+static bool stopping;
+static bool sleeping;
+static pthread_t flusher;
+static pthread_key_t ring_key;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; /* guards list */
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t flushed = PTHREAD_COND_INITIALIZER; /* passes moved */
+static alog_ring_t *rings;
+static alog_stats_t totals;
+static uint64_t passes; /* completed drain() passes */
+static int flush_waiters; /* threads in alog_flush(), changed under lock */
+
+static __thread alog_ring_t *tls_ring;
+static __thread unsigned tls_gen;
+
+void alog_config_init(alog_config_t *cfg) {
+    cfg->ring_size = ALOG_RING_SIZE;
+    cfg->policy = ALOG_DROP;
+    cfg->flush_ms = ALOG_FLUSH_MS;
+}
+
+static void ring_closed(void *arg) {
+    alog_ring_t *ring = arg;
+    __atomic_store_n(&ring->closed, 1, __ATOMIC_RELEASE);
+}
+
+static void wake_flusher(void) {
+    if (__atomic_load_n(&sleeping, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&lock);
+        pthread_cond_signal(&wake);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+static alog_ring_t *this_ring(void) {
+    alog_ring_t *ring = tls_ring;
+    unsigned g = __atomic_load_n(&gen, __ATOMIC_ACQUIRE);
+
+    if (LIKELY(ring && tls_gen == g)) {
+        return ring;
+    }
+    if (posix_memalign((void **)&ring, 64, sizeof(*ring) + config.ring_size)) {
+        return NULL;
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->mask = config.ring_size - 1;
+    pthread_mutex_lock(&lock);
+    ring->next = rings;
+    __atomic_store_n(&rings, ring, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&lock);
+    pthread_setspecific(ring_key, ring);
+    tls_ring = ring;
+    tls_gen = g;
+    return ring;
+}
+
+/* Copy one record into ring, or return -1 if there is no room. */
+static int ring_put(alog_ring_t *ring, const void *data, uint32_t len) {
+    size_t size = ring->mask + 1, rec = REC_SIZE(len);
+    uint64_t head = ring->head;
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    size_t off = head & ring->mask, contig = size - off;
+    uint32_t wrap = REC_WRAP;
+
+    if (rec > contig) {
+        /* record can't straddle the end: mark the rest unused and wrap */
+        if (head + contig + rec - tail > size) {
+            return -1;
+        }
+        memcpy(ring->buf + off, &wrap, REC_HDR);
+        head += contig;
+        off = 0;
+    } else if (head + rec - tail > size) {
+        return -1;
+    }
+    memcpy(ring->buf + off, &len, REC_HDR);
+    memcpy(ring->buf + off + REC_HDR, data, len);
+    __atomic_store_n(&ring->head, head + rec, __ATOMIC_RELEASE);
+    if ((head + rec - tail) * 2 > size) {
+        wake_flusher();
+    }
+    return 0;
+}
+
+int alog_write(const void *buf, size_t len) {
+    alog_ring_t *ring;
+
+    if (!alog_active() || !(ring = this_ring())) {
+        return fwrite(buf, 1, len, stderr) == len ? (int)len : -1;
+    }
+    if (len > ALOG_MAX_RECORD) {
+        len = ALOG_MAX_RECORD;
+    }
+    while (ring_put(ring, buf, len) == -1) {
+        if (config.policy == ALOG_DROP) {
+            __atomic_add_fetch(&totals.dropped, 1, __ATOMIC_RELAXED);
+            return -1;
+        }
+        wake_flusher();
+        sched_yield();
+    }
+    return len;
+}
+
+int alog_printf(const char *fmt, ...) {
+    char msg[ALOG_MAX_RECORD];
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    if (len < 0) {
+        return -1;
+    }
+    if ((size_t)len >= sizeof(msg)) {
+        len = sizeof(msg) - 1;
+        msg[len - 1] = '\n'; /* keep truncated lines terminated */
+    }
+    return alog_write(msg, len);
+}
+
+/* writev() every iovec, retrying after partial writes */
+static void writev_all(struct iovec *iov, int iovcnt) {
+    ssize_t n;
+
+    __atomic_add_fetch(&totals.writes, 1, __ATOMIC_RELAXED);
+    while (iovcnt > 0) {
+        NO_EINTR(n = writev(out_fd, iov, MIN(iovcnt, IOV_MAX)));
+        if (n == -1) {
+            return; /* nowhere to report it; drop the batch */
+        }
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+/* Release the space of every record written so far. */
+static void publish_tails(void) {
+    alog_ring_t *ring;
+
+    for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring;
+         ring = ring->next) {
+        __atomic_store_n(&ring->tail, ring->pending, __ATOMIC_RELEASE);
+    }
+}
+
+/* Write out everything queued in every ring. Returns the records written. */
+static size_t drain(void) {
+    struct iovec iov[MAX_IOV];
+    alog_ring_t *ring;
+    uint64_t head, pos;
+    size_t off, nrec = 0, nbytes = 0;
+    uint32_t len;
+    int n = 0;
+
+    for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring;
+         ring = ring->next) {
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        for (pos = ring->pending; pos < head;) {
+            off = pos & ring->mask;
+            memcpy(&len, ring->buf + off, REC_HDR);
+            if (len == REC_WRAP) {
+                pos += ring->mask + 1 - off;
+                continue;
+            }
+            iov[n].iov_base = ring->buf + off + REC_HDR;
+            iov[n].iov_len = len;
+            pos += REC_SIZE(len);
+            nrec++;
+            nbytes += len;
+            ring->pending = pos;
+            if (++n == MAX_IOV) {
+                writev_all(iov, n);
+                publish_tails();
+                n = 0;
+            }
+        }
+        ring->pending = pos;
+    }
+    if (n) {
+        writev_all(iov, n);
+    }
+    publish_tails();
+    __atomic_add_fetch(&totals.records, nrec, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&totals.bytes, nbytes, __ATOMIC_RELAXED);
+    /* a waiter counts itself in before it reads passes, so one of us sees
+     * the other */
+    __atomic_add_fetch(&passes, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&flush_waiters, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&lock);
+        pthread_cond_broadcast(&flushed);
+        pthread_mutex_unlock(&lock);
+    }
+    return nrec;
+}
+
+/* Free rings whose threads have exited and whose records are all out. */
+static void reap_rings(void) {
+    alog_ring_t **pp, *ring;
+
+    pthread_mutex_lock(&lock);
+    for (pp = &rings; (ring = *pp);) {
+        if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE) &&
+            ring->tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+            *pp = ring->next;
+            free(ring);
+        } else {
+            pp = &ring->next;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static void *flusher_main(void *arg) {
+    struct timespec ts;
+
+    (void)arg;
+    for (;;) {
+        if (drain()) {
+            continue;
+        }
+        reap_rings();
+        pthread_mutex_lock(&lock);
+        if (stopping) {
+            pthread_mutex_unlock(&lock);
+            break;
+        }
+        if (flush_waiters) {
+            pthread_mutex_unlock(&lock);
+            continue;
+        }
+        __atomic_store_n(&sleeping, true, __ATOMIC_RELEASE);
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += (long)config.flush_ms * 1000000;
+        ts.tv_sec += ts.tv_nsec / 1000000000;
+        ts.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&wake, &lock, &ts);
+        __atomic_store_n(&sleeping, false, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&lock);
+    }
+    drain(); /* anything queued while we were deciding to stop */
+    return NULL;
+}
+
+int alog_start(int fd, const alog_config_t *cfg) {
+    if (alog_active()) {
+        errno = EALREADY;
+        return -1;
+    }
+    if (cfg) {
+        config = *cfg;
+    } else {
+        alog_config_init(&config);
+    }
+    if (config.ring_size < 4 * REC_SIZE(ALOG_MAX_RECORD) ||
+        (config.ring_size & (config.ring_size - 1))) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (pthread_key_create(&ring_key, ring_closed)) {
+        return -1;
+    }
+    out_fd = fd;
+    stopping = false;
+    memset(&totals, 0, sizeof(totals));
+    __atomic_add_fetch(&gen, 1, __ATOMIC_RELEASE);
+    if ((errno = pthread_create(&flusher, NULL, flusher_main, NULL))) {
+        pthread_key_delete(ring_key);
+        return -1;
+    }
+    __atomic_store_n(&alog_running, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void alog_stop(void) {
+    alog_ring_t *ring, *next;
+
+    if (!alog_active()) {
+        return;
+    }
+    __atomic_store_n(&alog_running, 0, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    pthread_join(flusher, NULL);
+
+    /* destructors of threads still running must not touch freed rings */
+    pthread_key_delete(ring_key);
+    for (ring = rings; ring; ring = next) {
+        next = ring->next;
+        free(ring);
+    }
+    rings = NULL;
+}
+
+void alog_flush(void) {
+    uint64_t start = __atomic_load_n(&passes, __ATOMIC_ACQUIRE);
+
+    if (!alog_active()) {
+        fflush(stderr);
+        return;
+    }
+    /* the second pass to finish from now started after this call; the
+     * flusher doesn't sleep while anyone waits, and stops after alog_stop() */
+    pthread_mutex_lock(&lock);
+    __atomic_add_fetch(&flush_waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_cond_signal(&wake);
+    while (__atomic_load_n(&passes, __ATOMIC_SEQ_CST) < start + 2 &&
+           alog_active()) {
+        pthread_cond_wait(&flushed, &lock);
+    }
+    __atomic_sub_fetch(&flush_waiters, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&lock);
+}
+
+void alog_stats(alog_stats_t *stats) {
+    stats->records = __atomic_load_n(&totals.records, __ATOMIC_RELAXED);
+    stats->bytes = __atomic_load_n(&totals.bytes, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&totals.dropped, __ATOMIC_RELAXED);
+    stats->writes = __atomic_load_n(&totals.writes, __ATOMIC_RELAXED);
+}
@@ -3,6 +3,7 @@
 #include <stdint.h>
 #include <string.h>
 #include "dbg.h"
+#include "instrument.h"
 
 
 static const char b64e_std[] =
@@ -12,12 +13,19 @@ static const char b64e_url[] =
 #define INVALID (-1)
 
 char *b64encode(const char *in, const size_t inlen, const b64_encoding_t charset, size_t *outlen)
+{
+    return b64encode_with(in, inlen, charset, outlen, NULL);
+}
+
+
+char *b64encode_with(const char *in, const size_t inlen, const b64_encoding_t charset, size_t *outlen, allocator_t *alloc)
 {
     const char *end = in + inlen;
     char *out = NULL, *outp = NULL;
+    INST_SCOPE("b64encode");
 
     *outlen = ((inlen+2)/3)*4;  /* includes room for padding */
-    out = outp = calloc(1, *outlen + 1);
+    out = outp = al_calloc(alloc, 1, *outlen + 1);
     if (!out) {
         return NULL;
     }
@@ -62,12 +70,19 @@ char *b64encode(const char *in, const size_t inlen, const b64_encoding_t charset
 
 
 char *b64decode(const char *in, const size_t inlen, const b64_encoding_t charset, size_t *outlen)
+{
+    return b64decode_with(in, inlen, charset, outlen, NULL);
+}
+
+
+char *b64decode_with(const char *in, const size_t inlen, const b64_encoding_t charset, size_t *outlen, allocator_t *alloc)
 {
     const char *end = in + inlen;
     char *out = NULL, *outp = NULL;
+    INST_SCOPE("b64decode");
 
     *outlen = ((inlen+3)/4)*3;  /* Upper bound, corrected later */
-    out = outp = calloc(1, *outlen + 1);
+    out = outp = al_calloc(alloc, 1, *outlen + 1);
     if (!out) {
         return NULL;
     }
@@ -106,7 +121,7 @@ char *b64decode(const char *in, const size_t inlen, const b64_encoding_t charset
         padding = 4 - quadpos;
         if (padding == 3) {
             errno = EINVAL;
-            free(out);
+            al_free(alloc, out, ((inlen+3)/4)*3 + 1);
             *outlen = 0;
             return NULL;
         }
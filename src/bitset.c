@@ -0,0 +1,311 @@
+/**
+ * @brief Bitsets with popcnt/AVX2 counting and AVX2 bulk operations
+ * @file bitset.c
+ */
+
+#include "bitset.h"
+
+#include <errno.h>
+#include <string.h>
+#include "utils.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    define BS_HAVE_X86 1
+#    include <immintrin.h>
+#endif
+
+#define LINE_BYTES (BS_LINE_WORDS * sizeof(uint64_t))
+
+/*********************************************************************
+ * Kernels
+ *
+ * Word counts are always a multiple of BS_LINE_WORDS, so kernels process
+ * whole cache lines: two AVX2 vectors each.
+ *********************************************************************/
+
+enum { OP_AND, OP_OR, OP_ANDNOT };
+
+typedef size_t (*count_fn_t)(const uint64_t *w, size_t n);
+typedef void (*bulk_fn_t)(uint64_t *dst, const uint64_t *src, size_t n,
+                          int op);
+
+static inline __attribute__((always_inline)) uint64_t op_word(uint64_t a,
+                                                              uint64_t b,
+                                                              int op) {
+    switch (op) {
+    case OP_AND:
+        return a & b;
+    case OP_OR:
+        return a | b;
+    default:
+        return a & ~b;
+    }
+}
+
+/* the op is a constant in each caller, so each loop is branch-free */
+static inline __attribute__((always_inline)) void
+bulk_words(uint64_t *dst, const uint64_t *src, size_t n, int op) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = op_word(dst[i], src[i], op);
+    }
+}
+
+static size_t count_scalar(const uint64_t *w, size_t n) {
+    size_t i, c = 0;
+
+    for (i = 0; i < n; i++) {
+        c += __builtin_popcountll(w[i]);
+    }
+    return c;
+}
+
+static void bulk_scalar(uint64_t *dst, const uint64_t *src, size_t n, int op) {
+    switch (op) {
+    case OP_AND:
+        bulk_words(dst, src, n, OP_AND);
+        break;
+    case OP_OR:
+        bulk_words(dst, src, n, OP_OR);
+        break;
+    default:
+        bulk_words(dst, src, n, OP_ANDNOT);
+    }
+}
+
+#ifdef BS_HAVE_X86
+
+/* the same loop, but with the popcnt instruction instead of a libgcc call */
+__attribute__((target("popcnt"))) static size_t
+count_popcnt(const uint64_t *w, size_t n) {
+    size_t i, c = 0;
+
+    for (i = 0; i < n; i++) {
+        c += __builtin_popcountll(w[i]);
+    }
+    return c;
+}
+
+/* Mula's method: look up the count of each nibble with vpshufb, and sum the
+ * byte counts of a line into 64-bit lanes with vpsadbw */
+__attribute__((target("avx2"))) static size_t count_avx2(const uint64_t *w,
+                                                         size_t n) {
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3,
+                                         2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3,
+                                         1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i acc = _mm256_setzero_si256(), a, b, cnt;
+    uint64_t sums[4];
+    size_t i;
+
+    for (i = 0; i < n; i += BS_LINE_WORDS) {
+        a = _mm256_load_si256((const __m256i *)(w + i));
+        b = _mm256_load_si256((const __m256i *)(w + i + 4));
+        cnt = _mm256_add_epi8(
+            _mm256_add_epi8(
+                _mm256_shuffle_epi8(lut, _mm256_and_si256(a, low)),
+                _mm256_shuffle_epi8(
+                    lut, _mm256_and_si256(_mm256_srli_epi16(a, 4), low))),
+            _mm256_add_epi8(
+                _mm256_shuffle_epi8(lut, _mm256_and_si256(b, low)),
+                _mm256_shuffle_epi8(
+                    lut, _mm256_and_si256(_mm256_srli_epi16(b, 4), low))));
+        acc = _mm256_add_epi64(acc,
+                               _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+    }
+    _mm256_storeu_si256((__m256i *)sums, acc);
+    return (size_t)(sums[0] + sums[1] + sums[2] + sums[3]);
+}
+
+static inline __attribute__((always_inline, target("avx2"))) __m256i
+op_vec(__m256i a, __m256i b, int op) {
+    switch (op) {
+    case OP_AND:
+        return _mm256_and_si256(a, b);
+    case OP_OR:
+        return _mm256_or_si256(a, b);
+    default:
+        return _mm256_andnot_si256(b, a);
+    }
+}
+
+static inline __attribute__((always_inline, target("avx2"))) void
+bulk_lines_avx2(uint64_t *dst, const uint64_t *src, size_t n, int op) {
+    __m256i *d = (__m256i *)dst;
+    const __m256i *s = (const __m256i *)src;
+    size_t i;
+
+    for (i = 0; i < n / 4; i += 2) {
+        _mm256_store_si256(d + i, op_vec(_mm256_load_si256(d + i),
+                                         _mm256_load_si256(s + i), op));
+        _mm256_store_si256(d + i + 1, op_vec(_mm256_load_si256(d + i + 1),
+                                             _mm256_load_si256(s + i + 1), op));
+    }
+}
+
+__attribute__((target("avx2"))) static void
+bulk_avx2(uint64_t *dst, const uint64_t *src, size_t n, int op) {
+    switch (op) {
+    case OP_AND:
+        bulk_lines_avx2(dst, src, n, OP_AND);
+        break;
+    case OP_OR:
+        bulk_lines_avx2(dst, src, n, OP_OR);
+        break;
+    default:
+        bulk_lines_avx2(dst, src, n, OP_ANDNOT);
+    }
+}
+
+#endif /* BS_HAVE_X86 */
+
+typedef struct {
+    count_fn_t count;
+    bulk_fn_t bulk;
+} kernels_t;
+
+static const kernels_t *kernels_select(void) {
+    static const kernels_t scalar = {count_scalar, bulk_scalar};
+#ifdef BS_HAVE_X86
+    static const kernels_t popcnt = {count_popcnt, bulk_scalar};
+    static const kernels_t avx2 = {count_avx2, bulk_avx2};
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &avx2;
+    }
+    if (__builtin_cpu_supports("popcnt")) {
+        return &popcnt;
+    }
+#endif /* BS_HAVE_X86 */
+    return &scalar;
+}
+
+static const kernels_t *kernels(void) {
+    static const kernels_t *impl;
+    const kernels_t *k = __atomic_load_n(&impl, __ATOMIC_RELAXED);
+
+    if (UNLIKELY(!k)) {
+        k = kernels_select();
+        __atomic_store_n(&impl, k, __ATOMIC_RELAXED);
+    }
+    return k;
+}
+
+/*********************************************************************
+ * Bitsets
+ *********************************************************************/
+
+static size_t mem_size(const bitset_t *bs) {
+    return bs->nwords * sizeof(uint64_t) + LINE_BYTES - 1;
+}
+
+/* zero the bits past nbits in the last word, after setting whole words */
+static void trim(bitset_t *bs) {
+    size_t i = bs->nbits / BS_WORD_BITS;
+
+    if (i < bs->nwords) {
+        bs->words[i] &= bs_mask(bs->nbits) - 1;
+        memset(bs->words + i + 1, 0,
+               (bs->nwords - i - 1) * sizeof(uint64_t));
+    }
+}
+
+int bs_init(bitset_t *bs, size_t nbits, allocator_t *alloc) {
+    size_t line_bits = LINE_BYTES * 8;
+
+    if (!bs) {
+        errno = EINVAL;
+        return -1;
+    }
+    bs->nbits = nbits;
+    bs->nwords = MAX(nbits / line_bits + (nbits % line_bits != 0), 1) *
+                 BS_LINE_WORDS;
+    bs->alloc = alloc;
+    bs->mem = al_alloc(alloc, mem_size(bs));
+    if (!bs->mem) {
+        return -1;
+    }
+    bs->words =
+        (uint64_t *)(((uintptr_t)bs->mem + LINE_BYTES - 1) & -LINE_BYTES);
+    bs_clear_all(bs);
+    return 0;
+}
+
+void bs_destroy(bitset_t *bs) {
+    if (bs) {
+        al_free(bs->alloc, bs->mem, mem_size(bs));
+        bs->mem = bs->words = NULL;
+    }
+}
+
+void bs_clear_all(bitset_t *bs) {
+    memset(bs->words, 0, bs->nwords * sizeof(uint64_t));
+}
+
+void bs_set_all(bitset_t *bs) {
+    memset(bs->words, 0xff, bs->nwords * sizeof(uint64_t));
+    trim(bs);
+}
+
+size_t bs_count(const bitset_t *bs) {
+    return kernels()->count(bs->words, bs->nwords);
+}
+
+size_t bs_next_set(const bitset_t *bs, size_t from) {
+    size_t i = from / BS_WORD_BITS;
+    uint64_t w;
+
+    if (from >= bs->nbits) {
+        return BS_NONE;
+    }
+    /* bits past nbits are zero, so the scan can't find one of them */
+    w = bs->words[i] & ~(bs_mask(from) - 1);
+    while (!w) {
+        if (++i == bs->nwords) {
+            return BS_NONE;
+        }
+        w = bs->words[i];
+    }
+    return i * BS_WORD_BITS + __builtin_ctzll(w);
+}
+
+size_t bs_next_clear(const bitset_t *bs, size_t from) {
+    size_t i = from / BS_WORD_BITS, bit;
+    uint64_t w;
+
+    if (from >= bs->nbits) {
+        return BS_NONE;
+    }
+    w = ~bs->words[i] & ~(bs_mask(from) - 1);
+    while (!w) {
+        if (++i == bs->nwords) {
+            return BS_NONE;
+        }
+        w = ~bs->words[i];
+    }
+    bit = i * BS_WORD_BITS + __builtin_ctzll(w);
+    return bit < bs->nbits ? bit : BS_NONE;
+}
+
+static int bulk(bitset_t *dst, const bitset_t *src, int op) {
+    if (!dst || !src || dst->nbits != src->nbits) {
+        errno = EINVAL;
+        return -1;
+    }
+    kernels()->bulk(dst->words, src->words, dst->nwords, op);
+    return 0;
+}
+
+int bs_and(bitset_t *dst, const bitset_t *src) {
+    return bulk(dst, src, OP_AND);
+}
+
+int bs_or(bitset_t *dst, const bitset_t *src) {
+    return bulk(dst, src, OP_OR);
+}
+
+int bs_andnot(bitset_t *dst, const bitset_t *src) {
+    return bulk(dst, src, OP_ANDNOT);
+}
@@ -0,0 +1,343 @@
+/**
+ * @brief Blocked Bloom filters on cache-line blocks of a bitset
+ * @file bloom.c
+ */
+
+#include "bloom.h"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include "utils.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    define BLOOM_HAVE_X86 1
+#    include <immintrin.h>
+#endif
+
+#define BLOCK_WORDS BS_LINE_WORDS
+#define WORD_BITS BS_WORD_BITS
+
+/* bloom_init() grows a filter by 1/GROW_STEP at a time until it is accurate
+ * enough */
+#define GROW_STEP 32
+
+/* lookups ahead of the current one whose blocks bloom_contains_n()
+ * prefetches */
+#define PREFETCH_AHEAD 8
+
+/*********************************************************************
+ * Bit positions
+ *
+ * The high 32 bits of the hash pick the block (by multiply-shift, not
+ * modulo); the low 32 bits, multiplied by a different odd salt for each of
+ * the k bits, give each bit's position within its word (the top 6 bits of
+ * the product). Bit i goes in word i % 8, so for k <= 8 every bit is in a
+ * different word, and a lookup checks the whole block at once.
+ *********************************************************************/
+
+static const uint32_t salts[BLOOM_MAX_K] = {
+    0x47b6137b, 0x44974d91, 0x8824ad5b, 0xa2b7289d, 0x705495c7, 0x2df1424b,
+    0x9efc4947, 0x5c6bfb31, 0x9e3779b1, 0x85ebca6b, 0xc2b2ae35, 0x27d4eb2f,
+    0x165667b1, 0x7feb352d, 0x846ca68b, 0xcc9e2d51};
+
+static inline uint64_t *block_of(const bloom_t *bf, uint64_t hash) {
+    return bf->bits.words + ((hash >> 32) * bf->nblocks >> 32) * BLOCK_WORDS;
+}
+
+/*********************************************************************
+ * Block kernels
+ *
+ * Test or set the k bits of the key whose low hash bits are x in a block.
+ * The AVX2 kernels compute all eight word masks at once (a vpmulld by the
+ * salts, then a vpsllvq of 1 by each product's top 6 bits) and test them
+ * against the block's two vectors with vptest.
+ *
+ * Lookups may race with bloom_add_atomic(). The scalar kernel reads with
+ * relaxed atomic loads, which cost the same as plain ones; the AVX2 loads
+ * aren't atomic, but bits only ever go from 0 to 1, so a torn read can only
+ * miss a bit that a concurrent add is setting, which is a valid outcome of
+ * the race anyway.
+ *********************************************************************/
+
+typedef bool (*has_fn_t)(const uint64_t *block, unsigned k, uint32_t x);
+typedef bool (*set_fn_t)(uint64_t *block, unsigned k, uint32_t x);
+
+/* the bits of word w of a block that a key sets: bits w, w + 8, ... of
+ * its k (at most two) */
+static inline uint64_t word_mask(unsigned k, uint32_t x, unsigned w) {
+    uint64_t mask = 0;
+
+    for (; w < k; w += BLOCK_WORDS) {
+        mask |= (uint64_t)1 << ((x * salts[w]) >> 26);
+    }
+    return mask;
+}
+
+static bool has_scalar(const uint64_t *block, unsigned k, uint32_t x) {
+    uint64_t missing = 0;
+    unsigned w;
+
+    for (w = 0; w < BLOCK_WORDS; w++) {
+        missing |=
+            word_mask(k, x, w) & ~__atomic_load_n(&block[w], __ATOMIC_RELAXED);
+    }
+    return !missing;
+}
+
+static bool set_scalar(uint64_t *block, unsigned k, uint32_t x) {
+    uint64_t mask, missing = 0;
+    unsigned w;
+
+    for (w = 0; w < BLOCK_WORDS; w++) {
+        mask = word_mask(k, x, w);
+        missing |= mask & ~block[w];
+        block[w] |= mask;
+    }
+    return !missing;
+}
+
+#ifdef BLOOM_HAVE_X86
+
+/* shifts of 64 or more give 0, which masks out bits i >= k */
+static inline __attribute__((always_inline, target("avx2"))) void
+masks_avx2(unsigned k, uint32_t x, __m256i *lo, __m256i *hi) {
+    const __m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i kv = _mm256_set1_epi32(k), xv = _mm256_set1_epi32(x);
+    const __m256i one = _mm256_set1_epi64x(1), off = _mm256_set1_epi32(64);
+    __m256i sh, sh2;
+
+    sh = _mm256_srli_epi32(
+        _mm256_mullo_epi32(xv, _mm256_loadu_si256((const __m256i *)salts)),
+        26);
+    sh = _mm256_or_si256(sh, _mm256_andnot_si256(_mm256_cmpgt_epi32(kv, idx),
+                                                 off));
+    *lo = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(
+                                     _mm256_castsi256_si128(sh)));
+    *hi = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(
+                                     _mm256_extracti128_si256(sh, 1)));
+    if (k > BLOCK_WORDS) {
+        sh2 = _mm256_srli_epi32(
+            _mm256_mullo_epi32(
+                xv, _mm256_loadu_si256((const __m256i *)(salts + 8))),
+            26);
+        sh2 = _mm256_or_si256(
+            sh2, _mm256_andnot_si256(
+                     _mm256_cmpgt_epi32(
+                         kv, _mm256_add_epi32(idx, _mm256_set1_epi32(8))),
+                     off));
+        *lo = _mm256_or_si256(
+            *lo, _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(
+                                            _mm256_castsi256_si128(sh2))));
+        *hi = _mm256_or_si256(
+            *hi, _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(
+                                            _mm256_extracti128_si256(sh2, 1))));
+    }
+}
+
+__attribute__((target("avx2"))) static bool
+has_avx2(const uint64_t *block, unsigned k, uint32_t x) {
+    __m256i lo, hi;
+
+    masks_avx2(k, x, &lo, &hi);
+    return _mm256_testc_si256(_mm256_load_si256((const __m256i *)block), lo) &
+           _mm256_testc_si256(_mm256_load_si256((const __m256i *)(block + 4)),
+                              hi);
+}
+
+__attribute__((target("avx2"))) static bool set_avx2(uint64_t *block,
+                                                     unsigned k, uint32_t x) {
+    __m256i lo, hi, b0, b1;
+    bool had;
+
+    masks_avx2(k, x, &lo, &hi);
+    b0 = _mm256_load_si256((const __m256i *)block);
+    b1 = _mm256_load_si256((const __m256i *)(block + 4));
+    had = _mm256_testc_si256(b0, lo) & _mm256_testc_si256(b1, hi);
+    _mm256_store_si256((__m256i *)block, _mm256_or_si256(b0, lo));
+    _mm256_store_si256((__m256i *)(block + 4), _mm256_or_si256(b1, hi));
+    return had;
+}
+
+#endif /* BLOOM_HAVE_X86 */
+
+typedef struct {
+    has_fn_t has;
+    set_fn_t set;
+} kernels_t;
+
+static const kernels_t *kernels_select(void) {
+    static const kernels_t scalar = {has_scalar, set_scalar};
+#ifdef BLOOM_HAVE_X86
+    static const kernels_t avx2 = {has_avx2, set_avx2};
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &avx2;
+    }
+#endif /* BLOOM_HAVE_X86 */
+    return &scalar;
+}
+
+static const kernels_t *kernels(void) {
+    static const kernels_t *impl;
+    const kernels_t *k = __atomic_load_n(&impl, __ATOMIC_RELAXED);
+
+    if (UNLIKELY(!k)) {
+        k = kernels_select();
+        __atomic_store_n(&impl, k, __ATOMIC_RELAXED);
+    }
+    return k;
+}
+
+/*********************************************************************
+ * Sizing
+ *
+ * A block holding i other keys has bit j of word w set with probability
+ * 1 - (1 - 1/64)^(i * c_w), where c_w of the k bits of a key go in word w.
+ * A lookup is a false positive if all k of its bits are set, and block
+ * loads are Poisson-distributed with mean n / nblocks.
+ *********************************************************************/
+
+static double fp_rate_blocks(size_t nblocks, unsigned k, size_t n) {
+    double lambda = (double)n / nblocks, fp = 0, p, q, log_empty, spread;
+    size_t i, imin, imax;
+    unsigned w, c;
+
+    /* loads further than this from the mean have negligible probability */
+    spread = 12 * sqrt(lambda) + 30;
+    imin = lambda > spread ? (size_t)(lambda - spread) : 0;
+    imax = (size_t)(lambda + spread);
+    log_empty = log1p(-1.0 / WORD_BITS);
+    for (i = imin; i <= imax; i++) {
+        /* Poisson pmf in log space, as exp(-lambda) may underflow */
+        p = exp(-lambda + i * log(lambda) - lgamma(i + 1.0));
+        q = 1;
+        for (w = 0; w < BLOCK_WORDS && w < k; w++) {
+            c = k / BLOCK_WORDS + (w < k % BLOCK_WORDS);
+            q *= pow(1 - exp(log_empty * i * c), c);
+        }
+        fp += p * q;
+    }
+    return MIN(fp, 1.0);
+}
+
+double bloom_fp_rate(size_t nbits, unsigned k, size_t n) {
+    size_t nblocks = MAX((nbits + BLOOM_BLOCK_BITS - 1) / BLOOM_BLOCK_BITS, 1);
+
+    if (!k || k > BLOOM_MAX_K) {
+        return 1.0;
+    }
+    return n ? fp_rate_blocks(nblocks, k, n) : 0.0;
+}
+
+/*********************************************************************
+ * Filters
+ *********************************************************************/
+
+int bloom_init_size(bloom_t *bf, size_t nbits, unsigned k,
+                    allocator_t *alloc) {
+    size_t nblocks = MAX((nbits + BLOOM_BLOCK_BITS - 1) / BLOOM_BLOCK_BITS, 1);
+
+    if (!bf || !k || k > BLOOM_MAX_K) {
+        errno = EINVAL;
+        return -1;
+    }
+    /* the block index is the high half of a 32x32-bit product */
+    if (nblocks > UINT32_MAX) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (bs_init(&bf->bits, nblocks * BLOOM_BLOCK_BITS, alloc) == -1) {
+        return -1;
+    }
+    bf->nblocks = nblocks;
+    bf->k = k;
+    return 0;
+}
+
+int bloom_init(bloom_t *bf, size_t n, double fp_rate, allocator_t *alloc) {
+    double bits_per_key, fp, best_fp;
+    size_t nblocks;
+    unsigned k, best_k;
+
+    if (!n || !(fp_rate > 0 && fp_rate < 1)) {
+        errno = EINVAL;
+        return -1;
+    }
+    /* start from the size an unblocked filter needs, and grow */
+    bits_per_key = -log(fp_rate) / (log(2) * log(2));
+    nblocks = (size_t)(n * bits_per_key / BLOOM_BLOCK_BITS) + 1;
+    for (;;) {
+        best_k = 1;
+        best_fp = 1;
+        for (k = 1; k <= BLOOM_MAX_K; k++) {
+            fp = fp_rate_blocks(nblocks, k, n);
+            if (fp < best_fp) {
+                best_fp = fp;
+                best_k = k;
+            }
+        }
+        if (best_fp <= fp_rate || nblocks > UINT32_MAX) {
+            break;
+        }
+        nblocks += nblocks / GROW_STEP + 1;
+    }
+    return bloom_init_size(bf, nblocks * BLOOM_BLOCK_BITS, best_k, alloc);
+}
+
+void bloom_destroy(bloom_t *bf) {
+    if (bf) {
+        bs_destroy(&bf->bits);
+    }
+}
+
+void bloom_clear(bloom_t *bf) {
+    bs_clear_all(&bf->bits);
+}
+
+bool bloom_add(bloom_t *bf, uint64_t hash) {
+    return kernels()->set(block_of(bf, hash), bf->k, (uint32_t)hash);
+}
+
+bool bloom_add_atomic(bloom_t *bf, uint64_t hash) {
+    uint64_t *block = block_of(bf, hash), mask, missing = 0;
+    unsigned w;
+
+    /* a relaxed read first skips the locked OR for words already set */
+    for (w = 0; w < BLOCK_WORDS; w++) {
+        mask = word_mask(bf->k, (uint32_t)hash, w);
+        if (mask & ~__atomic_load_n(&block[w], __ATOMIC_RELAXED)) {
+            missing |= mask & ~__atomic_fetch_or(&block[w], mask,
+                                                 __ATOMIC_RELAXED);
+        }
+    }
+    return !missing;
+}
+
+bool bloom_contains(const bloom_t *bf, uint64_t hash) {
+    return kernels()->has(block_of(bf, hash), bf->k, (uint32_t)hash);
+}
+
+size_t bloom_contains_n(const bloom_t *bf, const uint64_t *hashes, size_t n,
+                        bool *found) {
+    has_fn_t has = kernels()->has;
+    size_t i, count = 0;
+
+    for (i = 0; i < n; i++) {
+        if (i + PREFETCH_AHEAD < n) {
+            __builtin_prefetch(block_of(bf, hashes[i + PREFETCH_AHEAD]));
+        }
+        found[i] = has(block_of(bf, hashes[i]), bf->k, (uint32_t)hashes[i]);
+        count += found[i];
+    }
+    return count;
+}
+
+int bloom_union(bloom_t *dst, const bloom_t *src) {
+    if (!dst || !src || dst->nblocks != src->nblocks || dst->k != src->k) {
+        errno = EINVAL;
+        return -1;
+    }
+    return bs_or(&dst->bits, &src->bits);
+}
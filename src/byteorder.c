@@ -0,0 +1,154 @@
+/**
+ * @brief Bulk byte swaps with SSSE3/AVX2 byte shuffles
+ * @file byteorder.c
+ */
+
+#include "byteorder.h"
+
+#include "utils.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    define BO_HAVE_X86 1
+#    include <immintrin.h>
+#endif
+
+/*********************************************************************
+ * Shuffle kernels
+ *
+ * Swapping every w-byte element of a vector is a single pshufb whose
+ * control picks source byte (i / w) * w + (w - 1 - i % w) for byte i.
+ * Elements never straddle a 16-byte lane, so the AVX2 form (which
+ * shuffles within each lane) uses the same control twice. Kernels swap
+ * whole vectors and return the number of bytes done; the caller swaps
+ * the remaining elements one at a time.
+ *********************************************************************/
+
+typedef size_t (*shuffle_fn_t)(uint8_t *dst, const uint8_t *src, size_t len,
+                               const uint8_t *ctl);
+
+static const uint8_t ctl16[32] = {1, 0, 3,  2,  5,  4,  7,  6,  9,  8,  11,
+                                  10, 13, 12, 15, 14, 1, 0, 3,  2,  5,  4,
+                                  7,  6,  9,  8,  11, 10, 13, 12, 15, 14};
+static const uint8_t ctl32[32] = {3,  2,  1,  0,  7,  6,  5,  4,  11, 10, 9,
+                                  8,  15, 14, 13, 12, 3,  2,  1,  0,  7,  6,
+                                  5,  4,  11, 10, 9,  8,  15, 14, 13, 12};
+static const uint8_t ctl64[32] = {7,  6,  5,  4,  3,  2,  1,  0,  15, 14, 13,
+                                  12, 11, 10, 9,  8,  7,  6,  5,  4,  3,  2,
+                                  1,  0,  15, 14, 13, 12, 11, 10, 9,  8};
+
+static size_t shuffle_scalar(uint8_t *dst, const uint8_t *src, size_t len,
+                             const uint8_t *ctl) {
+    (void)dst, (void)src, (void)len, (void)ctl;
+    return 0;
+}
+
+#ifdef BO_HAVE_X86
+
+__attribute__((target("ssse3"))) static size_t
+shuffle_ssse3(uint8_t *dst, const uint8_t *src, size_t len,
+              const uint8_t *ctl) {
+    const __m128i c = _mm_loadu_si128((const __m128i *)ctl);
+    __m128i a, b;
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        a = _mm_loadu_si128((const __m128i *)(src + i));
+        b = _mm_loadu_si128((const __m128i *)(src + i + 16));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(a, c));
+        _mm_storeu_si128((__m128i *)(dst + i + 16), _mm_shuffle_epi8(b, c));
+    }
+    if (i + 16 <= len) {
+        a = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(a, c));
+        i += 16;
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) static size_t
+shuffle_avx2(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t *ctl) {
+    const __m256i c = _mm256_loadu_si256((const __m256i *)ctl);
+    __m256i a, b;
+    size_t i = 0;
+
+    for (; i + 64 <= len; i += 64) {
+        a = _mm256_loadu_si256((const __m256i *)(src + i));
+        b = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(a, c));
+        _mm256_storeu_si256((__m256i *)(dst + i + 32),
+                            _mm256_shuffle_epi8(b, c));
+    }
+    if (i + 32 <= len) {
+        a = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(a, c));
+        i += 32;
+    }
+    if (i + 16 <= len) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+
+        _mm_storeu_si128((__m128i *)(dst + i),
+                         _mm_shuffle_epi8(x, _mm256_castsi256_si128(c)));
+        i += 16;
+    }
+    return i;
+}
+
+#endif /* BO_HAVE_X86 */
+
+static shuffle_fn_t shuffle_select(void) {
+#ifdef BO_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return shuffle_avx2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return shuffle_ssse3;
+    }
+#endif /* BO_HAVE_X86 */
+    return shuffle_scalar;
+}
+
+static size_t shuffle(void *dst, const void *src, size_t len,
+                      const uint8_t *ctl) {
+    static shuffle_fn_t impl;
+    shuffle_fn_t fn = __atomic_load_n(&impl, __ATOMIC_RELAXED);
+
+    if (UNLIKELY(!fn)) {
+        fn = shuffle_select();
+        __atomic_store_n(&impl, fn, __ATOMIC_RELAXED);
+    }
+    return fn(dst, src, len, ctl);
+}
+
+void bo_bswap16_n(void *dst, const void *src, size_t n) {
+    size_t i = shuffle(dst, src, n * sizeof(uint16_t), ctl16) / sizeof(uint16_t);
+    uint16_t x;
+
+    for (; i < n; i++) {
+        memcpy(&x, (const uint16_t *)src + i, sizeof(x));
+        x = bo_bswap16(x);
+        memcpy((uint16_t *)dst + i, &x, sizeof(x));
+    }
+}
+
+void bo_bswap32_n(void *dst, const void *src, size_t n) {
+    size_t i = shuffle(dst, src, n * sizeof(uint32_t), ctl32) / sizeof(uint32_t);
+    uint32_t x;
+
+    for (; i < n; i++) {
+        memcpy(&x, (const uint32_t *)src + i, sizeof(x));
+        x = bo_bswap32(x);
+        memcpy((uint32_t *)dst + i, &x, sizeof(x));
+    }
+}
+
+void bo_bswap64_n(void *dst, const void *src, size_t n) {
+    size_t i = shuffle(dst, src, n * sizeof(uint64_t), ctl64) / sizeof(uint64_t);
+    uint64_t x;
+
+    for (; i < n; i++) {
+        memcpy(&x, (const uint64_t *)src + i, sizeof(x));
+        x = bo_bswap64(x);
+        memcpy((uint64_t *)dst + i, &x, sizeof(x));
+    }
+}
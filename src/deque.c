@@ -8,13 +8,23 @@
 
 #include <assert.h>
 #include <errno.h>
+#include "instrument.h"
 
 /* Return a pointer to a new deque object. This pointer must be freed by the
  * caller. Before freeing the deque, be sure to pop all items off of the
  * deque
  * first. As a convenience, you can accomplish that with dq_destroy() */
 deque_t *dq_create(void) {
-    return calloc(1, sizeof(deque_t));
+    return dq_create_with(NULL);
+}
+
+/* Like dq_create(), but the deque and its nodes come from alloc */
+deque_t *dq_create_with(allocator_t *alloc) {
+    deque_t *dq = al_calloc(alloc, 1, sizeof(deque_t));
+    if (dq) {
+        dq->alloc = alloc;
+    }
+    return dq;
 }
 
 /* Empties the deque of nodes, optionally calling free_func on the node
@@ -32,7 +42,7 @@ void dq_destroy(deque_t *dq, freefunc_t free_func) {
             free_func(data);
         }
     }
-    free(dq);
+    al_free(dq->alloc, dq, sizeof(*dq));
 }
 
 /* return true if there are no items (nodes) in the deque */
@@ -56,12 +66,13 @@ node_t *dq_push(deque_t *dq, void *data) {
         return NULL;
     }
 
-    new = calloc(1, sizeof(*new));
+    new = al_calloc(dq->alloc, 1, sizeof(*new));
     if (!new) {
         errno = ENOMEM;
         return NULL;
     }
 
+    INST_COUNT("deque.nodes", 1);
     new->data = data;
     new->next = dq->head;
     if (dq->head) {
@@ -89,7 +100,7 @@ void *dq_pop(deque_t *dq) {
         tmp = dq->head;
         ret = tmp->data;
         dq->head = dq->head->next;
-        free(tmp);
+        al_free(dq->alloc, tmp, sizeof(*tmp));
         if (dq->head) {
             dq->head->prev = NULL;
         } else {
@@ -110,12 +121,13 @@ node_t *dq_append(deque_t *dq, void *data) {
         return NULL;
     }
 
-    new = calloc(1, sizeof(*new));
+    new = al_calloc(dq->alloc, 1, sizeof(*new));
     if (!new) {
         errno = ENOMEM;
         return NULL;
     }
 
+    INST_COUNT("deque.nodes", 1);
     new->data = data;
     new->prev = dq->tail;
     if (dq->tail)
@@ -142,7 +154,7 @@ void *dq_dequeue(deque_t *dq) {
         tmp = dq->tail;
         ret = tmp->data;
         dq->tail = dq->tail->prev;
-        free(tmp);
+        al_free(dq->alloc, tmp, sizeof(*tmp));
         if (dq->tail) {
             dq->tail->next = NULL;
         } else {
@@ -163,12 +175,13 @@ ssize_t dq_len(deque_t *dq) {
 
 
 /* Joins A and B. Returns pointer to A on success, NULL on failure, with
- * errno set to EINVAL (i.e. A or B is NULL). Items from B are appended to the
+ * errno set to EINVAL (i.e. A or B is NULL, or they use different
+ * allocators). Items from B are appended to the
  * end of A (in order). B will be empty after calling. Result after execution: A
  * -> A + B; B -> <empty>. NOTE: this is faster than manually popping and
  * appending. */
 deque_t *dq_join(deque_t *a, deque_t *b) {
-    if (!a || !b) {
+    if (!a || !b || a->alloc != b->alloc) {
         errno = EINVAL;
         return NULL;
     }
@@ -199,7 +212,7 @@ deque_t *dq_copy(deque_t *orig) {
         errno = EINVAL;
         return NULL;
     }
-    new = dq_create();
+    new = dq_create_with(orig->alloc);
     if (!new) {
         errno = ENOMEM;
         return NULL;
@@ -228,7 +241,7 @@ deque_t *dq_merge(deque_t *left, deque_t *right) {
         return NULL;
     }
 
-    result = dq_create();
+    result = dq_create_with(left->alloc);
     if (!result) {
         errno = ENOMEM;
         return NULL;
@@ -255,15 +268,15 @@ deque_t *dq_merge(deque_t *left, deque_t *right) {
 /* Returns a new list containing the elemints of orig, sorted in ascending order
  */
 deque_t *dq_sorted(deque_t *orig) {
-    deque_t *left, *right, *dq, *result;
+    deque_t *left, *right, *sorted_left, *sorted_right, *dq, *result;
     size_t split, i = 0;
 
     if (!orig)
         return NULL;
     if (orig->n_items < 2)
         return orig; /* base case: sorted by definition */
-    left = dq_create();
-    right = dq_create();
+    left = dq_create_with(orig->alloc);
+    right = dq_create_with(orig->alloc);
     dq = dq_copy(orig);
     if (!left || !right || !dq) {
         dq_destroy(left, NULL);
@@ -281,11 +294,16 @@ deque_t *dq_sorted(deque_t *orig) {
             dq_push(right, dq_pop(dq));
         i++;
     }
-    left = dq_sorted(left);
-    right = dq_sorted(right);
-    result = dq_merge(left, right);
-    dq_destroy(dq, NULL);    /* empty, so don't need free_func */
-    dq_destroy(left, NULL);  /* empty, so don't need free_func */
-    dq_destroy(right, NULL); /* empty, so don't need free_func */
+    sorted_left = dq_sorted(left);
+    sorted_right = dq_sorted(right);
+    result = dq_merge(sorted_left, sorted_right);
+    dq_destroy(dq, NULL); /* empty, so don't need free_func */
+    /* the sorted halves are new lists unless they had < 2 items */
+    if (sorted_left != left)
+        dq_destroy(sorted_left, NULL);
+    if (sorted_right != right)
+        dq_destroy(sorted_right, NULL);
+    dq_destroy(left, NULL);
+    dq_destroy(right, NULL);
     return result;
 }
@@ -0,0 +1,396 @@
+/**
+ * @brief Memory-mapped files, a buffered line reader and a batched writer
+ * @file fileio.c
+ */
+
+#define _GNU_SOURCE
+
+#include "fileio.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "utils.h"
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* most iovecs fio_writev() gathers into one pwritev() */
+#define FIO_MAX_IOV 64
+
+/*********************************************************************
+ * Memory maps
+ *********************************************************************/
+
+/* Map len bytes of fd at a huge page boundary: reserve enough address space
+ * to slide the mapping into alignment, map over it, and give back the
+ * unused ends. */
+static void *map_aligned(int fd, size_t len, int mflags) {
+    size_t page = sysconf(_SC_PAGESIZE), span = len + HUGE_PAGE_SIZE;
+    char *base, *p, *end;
+
+    base = mmap(NULL, span, PROT_NONE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+    p = (char *)ROUNDUP((uintptr_t)base, HUGE_PAGE_SIZE);
+    if (mmap(p, len, PROT_READ, mflags | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, span);
+        return MAP_FAILED;
+    }
+    end = p + ROUNDUP(len, page);
+    if (p > base) {
+        munmap(base, p - base);
+    }
+    if (base + span > end) {
+        munmap(end, base + span - end);
+    }
+    return p;
+}
+
+int fio_map_fd(file_map_t *m, int fd, int flags) {
+    int mflags = MAP_PRIVATE | (flags & FIO_POPULATE ? MAP_POPULATE : 0);
+    struct stat st;
+    void *p;
+
+    m->data = NULL;
+    m->len = 0;
+    if (fstat(fd, &st) == -1) {
+        return -1;
+    }
+    if (st.st_size == 0) {
+        return 0; /* mmap() rejects empty mappings */
+    }
+    if (flags & FIO_HUGEPAGES) {
+        p = map_aligned(fd, st.st_size, mflags);
+    } else {
+        p = mmap(NULL, st.st_size, PROT_READ, mflags, fd, 0);
+    }
+    if (p == MAP_FAILED) {
+        return -1;
+    }
+    /* hints are best effort: old kernels and some file systems refuse them */
+#ifdef MADV_HUGEPAGE
+    if (flags & FIO_HUGEPAGES) {
+        madvise(p, st.st_size, MADV_HUGEPAGE);
+    }
+#endif
+    if (flags & FIO_SEQUENTIAL) {
+        madvise(p, st.st_size, MADV_SEQUENTIAL);
+    }
+    if (flags & FIO_WILLNEED) {
+        madvise(p, st.st_size, MADV_WILLNEED);
+    }
+    m->data = p;
+    m->len = st.st_size;
+    return 0;
+}
+
+int fio_map(file_map_t *m, const char *path, int flags) {
+    int fd, rc, saved;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+        return -1;
+    }
+    rc = fio_map_fd(m, fd, flags);
+    saved = errno;
+    close(fd);
+    errno = saved;
+    return rc;
+}
+
+void fio_unmap(file_map_t *m) {
+    if (m->data) {
+        munmap((void *)m->data, m->len);
+    }
+    m->data = NULL;
+    m->len = 0;
+}
+
+/*********************************************************************
+ * Reader
+ *********************************************************************/
+
+int fio_reader_open(file_reader_t *r, const char *path, size_t cap) {
+    memset(r, 0, sizeof(*r));
+    r->cap = cap ? cap : FIO_BUFSZ;
+    if (!(r->buf = malloc(r->cap))) {
+        return -1;
+    }
+    if ((r->fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+        free(r->buf);
+        r->buf = NULL;
+        return -1;
+    }
+    posix_fadvise(r->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return 0;
+}
+
+void fio_reader_close(file_reader_t *r) {
+    if (!r || !r->buf) {
+        return;
+    }
+    close(r->fd);
+    free(r->buf);
+    r->buf = NULL;
+    r->cap = r->start = r->end = r->scanned = 0;
+}
+
+/**
+ * @brief Read more of the file into the buffer, first moving unconsumed
+ * bytes to the front, or doubling the buffer if they already fill it.
+ * @returns Bytes read, @c 0 at the end of the file, @c -1 on error.
+ */
+static ssize_t reader_fill(file_reader_t *r) {
+    size_t avail = r->end - r->start;
+    ssize_t nbytes;
+    char *buf;
+
+    if (avail == 0) {
+        r->start = r->end = 0;
+    } else if (r->end == r->cap && r->start > 0) {
+        memmove(r->buf, r->buf + r->start, avail);
+        r->start = 0;
+        r->end = avail;
+    } else if (r->end == r->cap) {
+        if (!(buf = realloc(r->buf, r->cap * 2))) {
+            return -1;
+        }
+        r->buf = buf;
+        r->cap *= 2;
+    }
+
+    NO_EINTR(nbytes = read(r->fd, r->buf + r->end, r->cap - r->end));
+    if (nbytes > 0) {
+        r->end += nbytes;
+    } else if (nbytes == 0) {
+        r->eof = true;
+    }
+    return nbytes;
+}
+
+ssize_t fio_next_line(file_reader_t *r, str_t *line) {
+    const char *start, *nl;
+    size_t len;
+
+    for (;;) {
+        start = r->buf + r->start;
+        nl = memchr(start + r->scanned, '\n', r->end - r->start - r->scanned);
+        if (nl) {
+            len = nl - start;
+            r->start += len + 1;
+            break;
+        }
+        r->scanned = r->end - r->start;
+        if (!r->eof && reader_fill(r) == -1) {
+            return -1;
+        }
+        if (r->eof) {
+            if (r->start == r->end) {
+                return FIO_EOF;
+            }
+            start = r->buf + r->start;
+            len = r->end - r->start;
+            r->start = r->end;
+            break;
+        }
+    }
+    r->scanned = 0;
+    *line = str_make(start, len);
+    return len;
+}
+
+ssize_t fio_read(file_reader_t *r, void *dst, size_t len) {
+    size_t avail = r->end - r->start;
+    ssize_t nbytes;
+
+    if (avail == 0 && len >= r->cap) {
+        NO_EINTR(nbytes = read(r->fd, dst, len));
+        return nbytes;
+    }
+    if (avail == 0) {
+        if ((nbytes = reader_fill(r)) <= 0) {
+            return nbytes;
+        }
+        avail = r->end - r->start;
+    }
+    len = MIN(len, avail);
+    memcpy(dst, r->buf + r->start, len);
+    r->start += len;
+    r->scanned = 0;
+    return len;
+}
+
+/*********************************************************************
+ * Writer
+ *********************************************************************/
+
+/**
+ * @brief pwritev() the whole iovec array at offset, resuming after partial
+ * writes.
+ * @note Modifies iov in place.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+static int pwritev_all(int fd, struct iovec *iov, int iovcnt, off_t offset) {
+    ssize_t nbytes;
+
+    while (iovcnt > 0) {
+        NO_EINTR(nbytes = pwritev(fd, iov, iovcnt, offset));
+        if (nbytes == -1) {
+            return -1;
+        }
+        offset += nbytes;
+        while (iovcnt > 0 && (size_t)nbytes >= iov->iov_len) {
+            nbytes -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + nbytes;
+            iov->iov_len -= nbytes;
+        }
+    }
+    return 0;
+}
+
+static int drop_direct(file_writer_t *w) {
+    int fl = fcntl(w->fd, F_GETFL);
+
+    if (fl == -1 || fcntl(w->fd, F_SETFL, fl & ~O_DIRECT) == -1) {
+        return -1;
+    }
+    w->direct = false;
+    return 0;
+}
+
+/**
+ * @brief Write the first len buffered bytes and drop them from the buffer.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+static int write_buffered(file_writer_t *w, size_t len) {
+    struct iovec iov = {w->buf, len};
+
+    if (pwritev_all(w->fd, &iov, 1, w->offset) == -1) {
+        /* some file systems accept O_DIRECT in open() but not in writes */
+        if (!w->direct || errno != EINVAL || drop_direct(w) == -1) {
+            return -1;
+        }
+        iov.iov_base = w->buf;
+        iov.iov_len = len;
+        if (pwritev_all(w->fd, &iov, 1, w->offset) == -1) {
+            return -1;
+        }
+    }
+    w->offset += len;
+    w->len -= len;
+    memmove(w->buf, w->buf + len, w->len);
+    return 0;
+}
+
+int fio_writer_open(file_writer_t *w, const char *path, int flags, size_t cap) {
+    int oflags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+    memset(w, 0, sizeof(*w));
+    w->cap = ROUNDUP(cap ? cap : FIO_BUFSZ, FIO_DIRECT_ALIGN);
+    if ((errno = posix_memalign((void **)&w->buf, FIO_DIRECT_ALIGN, w->cap))) {
+        w->buf = NULL;
+        return -1;
+    }
+    w->fd = -1;
+    if (flags & FIO_DIRECT) {
+        w->fd = open(path, oflags | O_DIRECT, 0666);
+        w->direct = w->fd != -1;
+    }
+    if (w->fd == -1 && (w->fd = open(path, oflags, 0666)) == -1) {
+        free(w->buf);
+        w->buf = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int fio_writev(file_writer_t *w, const struct iovec *iov, int iovcnt) {
+    struct iovec gather[FIO_MAX_IOV + 1];
+    size_t total = 0, n;
+    const char *p;
+    int i;
+
+    if (iovcnt > FIO_MAX_IOV) {
+        for (i = 0; i < iovcnt; i += FIO_MAX_IOV) {
+            if (fio_writev(w, iov + i, MIN(FIO_MAX_IOV, iovcnt - i)) == -1) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        total += iov[i].iov_len;
+    }
+
+    /* too much to buffer: send the buffer and the caller's data together */
+    if (!w->direct && w->len + total > w->cap) {
+        gather[0].iov_base = w->buf;
+        gather[0].iov_len = w->len;
+        memcpy(gather + 1, iov, iovcnt * sizeof(*iov));
+        if (pwritev_all(w->fd, gather, iovcnt + 1, w->offset) == -1) {
+            return -1;
+        }
+        w->offset += w->len + total;
+        w->len = 0;
+        return 0;
+    }
+
+    for (i = 0; i < iovcnt; i++) {
+        p = iov[i].iov_base;
+        for (total = iov[i].iov_len; total > 0; total -= n, p += n) {
+            n = MIN(w->cap - w->len, total);
+            memcpy(w->buf + w->len, p, n);
+            w->len += n;
+            if (w->len == w->cap && write_buffered(w, w->cap) == -1) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int fio_write(file_writer_t *w, const void *data, size_t len) {
+    struct iovec iov = {(void *)data, len};
+
+    return fio_writev(w, &iov, 1);
+}
+
+int fio_flush(file_writer_t *w) {
+    size_t len = w->direct ? ROUNDDOWN(w->len, FIO_DIRECT_ALIGN) : w->len;
+
+    return len ? write_buffered(w, len) : 0;
+}
+
+int fio_writer_close(file_writer_t *w) {
+    int rc = 0;
+
+    if (!w || !w->buf) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (fio_flush(w) == -1) {
+        rc = -1;
+    } else if (w->len && (drop_direct(w) == -1 ||
+                          write_buffered(w, w->len) == -1)) {
+        /* the tail is not a whole block, so it cannot go through O_DIRECT */
+        rc = -1;
+    }
+    if (close(w->fd) == -1) {
+        rc = -1;
+    }
+    free(w->buf);
+    w->buf = NULL;
+    w->fd = -1;
+    w->cap = w->len = 0;
+    w->direct = false;
+    return rc;
+}
@@ -0,0 +1,417 @@
+/**
+ * @brief Buffered message framing on top of stream sockets
+ * @file framing.c
+ */
+
+#define _GNU_SOURCE /* memmem() */
+
+#include "framing.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "byteorder.h"
+#include "serial.h"
+#include "utils.h"
+
+/* Compact the buffer when less than this fraction of it is free at the tail,
+ * so most recv() calls get a large contiguous region to fill. */
+#define COMPACT_DIVISOR 4
+
+/**
+ * @brief Move unconsumed bytes to the front of the buffer and receive more.
+ * @returns Bytes received, @c 0 if the peer closed the connection, @c -1 on
+ * error.
+ */
+static ssize_t fr_fill(frame_reader_t *fr) {
+    ssize_t nbytes;
+    size_t avail = fr->end - fr->start;
+
+    if (avail == 0) {
+        fr->start = fr->end = 0;
+    } else if (fr->start > 0 &&
+               fr->cap - fr->end < fr->cap / COMPACT_DIVISOR) {
+        memmove(fr->buf, fr->buf + fr->start, avail);
+        fr->start = 0;
+        fr->end = avail;
+    }
+    if (fr->end == fr->cap) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    NO_EINTR(nbytes = recv(fr->fd, fr->buf + fr->end, fr->cap - fr->end, 0));
+    if (nbytes > 0) {
+        fr->end += nbytes;
+    }
+    return nbytes;
+}
+
+/**
+ * @brief Map the result of fr_fill() onto the fr_next_*() return convention.
+ */
+static ssize_t fr_fill_failed(frame_reader_t *fr, ssize_t nbytes) {
+    if (nbytes == 0) {
+        if (fr->start == fr->end) {
+            return FRAME_EOF;
+        }
+        errno = ECONNRESET;
+    }
+    return -1;
+}
+
+static int frame_buf_init(char **buf, size_t *cap, bool *owns_buf,
+                          void *user_buf, size_t user_cap) {
+    if (!user_buf) {
+        user_cap = user_cap ? user_cap : FRAME_BUFSZ;
+        user_buf = malloc(user_cap);
+        if (!user_buf) {
+            return -1;
+        }
+        *owns_buf = true;
+    } else if (user_cap == 0) {
+        errno = EINVAL;
+        return -1;
+    } else {
+        *owns_buf = false;
+    }
+    *buf = user_buf;
+    *cap = user_cap;
+    return 0;
+}
+
+int fr_init(frame_reader_t *fr, int fd, void *buf, size_t cap) {
+    if (!fr) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(fr, 0, sizeof(*fr));
+    fr->fd = fd;
+    return frame_buf_init(&fr->buf, &fr->cap, &fr->owns_buf, buf, cap);
+}
+
+void fr_destroy(frame_reader_t *fr) {
+    if (!fr) {
+        return;
+    }
+    if (fr->owns_buf) {
+        free(fr->buf);
+    }
+    fr->buf = NULL;
+    fr->cap = fr->start = fr->end = fr->scanned = 0;
+}
+
+ssize_t fr_next_prefixed(frame_reader_t *fr, frame_prefix_t kind,
+                         const void **msg) {
+    const unsigned char *p;
+    uint64_t msglen;
+    size_t avail, hdrlen;
+    ssize_t nbytes;
+    int rv;
+
+    if (!fr || !msg) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (;;) {
+        p = (const unsigned char *)fr->buf + fr->start;
+        avail = fr->end - fr->start;
+        hdrlen = 0;
+
+        if (kind == FRAME_LEN32) {
+            if (avail >= sizeof(uint32_t)) {
+                msglen = bo_load_be32(p);
+                hdrlen = sizeof(uint32_t);
+            }
+        } else {
+            rv = varint_decode(p, avail, &msglen);
+            if (rv == -1) {
+                errno = EBADMSG;
+                return -1;
+            }
+            hdrlen = rv;
+        }
+
+        if (hdrlen) {
+            if (msglen > fr->cap - hdrlen) {
+                errno = EMSGSIZE;
+                return -1;
+            }
+            if (avail >= hdrlen + msglen) {
+                *msg = p + hdrlen;
+                fr->start += hdrlen + msglen;
+                fr->scanned = 0;
+                return msglen;
+            }
+            /* make room for the whole frame up front, so it can arrive in
+             * as few recv() calls as possible */
+            if (fr->cap - fr->start < hdrlen + msglen) {
+                memmove(fr->buf, p, avail);
+                fr->start = 0;
+                fr->end = avail;
+            }
+        }
+
+        if ((nbytes = fr_fill(fr)) <= 0) {
+            return fr_fill_failed(fr, nbytes);
+        }
+    }
+}
+
+ssize_t fr_next_delim(frame_reader_t *fr, const void *delim, size_t delim_len,
+                      const void **msg) {
+    char *p, *found;
+    size_t avail, from;
+    ssize_t nbytes, msglen;
+
+    if (!fr || !delim || !delim_len || !msg) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (;;) {
+        p = fr->buf + fr->start;
+        avail = fr->end - fr->start;
+
+        /* only search bytes not searched before, backing up far enough to
+         * catch a delimiter that straddled the previous end of data */
+        from = fr->scanned >= delim_len ? fr->scanned - (delim_len - 1) : 0;
+        found = memmem(p + from, avail - from, delim, delim_len);
+        if (found) {
+            msglen = found - p;
+            *msg = p;
+            fr->start += msglen + delim_len;
+            fr->scanned = 0;
+            return msglen;
+        }
+        fr->scanned = avail;
+
+        if ((nbytes = fr_fill(fr)) <= 0) {
+            return fr_fill_failed(fr, nbytes);
+        }
+    }
+}
+
+int fw_init(frame_writer_t *fw, int fd, void *buf, size_t cap) {
+    if (!fw) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(fw, 0, sizeof(*fw));
+    fw->fd = fd;
+    return frame_buf_init(&fw->buf, &fw->cap, &fw->owns_buf, buf, cap);
+}
+
+void fw_destroy(frame_writer_t *fw) {
+    if (!fw) {
+        return;
+    }
+    if (fw->owns_buf) {
+        free(fw->buf);
+    }
+    free(fw->pending);
+    fw->buf = fw->pending = NULL;
+    fw->cap = fw->len = fw->pending_len = fw->pending_off = 0;
+}
+
+/**
+ * @brief writev() the whole iovec array, resuming after partial writes.
+ * @note Advances *iov and *iovcnt past what was written, so on error they
+ * describe what is left.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+static int writev_all(int fd, struct iovec **iov, int *iovcnt) {
+    ssize_t nbytes;
+
+    while (*iovcnt > 0) {
+        NO_EINTR(nbytes = writev(fd, *iov, *iovcnt));
+        if (nbytes == -1) {
+            return -1;
+        }
+        while (*iovcnt > 0 && (size_t)nbytes >= (*iov)->iov_len) {
+            nbytes -= (*iov)->iov_len;
+            (*iov)++;
+            (*iovcnt)--;
+        }
+        if (*iovcnt > 0) {
+            (*iov)->iov_base = (char *)(*iov)->iov_base + nbytes;
+            (*iov)->iov_len -= nbytes;
+        }
+    }
+    return 0;
+}
+
+static size_t iov_bytes(const struct iovec *iov, int iovcnt) {
+    size_t n = 0;
+
+    while (iovcnt-- > 0) {
+        n += iov++->iov_len;
+    }
+    return n;
+}
+
+/**
+ * @brief Point iov[0] at the unsent rest of a partly written frame and iov[1]
+ * at the buffer, which goes out after it.
+ */
+static void fw_queued_iov(const frame_writer_t *fw, struct iovec *iov) {
+    iov[0].iov_base = fw->pending ? fw->pending + fw->pending_off : NULL;
+    iov[0].iov_len = fw->pending_len - fw->pending_off;
+    iov[1].iov_base = fw->buf;
+    iov[1].iov_len = fw->len;
+}
+
+/**
+ * @brief Drop the first sent bytes of what was queued, pending bytes first.
+ * @returns How many of the sent bytes were not queued ones.
+ */
+static size_t fw_consume(frame_writer_t *fw, size_t sent) {
+    size_t n = MIN(sent, fw->pending_len - fw->pending_off);
+
+    fw->pending_off += n;
+    sent -= n;
+    if (fw->pending && fw->pending_off == fw->pending_len) {
+        free(fw->pending);
+        fw->pending = NULL;
+        fw->pending_len = fw->pending_off = 0;
+    }
+    n = MIN(sent, fw->len);
+    fw->len -= n;
+    memmove(fw->buf, fw->buf + n, fw->len);
+    return sent - n;
+}
+
+int fw_flush(frame_writer_t *fw) {
+    struct iovec iov[2], *iovp = iov;
+    size_t before;
+    int iovcnt = ARRAYLEN(iov), rv;
+
+    if (!fw) {
+        errno = EINVAL;
+        return -1;
+    }
+    fw_queued_iov(fw, iov);
+    if ((before = iov_bytes(iov, iovcnt)) == 0) {
+        return 0;
+    }
+    rv = writev_all(fw->fd, &iovp, &iovcnt);
+    fw_consume(fw, before - iov_bytes(iovp, iovcnt));
+    return rv;
+}
+
+/**
+ * @brief Write a large frame from the caller's memory, behind whatever is
+ * already queued, in one syscall. iov[0] and iov[1] must be set by
+ * fw_queued_iov().
+ *
+ * If the write fails before any of the frame went out, the frame is not
+ * queued and the unsent queued bytes are kept. Once part of it is out, the
+ * rest must follow for the stream to stay whole: if the socket is only full,
+ * the rest is kept, in the buffer if it fits or else in a copy, to go out
+ * before anything queued later.
+ */
+static int fw_put_direct(frame_writer_t *fw, struct iovec *iov, int iovcnt) {
+    size_t before = iov_bytes(iov, iovcnt), rest;
+    char *dst = fw->buf;
+    int rv, i;
+
+    rv = writev_all(fw->fd, &iov, &iovcnt);
+    rest = iov_bytes(iov, iovcnt);
+    if (!fw_consume(fw, before - rest) || rv == 0) {
+        return rv;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        return -1;
+    }
+    /* everything queued went out before the frame did */
+    if (rest > fw->cap) {
+        if (!(dst = fw->pending = malloc(rest))) {
+            return -1;
+        }
+        fw->pending_len = rest;
+    } else {
+        fw->len = rest;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len) {
+            memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+            dst += iov[i].iov_len;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Queue head + msg + tail as a single frame.
+ */
+static int fw_put(frame_writer_t *fw, const void *head, size_t head_len,
+                  const void *msg, size_t len, const void *tail,
+                  size_t tail_len) {
+    struct iovec iov[5];
+    size_t total = head_len + len + tail_len;
+
+    if (total > fw->cap - fw->len) {
+        if (total > fw->cap / 2) {
+            fw_queued_iov(fw, iov);
+            iov[2].iov_base = (void *)head;
+            iov[2].iov_len = head_len;
+            iov[3].iov_base = (void *)msg;
+            iov[3].iov_len = len;
+            iov[4].iov_base = (void *)tail;
+            iov[4].iov_len = tail_len;
+            return fw_put_direct(fw, iov, ARRAYLEN(iov));
+        }
+        if (fw_flush(fw) == -1) {
+            return -1;
+        }
+    }
+
+    if (head_len) {
+        memcpy(fw->buf + fw->len, head, head_len);
+        fw->len += head_len;
+    }
+    if (len) {
+        memcpy(fw->buf + fw->len, msg, len);
+        fw->len += len;
+    }
+    if (tail_len) {
+        memcpy(fw->buf + fw->len, tail, tail_len);
+        fw->len += tail_len;
+    }
+    return 0;
+}
+
+int fw_write_prefixed(frame_writer_t *fw, frame_prefix_t kind,
+                      const void *msg, size_t len) {
+    unsigned char hdr[FRAME_VARINT_MAXLEN];
+    size_t hdrlen;
+
+    if (!fw || (!msg && len)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (kind == FRAME_LEN32) {
+        if (len > UINT32_MAX) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        bo_store_be32(hdr, (uint32_t)len);
+        hdrlen = sizeof(uint32_t);
+    } else {
+        hdrlen = varint_encode(len, hdr);
+    }
+    return fw_put(fw, hdr, hdrlen, msg, len, NULL, 0);
+}
+
+int fw_write_delim(frame_writer_t *fw, const void *msg, size_t len,
+                   const void *delim, size_t delim_len) {
+    if (!fw || (!msg && len) || !delim || !delim_len) {
+        errno = EINVAL;
+        return -1;
+    }
+    return fw_put(fw, NULL, 0, msg, len, delim, delim_len);
+}
@@ -0,0 +1,137 @@
+/**
+ * @brief Open-addressing hash map of void * keys and values
+ * @file hashmap.c
+ */
+
+#include "hashmap.h"
+
+#include <string.h>
+
+#define P0 0xa0761d6478bd642fULL
+#define P1 0xe7037ed1a0b428dbULL
+#define P2 0x8ebc6af09c88c6e3ULL
+
+/* multiply, then fold the high half of the product into the low half */
+static inline uint64_t mum(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+    uint64_t r = a * b;
+    return r ^ (r >> 29) ^ (a >> 32) * (b >> 32);
+#endif /* __SIZEOF_INT128__ */
+}
+
+static inline uint64_t load64(const uint8_t *p) {
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+uint64_t hm_hash_bytes(const void *data, size_t len) {
+    const uint8_t *p = data;
+    uint64_t h = P0 ^ mum(len ^ P1, P2);
+    uint8_t tail[16] = {0};
+    size_t n = len;
+
+    for (; n > 16; p += 16, n -= 16) {
+        h = mum(load64(p) ^ P1, load64(p + 8) ^ h);
+    }
+    memcpy(tail, p, n);
+    h = mum(load64(tail) ^ P1, load64(tail + 8) ^ h);
+    return mum(h ^ P2, len ^ P0);
+}
+
+uint64_t hm_hash_str(const void *s) {
+    return hm_hash_bytes(s, strlen(s));
+}
+
+bool hm_eq_str(const void *a, const void *b) {
+    return strcmp(a, b) == 0;
+}
+
+static bool eq_ptr(const void *a, const void *b) {
+    return a == b;
+}
+
+static inline uint64_t hm___hash(const hashmap_t *m, void *key) {
+    return m->hash(key);
+}
+
+static inline bool hm___eq(const hashmap_t *m, void *a, void *b) {
+    return a == b || m->eq(a, b);
+}
+
+HM_IMPL(hm_, hashmap_t, hm_entry_t, void *, void *, static)
+
+hashmap_t *hm_create(hm_hash_fn hash, hm_eq_fn eq) {
+    return hm_create_with(hash, eq, NULL);
+}
+
+hashmap_t *hm_create_with(hm_hash_fn hash, hm_eq_fn eq, allocator_t *alloc) {
+    hashmap_t *hm = al_calloc(alloc, 1, sizeof(*hm));
+
+    if (hm) {
+        hm->alloc = alloc;
+        hm->hash = hash ? hash : hm_hash_ptr;
+        hm->eq = eq ? eq : eq_ptr;
+    }
+    return hm;
+}
+
+void hm_destroy(hashmap_t *hm, void (*free_key)(void *),
+                void (*free_val)(void *)) {
+    hm_entry_t *e;
+    size_t iter = 0;
+
+    if (!hm) {
+        return;
+    }
+    while ((free_key || free_val) && (e = hm__next(hm, &iter))) {
+        if (free_key) {
+            free_key(e->key);
+        }
+        if (free_val) {
+            free_val(e->val);
+        }
+    }
+    hm__destroy(hm);
+    al_free(hm->alloc, hm, sizeof(*hm));
+}
+
+size_t hm_len(const hashmap_t *hm) {
+    return hm__len(hm);
+}
+
+int hm_reserve(hashmap_t *hm, size_t n) {
+    return hm__reserve(hm, n);
+}
+
+int hm_put(hashmap_t *hm, void *key, void *val) {
+    return hm__put(hm, key, val);
+}
+
+void *hm_get(hashmap_t *hm, const void *key) {
+    void **val = hm__find(hm, (void *)key);
+    return val ? *val : NULL;
+}
+
+void **hm_find(hashmap_t *hm, const void *key) {
+    return hm__find(hm, (void *)key);
+}
+
+void **hm_insert(hashmap_t *hm, void *key, bool *inserted) {
+    return hm__insert(hm, key, inserted);
+}
+
+int hm_erase(hashmap_t *hm, const void *key, void **old_key, void **old_val) {
+    return hm__erase(hm, (void *)key, old_key, old_val);
+}
+
+void hm_clear(hashmap_t *hm) {
+    hm__clear(hm);
+}
+
+hm_entry_t *hm_next(hashmap_t *hm, size_t *iter) {
+    return hm__next(hm, iter);
+}
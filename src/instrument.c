@@ -0,0 +1,446 @@
+/**
+ * @brief High-resolution timers, latency histograms and counters
+ * @file instrument.c
+ */
+
+#define _GNU_SOURCE
+
+#include "instrument.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct InstHist {
+    uint64_t count, sum, min, max; /* in ticks */
+    uint64_t buckets[INST_BUCKETS];
+} inst_hist_t;
+
+/* Everything one thread has recorded. Only the owning thread writes it;
+ * reporters read it concurrently, so every field is accessed atomically. */
+typedef struct InstThread {
+    struct InstThread *next;
+    inst_hist_t *hists[INST_MAX_REGIONS];
+    uint64_t counters[INST_MAX_COUNTERS];
+} inst_thread_t;
+
+int inst_on = 1;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *region_names[INST_MAX_REGIONS];
+static const char *counter_names[INST_MAX_COUNTERS];
+static int n_regions, n_counters;
+/* what exited threads recorded, always last on the threads list */
+static inst_thread_t retired;
+static inst_thread_t *threads = &retired; /* every live recording thread */
+static inst_thread_t *spare; /* exited threads' records, for reuse */
+static __thread inst_thread_t *tls_thread;
+
+static pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_key;
+static bool have_thread_key;
+
+static pthread_once_t calibrate_once = PTHREAD_ONCE_INIT;
+static double ns_per_tick = 1.0;
+
+/* owner-only increment that concurrent readers may observe */
+#define BUMP(X, N) __atomic_store_n(&(X), (X) + (N), __ATOMIC_RELAXED)
+#define LOAD(X) __atomic_load_n(&(X), __ATOMIC_RELAXED)
+
+uint64_t inst_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void calibrate(void) {
+    uint64_t t0, t1, c0, c1;
+
+    t0 = inst_now_ns();
+    c0 = inst_ticks();
+    while ((t1 = inst_now_ns()) - t0 < 10000000) {
+    }
+    c1 = inst_ticks();
+    if (c1 > c0) {
+        ns_per_tick = (double)(t1 - t0) / (c1 - c0);
+    }
+}
+
+double inst_ticks_to_ns(uint64_t ticks) {
+    pthread_once(&calibrate_once, calibrate);
+    return ticks * ns_per_tick;
+}
+
+void inst_enable(bool on) {
+    __atomic_store_n(&inst_on, on, __ATOMIC_RELAXED);
+}
+
+/* Look up or assign the id for site in names. Returns -1 if names is full. */
+static int site_id(inst_site_t *site, const char **names, int *n, int max) {
+    int id = __atomic_load_n(&site->id, __ATOMIC_ACQUIRE);
+
+    if (LIKELY(id)) {
+        return id > 0 ? id - 1 : -1;
+    }
+    pthread_mutex_lock(&lock);
+    for (id = 0; id < *n; id++) {
+        if (!strcmp(names[id], site->name)) {
+            break;
+        }
+    }
+    if (id == *n) {
+        if (*n == max) {
+            id = -2;
+        } else {
+            __atomic_store_n(&names[id], site->name, __ATOMIC_RELEASE);
+            __atomic_store_n(n, *n + 1, __ATOMIC_RELEASE);
+        }
+    }
+    __atomic_store_n(&site->id, id + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&lock);
+    return id < 0 ? -1 : id;
+}
+
+static void hist_clear(inst_hist_t *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+/*
+ * Fold an exiting thread's record into retired and keep it for the next new
+ * thread. If retired can't get a histogram for one of its regions the record
+ * stays listed as it is, so nothing is lost.
+ */
+static void thread_exit(void *arg) {
+    inst_thread_t *t = arg, **p;
+    inst_hist_t *h, *r;
+    size_t i, b;
+
+    tls_thread = NULL;
+    pthread_mutex_lock(&lock);
+    for (i = 0; i < INST_MAX_REGIONS; i++) {
+        if (t->hists[i] && !retired.hists[i]) {
+            if (!(r = malloc(sizeof(*r)))) {
+                pthread_mutex_unlock(&lock);
+                return;
+            }
+            hist_clear(r);
+            __atomic_store_n(&retired.hists[i], r, __ATOMIC_RELEASE);
+        }
+    }
+    for (i = 0; i < INST_MAX_REGIONS; i++) {
+        if (!(h = t->hists[i])) {
+            continue;
+        }
+        r = retired.hists[i];
+        BUMP(r->count, h->count);
+        BUMP(r->sum, h->sum);
+        if (h->min < r->min) {
+            __atomic_store_n(&r->min, h->min, __ATOMIC_RELAXED);
+        }
+        if (h->max > r->max) {
+            __atomic_store_n(&r->max, h->max, __ATOMIC_RELAXED);
+        }
+        for (b = 0; b < INST_BUCKETS; b++) {
+            if (h->buckets[b]) {
+                BUMP(r->buckets[b], h->buckets[b]);
+            }
+        }
+        hist_clear(h);
+    }
+    for (i = 0; i < INST_MAX_COUNTERS; i++) {
+        BUMP(retired.counters[i], t->counters[i]);
+        t->counters[i] = 0;
+    }
+    for (p = &threads; *p != t; p = &(*p)->next) {
+    }
+    *p = t->next;
+    t->next = spare;
+    spare = t;
+    pthread_mutex_unlock(&lock);
+}
+
+static void make_thread_key(void) {
+    have_thread_key = pthread_key_create(&thread_key, thread_exit) == 0;
+}
+
+static inst_thread_t *this_thread(void) {
+    inst_thread_t *t = tls_thread;
+
+    if (UNLIKELY(!t)) {
+        pthread_mutex_lock(&lock);
+        if ((t = spare)) {
+            spare = t->next;
+        } else if (!(t = calloc(1, sizeof(*t)))) {
+            pthread_mutex_unlock(&lock);
+            return NULL;
+        }
+        t->next = threads;
+        threads = t;
+        pthread_mutex_unlock(&lock);
+        tls_thread = t;
+        pthread_once(&thread_key_once, make_thread_key);
+        if (have_thread_key) {
+            pthread_setspecific(thread_key, t);
+        }
+    }
+    return t;
+}
+
+/* Log-linear bucket: values below INST_SUB_BUCKETS are exact, above that each
+ * power of two is split into INST_SUB_BUCKETS equal parts. */
+static inline size_t bucket_of(uint64_t v) {
+    int msb;
+
+    if (v < INST_SUB_BUCKETS) {
+        return v;
+    }
+    msb = 63 - __builtin_clzll(v);
+    return (size_t)(msb - INST_SUB_BITS + 1) * INST_SUB_BUCKETS +
+           ((v >> (msb - INST_SUB_BITS)) - INST_SUB_BUCKETS);
+}
+
+/* midpoint of the values that map to bucket i */
+static double bucket_value(size_t i) {
+    size_t group = i / INST_SUB_BUCKETS, sub = i % INST_SUB_BUCKETS;
+    double width;
+
+    if (group == 0) {
+        return i;
+    }
+    width = (double)(1ULL << (group - 1));
+    return (INST_SUB_BUCKETS + sub) * width + (width - 1) / 2;
+}
+
+void inst_record(inst_site_t *site, uint64_t ticks) {
+    int id = site_id(site, region_names, &n_regions, INST_MAX_REGIONS);
+    inst_thread_t *t;
+    inst_hist_t *h;
+
+    if (id < 0 || !(t = this_thread())) {
+        return;
+    }
+    h = t->hists[id];
+    if (UNLIKELY(!h)) {
+        if (!(h = malloc(sizeof(*h)))) {
+            return;
+        }
+        hist_clear(h);
+        __atomic_store_n(&t->hists[id], h, __ATOMIC_RELEASE);
+    }
+    BUMP(h->buckets[bucket_of(ticks)], 1);
+    BUMP(h->count, 1);
+    BUMP(h->sum, ticks);
+    if (ticks < h->min) {
+        __atomic_store_n(&h->min, ticks, __ATOMIC_RELAXED);
+    }
+    if (ticks > h->max) {
+        __atomic_store_n(&h->max, ticks, __ATOMIC_RELAXED);
+    }
+}
+
+void inst_count(inst_site_t *site, uint64_t n) {
+    int id = site_id(site, counter_names, &n_counters, INST_MAX_COUNTERS);
+    inst_thread_t *t;
+
+    if (id < 0 || !(t = this_thread())) {
+        return;
+    }
+    BUMP(t->counters[id], n);
+}
+
+static int find_name(const char **names, int n, const char *name) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (!strcmp(names[i], name)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Merge region id across threads into merged. Call with lock held. */
+static void merge_region(int id, inst_hist_t *merged) {
+    inst_thread_t *t;
+    inst_hist_t *h;
+    uint64_t v;
+    size_t i;
+
+    memset(merged, 0, sizeof(*merged));
+    merged->min = UINT64_MAX;
+    for (t = threads; t; t = t->next) {
+        if (!(h = __atomic_load_n(&t->hists[id], __ATOMIC_ACQUIRE))) {
+            continue;
+        }
+        merged->count += LOAD(h->count);
+        merged->sum += LOAD(h->sum);
+        merged->min = MIN(merged->min, LOAD(h->min));
+        merged->max = MAX(merged->max, LOAD(h->max));
+        for (i = 0; i < INST_BUCKETS; i++) {
+            if ((v = LOAD(h->buckets[i]))) {
+                merged->buckets[i] += v;
+            }
+        }
+    }
+}
+
+/* value (in ticks) below which a fraction q of the samples fall */
+static double percentile(const inst_hist_t *h, uint64_t total, double q) {
+    uint64_t target = (uint64_t)(q * total + 0.5), seen = 0;
+    size_t i;
+
+    if (target == 0) {
+        target = 1;
+    }
+    for (i = 0; i < INST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= target) {
+            /* buckets are approximate; never report outside [min, max] */
+            return MAX((double)h->min, MIN((double)h->max, bucket_value(i)));
+        }
+    }
+    return h->max;
+}
+
+static void fill_stats(const inst_hist_t *h, inst_stats_t *stats) {
+    /* sample counts may lag the buckets while threads are recording */
+    uint64_t total = 0;
+    size_t i;
+
+    for (i = 0; i < INST_BUCKETS; i++) {
+        total += h->buckets[i];
+    }
+    memset(stats, 0, sizeof(*stats));
+    stats->count = total;
+    if (!total) {
+        return;
+    }
+    stats->min = inst_ticks_to_ns(h->min);
+    stats->max = inst_ticks_to_ns(h->max);
+    stats->mean = inst_ticks_to_ns(h->sum) / total;
+    stats->p50 = percentile(h, total, 0.50) * ns_per_tick;
+    stats->p90 = percentile(h, total, 0.90) * ns_per_tick;
+    stats->p99 = percentile(h, total, 0.99) * ns_per_tick;
+    stats->p999 = percentile(h, total, 0.999) * ns_per_tick;
+}
+
+int inst_region_stats(const char *name, inst_stats_t *stats) {
+    inst_hist_t *merged;
+    int id;
+
+    if (!(merged = malloc(sizeof(*merged)))) {
+        return -1;
+    }
+    pthread_mutex_lock(&lock);
+    if ((id = find_name(region_names, n_regions, name)) != -1) {
+        merge_region(id, merged);
+    }
+    pthread_mutex_unlock(&lock);
+    if (id != -1) {
+        fill_stats(merged, stats);
+    }
+    free(merged);
+    return id == -1 ? -1 : 0;
+}
+
+/* Sum counter id across threads. Call with lock held. */
+static uint64_t sum_counter(int id) {
+    inst_thread_t *t;
+    uint64_t sum = 0;
+
+    for (t = threads; t; t = t->next) {
+        sum += LOAD(t->counters[id]);
+    }
+    return sum;
+}
+
+uint64_t inst_counter_value(const char *name) {
+    uint64_t sum = 0;
+    int id;
+
+    pthread_mutex_lock(&lock);
+    if ((id = find_name(counter_names, n_counters, name)) != -1) {
+        sum = sum_counter(id);
+    }
+    pthread_mutex_unlock(&lock);
+    return sum;
+}
+
+static void report(FILE *out, bool csv) {
+    inst_hist_t *merged = malloc(sizeof(*merged));
+    inst_stats_t s;
+    int i;
+
+    if (!merged) {
+        return;
+    }
+    if (csv) {
+        fprintf(out, "kind,name,count,min_ns,p50_ns,p90_ns,p99_ns,p999_ns,"
+                     "max_ns,mean_ns\n");
+    } else {
+        fprintf(out, "%-24s %10s %10s %10s %10s %10s %10s %10s %10s\n",
+                "region (ns)", "count", "min", "p50", "p90", "p99", "p999",
+                "max", "mean");
+    }
+    pthread_mutex_lock(&lock);
+    for (i = 0; i < n_regions; i++) {
+        merge_region(i, merged);
+        fill_stats(merged, &s);
+        if (csv) {
+            fprintf(out, "region,%s,%llu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+                    region_names[i], (unsigned long long)s.count, s.min, s.p50,
+                    s.p90, s.p99, s.p999, s.max, s.mean);
+        } else {
+            fprintf(out,
+                    "%-24s %10llu %10.0f %10.0f %10.0f %10.0f %10.0f %10.0f "
+                    "%10.0f\n",
+                    region_names[i], (unsigned long long)s.count, s.min, s.p50,
+                    s.p90, s.p99, s.p999, s.max, s.mean);
+        }
+    }
+    if (!csv && n_counters) {
+        fprintf(out, "%-24s %10s\n", "counter", "value");
+    }
+    for (i = 0; i < n_counters; i++) {
+        fprintf(out, csv ? "counter,%s,%llu,,,,,,,\n" : "%-24s %10llu\n",
+                counter_names[i], (unsigned long long)sum_counter(i));
+    }
+    pthread_mutex_unlock(&lock);
+    free(merged);
+}
+
+void inst_report(FILE *out) {
+    report(out, false);
+}
+
+void inst_dump_csv(FILE *out) {
+    report(out, true);
+}
+
+void inst_reset(void) {
+    inst_thread_t *t;
+    inst_hist_t *h;
+    size_t i, b;
+
+    pthread_mutex_lock(&lock);
+    for (t = threads; t; t = t->next) {
+        for (i = 0; i < INST_MAX_REGIONS; i++) {
+            if (!(h = __atomic_load_n(&t->hists[i], __ATOMIC_ACQUIRE))) {
+                continue;
+            }
+            __atomic_store_n(&h->count, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&h->sum, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&h->min, UINT64_MAX, __ATOMIC_RELAXED);
+            __atomic_store_n(&h->max, 0, __ATOMIC_RELAXED);
+            for (b = 0; b < INST_BUCKETS; b++) {
+                __atomic_store_n(&h->buckets[b], 0, __ATOMIC_RELAXED);
+            }
+        }
+        for (i = 0; i < INST_MAX_COUNTERS; i++) {
+            __atomic_store_n(&t->counters[i], 0, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
@@ -9,6 +9,8 @@
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <net/if.h>
 #include <netdb.h>
 #include <netinet/if_ether.h>
@@ -20,14 +22,18 @@
 #include <netinet/tcp_var.h>
 #include <netinet/udp.h>
 #include <netinet/udp_var.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
+#include "instrument.h"
 
 /**
  * @brief Get sockaddr, IPv4 or IPv6.
@@ -73,6 +79,7 @@ ssize_t sendall(int sockfd, void *buf, size_t *len) {
     size_t total = 0;
     size_t bytesleft = *len;
     ssize_t n;
+    INST_SCOPE("net.sendall");
 
     while (total < *len) {
         n = send(sockfd, (char *)buf + total, bytesleft, 0);
@@ -83,47 +90,171 @@ ssize_t sendall(int sockfd, void *buf, size_t *len) {
         bytesleft -= n;
     }
     *len = total;
+    INST_COUNT("net.bytes_sent", total);
     return n == -1 ? -1 : total;
 }
 
 /**
- * @brief Receives all data through sockfd until timeout or connection closes.
+ * @brief The deadline timeout_millis from now, or NET_NO_DEADLINE if < 0.
+ */
+uint64_t net_deadline(int timeout_millis) {
+    if (timeout_millis < 0) {
+        return NET_NO_DEADLINE;
+    }
+    return inst_now_ns() + (uint64_t)timeout_millis * 1000000;
+}
+
+/**
+ * @brief Set or clear O_NONBLOCK on fd.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+int set_nonblocking(int fd, bool val) {
+    int flags = fcntl(fd, F_GETFL);
+
+    if (-1 == flags) {
+        return -1;
+    }
+    flags = val ? flags | O_NONBLOCK : flags & ~O_NONBLOCK;
+    return fcntl(fd, F_SETFL, flags);
+}
+
+/* Wait until fd is ready for events or deadline passes (ETIMEDOUT). */
+static int wait_deadline(int fd, short events, uint64_t deadline) {
+    struct pollfd pfd;
+    uint64_t now, left;
+    int rv, millis;
+
+    pfd.fd = fd;
+    pfd.events = events;
+    do {
+        millis = -1;
+        if (deadline != NET_NO_DEADLINE) {
+            if ((now = inst_now_ns()) >= deadline) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            /* round up, so as not to wake just before the deadline */
+            left = (deadline - now + 999999) / 1000000;
+            millis = left < INT_MAX ? (int)left : INT_MAX;
+        }
+        /* errors and hangups show as ready: the next call reports them */
+        rv = poll(&pfd, 1, millis);
+    } while (rv == 0 || (rv == -1 && errno == EINTR));
+    return rv > 0 ? 0 : -1;
+}
+
+/**
+ * @brief Receive up to len bytes into buf, waiting until deadline for some.
+ * @returns Bytes received, @c 0 if the peer closed, @c -1 on error.
+ */
+ssize_t recv_deadline(int sockfd, void *buf, size_t len, uint64_t deadline) {
+    ssize_t n;
+
+    while (-1 == (n = recv(sockfd, buf, len, MSG_DONTWAIT))) {
+        if (errno == EINTR) {
+            continue;
+        }
+        if (!(errno == EWOULDBLOCK || errno == EAGAIN) ||
+            -1 == wait_deadline(sockfd, POLLIN, deadline)) {
+            return -1;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Receive *len bytes into buf by deadline.
+ * @returns Bytes received, @c -1 on error or timeout (with *len received).
+ */
+ssize_t recvall_deadline(int sockfd, void *buf, size_t *len,
+                         uint64_t deadline) {
+    size_t total = 0;
+    ssize_t n = 0;
+    INST_SCOPE("net.recvall_deadline");
+
+    while (total < *len &&
+           0 < (n = recv_deadline(sockfd, (char *)buf + total, *len - total,
+                                  deadline))) {
+        total += n;
+    }
+    *len = total;
+    INST_COUNT("net.bytes_received", total);
+    return n == -1 ? -1 : (ssize_t)total;
+}
+
+/**
+ * @brief Send the *len bytes in buf by deadline.
+ * @returns Bytes sent, @c -1 on error or timeout (with *len sent).
+ */
+ssize_t sendall_deadline(int sockfd, const void *buf, size_t *len,
+                         uint64_t deadline) {
+    size_t total = 0;
+    ssize_t n = 0;
+    INST_SCOPE("net.sendall_deadline");
+
+    while (total < *len) {
+        n = send(sockfd, (const char *)buf + total, *len - total,
+                 MSG_DONTWAIT);
+        if (n >= 0) {
+            total += n;
+        } else if (errno != EINTR &&
+                   (!(errno == EWOULDBLOCK || errno == EAGAIN) ||
+                    -1 == wait_deadline(sockfd, POLLOUT, deadline))) {
+            break;
+        }
+    }
+    *len = total;
+    INST_COUNT("net.bytes_sent", total);
+    return n == -1 ? -1 : (ssize_t)total;
+}
+
+/**
+ * @brief Receives all data through sockfd until the connection closes or
+ * timeout_millis have passed in all.
  * @returns Bytes received on success, -1 on error.
  */
 ssize_t recv_timeout(int sockfd, void **buf, size_t *len, int timeout_millis) {
-    size_t total = 0, allocated;
+    return recv_timeout_with(sockfd, buf, len, timeout_millis, NULL);
+}
+
+ssize_t recv_timeout_with(int sockfd, void **buf, size_t *len,
+                          int timeout_millis, allocator_t *alloc) {
+    size_t total = 0, allocated, bufsize;
+    uint64_t deadline = net_deadline(timeout_millis > 0 ? timeout_millis : -1);
     ssize_t nbytes;
     void *new;
+    INST_SCOPE("net.recv_timeout");
 
     if (!buf || !len) {
         errno = EINVAL;
         return -1;
     }
+    bufsize = *buf ? *len : 0;
     allocated = *len ? *len : RECVBUFSZ;
 
-    if (-1 == setsockopt_rcvtimeo(sockfd, timeout_millis)) {
-        return -1;
-    }
-
     do {
         if (total >= allocated - 1)
             allocated += RECVBUFSZ;
-        new = realloc(*buf, allocated);
-        if (!new) {
-            *len = total;
-            return -1;
+        if (allocated != bufsize) {
+            new = al_realloc(alloc, *buf, bufsize, allocated);
+            if (!new) {
+                *len = total;
+                return -1;
+            }
+            *buf = new;
+            bufsize = allocated;
         }
-        *buf = new;
-        if (-1 == (nbytes = recv(sockfd, (char *)*buf + total,
-                                 allocated - total - 1, 0))) {
+        if (-1 == (nbytes = recv_deadline(sockfd, (char *)*buf + total,
+                                          allocated - total - 1, deadline))) {
             break;
         }
         total += nbytes;
     } while (nbytes > 0);
     *((char *)(*buf) + total) = '\0';
     *len = total;
+    INST_COUNT("net.bytes_received", total);
 
-    if (nbytes == -1 && !(errno == EWOULDBLOCK || errno == EAGAIN)) {
+    if (nbytes == -1 && errno != ETIMEDOUT) {
         return -1;
     }
 
@@ -136,33 +267,44 @@ ssize_t recv_timeout(int sockfd, void **buf, size_t *len, int timeout_millis) {
  */
 ssize_t recv_delim(int sockfd, void **buf, size_t *len, void *delim,
                    size_t delim_len) {
-    size_t total = 0, allocated;
-    ssize_t nbytes;
+    return recv_delim_with(sockfd, buf, len, delim, delim_len, NULL);
+}
+
+ssize_t recv_delim_with(int sockfd, void **buf, size_t *len, void *delim,
+                        size_t delim_len, allocator_t *alloc) {
+    size_t total = 0, allocated, bufsize;
+    ssize_t nbytes = 0;
     void *new;
+    INST_SCOPE("net.recv_delim");
 
     if (!buf || !len) {
         errno = EINVAL;
         return -1;
     }
+    bufsize = *buf ? *len : 0;
     allocated = *len ? *len : RECVBUFSZ;
 
     while (!memmem(*buf, total, delim, delim_len)) {
         if (total >= allocated - 1)
             allocated += RECVBUFSZ;
-        new = realloc(*buf, allocated);
-        if (!new) {
-            *len = total;
-            return -1;
+        if (allocated != bufsize) {
+            new = al_realloc(alloc, *buf, bufsize, allocated);
+            if (!new) {
+                *len = total;
+                return -1;
+            }
+            *buf = new;
+            bufsize = allocated;
         }
-        *buf = new;
-        if (-1 == (nbytes = recv(sockfd, (char *)*buf + total,
-                                 allocated - total - 1, 0))) {
+        if (0 >= (nbytes = recv(sockfd, (char *)*buf + total,
+                                allocated - total - 1, 0))) {
             break;
         }
         total += nbytes;
     }
     *((char *)(*buf) + total) = '\0';
     *len = total;
+    INST_COUNT("net.bytes_received", total);
     return nbytes > 0 ? total : -1;
 }
 
@@ -172,24 +314,34 @@ ssize_t recv_delim(int sockfd, void **buf, size_t *len, void *delim,
  * than count if the socket is closed normally while receiving.
  */
 ssize_t recv_count(int sockfd, void **buf, size_t count) {
+    return recv_count_with(sockfd, buf, 0, count, NULL);
+}
+
+ssize_t recv_count_with(int sockfd, void **buf, size_t bufsize, size_t count,
+                        allocator_t *alloc) {
     size_t total = 0;
-    ssize_t nbytes;
+    ssize_t nbytes = 0;
     void *new = NULL;
+    INST_SCOPE("net.recv_count");
 
     if (!buf) {
         errno = EINVAL;
         return -1;
     }
-    new = calloc(1, count + 1);
-    if (!new) {
-        return -1;
+    if (!*buf || bufsize < count + 1) {
+        new = al_realloc(alloc, *buf, bufsize, count + 1);
+        if (!new) {
+            return -1;
+        }
+        *buf = new;
     }
 
-    while (0 <
-           (nbytes = recv(sockfd, (char *)*buf + total, count - total, 0))) {
+    while (total < count &&
+           0 < (nbytes = recv(sockfd, (char *)*buf + total, count - total, 0))) {
         total += nbytes;
     }
     *((char *)(*buf) + total) = '\0';
+    INST_COUNT("net.bytes_received", total);
     return nbytes == -1 ? -1 : total;
 }
 
@@ -383,6 +535,181 @@ int udp_server_bind(const char *port) {
     return sockfd;
 }
 
+static int unix_address(struct sockaddr_un *addr, const char *path) {
+    size_t len = path ? strlen(path) : 0;
+
+    if (!len || len >= sizeof(addr->sun_path)) {
+        errno = len ? ENAMETOOLONG : EINVAL;
+        return -1;
+    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    memcpy(addr->sun_path, path, len + 1);
+    return 0;
+}
+
+/*
+ * A server that exited leaves its socket file behind, failing bind(). Remove
+ * it only if a connect() to it is refused: if one goes through, a server is
+ * still listening there.
+ */
+static int unix_remove_stale(const struct sockaddr_un *addr, int type) {
+    struct stat st;
+    int probe, rv = 0;
+
+    if (-1 == lstat(addr->sun_path, &st) || !S_ISSOCK(st.st_mode)) {
+        return 0;
+    }
+    if (-1 == (probe = socket(AF_UNIX, type, 0))) {
+        return -1;
+    }
+    /* don't wait on a live server whose backlog is full */
+    set_nonblocking(probe, true);
+    if (0 == connect(probe, (const struct sockaddr *)addr, sizeof(*addr))) {
+        errno = EADDRINUSE;
+        rv = -1;
+    } else if (ECONNREFUSED == errno) {
+        unlink(addr->sun_path);
+    } /* else busy, or can't tell: bind() fails on it */
+    close(probe);
+    return rv;
+}
+
+/**
+ * @returns Socket descriptor listening on AF_UNIX path, @c -1 on error
+ */
+int unix_server_listen(const char *path, int type) {
+    struct sockaddr_un addr;
+    int sockfd;
+
+    if (-1 == unix_address(&addr, path) ||
+        -1 == unix_remove_stale(&addr, type)) {
+        return -1;
+    }
+    if (-1 == (sockfd = socket(AF_UNIX, type, 0))) {
+        return -1;
+    }
+    if (-1 == bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        -1 == listen(sockfd, SERVER_BACKLOG)) {
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+/**
+ * @returns Socket descriptor connected to AF_UNIX path, @c -1 on error
+ */
+int unix_client_connect(const char *path, int type) {
+    struct sockaddr_un addr;
+    int sockfd;
+
+    if (-1 == unix_address(&addr, path) ||
+        -1 == (sockfd = socket(AF_UNIX, type, 0))) {
+        return -1;
+    }
+    if (-1 == connect(sockfd, (struct sockaddr *)&addr, sizeof(addr))) {
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+/* room for a control message carrying NET_MAX_FDS descriptors */
+typedef union {
+    char buf[CMSG_SPACE(NET_MAX_FDS * sizeof(int))];
+    struct cmsghdr align;
+} fd_control_t;
+
+/**
+ * @brief Send len bytes of buf with nfds descriptors attached (SCM_RIGHTS).
+ * @returns Bytes sent, @c -1 on error
+ */
+ssize_t send_fds(int sockfd, const void *buf, size_t len, const int *fds,
+                 size_t nfds) {
+    struct cmsghdr *cmsg;
+    fd_control_t control;
+    struct msghdr msg;
+    struct iovec iov;
+
+    /* descriptors travel with data: a message of none would be lost */
+    if (!len || nfds > NET_MAX_FDS) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = (void *)buf;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (nfds) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+    }
+    return sendmsg(sockfd, &msg, 0);
+}
+
+/**
+ * @brief Receive up to len bytes into buf, and up to *nfds descriptors.
+ * @returns Bytes received, @c 0 if the peer closed, @c -1 on error
+ */
+ssize_t recv_fds(int sockfd, void *buf, size_t len, int *fds, size_t *nfds) {
+    size_t max = *nfds, i, n;
+    struct cmsghdr *cmsg;
+    fd_control_t control;
+    struct msghdr msg;
+    struct iovec iov;
+    bool truncated;
+    ssize_t nbytes;
+    int fd, flags = 0;
+
+#ifdef MSG_CMSG_CLOEXEC
+    flags |= MSG_CMSG_CLOEXEC;
+#endif
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    *nfds = 0;
+    if (-1 == (nbytes = recvmsg(sockfd, &msg, flags))) {
+        return -1;
+    }
+    truncated = msg.msg_flags & MSG_CTRUNC;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (i = 0; i < n; i++) {
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (*nfds < max) {
+                fds[(*nfds)++] = fd;
+            } else {
+                close(fd);
+                truncated = true;
+            }
+        }
+    }
+    if (truncated) {
+        for (i = 0; i < *nfds; i++) {
+            close(fds[i]);
+        }
+        *nfds = 0;
+        errno = EMSGSIZE;
+        return -1;
+    }
+    return nbytes;
+}
+
 /**
  * @brief Open a raw IPv4 socket
  * @returns Socket descriptor on success, @c -1 on error.
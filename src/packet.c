@@ -0,0 +1,470 @@
+/**
+ * @brief Zero-copy IPv4/IPv6/TCP/UDP header parsing and Internet checksums
+ * @file packet.c
+ */
+
+#include "packet.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include "utils.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    define PKT_HAVE_X86 1
+#    include <immintrin.h>
+#endif
+
+/* upper bound on IPv6 extension headers walked before giving up */
+#define MAX_IPV6_EXT_HDRS 8
+
+/* offsets of the checksum fields */
+#define IPV4_CSUM_OFF 10
+#define TCP_CSUM_OFF 16
+#define UDP_CSUM_OFF 6
+
+/*********************************************************************
+ * Checksum kernels
+ *
+ * Each kernel sums its buffer as native-endian 16-bit words into a 64-bit
+ * accumulator. Because the ones-complement sum is byte-order independent
+ * (RFC 1071, section 2), folding that sum and storing it natively gives the
+ * checksum in network byte order without swapping anything.
+ *********************************************************************/
+
+typedef uint64_t (*csum_fn_t)(const uint8_t *p, size_t len, uint64_t sum);
+
+static uint64_t csum_tail(const uint8_t *p, size_t len, uint64_t sum) {
+    uint16_t w;
+    uint8_t last[2];
+
+    while (len >= 2) {
+        memcpy(&w, p, sizeof(w));
+        sum += w;
+        p += 2;
+        len -= 2;
+    }
+    if (len) {
+        last[0] = *p;
+        last[1] = 0;
+        memcpy(&w, last, sizeof(w));
+        sum += w;
+    }
+    return sum;
+}
+
+static uint64_t csum_scalar(const uint8_t *p, size_t len, uint64_t sum) {
+    uint64_t w;
+
+    /* 32-bit halves of each 64-bit word: no carries are lost for any
+     * buffer smaller than 2^34 bytes */
+    while (len >= 8) {
+        memcpy(&w, p, sizeof(w));
+        sum += (w & 0xffffffff) + (w >> 32);
+        p += 8;
+        len -= 8;
+    }
+    return csum_tail(p, len, sum);
+}
+
+#ifdef PKT_HAVE_X86
+
+/* 32-bit lanes gain at most 2 * 0xffff per vector, so spill them into the
+ * 64-bit accumulator well before they could overflow */
+#    define SIMD_SPILL_VECTORS 16384
+
+static uint64_t csum_sse2(const uint8_t *p, size_t len, uint64_t sum) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc, acc64 = zero, v;
+    uint64_t lanes[2];
+    size_t n;
+
+    while (len >= 16) {
+        acc = zero;
+        for (n = 0; n < SIMD_SPILL_VECTORS && len >= 16; n++) {
+            v = _mm_loadu_si128((const __m128i *)p);
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+            p += 16;
+            len -= 16;
+        }
+        acc64 = _mm_add_epi64(acc64, _mm_unpacklo_epi32(acc, zero));
+        acc64 = _mm_add_epi64(acc64, _mm_unpackhi_epi32(acc, zero));
+    }
+    _mm_storeu_si128((__m128i *)lanes, acc64);
+    return csum_scalar(p, len, sum + lanes[0] + lanes[1]);
+}
+
+__attribute__((target("avx2"))) static uint64_t
+csum_avx2(const uint8_t *p, size_t len, uint64_t sum) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0, acc1, acc64 = zero, v0, v1;
+    uint64_t lanes[4];
+    size_t n;
+
+    while (len >= 64) {
+        acc0 = acc1 = zero;
+        for (n = 0; n < SIMD_SPILL_VECTORS && len >= 64; n++) {
+            v0 = _mm256_loadu_si256((const __m256i *)p);
+            v1 = _mm256_loadu_si256((const __m256i *)(p + 32));
+            acc0 = _mm256_add_epi32(acc0, _mm256_unpacklo_epi16(v0, zero));
+            acc1 = _mm256_add_epi32(acc1, _mm256_unpackhi_epi16(v0, zero));
+            acc0 = _mm256_add_epi32(acc0, _mm256_unpacklo_epi16(v1, zero));
+            acc1 = _mm256_add_epi32(acc1, _mm256_unpackhi_epi16(v1, zero));
+            p += 64;
+            len -= 64;
+        }
+        acc64 = _mm256_add_epi64(acc64, _mm256_unpacklo_epi32(acc0, zero));
+        acc64 = _mm256_add_epi64(acc64, _mm256_unpackhi_epi32(acc0, zero));
+        acc64 = _mm256_add_epi64(acc64, _mm256_unpacklo_epi32(acc1, zero));
+        acc64 = _mm256_add_epi64(acc64, _mm256_unpackhi_epi32(acc1, zero));
+    }
+    _mm256_storeu_si256((__m256i *)lanes, acc64);
+    return csum_sse2(p, len, sum + lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+}
+
+#endif /* PKT_HAVE_X86 */
+
+static csum_fn_t csum_select(void) {
+#ifdef PKT_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return csum_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return csum_sse2;
+    }
+#endif /* PKT_HAVE_X86 */
+    return csum_scalar;
+}
+
+/* short buffers (most headers) are not worth a vector setup */
+#define SIMD_MIN_LEN 64
+
+uint64_t pkt_csum_partial(const void *buf, size_t len, uint64_t sum) {
+    static csum_fn_t impl;
+    csum_fn_t fn;
+
+    if (len < SIMD_MIN_LEN) {
+        return csum_scalar(buf, len, sum);
+    }
+    fn = __atomic_load_n(&impl, __ATOMIC_RELAXED);
+    if (UNLIKELY(!fn)) {
+        fn = csum_select();
+        __atomic_store_n(&impl, fn, __ATOMIC_RELAXED);
+    }
+    return fn(buf, len, sum);
+}
+
+uint16_t pkt_csum_finish(uint64_t sum) {
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+uint16_t pkt_checksum(const void *buf, size_t len) {
+    return pkt_csum_finish(pkt_csum_partial(buf, len, 0));
+}
+
+uint16_t pkt_csum_adjust(uint16_t csum, const void *old_val,
+                         const void *new_val, size_t len) {
+    const uint8_t *o = old_val, *n = new_val;
+    uint64_t sum = (uint16_t)~csum;
+    uint16_t w;
+    size_t i;
+
+    /* RFC 1624, eqn. 3: HC' = ~(~HC + ~m + m') */
+    for (i = 0; i + 1 < len; i += 2) {
+        memcpy(&w, o + i, sizeof(w));
+        sum += (uint16_t)~w;
+        memcpy(&w, n + i, sizeof(w));
+        sum += w;
+    }
+    return pkt_csum_finish(sum);
+}
+
+/*********************************************************************
+ * Parsing
+ *********************************************************************/
+
+static int parse_l4(pkt_view_t *v, size_t off) {
+    const uint8_t *p = v->l3 + off;
+    size_t avail = v->len - off;
+    size_t hlen;
+
+    switch (v->proto) {
+        case IPPROTO_TCP:
+            if (avail < PKT_TCP_HLEN) {
+                goto bad;
+            }
+            hlen = (p[12] >> 4) * 4;
+            if (hlen < PKT_TCP_HLEN || hlen > avail) {
+                goto bad;
+            }
+            v->tcp_flags = p[13];
+            break;
+        case IPPROTO_UDP:
+            if (avail < PKT_UDP_HLEN) {
+                goto bad;
+            }
+            hlen = PKT_UDP_HLEN;
+            /* the UDP length may not exceed the IP payload; anything past it
+             * is padding */
+            if (pkt_get16(p + 4) < PKT_UDP_HLEN || pkt_get16(p + 4) > avail) {
+                goto bad;
+            }
+            avail = pkt_get16(p + 4);
+            break;
+        default:
+            v->payload = p;
+            v->payload_len = avail;
+            return 0;
+    }
+    v->l4 = p;
+    v->l4_len = hlen;
+    v->sport = pkt_get16(p);
+    v->dport = pkt_get16(p + 2);
+    v->payload = p + hlen;
+    v->payload_len = avail - hlen;
+    return 0;
+
+bad:
+    errno = EBADMSG;
+    return -1;
+}
+
+static int parse_ipv4(pkt_view_t *v, size_t len) {
+    const uint8_t *p = v->l3;
+    size_t hlen, total;
+    uint16_t frag;
+
+    if (len < PKT_IPV4_HLEN) {
+        goto bad;
+    }
+    hlen = (p[0] & 0x0f) * 4;
+    total = pkt_get16(p + 2);
+    if (hlen < PKT_IPV4_HLEN || total < hlen || total > len) {
+        goto bad;
+    }
+    frag = pkt_get16(p + 6);
+    v->len = total;
+    v->l3_len = hlen;
+    v->ttl = p[8];
+    v->proto = p[9];
+    v->src = p + 12;
+    v->dst = p + 16;
+    v->fragment = (frag & 0x3fff) != 0; /* MF flag or nonzero offset */
+
+    if (frag & 0x1fff) {
+        /* not the first fragment: no transport header */
+        v->payload = p + hlen;
+        v->payload_len = total - hlen;
+        return 0;
+    }
+    return parse_l4(v, hlen);
+
+bad:
+    errno = EBADMSG;
+    return -1;
+}
+
+static int parse_ipv6(pkt_view_t *v, size_t len) {
+    const uint8_t *p = v->l3;
+    size_t off = PKT_IPV6_HLEN, hlen;
+    uint8_t next;
+    int i;
+
+    if (len < PKT_IPV6_HLEN ||
+        PKT_IPV6_HLEN + (size_t)pkt_get16(p + 4) > len) {
+        goto bad;
+    }
+    v->len = PKT_IPV6_HLEN + pkt_get16(p + 4);
+    next = p[6];
+    v->ttl = p[7];
+    v->src = p + 8;
+    v->dst = p + 24;
+
+    for (i = 0; i < MAX_IPV6_EXT_HDRS; i++) {
+        switch (next) {
+            case IPPROTO_HOPOPTS:
+            case IPPROTO_ROUTING:
+            case IPPROTO_DSTOPTS:
+                if (off + 2 > v->len) {
+                    goto bad;
+                }
+                hlen = ((size_t)p[off + 1] + 1) * 8;
+                break;
+            case IPPROTO_AH:
+                if (off + 2 > v->len) {
+                    goto bad;
+                }
+                hlen = ((size_t)p[off + 1] + 2) * 4;
+                break;
+            case IPPROTO_FRAGMENT:
+                if (off + 8 > v->len) {
+                    goto bad;
+                }
+                hlen = 8;
+                v->fragment = true;
+                if (pkt_get16(p + off + 2) & 0xfff8) {
+                    /* not the first fragment: no transport header */
+                    v->proto = p[off];
+                    v->l3_len = off + hlen;
+                    v->payload = p + off + hlen;
+                    v->payload_len = v->len - off - hlen;
+                    return 0;
+                }
+                break;
+            default:
+                v->proto = next;
+                v->l3_len = off;
+                return parse_l4(v, off);
+        }
+        if (off + hlen > v->len) {
+            goto bad;
+        }
+        next = p[off];
+        off += hlen;
+    }
+
+bad:
+    errno = EBADMSG;
+    return -1;
+}
+
+int pkt_parse(pkt_view_t *v, const void *buf, size_t len) {
+    if (!v || !buf) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(v, 0, sizeof(*v));
+    if (len < 1) {
+        errno = EBADMSG;
+        return -1;
+    }
+    v->l3 = buf;
+    v->version = v->l3[0] >> 4;
+    if (v->version == 4) {
+        return parse_ipv4(v, len);
+    }
+    if (v->version == 6) {
+        return parse_ipv6(v, len);
+    }
+    errno = EPROTONOSUPPORT;
+    return -1;
+}
+
+int pkt_parse_eth(pkt_view_t *v, const void *frame, size_t len) {
+    const uint8_t *p = frame;
+    size_t off = 12; /* ethertype follows the two MAC addresses */
+    uint16_t type;
+    int rv, tags;
+
+    if (!v || !frame) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (tags = 0; tags <= 2; tags++) {
+        if (off + 2 > len) {
+            errno = EBADMSG;
+            return -1;
+        }
+        type = pkt_get16(p + off);
+        off += 2;
+        if (type != PKT_ETHERTYPE_VLAN && type != PKT_ETHERTYPE_QINQ) {
+            break;
+        }
+        off += 2; /* skip the tag control info */
+    }
+    if (type != PKT_ETHERTYPE_IPV4 && type != PKT_ETHERTYPE_IPV6) {
+        memset(v, 0, sizeof(*v));
+        errno = EPROTONOSUPPORT;
+        return -1;
+    }
+    rv = pkt_parse(v, p + off, len - off);
+    v->l2 = p;
+    return rv;
+}
+
+/*********************************************************************
+ * Validation and building
+ *********************************************************************/
+
+uint16_t pkt_l4_checksum(const pkt_view_t *v) {
+    uint8_t pseudo[PKT_IPV6_HLEN];
+    size_t seglen, plen;
+    uint64_t sum;
+
+    if (!v || !v->l4) {
+        return 0;
+    }
+    seglen = v->l4_len + v->payload_len;
+
+    if (v->version == 4) {
+        memcpy(pseudo, v->src, 4);
+        memcpy(pseudo + 4, v->dst, 4);
+        pseudo[8] = 0;
+        pseudo[9] = v->proto;
+        pseudo[10] = (uint8_t)(seglen >> 8);
+        pseudo[11] = (uint8_t)seglen;
+        plen = 12;
+    } else {
+        memcpy(pseudo, v->src, 16);
+        memcpy(pseudo + 16, v->dst, 16);
+        pseudo[32] = (uint8_t)(seglen >> 24);
+        pseudo[33] = (uint8_t)(seglen >> 16);
+        pseudo[34] = (uint8_t)(seglen >> 8);
+        pseudo[35] = (uint8_t)seglen;
+        memset(pseudo + 36, 0, 3);
+        pseudo[39] = v->proto;
+        plen = PKT_IPV6_HLEN;
+    }
+    sum = pkt_csum_partial(pseudo, plen, 0);
+    return pkt_csum_finish(pkt_csum_partial(v->l4, seglen, sum));
+}
+
+bool pkt_verify(const pkt_view_t *v) {
+    if (!v || !v->l3) {
+        return false;
+    }
+    if (v->version == 4 && pkt_checksum(v->l3, v->l3_len) != 0) {
+        return false;
+    }
+    if (!v->l4 || v->fragment) {
+        return true;
+    }
+    if (v->version == 4 && v->proto == IPPROTO_UDP &&
+        pkt_get16(v->l4 + UDP_CSUM_OFF) == 0) {
+        return true;
+    }
+    return pkt_l4_checksum(v) == 0;
+}
+
+int pkt_set_checksums(void *buf, size_t len) {
+    pkt_view_t v;
+    uint8_t *field;
+    uint16_t csum;
+
+    if (pkt_parse(&v, buf, len) == -1) {
+        return -1;
+    }
+    if (v.version == 4) {
+        field = (uint8_t *)buf + IPV4_CSUM_OFF;
+        memset(field, 0, sizeof(csum));
+        csum = pkt_checksum(buf, v.l3_len);
+        memcpy(field, &csum, sizeof(csum));
+    }
+    if (v.l4 && !v.fragment) {
+        field = (uint8_t *)v.l4 +
+                (v.proto == IPPROTO_TCP ? TCP_CSUM_OFF : UDP_CSUM_OFF);
+        memset(field, 0, sizeof(csum));
+        csum = pkt_l4_checksum(&v);
+        if (csum == 0 && v.proto == IPPROTO_UDP) {
+            csum = 0xffff; /* 0 means "no checksum" for UDP */
+        }
+        memcpy(field, &csum, sizeof(csum));
+    }
+    return 0;
+}
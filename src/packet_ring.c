@@ -0,0 +1,417 @@
+/**
+ * @brief Zero-copy packet capture and injection with AF_PACKET mmap rings
+ * @file packet_ring.c
+ */
+
+#define _GNU_SOURCE /* MAP_POPULATE */
+
+#include "packet_ring.h"
+
+#include <errno.h>
+#include <string.h>
+
+#ifdef __linux__
+
+#    include <arpa/inet.h>
+#    include <linux/if_ether.h>
+#    include <linux/if_packet.h>
+#    include <net/if.h>
+#    include <poll.h>
+#    include <sys/mman.h>
+#    include <sys/socket.h>
+#    include <unistd.h>
+#    include "utils.h"
+
+/* offset of packet data within a tx frame when PACKET_TX_HAS_OFF is unset */
+#    define TX_DATA_OFFSET (TPACKET_ALIGN(sizeof(struct tpacket2_hdr)))
+
+void pr_config_init(pr_config_t *cfg, const char *ifname) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->ifname = ifname;
+    cfg->block_size = PR_DEFAULT_BLOCK_SIZE;
+    cfg->block_count = PR_DEFAULT_BLOCK_COUNT;
+    cfg->frame_size = PR_DEFAULT_FRAME_SIZE;
+    cfg->retire_tov_ms = PR_DEFAULT_RETIRE_TOV;
+    cfg->fanout_mode = PACKET_FANOUT_HASH;
+}
+
+/**
+ * @brief Create the packet socket, set its TPACKET version, and validate the
+ * ring geometry shared by rx and tx.
+ * @returns Socket descriptor, @c -1 on error.
+ */
+static int ring_socket(pr_ring_t *ring, const pr_config_t *cfg, int protocol,
+                       int version) {
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    if (!cfg || !cfg->block_size || !cfg->block_count || !cfg->frame_size ||
+        cfg->block_size % cfg->frame_size ||
+        cfg->frame_size % TPACKET_ALIGNMENT) {
+        errno = EINVAL;
+        return -1;
+    }
+    ring->block_size = cfg->block_size;
+    ring->block_count = cfg->block_count;
+    ring->frame_size = cfg->frame_size;
+    ring->frame_count = cfg->block_size / cfg->frame_size * cfg->block_count;
+    ring->map_len = (size_t)cfg->block_size * cfg->block_count;
+
+    ring->fd = socket(AF_PACKET, SOCK_RAW, protocol);
+    if (ring->fd == -1) {
+        return -1;
+    }
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_VERSION, &version,
+                   sizeof(version)) == -1) {
+        return -1;
+    }
+    return ring->fd;
+}
+
+/**
+ * @brief Map the ring set up with PACKET_RX_RING/PACKET_TX_RING and bind the
+ * socket to cfg->ifname.
+ * @returns @c 0 on success, @c -1 on error.
+ */
+static int ring_map_bind(pr_ring_t *ring, const pr_config_t *cfg,
+                         uint16_t protocol) {
+    struct sockaddr_ll sll;
+    void *map;
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = protocol;
+    if (cfg->ifname) {
+        sll.sll_ifindex = if_nametoindex(cfg->ifname);
+        if (!sll.sll_ifindex) {
+            errno = ENODEV;
+            return -1;
+        }
+    }
+
+    map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ring->fd, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    ring->map = map;
+
+    return bind(ring->fd, (struct sockaddr *)&sll, sizeof(sll));
+}
+
+int pr_rx_open(pr_ring_t *ring, const pr_config_t *cfg) {
+    struct tpacket_req3 req;
+    int optval;
+
+    if (!ring) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (ring_socket(ring, cfg, htons(ETH_P_ALL), TPACKET_V3) == -1) {
+        goto error;
+    }
+
+#    ifdef PACKET_IGNORE_OUTGOING
+    optval = 1;
+    if (cfg->ignore_outgoing &&
+        setsockopt(ring->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &optval,
+                   sizeof(optval)) == -1) {
+        goto error;
+    }
+#    endif /* PACKET_IGNORE_OUTGOING */
+
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = ring->block_size;
+    req.tp_block_nr = ring->block_count;
+    req.tp_frame_size = ring->frame_size;
+    req.tp_frame_nr = ring->frame_count;
+    req.tp_retire_blk_tov = cfg->retire_tov_ms;
+    req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) ==
+        -1) {
+        goto error;
+    }
+
+    if (ring_map_bind(ring, cfg, htons(ETH_P_ALL)) == -1) {
+        goto error;
+    }
+
+    /* fanout must be configured after bind() */
+    if (cfg->fanout_group) {
+        optval = cfg->fanout_group | ((int)cfg->fanout_mode << 16);
+        if (setsockopt(ring->fd, SOL_PACKET, PACKET_FANOUT, &optval,
+                       sizeof(optval)) == -1) {
+            goto error;
+        }
+    }
+    return 0;
+
+error:
+    pr_close(ring);
+    return -1;
+}
+
+static inline struct tpacket_block_desc *rx_block(pr_ring_t *ring,
+                                                  unsigned int idx) {
+    return (struct tpacket_block_desc *)(ring->map +
+                                         (size_t)idx * ring->block_size);
+}
+
+int pr_rx_next(pr_ring_t *ring, pr_packet_t *pkt, int timeout_ms) {
+    struct tpacket_block_desc *bd;
+    struct tpacket3_hdr *hdr;
+    struct sockaddr_ll *sll;
+    struct pollfd pfd;
+    int rv;
+
+    if (!ring || !ring->map || !pkt) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (;;) {
+        if (ring->pkts_left) {
+            hdr = ring->pkt;
+            sll = (struct sockaddr_ll *)((uint8_t *)hdr +
+                                         TPACKET_ALIGN(sizeof(*hdr)));
+            pkt->data = (uint8_t *)hdr + hdr->tp_mac;
+            pkt->caplen = hdr->tp_snaplen;
+            pkt->len = hdr->tp_len;
+            pkt->sec = hdr->tp_sec;
+            pkt->nsec = hdr->tp_nsec;
+            pkt->rxhash = hdr->hv1.tp_rxhash;
+            pkt->ifindex = sll->sll_ifindex;
+            pkt->pkttype = sll->sll_pkttype;
+            ring->pkt = (uint8_t *)hdr + hdr->tp_next_offset;
+            ring->pkts_left--;
+            return 1;
+        }
+
+        bd = rx_block(ring, ring->cur);
+        if (ring->pkt) {
+            /* every packet in this block was handed out: give it back */
+            __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                             __ATOMIC_RELEASE);
+            ring->pkt = NULL;
+            ring->cur = (ring->cur + 1) % ring->block_count;
+            bd = rx_block(ring, ring->cur);
+        }
+
+        if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+              TP_STATUS_USER)) {
+            pfd.fd = ring->fd;
+            pfd.events = POLLIN | POLLERR;
+            pfd.revents = 0;
+            NO_EINTR(rv = poll(&pfd, 1, timeout_ms));
+            if (rv <= 0) {
+                return rv;
+            }
+            continue;
+        }
+
+        ring->pkt = (uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt;
+        ring->pkts_left = bd->hdr.bh1.num_pkts;
+    }
+}
+
+int pr_rx_stats(pr_ring_t *ring, uint64_t *packets, uint64_t *drops) {
+    struct tpacket_stats_v3 st;
+    socklen_t len = sizeof(st);
+
+    if (!ring) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (getsockopt(ring->fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) ==
+        -1) {
+        return -1;
+    }
+    if (packets) {
+        *packets = st.tp_packets;
+    }
+    if (drops) {
+        *drops = st.tp_drops;
+    }
+    return 0;
+}
+
+int pr_tx_open(pr_ring_t *ring, const pr_config_t *cfg) {
+    struct tpacket_req req;
+    int optval;
+
+    if (!ring || !cfg || !cfg->ifname) {
+        errno = EINVAL;
+        return -1;
+    }
+    /* protocol 0: this socket never receives */
+    if (ring_socket(ring, cfg, 0, TPACKET_V2) == -1) {
+        goto error;
+    }
+
+    optval = 1;
+    if (cfg->qdisc_bypass &&
+        setsockopt(ring->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &optval,
+                   sizeof(optval)) == -1) {
+        goto error;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = ring->block_size;
+    req.tp_block_nr = ring->block_count;
+    req.tp_frame_size = ring->frame_size;
+    req.tp_frame_nr = ring->frame_count;
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) ==
+        -1) {
+        goto error;
+    }
+
+    if (ring_map_bind(ring, cfg, 0) == -1) {
+        goto error;
+    }
+    return 0;
+
+error:
+    pr_close(ring);
+    return -1;
+}
+
+static inline struct tpacket2_hdr *tx_frame(pr_ring_t *ring, unsigned int idx) {
+    unsigned int per_block = ring->block_size / ring->frame_size;
+    return (struct tpacket2_hdr *)(ring->map +
+                                   (size_t)(idx / per_block) *
+                                       ring->block_size +
+                                   (size_t)(idx % per_block) *
+                                       ring->frame_size);
+}
+
+void *pr_tx_frame(pr_ring_t *ring, size_t *maxlen) {
+    struct tpacket2_hdr *hdr;
+    uint32_t status;
+
+    if (!ring || !ring->map) {
+        errno = EINVAL;
+        return NULL;
+    }
+    hdr = tx_frame(ring, ring->cur);
+    status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+    if (status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT) {
+        errno = ENOBUFS;
+        return NULL;
+    }
+    if (maxlen) {
+        *maxlen = ring->frame_size - TX_DATA_OFFSET;
+    }
+    return (uint8_t *)hdr + TX_DATA_OFFSET;
+}
+
+int pr_tx_commit(pr_ring_t *ring, size_t len) {
+    struct tpacket2_hdr *hdr;
+
+    if (!ring || !ring->map || len > ring->frame_size - TX_DATA_OFFSET) {
+        errno = EINVAL;
+        return -1;
+    }
+    hdr = tx_frame(ring, ring->cur);
+    hdr->tp_len = len;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST,
+                     __ATOMIC_RELEASE);
+    ring->cur = (ring->cur + 1) % ring->frame_count;
+    ring->tx_queued++;
+    return 0;
+}
+
+int pr_tx_flush(pr_ring_t *ring, bool wait) {
+    ssize_t rv;
+
+    if (!ring || !ring->map) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!ring->tx_queued) {
+        return 0;
+    }
+    NO_EINTR(rv = send(ring->fd, NULL, 0, wait ? 0 : MSG_DONTWAIT));
+    if (rv == -1) {
+        return -1; /* still queued: the next flush kicks them again */
+    }
+    ring->tx_queued = 0;
+    return 0;
+}
+
+void pr_close(pr_ring_t *ring) {
+    if (!ring) {
+        return;
+    }
+    if (ring->map) {
+        munmap(ring->map, ring->map_len);
+    }
+    if (ring->fd != -1) {
+        close(ring->fd);
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+#else /* !__linux__ */
+
+void pr_config_init(pr_config_t *cfg, const char *ifname) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->ifname = ifname;
+}
+
+int pr_rx_open(pr_ring_t *ring, const pr_config_t *cfg) {
+    (void)ring;
+    (void)cfg;
+    errno = ENOSYS;
+    return -1;
+}
+
+int pr_rx_next(pr_ring_t *ring, pr_packet_t *pkt, int timeout_ms) {
+    (void)ring;
+    (void)pkt;
+    (void)timeout_ms;
+    errno = ENOSYS;
+    return -1;
+}
+
+int pr_rx_stats(pr_ring_t *ring, uint64_t *packets, uint64_t *drops) {
+    (void)ring;
+    (void)packets;
+    (void)drops;
+    errno = ENOSYS;
+    return -1;
+}
+
+int pr_tx_open(pr_ring_t *ring, const pr_config_t *cfg) {
+    (void)ring;
+    (void)cfg;
+    errno = ENOSYS;
+    return -1;
+}
+
+void *pr_tx_frame(pr_ring_t *ring, size_t *maxlen) {
+    (void)ring;
+    (void)maxlen;
+    errno = ENOSYS;
+    return NULL;
+}
+
+int pr_tx_commit(pr_ring_t *ring, size_t len) {
+    (void)ring;
+    (void)len;
+    errno = ENOSYS;
+    return -1;
+}
+
+int pr_tx_flush(pr_ring_t *ring, bool wait) {
+    (void)ring;
+    (void)wait;
+    errno = ENOSYS;
+    return -1;
+}
+
+void pr_close(pr_ring_t *ring) {
+    (void)ring;
+}
+
+#endif /* __linux__ */
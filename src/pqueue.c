@@ -0,0 +1,222 @@
+/**
+ * @brief d-ary heap priority queue with handles
+ * @file pqueue.c
+ */
+
+#include "pqueue.h"
+
+#include <errno.h>
+#include <string.h>
+#include "utils.h"
+
+#define PQ_MIN_CAPACITY 16
+
+/*********************************************************************
+ * Sifting
+ *
+ * Both directions carry the moving node in a local and shift the nodes it
+ * passes into the hole, writing it (and its handle's position) once at
+ * the end, instead of swapping at every level.
+ *********************************************************************/
+
+static inline void place(pqueue_t *pq, size_t i, pq_node_t node) {
+    pq->heap[i] = node;
+    pq->pos[node.handle] = i;
+}
+
+static void sift_up(pqueue_t *pq, size_t i, pq_node_t node) {
+    size_t parent;
+
+    while (i > 0) {
+        parent = (i - 1) / pq->arity;
+        if (pq->cmp(node.item, pq->heap[parent].item, pq->ctx) >= 0) {
+            break;
+        }
+        place(pq, i, pq->heap[parent]);
+        i = parent;
+    }
+    place(pq, i, node);
+}
+
+static void sift_down(pqueue_t *pq, size_t i, pq_node_t node) {
+    size_t first, last, best, c;
+
+    for (;;) {
+        first = i * pq->arity + 1;
+        if (first >= pq->len) {
+            break;
+        }
+        last = MIN(first + pq->arity, pq->len);
+        best = first;
+        for (c = first + 1; c < last; c++) {
+            if (pq->cmp(pq->heap[c].item, pq->heap[best].item, pq->ctx) < 0) {
+                best = c;
+            }
+        }
+        if (pq->cmp(pq->heap[best].item, node.item, pq->ctx) >= 0) {
+            break;
+        }
+        place(pq, i, pq->heap[best]);
+        i = best;
+    }
+    place(pq, i, node);
+}
+
+/* put node at i, wherever it belongs relative to its new neighbours */
+static void sift(pqueue_t *pq, size_t i, pq_node_t node) {
+    if (i > 0 && pq->cmp(node.item, pq->heap[(i - 1) / pq->arity].item,
+                         pq->ctx) < 0) {
+        sift_up(pq, i, node);
+    } else {
+        sift_down(pq, i, node);
+    }
+}
+
+/* heap and pos share one block, nodes first, so they grow together */
+static size_t block_size(size_t cap) {
+    return cap * (sizeof(pq_node_t) + sizeof(size_t));
+}
+
+static void free_handle(pqueue_t *pq, pq_handle_t h) {
+    pq->pos[h] = pq->free_head;
+    pq->free_head = h;
+}
+
+/*********************************************************************
+ * Queue operations
+ *********************************************************************/
+
+pqueue_t *pq_create(unsigned arity, pq_cmp_fn cmp, void *ctx) {
+    return pq_create_with(arity, cmp, ctx, NULL);
+}
+
+pqueue_t *pq_create_with(unsigned arity, pq_cmp_fn cmp, void *ctx,
+                         allocator_t *alloc) {
+    pqueue_t *pq;
+
+    if (!arity) {
+        arity = PQ_DEFAULT_ARITY;
+    }
+    if (!cmp || arity < 2 || arity > PQ_MAX_ARITY) {
+        errno = EINVAL;
+        return NULL;
+    }
+    pq = al_calloc(alloc, 1, sizeof(*pq));
+    if (pq) {
+        pq->free_head = PQ_INVALID;
+        pq->arity = arity;
+        pq->cmp = cmp;
+        pq->ctx = ctx;
+        pq->alloc = alloc;
+    }
+    return pq;
+}
+
+void pq_destroy(pqueue_t *pq, void (*free_func)(void *)) {
+    size_t i;
+
+    if (!pq) {
+        return;
+    }
+    for (i = 0; free_func && i < pq->len; i++) {
+        free_func(pq->heap[i].item);
+    }
+    al_free(pq->alloc, pq->heap, block_size(pq->cap));
+    al_free(pq->alloc, pq, sizeof(*pq));
+}
+
+int pq_reserve(pqueue_t *pq, size_t n) {
+    char *block;
+    size_t cap;
+
+    if (!pq) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (n <= pq->cap) {
+        return 0;
+    }
+    cap = MAX(n, PQ_MIN_CAPACITY);
+    block = al_realloc(pq->alloc, pq->heap, block_size(pq->cap),
+                       block_size(cap));
+    if (!block) {
+        return -1;
+    }
+    memmove(block + cap * sizeof(pq_node_t),
+            block + pq->cap * sizeof(pq_node_t), pq->cap * sizeof(size_t));
+    pq->heap = (pq_node_t *)block;
+    pq->pos = (size_t *)(block + cap * sizeof(pq_node_t));
+    pq->cap = cap;
+    return 0;
+}
+
+pq_handle_t pq_push(pqueue_t *pq, void *item) {
+    pq_node_t node = {item, PQ_INVALID};
+
+    if (!pq) {
+        errno = EINVAL;
+        return PQ_INVALID;
+    }
+    if (pq->len == pq->cap &&
+        pq_reserve(pq, pq->cap ? 2 * pq->cap : PQ_MIN_CAPACITY) == -1) {
+        return PQ_INVALID;
+    }
+    /* live handles never outnumber items, so pos has room for a new one */
+    if (pq->free_head != PQ_INVALID) {
+        node.handle = pq->free_head;
+        pq->free_head = pq->pos[node.handle];
+    } else {
+        node.handle = pq->npos++;
+    }
+    sift_up(pq, pq->len++, node);
+    return node.handle;
+}
+
+void *pq_pop(pqueue_t *pq) {
+    pq_node_t top;
+
+    if (!pq || !pq->len) {
+        return NULL;
+    }
+    top = pq->heap[0];
+    free_handle(pq, top.handle);
+    if (--pq->len) {
+        sift_down(pq, 0, pq->heap[pq->len]);
+    }
+    return top.item;
+}
+
+int pq_update(pqueue_t *pq, pq_handle_t h) {
+    if (!pq || !pq_contains(pq, h)) {
+        errno = EINVAL;
+        return -1;
+    }
+    sift(pq, pq->pos[h], pq->heap[pq->pos[h]]);
+    return 0;
+}
+
+int pq_decrease(pqueue_t *pq, pq_handle_t h) {
+    if (!pq || !pq_contains(pq, h)) {
+        errno = EINVAL;
+        return -1;
+    }
+    sift_up(pq, pq->pos[h], pq->heap[pq->pos[h]]);
+    return 0;
+}
+
+void *pq_remove(pqueue_t *pq, pq_handle_t h) {
+    void *item;
+    size_t i;
+
+    if (!pq || !pq_contains(pq, h)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    i = pq->pos[h];
+    item = pq->heap[i].item;
+    free_handle(pq, h);
+    if (i < --pq->len) {
+        sift(pq, i, pq->heap[pq->len]);
+    }
+    return item;
+}
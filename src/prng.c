@@ -0,0 +1,237 @@
+/**
+ * @brief xoshiro256** and PCG64 seeding, jumps, per-thread generators and
+ * bulk fills
+ * @file prng.c
+ */
+
+#define _GNU_SOURCE /* clock_gettime() */
+
+#include "prng.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include "utils.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    define PRNG_HAVE_X86 1
+#    include <immintrin.h>
+#endif
+
+/* streams interleaved by prng_fill() */
+#define LANES 4
+
+/* below this, deriving the other lanes costs more than it saves */
+#define FILL_MIN (64 * LANES)
+
+/* values generated per pass of prng_fill_double() */
+#define DOUBLE_BATCH 1024
+
+/* Expand a 64-bit seed into well-mixed words (Vigna's recommendation for
+ * seeding xoshiro: an all-zero state would be stuck at zero forever). */
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void prng_seed(prng_t *r, uint64_t seed) {
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        r->s[i] = splitmix64(&seed);
+    }
+}
+
+void prng_jump(prng_t *r) {
+    static const uint64_t jump[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                    0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+    uint64_t s[4] = {0, 0, 0, 0};
+    int i, b, k;
+
+    for (i = 0; i < 4; i++) {
+        for (b = 0; b < 64; b++) {
+            if (jump[i] & (1ULL << b)) {
+                for (k = 0; k < 4; k++) {
+                    s[k] ^= r->s[k];
+                }
+            }
+            prng_next(r);
+        }
+    }
+    memcpy(r->s, s, sizeof(s));
+}
+
+prng_t *prng_thread(void) {
+    static uint64_t counter;
+    static __thread prng_t tls_prng;
+    static __thread bool seeded;
+    struct timespec ts;
+    uint64_t seed;
+
+    if (UNLIKELY(!seeded)) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        seed = ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec) ^
+               (uint64_t)(uintptr_t)pthread_self() ^
+               __atomic_add_fetch(&counter, 0x9e3779b97f4a7c15ULL,
+                                  __ATOMIC_RELAXED);
+        prng_seed(&tls_prng, seed);
+        seeded = true;
+    }
+    return &tls_prng;
+}
+
+void pcg64_seed(pcg64_t *r, uint64_t seed, uint64_t stream) {
+    uint64_t x = seed;
+
+#ifdef __SIZEOF_INT128__
+    r->state = 0;
+    r->inc = ((__uint128_t)splitmix64(&x) << 64 | stream) << 1 | 1;
+    pcg64_next(r);
+    r->state += (__uint128_t)splitmix64(&x) << 64 | seed;
+    pcg64_next(r);
+#else
+    uint64_t hi = splitmix64(&x), lo;
+
+    r->state.hi = r->state.lo = 0;
+    r->inc.hi = hi << 1 | stream >> 63;
+    r->inc.lo = stream << 1 | 1;
+    pcg64_next(r);
+    hi = splitmix64(&x);
+    lo = r->state.lo;
+    r->state.lo += seed;
+    r->state.hi += hi + (r->state.lo < lo);
+    pcg64_next(r);
+#endif /* __SIZEOF_INT128__ */
+}
+
+/*********************************************************************
+ * Bulk fill
+ *
+ * out[LANES * i + l] is the i-th output of lane l. Lane 0 is r itself, so
+ * writing it back leaves r advanced past everything it produced. The other
+ * lanes are seeded afresh from r on each call: a jump would guarantee they
+ * never overlap, but costs hundreds of outputs per lane, and the chance of
+ * randomly chosen 256-bit states landing within reach of each other is
+ * negligible.
+ *********************************************************************/
+
+typedef void (*fill_fn_t)(uint64_t (*lanes)[LANES], uint64_t *out,
+                          size_t rounds);
+
+static void fill_scalar(uint64_t (*lanes)[LANES], uint64_t *out,
+                        size_t rounds) {
+    uint64_t *s0 = lanes[0], *s1 = lanes[1], *s2 = lanes[2], *s3 = lanes[3];
+    uint64_t t;
+    size_t i;
+    int l;
+
+    for (i = 0; i < rounds; i++) {
+        for (l = 0; l < LANES; l++) {
+            out[i * LANES + l] = prng_rotl(s1[l] * 5, 7) * 9;
+            t = s1[l] << 17;
+            s2[l] ^= s0[l];
+            s3[l] ^= s1[l];
+            s1[l] ^= s2[l];
+            s0[l] ^= s3[l];
+            s2[l] ^= t;
+            s3[l] = prng_rotl(s3[l], 45);
+        }
+    }
+}
+
+#ifdef PRNG_HAVE_X86
+
+#    define ROTL256(X, K) \
+        _mm256_or_si256(_mm256_slli_epi64((X), (K)), _mm256_srli_epi64((X), 64 - (K)))
+
+/* AVX2 has no 64-bit multiply, but *5 and *9 are a shift and an add */
+__attribute__((target("avx2"))) static void
+fill_avx2(uint64_t (*lanes)[LANES], uint64_t *out, size_t rounds) {
+    __m256i s0 = _mm256_loadu_si256((const __m256i *)lanes[0]);
+    __m256i s1 = _mm256_loadu_si256((const __m256i *)lanes[1]);
+    __m256i s2 = _mm256_loadu_si256((const __m256i *)lanes[2]);
+    __m256i s3 = _mm256_loadu_si256((const __m256i *)lanes[3]);
+    __m256i x, t;
+    size_t i;
+
+    for (i = 0; i < rounds; i++) {
+        x = _mm256_add_epi64(_mm256_slli_epi64(s1, 2), s1);
+        x = ROTL256(x, 7);
+        x = _mm256_add_epi64(_mm256_slli_epi64(x, 3), x);
+        _mm256_storeu_si256((__m256i *)(out + i * LANES), x);
+        t = _mm256_slli_epi64(s1, 17);
+        s2 = _mm256_xor_si256(s2, s0);
+        s3 = _mm256_xor_si256(s3, s1);
+        s1 = _mm256_xor_si256(s1, s2);
+        s0 = _mm256_xor_si256(s0, s3);
+        s2 = _mm256_xor_si256(s2, t);
+        s3 = ROTL256(s3, 45);
+    }
+    _mm256_storeu_si256((__m256i *)lanes[0], s0);
+    _mm256_storeu_si256((__m256i *)lanes[1], s1);
+    _mm256_storeu_si256((__m256i *)lanes[2], s2);
+    _mm256_storeu_si256((__m256i *)lanes[3], s3);
+}
+
+#endif /* PRNG_HAVE_X86 */
+
+static fill_fn_t fill_select(void) {
+#ifdef PRNG_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return fill_avx2;
+    }
+#endif /* PRNG_HAVE_X86 */
+    return fill_scalar;
+}
+
+void prng_fill(prng_t *r, uint64_t *out, size_t n) {
+    static fill_fn_t impl;
+    uint64_t lanes[4][LANES]; /* lanes[k][l]: word k of lane l's state */
+    uint64_t seed;
+    fill_fn_t fn;
+    size_t rounds = n / LANES;
+    int k, l;
+
+    if (n >= FILL_MIN) {
+        for (l = 1; l < LANES; l++) {
+            for (k = 0; k < 4; k++) {
+                seed = prng_next(r);
+                lanes[k][l] = splitmix64(&seed);
+            }
+        }
+        for (k = 0; k < 4; k++) {
+            lanes[k][0] = r->s[k];
+        }
+        fn = __atomic_load_n(&impl, __ATOMIC_RELAXED);
+        if (UNLIKELY(!fn)) {
+            fn = fill_select();
+            __atomic_store_n(&impl, fn, __ATOMIC_RELAXED);
+        }
+        fn(lanes, out, rounds);
+        for (k = 0; k < 4; k++) {
+            r->s[k] = lanes[k][0];
+        }
+        out += rounds * LANES;
+        n -= rounds * LANES;
+    }
+    while (n--) {
+        *out++ = prng_next(r);
+    }
+}
+
+void prng_fill_double(prng_t *r, double *out, size_t n) {
+    uint64_t bits[DOUBLE_BATCH];
+    size_t len, i;
+
+    for (; n > 0; n -= len, out += len) {
+        len = MIN(n, DOUBLE_BATCH);
+        prng_fill(r, bits, len);
+        for (i = 0; i < len; i++) {
+            out[i] = (bits[i] >> 11) * 0x1.0p-53;
+        }
+    }
+}
@@ -0,0 +1,464 @@
+/**
+ * @brief LSD/MSD radix sorts, optionally spread over a thread pool
+ * @file radix.c
+ */
+
+#include "radix.h"
+
+#include <errno.h>
+#include <string.h>
+#include "utils.h"
+
+#define RADIX 256
+#define MAX_DIGITS 8
+
+/* insertion sort below this many records */
+#define SMALL_SORT 32
+
+/* without a pool, LSD alone below this many records; above it, the MSD
+ * split keeps each bucket's LSD passes in cache */
+#define MSD_MIN (1 << 16)
+
+/* records per chunk of a parallel histogram or scatter, at least */
+#define CHUNK_MIN 16384
+
+/* records ahead of the scatter cursor whose destination is prefetched */
+#define PREFETCH_AHEAD 8
+
+typedef size_t hist_t[MAX_DIGITS][RADIX];
+
+/* where the key is, and how to read it */
+typedef struct {
+    size_t size;   /* bytes per record */
+    size_t off;    /* offset of the key in a record */
+    size_t kbytes; /* key size: 1, 2, 4 or 8 */
+    uint64_t flip; /* xor'ed into every key: the sign bit for signed keys */
+} layout_t;
+
+/*********************************************************************
+ * Passes
+ *
+ * Each pass is written once as an always-inlined function of the layout,
+ * and called from a dispatcher with a constant layout for plain key
+ * arrays and key/pointer pairs, so that their key loads and record copies
+ * compile to single moves. Other layouts share a generic instance.
+ *********************************************************************/
+
+static inline __attribute__((always_inline)) uint64_t
+key_of(const char *rec, layout_t l) {
+    uint64_t k;
+    uint32_t k32;
+    uint16_t k16;
+
+    switch (l.kbytes) {
+    case 1:
+        k = *(const uint8_t *)(rec + l.off);
+        break;
+    case 2:
+        memcpy(&k16, rec + l.off, sizeof(k16));
+        k = k16;
+        break;
+    case 4:
+        memcpy(&k32, rec + l.off, sizeof(k32));
+        k = k32;
+        break;
+    default:
+        memcpy(&k, rec + l.off, sizeof(k));
+    }
+    return k ^ l.flip;
+}
+
+static inline size_t digit(uint64_t key, int d) {
+    return (size_t)(key >> (8 * d)) & (RADIX - 1);
+}
+
+/* count every digit of n records at once */
+static inline __attribute__((always_inline)) void
+hist_impl(const char *p, size_t n, layout_t l, hist_t h) {
+    uint64_t k;
+    size_t i, d;
+
+    for (i = 0; i < n; i++) {
+        k = key_of(p + i * l.size, l);
+        for (d = 0; d < l.kbytes; d++) {
+            h[d][digit(k, d)]++;
+        }
+    }
+}
+
+/* stable scatter of n records by digit d; offs[b] is where the next record
+ * with digit b goes, and ends up one past the last one */
+static inline __attribute__((always_inline)) void
+scatter_impl(const char *src, char *dst, size_t n, layout_t l, int d,
+             size_t *offs) {
+    size_t i, b;
+
+    for (i = 0; i < n; i++) {
+        if (i + PREFETCH_AHEAD < n) {
+            b = digit(key_of(src + (i + PREFETCH_AHEAD) * l.size, l), d);
+            __builtin_prefetch(dst + offs[b] * l.size, 1);
+        }
+        b = digit(key_of(src + i * l.size, l), d);
+        memcpy(dst + offs[b]++ * l.size, src + i * l.size, l.size);
+    }
+}
+
+static inline __attribute__((always_inline)) void
+insertion_impl(char *a, size_t n, layout_t l) {
+    char rec[MAX(l.size, 1)];
+    uint64_t k;
+    size_t i, j;
+
+    for (i = 1; i < n; i++) {
+        k = key_of(a + i * l.size, l);
+        if (key_of(a + (i - 1) * l.size, l) <= k) {
+            continue;
+        }
+        memcpy(rec, a + i * l.size, l.size);
+        for (j = i; j > 0 && key_of(a + (j - 1) * l.size, l) > k; j--) {
+            memcpy(a + j * l.size, a + (j - 1) * l.size, l.size);
+        }
+        memcpy(a + j * l.size, rec, l.size);
+    }
+}
+
+enum { LAYOUT_U32, LAYOUT_U64, LAYOUT_PAIR, LAYOUT_OTHER };
+
+static int kind(const layout_t *l) {
+    if (l->off == 0 && l->kbytes == 4 && l->size == 4) {
+        return LAYOUT_U32;
+    }
+    if (l->off == 0 && l->kbytes == 8 && l->size == 8) {
+        return LAYOUT_U64;
+    }
+    if (l->off == 0 && l->kbytes == 8 && l->size == 16) {
+        return LAYOUT_PAIR;
+    }
+    return LAYOUT_OTHER;
+}
+
+static layout_t fixed(size_t size, size_t kbytes, uint64_t flip) {
+    layout_t l = {size, 0, kbytes, flip};
+
+    return l;
+}
+
+static void hist(const char *p, size_t n, const layout_t *l, hist_t h) {
+    switch (kind(l)) {
+    case LAYOUT_U32:
+        hist_impl(p, n, fixed(4, 4, l->flip), h);
+        break;
+    case LAYOUT_U64:
+        hist_impl(p, n, fixed(8, 8, l->flip), h);
+        break;
+    case LAYOUT_PAIR:
+        hist_impl(p, n, fixed(16, 8, l->flip), h);
+        break;
+    default:
+        hist_impl(p, n, *l, h);
+    }
+}
+
+static void scatter(const char *src, char *dst, size_t n, const layout_t *l,
+                    int d, size_t *offs) {
+    switch (kind(l)) {
+    case LAYOUT_U32:
+        scatter_impl(src, dst, n, fixed(4, 4, l->flip), d, offs);
+        break;
+    case LAYOUT_U64:
+        scatter_impl(src, dst, n, fixed(8, 8, l->flip), d, offs);
+        break;
+    case LAYOUT_PAIR:
+        scatter_impl(src, dst, n, fixed(16, 8, l->flip), d, offs);
+        break;
+    default:
+        scatter_impl(src, dst, n, *l, d, offs);
+    }
+}
+
+static void insertion(char *a, size_t n, const layout_t *l) {
+    switch (kind(l)) {
+    case LAYOUT_U32:
+        insertion_impl(a, n, fixed(4, 4, l->flip));
+        break;
+    case LAYOUT_U64:
+        insertion_impl(a, n, fixed(8, 8, l->flip));
+        break;
+    case LAYOUT_PAIR:
+        insertion_impl(a, n, fixed(16, 8, l->flip));
+        break;
+    default:
+        insertion_impl(a, n, *l);
+    }
+}
+
+/**
+ * @brief LSD sort of the n records at src by digits [0, ndigits), with h
+ * their histograms, ping-ponging through the scratch buffer dst.
+ * @returns Whichever of src and dst holds the result.
+ */
+static char *lsd(char *src, char *dst, size_t n, const layout_t *l, hist_t h,
+                 int ndigits) {
+    size_t offs[RADIX], sum, b;
+    char *t;
+    int d;
+
+    for (d = 0; d < ndigits; d++) {
+        /* every record has the same digit: the pass would change nothing */
+        if (h[d][digit(key_of(src, *l), d)] == n) {
+            continue;
+        }
+        for (b = 0, sum = 0; b < RADIX; b++) {
+            offs[b] = sum;
+            sum += h[d][b];
+        }
+        scatter(src, dst, n, l, d, offs);
+        t = src;
+        src = dst;
+        dst = t;
+    }
+    return src;
+}
+
+/*********************************************************************
+ * MSD split
+ *
+ * The input is cut into chunks that are counted, then scattered by the
+ * most significant varying digit, independently: chunk c's records with
+ * digit b go after those of chunks before c, so the split is stable. Each
+ * bucket is then finished by LSD from the scratch buffer back into place.
+ *********************************************************************/
+
+typedef struct {
+    char *a;   /* the input, and the output */
+    char *tmp; /* scratch */
+    size_t n;
+    layout_t l;
+    size_t nchunks;
+    hist_t *chunk_hist;        /* per chunk, all digits */
+    size_t (*chunk_offs)[RADIX]; /* per chunk, the split digit */
+    int msd;                   /* the split digit */
+    size_t start[RADIX + 1];   /* bucket b is [start[b], start[b + 1]) */
+} job_t;
+
+static size_t chunk_begin(const job_t *job, size_t c) {
+    return job->n / job->nchunks * c + MIN(c, job->n % job->nchunks);
+}
+
+static void count_chunks(size_t begin, size_t end, void *arg) {
+    job_t *job = arg;
+    size_t c, from;
+
+    for (c = begin; c < end; c++) {
+        from = chunk_begin(job, c);
+        memset(job->chunk_hist[c], 0, sizeof(hist_t));
+        hist(job->a + from * job->l.size, chunk_begin(job, c + 1) - from,
+             &job->l, job->chunk_hist[c]);
+    }
+}
+
+static void scatter_chunks(size_t begin, size_t end, void *arg) {
+    job_t *job = arg;
+    size_t c, from;
+
+    for (c = begin; c < end; c++) {
+        from = chunk_begin(job, c);
+        scatter(job->a + from * job->l.size, job->tmp,
+                chunk_begin(job, c + 1) - from, &job->l, job->msd,
+                job->chunk_offs[c]);
+    }
+}
+
+static void sort_buckets(size_t begin, size_t end, void *arg) {
+    job_t *job = arg;
+    size_t b, from, m, size = job->l.size;
+    hist_t h;
+    char *res;
+
+    for (b = begin; b < end; b++) {
+        from = job->start[b];
+        m = job->start[b + 1] - from;
+        if (m > SMALL_SORT && job->msd > 0) {
+            memset(h, 0, sizeof(h));
+            hist(job->tmp + from * size, m, &job->l, h);
+            res = lsd(job->tmp + from * size, job->a + from * size, m, &job->l,
+                      h, job->msd);
+        } else {
+            res = job->tmp + from * size;
+        }
+        if (res != job->a + from * size) {
+            memcpy(job->a + from * size, res, m * size);
+        }
+        if (m <= SMALL_SORT && job->msd > 0) {
+            insertion(job->a + from * size, m, &job->l);
+        }
+    }
+}
+
+/* run fn over [0, count) on pool's workers, or on this thread without one */
+static int run(tp_pool_t *pool, size_t count, tp_range_fn_t fn, void *arg) {
+    if (!pool) {
+        fn(0, count, arg);
+        return 0;
+    }
+    return tp_parallel_for(pool, 0, count, 1, fn, arg);
+}
+
+static int msd_sort(job_t *job, tp_pool_t *pool) {
+    hist_t total;
+    size_t c, b, d, sum;
+    int rv = -1;
+
+    job->nchunks = pool ? MIN(2 * tp_size(pool), job->n / CHUNK_MIN + 1) : 1;
+    job->chunk_hist = malloc(job->nchunks * sizeof(hist_t));
+    job->chunk_offs = malloc(job->nchunks * sizeof(*job->chunk_offs));
+    if (!job->chunk_hist || !job->chunk_offs ||
+        run(pool, job->nchunks, count_chunks, job) == -1) {
+        goto out;
+    }
+
+    memset(total, 0, sizeof(total));
+    for (c = 0; c < job->nchunks; c++) {
+        for (d = 0; d < job->l.kbytes; d++) {
+            for (b = 0; b < RADIX; b++) {
+                total[d][b] += job->chunk_hist[c][d][b];
+            }
+        }
+    }
+    /* the highest digit on which the keys differ */
+    for (job->msd = job->l.kbytes - 1; job->msd >= 0; job->msd--) {
+        if (total[job->msd][digit(key_of(job->a, job->l), job->msd)] !=
+            job->n) {
+            break;
+        }
+    }
+    if (job->msd < 0) {
+        rv = 0; /* all keys are equal */
+        goto out;
+    }
+
+    for (b = 0, sum = 0; b < RADIX; b++) {
+        job->start[b] = sum;
+        for (c = 0; c < job->nchunks; c++) {
+            job->chunk_offs[c][b] = sum;
+            sum += job->chunk_hist[c][job->msd][b];
+        }
+    }
+    job->start[RADIX] = sum;
+    if (run(pool, job->nchunks, scatter_chunks, job) == -1 ||
+        run(pool, RADIX, sort_buckets, job) == -1) {
+        goto out;
+    }
+    rv = 0;
+out:
+    free(job->chunk_hist);
+    free(job->chunk_offs);
+    return rv;
+}
+
+static int sort(void *base, size_t n, layout_t l, tp_pool_t *pool) {
+    job_t job;
+    hist_t h;
+    char *res;
+    int rv = 0;
+
+    if (n <= SMALL_SORT) {
+        insertion(base, n, &l);
+        return 0;
+    }
+    if (n > SIZE_MAX / l.size) {
+        errno = ENOMEM;
+        return -1;
+    }
+    job.a = base;
+    job.n = n;
+    job.l = l;
+    job.tmp = malloc(n * l.size);
+    if (!job.tmp) {
+        return -1;
+    }
+    if (!pool && n < MSD_MIN) {
+        memset(h, 0, sizeof(h));
+        hist(base, n, &l, h);
+        res = lsd(base, job.tmp, n, &l, h, l.kbytes);
+        if (res != base) {
+            memcpy(base, res, n * l.size);
+        }
+    } else {
+        rv = msd_sort(&job, pool);
+    }
+    free(job.tmp);
+    return rv;
+}
+
+/*********************************************************************
+ * Public interface
+ *********************************************************************/
+
+int radix_sort_u32(uint32_t *keys, size_t n, tp_pool_t *pool) {
+    return sort(keys, n, fixed(4, 4, 0), pool);
+}
+
+int radix_sort_u64(uint64_t *keys, size_t n, tp_pool_t *pool) {
+    return sort(keys, n, fixed(8, 8, 0), pool);
+}
+
+int radix_sort_i32(int32_t *keys, size_t n, tp_pool_t *pool) {
+    return sort(keys, n, fixed(4, 4, 1ULL << 31), pool);
+}
+
+int radix_sort_i64(int64_t *keys, size_t n, tp_pool_t *pool) {
+    return sort(keys, n, fixed(8, 8, 1ULL << 63), pool);
+}
+
+int radix_sort_records(void *base, size_t n, size_t size, size_t key_off,
+                       size_t key_size, int flags, tp_pool_t *pool) {
+    layout_t l = {size, key_off, key_size, 0};
+
+    if ((!base && n) || (key_size != 1 && key_size != 2 && key_size != 4 &&
+                         key_size != 8) ||
+        key_off > size || size - key_off < key_size) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (flags & RADIX_SIGNED) {
+        l.flip = 1ULL << (8 * key_size - 1);
+    }
+    return sort(base, n, l, pool);
+}
+
+typedef struct {
+    uint64_t key;
+    void *data;
+} pair_t;
+
+int radix_sort_deque(deque_t *dq, radix_key_fn key, tp_pool_t *pool) {
+    pair_t *pairs;
+    node_t *node;
+    size_t i, n;
+    int rv;
+
+    if (!dq) {
+        errno = EINVAL;
+        return -1;
+    }
+    n = dq->n_items;
+    pairs = malloc(MAX(n, 1) * sizeof(*pairs));
+    if (!pairs) {
+        return -1;
+    }
+    for (i = 0, node = dq->head; node; i++, node = node->next) {
+        pairs[i].key = key ? key(node->data) : (uint64_t)(uintptr_t)node->data;
+        pairs[i].data = node->data;
+    }
+    /* a pair is 16 bytes on LP64, where it takes the specialized path */
+    rv = radix_sort_records(pairs, n, sizeof(pair_t), 0, sizeof(uint64_t), 0,
+                            pool);
+    if (rv == 0) {
+        for (i = 0, node = dq->head; node; i++, node = node->next) {
+            node->data = pairs[i].data;
+        }
+    }
+    free(pairs);
+    return rv;
+}
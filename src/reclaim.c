@@ -0,0 +1,471 @@
+/**
+ * @brief Epoch-based reclamation and hazard pointers with batched freeing
+ * @file reclaim.c
+ */
+
+#define _GNU_SOURCE
+
+#include "reclaim.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include "utils.h"
+
+#define CACHE_LINE 64
+
+/* Free every node of list, returning how many there were. */
+static size_t free_all(reclaim_node_t *list) {
+    reclaim_node_t *next;
+    size_t n = 0;
+
+    for (; list; list = next, n++) {
+        next = list->next;
+        list->free_fn(list);
+    }
+    return n;
+}
+
+/* Put list at the front of *orphans. Call with the domain's lock held. */
+static void add_orphans(reclaim_node_t **orphans, reclaim_node_t *list) {
+    reclaim_node_t *tail = list;
+
+    if (!list) {
+        return;
+    }
+    while (tail->next) {
+        tail = tail->next;
+    }
+    tail->next = *orphans;
+    __atomic_store_n(orphans, list, __ATOMIC_RELAXED);
+}
+
+/* Take every orphan, unless another thread holds the lock. */
+static reclaim_node_t *take_orphans(pthread_mutex_t *lock,
+                                    reclaim_node_t **orphans) {
+    reclaim_node_t *list;
+
+    if (LIKELY(!__atomic_load_n(orphans, __ATOMIC_RELAXED)) ||
+        pthread_mutex_trylock(lock)) {
+        return NULL;
+    }
+    list = *orphans;
+    __atomic_store_n(orphans, NULL, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(lock);
+    return list;
+}
+
+/* Handles are never unlinked, as other threads may be walking the list
+ * without a lock; a thread that registers takes a free one if it can. */
+#define CLAIM_HANDLE(HEAD, T)                                                \
+    do {                                                                     \
+        for ((T) = __atomic_load_n(&(HEAD), __ATOMIC_ACQUIRE); (T);          \
+             (T) = (T)->next) {                                              \
+            if (!__atomic_load_n(&(T)->in_use, __ATOMIC_RELAXED) &&          \
+                !__atomic_exchange_n(&(T)->in_use, 1, __ATOMIC_ACQUIRE)) {   \
+                break;                                                       \
+            }                                                                \
+        }                                                                    \
+    } while (0)
+
+/*********************************************************************
+ * Epoch-based reclamation
+ *
+ * The global epoch only advances once every thread inside a critical
+ * section has entered it in the current epoch. Retired nodes are stamped,
+ * a batch at a time, with the epoch after they were unlinked: a thread that
+ * could still hold one is in a section of at most that epoch, so once the
+ * epoch has advanced twice past the stamp, none can.
+ *********************************************************************/
+
+struct EbrThread {
+    uint64_t state ALIGNED(CACHE_LINE); /* epoch << 1 | 1 while inside */
+    ebr_thread_t *next;
+    ebr_t *domain;
+    int in_use;
+    unsigned nest;
+    reclaim_node_t *open; /* retired since the last seal, newest first */
+    reclaim_node_t *open_last;
+    size_t nopen;
+    reclaim_node_t *sealed; /* stamped, oldest first */
+    reclaim_node_t *sealed_last;
+};
+
+int ebr_init(ebr_t *d) {
+    memset(d, 0, sizeof(*d));
+    return pthread_mutex_init(&d->lock, NULL) ? -1 : 0;
+}
+
+void ebr_destroy(ebr_t *d) {
+    ebr_thread_t *t, *next;
+
+    if (!d) {
+        return;
+    }
+    for (t = d->threads; t; t = next) {
+        next = t->next;
+        free_all(t->open);
+        free_all(t->sealed);
+        free(t);
+    }
+    free_all(d->orphans);
+    d->threads = NULL;
+    d->orphans = NULL;
+    pthread_mutex_destroy(&d->lock);
+}
+
+ebr_thread_t *ebr_register(ebr_t *d) {
+    ebr_thread_t *t;
+
+    CLAIM_HANDLE(d->threads, t);
+    if (t) {
+        return t;
+    }
+    if (posix_memalign((void **)&t, CACHE_LINE, sizeof(*t))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(t, 0, sizeof(*t));
+    t->domain = d;
+    t->in_use = 1;
+    pthread_mutex_lock(&d->lock);
+    t->next = d->threads;
+    __atomic_store_n(&d->threads, t, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&d->lock);
+    return t;
+}
+
+void ebr_enter(ebr_thread_t *t) {
+    uint64_t epoch;
+
+    if (t->nest++) {
+        return;
+    }
+    epoch = __atomic_load_n(&t->domain->epoch, __ATOMIC_RELAXED);
+    /* announce the epoch before loading any shared pointer */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    /* a locked exchange is a full barrier on x86, and cheaper than mfence */
+    __atomic_exchange_n(&t->state, epoch << 1 | 1, __ATOMIC_SEQ_CST);
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+#else
+    __atomic_store_n(&t->state, epoch << 1 | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+void ebr_exit(ebr_thread_t *t) {
+    if (--t->nest == 0) {
+        __atomic_store_n(&t->state, 0, __ATOMIC_RELEASE);
+    }
+}
+
+/* Advance the epoch if every thread inside a critical section is in the
+ * current one, returning the epoch. */
+static uint64_t try_advance(ebr_t *d) {
+    uint64_t epoch, state;
+    ebr_thread_t *t;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    epoch = __atomic_load_n(&d->epoch, __ATOMIC_SEQ_CST);
+    for (t = __atomic_load_n(&d->threads, __ATOMIC_ACQUIRE); t; t = t->next) {
+        state = __atomic_load_n(&t->state, __ATOMIC_RELAXED);
+        if ((state & 1) && state >> 1 != epoch) {
+            return epoch;
+        }
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    /* on failure another thread advanced it, and epoch is the new value */
+    if (__atomic_compare_exchange_n(&d->epoch, &epoch, epoch + 1, false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        epoch++;
+    }
+    return epoch;
+}
+
+/* Stamp the open nodes with the current epoch and move them to the end of
+ * sealed, which so stays in epoch order. */
+static void seal(ebr_thread_t *t) {
+    reclaim_node_t *node;
+    uint64_t epoch;
+
+    if (!t->open) {
+        return;
+    }
+    /* the nodes were unlinked before the epoch is read */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    epoch = __atomic_load_n(&t->domain->epoch, __ATOMIC_SEQ_CST);
+    for (node = t->open; node; node = node->next) {
+        node->epoch = epoch;
+    }
+    if (t->sealed) {
+        t->sealed_last->next = t->open;
+    } else {
+        t->sealed = t->open;
+    }
+    t->sealed_last = t->open_last;
+    t->open = t->open_last = NULL;
+    t->nopen = 0;
+}
+
+size_t ebr_collect(ebr_thread_t *t) {
+    reclaim_node_t *node, *orphans;
+    ebr_t *d = t->domain;
+    uint64_t epoch;
+    size_t n = 0;
+
+    seal(t);
+    if ((orphans = take_orphans(&d->lock, &d->orphans))) {
+        /* orphans were sealed before anything t seals from now on, so they
+         * go in front; out of order among themselves, some wait longer */
+        for (node = orphans; node->next; node = node->next) {
+        }
+        node->next = t->sealed;
+        if (!t->sealed) {
+            t->sealed_last = node;
+        }
+        t->sealed = orphans;
+    }
+    if (!t->sealed) {
+        return 0;
+    }
+    epoch = try_advance(d);
+    while ((node = t->sealed) && node->epoch + 2 <= epoch) {
+        t->sealed = node->next;
+        node->free_fn(node);
+        n++;
+    }
+    return n;
+}
+
+void ebr_retire(ebr_thread_t *t, reclaim_node_t *node, reclaim_fn_t free_fn) {
+    node->free_fn = free_fn;
+    node->next = t->open;
+    if (!t->open) {
+        t->open_last = node;
+    }
+    t->open = node;
+    if (++t->nopen >= EBR_BATCH) {
+        ebr_collect(t);
+    }
+}
+
+void ebr_synchronize(ebr_thread_t *t) {
+    ebr_collect(t);
+    while (t->sealed) {
+        sched_yield();
+        ebr_collect(t);
+    }
+}
+
+void ebr_unregister(ebr_thread_t *t) {
+    ebr_t *d = t->domain;
+
+    ebr_collect(t);
+    if (t->sealed) {
+        pthread_mutex_lock(&d->lock);
+        add_orphans(&d->orphans, t->sealed);
+        pthread_mutex_unlock(&d->lock);
+        t->sealed = t->sealed_last = NULL;
+    }
+    t->nest = 0;
+    __atomic_store_n(&t->state, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&t->in_use, 0, __ATOMIC_RELEASE);
+}
+
+/*********************************************************************
+ * Hazard pointers
+ *
+ * A scan reads every slot after the nodes were unlinked, so a pointer
+ * published after it was either published before the unlink (and is seen)
+ * or failed hp_protect()'s second load.
+ *********************************************************************/
+
+struct HpThread {
+    hp_thread_t *next;
+    hp_t *domain;
+    int in_use;
+    reclaim_node_t *retired;
+    size_t nretired;
+    void **scan; /* the hazards seen by the last scan, sorted */
+    size_t scan_cap;
+    void *hazards[] ALIGNED(CACHE_LINE);
+};
+
+int hp_init(hp_t *d, unsigned slots) {
+    if (!d || !slots) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(d, 0, sizeof(*d));
+    d->slots = slots;
+    return pthread_mutex_init(&d->lock, NULL) ? -1 : 0;
+}
+
+void hp_destroy(hp_t *d) {
+    hp_thread_t *t, *next;
+
+    if (!d) {
+        return;
+    }
+    for (t = d->threads; t; t = next) {
+        next = t->next;
+        free_all(t->retired);
+        free(t->scan);
+        free(t);
+    }
+    free_all(d->orphans);
+    d->threads = NULL;
+    d->orphans = NULL;
+    pthread_mutex_destroy(&d->lock);
+}
+
+hp_thread_t *hp_register(hp_t *d) {
+    size_t size = ROUNDUP(sizeof(hp_thread_t) + d->slots * sizeof(void *),
+                          CACHE_LINE);
+    hp_thread_t *t;
+
+    CLAIM_HANDLE(d->threads, t);
+    if (t) {
+        return t;
+    }
+    if (posix_memalign((void **)&t, CACHE_LINE, size)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(t, 0, size);
+    t->domain = d;
+    t->in_use = 1;
+    pthread_mutex_lock(&d->lock);
+    t->next = d->threads;
+    __atomic_store_n(&d->threads, t, __ATOMIC_RELEASE);
+    __atomic_store_n(&d->nthreads, d->nthreads + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&d->lock);
+    /* a scan that missed this handle happened before any of its hazards */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return t;
+}
+
+void *hp_protect(hp_thread_t *t, unsigned slot, void *const *src) {
+    void *p = __atomic_load_n(src, __ATOMIC_RELAXED), *q;
+
+    for (;;) {
+        __atomic_store_n(&t->hazards[slot], p, __ATOMIC_SEQ_CST);
+        q = __atomic_load_n(src, __ATOMIC_SEQ_CST);
+        if (LIKELY(q == p)) {
+            return p;
+        }
+        p = q;
+    }
+}
+
+void hp_set(hp_thread_t *t, unsigned slot, void *ptr) {
+    __atomic_store_n(&t->hazards[slot], ptr, __ATOMIC_SEQ_CST);
+}
+
+void hp_clear(hp_thread_t *t, unsigned slot) {
+    __atomic_store_n(&t->hazards[slot], NULL, __ATOMIC_RELEASE);
+}
+
+static int cmp_ptr(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t) * (void *const *)a;
+    uintptr_t y = (uintptr_t) * (void *const *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Gather the hazards of every handle into t->scan, sorted. */
+static ssize_t gather_hazards(hp_thread_t *t) {
+    hp_t *d = t->domain;
+    hp_thread_t *head = __atomic_load_n(&d->threads, __ATOMIC_ACQUIRE), *u;
+    size_t n = 0, k = 0, i;
+    void **scan, *p;
+
+    /* handles are only ever added in front of head */
+    for (u = head; u; u = u->next) {
+        n += d->slots;
+    }
+    if (n > t->scan_cap) {
+        if (!(scan = realloc(t->scan, n * sizeof(void *)))) {
+            return -1;
+        }
+        t->scan = scan;
+        t->scan_cap = n;
+    }
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (u = head; u; u = u->next) {
+        for (i = 0; i < d->slots; i++) {
+            if ((p = __atomic_load_n(&u->hazards[i], __ATOMIC_ACQUIRE))) {
+                t->scan[k++] = p;
+            }
+        }
+    }
+    qsort(t->scan, k, sizeof(void *), cmp_ptr);
+    return (ssize_t)k;
+}
+
+ssize_t hp_collect(hp_thread_t *t) {
+    reclaim_node_t **link = &t->retired, *node, *orphans;
+    hp_t *d = t->domain;
+    ssize_t nhazards;
+    size_t n = 0;
+
+    if ((orphans = take_orphans(&d->lock, &d->orphans))) {
+        for (node = orphans;; node = node->next) {
+            t->nretired++;
+            if (!node->next) {
+                break;
+            }
+        }
+        node->next = t->retired;
+        t->retired = orphans;
+    }
+    if (!t->retired) {
+        return 0;
+    }
+    if ((nhazards = gather_hazards(t)) == -1) {
+        return -1;
+    }
+    while ((node = *link)) {
+        if (!bsearch(&node, t->scan, (size_t)nhazards, sizeof(void *),
+                     cmp_ptr)) {
+            *link = node->next;
+            node->free_fn(node);
+            n++;
+        } else {
+            link = &node->next;
+        }
+    }
+    t->nretired -= n;
+    return (ssize_t)n;
+}
+
+void hp_retire(hp_thread_t *t, reclaim_node_t *node, reclaim_fn_t free_fn) {
+    hp_t *d = t->domain;
+    unsigned nthreads = __atomic_load_n(&d->nthreads, __ATOMIC_RELAXED);
+    size_t limit = HP_BATCH + 2 * (size_t)d->slots * nthreads;
+
+    node->free_fn = free_fn;
+    node->next = t->retired;
+    t->retired = node;
+    if (++t->nretired >= limit) {
+        hp_collect(t);
+    }
+}
+
+void hp_unregister(hp_thread_t *t) {
+    hp_t *d = t->domain;
+    unsigned i;
+
+    for (i = 0; i < d->slots; i++) {
+        hp_clear(t, i);
+    }
+    hp_collect(t);
+    if (t->retired) {
+        pthread_mutex_lock(&d->lock);
+        add_orphans(&d->orphans, t->retired);
+        pthread_mutex_unlock(&d->lock);
+        t->retired = NULL;
+        t->nretired = 0;
+    }
+    __atomic_store_n(&t->in_use, 0, __ATOMIC_RELEASE);
+}
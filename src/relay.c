@@ -0,0 +1,239 @@
+/**
+ * @brief Zero-copy relaying between sockets with splice()
+ * @file relay.c
+ */
+
+#define _GNU_SOURCE /* splice(), pipe2(), EPOLLRDHUP */
+
+#include "relay.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "network.h"
+
+#ifdef __linux__
+#    include <sys/epoll.h>
+#endif
+
+/* Release what r allocated, leaving its sockets open. */
+static void release(relay_t *r) {
+    relay_half_t *h;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        h = &r->half[i];
+        if (h->pipe[0] != -1) {
+            close(h->pipe[0]);
+            close(h->pipe[1]);
+            h->pipe[0] = h->pipe[1] = -1;
+        }
+        free(h->buf);
+        h->buf = NULL;
+    }
+}
+
+int relay_init(relay_t *r, int a, int b, int flags) {
+    relay_half_t *h;
+    int i;
+
+    if (!r || a < 0 || b < 0 || a == b) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(r, 0, sizeof(*r));
+    r->a = a;
+    r->b = b;
+    for (i = 0; i < 2; i++) {
+        h = &r->half[i];
+        h->from = i ? b : a;
+        h->to = i ? a : b;
+        h->pipe[0] = h->pipe[1] = -1;
+    }
+    if (-1 == set_nonblocking(a, true) || -1 == set_nonblocking(b, true)) {
+        return -1;
+    }
+    for (i = 0; i < 2; i++) {
+        h = &r->half[i];
+#ifdef __linux__
+        if (!(flags & RELAY_COPY) && 0 == pipe2(h->pipe, O_NONBLOCK | O_CLOEXEC)) {
+            continue;
+        }
+        h->pipe[0] = h->pipe[1] = -1;
+#else
+        (void)flags;
+#endif
+        if (!(h->buf = malloc(RELAY_BUFSZ))) {
+            release(r);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void relay_destroy(relay_t *r) {
+    if (!r) {
+        return;
+    }
+    release(r);
+    close(r->a);
+    close(r->b);
+    r->a = r->b = -1;
+}
+
+bool relay_spliced(const relay_t *r) {
+    return r->half[0].pipe[0] != -1;
+}
+
+bool relay_done(const relay_t *r) {
+    return r->half[0].done && r->half[1].done;
+}
+
+#ifdef __linux__
+/* Move pipe contents out and refill the pipe until a socket would block. */
+static ssize_t pump_splice(relay_half_t *h) {
+    const unsigned flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+    ssize_t n, moved = 0;
+
+    for (;;) {
+        if (h->pending) {
+            n = splice(h->pipe[0], NULL, h->to, NULL, h->pending, flags);
+            if (n > 0) {
+                h->pending -= n;
+                h->bytes += n;
+                moved += n;
+                continue;
+            }
+        } else if (h->eof) {
+            return moved;
+        } else {
+            /* the pipe is empty, so this only blocks on the socket */
+            n = splice(h->from, NULL, h->pipe[1], NULL, RELAY_BUFSZ, flags);
+            if (n >= 0) {
+                h->pending = n;
+                h->eof = n == 0;
+                continue;
+            }
+        }
+        if (errno != EINTR) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? moved : -1;
+        }
+    }
+}
+#endif
+
+/* pump_splice() through h->buf, with recv() and send(). */
+static ssize_t pump_copy(relay_half_t *h) {
+    ssize_t n, moved = 0;
+
+    for (;;) {
+        if (h->pending) {
+            n = send(h->to, h->buf + h->off, h->pending, 0);
+            if (n > 0) {
+                h->off += n;
+                h->pending -= n;
+                h->bytes += n;
+                moved += n;
+                continue;
+            }
+        } else if (h->eof) {
+            return moved;
+        } else {
+            n = recv(h->from, h->buf, RELAY_BUFSZ, 0);
+            if (n >= 0) {
+                h->off = 0;
+                h->pending = n;
+                h->eof = n == 0;
+                continue;
+            }
+        }
+        if (errno != EINTR) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? moved : -1;
+        }
+    }
+}
+
+static ssize_t pump_half(relay_half_t *h) {
+    ssize_t moved;
+
+    if (h->done) {
+        return 0;
+    }
+#ifdef __linux__
+    moved = h->pipe[0] != -1 ? pump_splice(h) : pump_copy(h);
+#else
+    moved = pump_copy(h);
+#endif
+    if (moved != -1 && h->eof && !h->pending) {
+        /* the peer may have closed already; that's the same end */
+        shutdown(h->to, SHUT_WR);
+        h->done = true;
+    }
+    return moved;
+}
+
+ssize_t relay_pump(relay_t *r) {
+    ssize_t a, b;
+
+    if (-1 == (a = pump_half(&r->half[0])) ||
+        -1 == (b = pump_half(&r->half[1]))) {
+        return -1;
+    }
+    return a + b;
+}
+
+#ifdef __linux__
+int relay_epoll_add(relay_t *r, int epfd) {
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = r;
+    if (-1 == epoll_ctl(epfd, EPOLL_CTL_ADD, r->a, &ev)) {
+        return -1;
+    }
+    if (-1 == epoll_ctl(epfd, EPOLL_CTL_ADD, r->b, &ev)) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, r->a, &ev);
+        return -1;
+    }
+    return 0;
+}
+#else
+int relay_epoll_add(relay_t *r, int epfd) {
+    (void)r;
+    (void)epfd;
+    errno = ENOSYS;
+    return -1;
+}
+#endif
+
+int relay_run(relay_t *r) {
+    struct pollfd pfd[2];
+    relay_half_t *h;
+    int i;
+
+    pfd[0].fd = r->a;
+    pfd[1].fd = r->b;
+    while (relay_pump(r) != -1) {
+        if (relay_done(r)) {
+            return 0;
+        }
+        /* each half waits to write what it holds, or else to read more */
+        pfd[0].events = pfd[1].events = 0;
+        for (i = 0; i < 2; i++) {
+            h = &r->half[i];
+            if (h->pending) {
+                pfd[1 - i].events |= POLLOUT;
+            } else if (!h->done) {
+                pfd[i].events |= POLLIN;
+            }
+        }
+        if (-1 == poll(pfd, 2, -1) && errno != EINTR) {
+            break;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,243 @@
+/**
+ * @brief Bulk varint encoding and SIMD-assisted bulk decoding
+ * @file serial.c
+ */
+
+#include "serial.h"
+
+#include "utils.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    define SER_HAVE_X86 1
+#    include <immintrin.h>
+#endif
+
+/*********************************************************************
+ * Bulk decode
+ *
+ * In the spirit of Masked VByte: one movemask over a block of 16 or 32
+ * input bytes gives a bitmap of the bytes that end a value, so value
+ * boundaries come from counting trailing zeros instead of testing each
+ * byte. A value of up to 8 bytes (56 bits) is then assembled from one
+ * unaligned 8-byte load by squeezing out the continuation bits, with a
+ * single pext on CPUs with BMI2 (which AVX2 CPUs nearly all have). Longer
+ * values go through varint_decode(). A block made only of one-byte
+ * values, common for small counts and deltas, is simply widened.
+ *
+ * Kernels decode whole blocks while at least a block plus 8 bytes of
+ * input (for the 8-byte loads) and a block's worth of output remain, and
+ * return the number of bytes consumed; varint_decode_n() finishes the
+ * rest one value at a time.
+ *********************************************************************/
+
+typedef size_t (*decode_fn_t)(const uint8_t *p, size_t len, uint64_t *out,
+                              size_t n, size_t *count);
+
+/* the low len (1..8) bytes of the little-endian word x, 7 bits each */
+static inline uint64_t squeeze_swar(uint64_t x, size_t len) {
+    x &= 0x7f7f7f7f7f7f7f7fULL >> (64 - 8 * len);
+    x = (x & 0x007f007f007f007fULL) | ((x & 0x7f007f007f007f00ULL) >> 1);
+    x = (x & 0x00003fff00003fffULL) | ((x & 0x3fff00003fff0000ULL) >> 2);
+    return (x & 0x000000000fffffffULL) | ((x & 0x0fffffff00000000ULL) >> 4);
+}
+
+/**
+ * @brief Decode the values ending in a block, given the bitmap of their
+ * last bytes.
+ * @returns Bytes consumed: up to the end of the last complete value, or
+ * @c 0 if the first value cannot be decoded here.
+ */
+static inline __attribute__((always_inline)) size_t
+decode_ends(const uint8_t *p, size_t len, uint64_t ends, uint64_t *out,
+            size_t *count, uint64_t (*squeeze)(uint64_t x, size_t len)) {
+    size_t start = 0, end, k = *count;
+    uint64_t x;
+    int rv;
+
+    while (ends) {
+        end = __builtin_ctzll(ends) + 1;
+        ends &= ends - 1;
+        if (UNLIKELY(end - start > 8)) {
+            rv = varint_decode(p + start, len - start, &out[k]);
+            if (rv <= 0) {
+                break;
+            }
+            k++;
+            start += rv;
+            /* skip the terminators passed over */
+            ends &= ~0ULL << MIN(start, 63);
+            ends = start >= 64 ? 0 : ends;
+            continue;
+        }
+        memcpy(&x, p + start, sizeof(x));
+        out[k++] = squeeze(bo_le64(x), end - start);
+        start = end;
+    }
+    *count = k;
+    return start;
+}
+
+static size_t decode_scalar(const uint8_t *p, size_t len, uint64_t *out,
+                            size_t n, size_t *count) {
+    (void)p, (void)len, (void)out, (void)n;
+    *count = 0;
+    return 0;
+}
+
+#ifdef SER_HAVE_X86
+
+static size_t decode_sse2(const uint8_t *p, size_t len, uint64_t *out,
+                          size_t n, size_t *count) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v, w16, w32;
+    size_t pos = 0, k = 0, used;
+    unsigned ends;
+    int i;
+
+    while (len - pos >= 16 + 8 && n - k >= 16) {
+        v = _mm_loadu_si128((const __m128i *)(p + pos));
+        ends = ~_mm_movemask_epi8(v) & 0xffff;
+        if (ends == 0xffff) {
+            for (i = 0; i < 2; i++) {
+                w16 = i ? _mm_unpackhi_epi8(v, zero)
+                        : _mm_unpacklo_epi8(v, zero);
+                w32 = _mm_unpacklo_epi16(w16, zero);
+                _mm_storeu_si128((__m128i *)(out + k),
+                                 _mm_unpacklo_epi32(w32, zero));
+                _mm_storeu_si128((__m128i *)(out + k + 2),
+                                 _mm_unpackhi_epi32(w32, zero));
+                w32 = _mm_unpackhi_epi16(w16, zero);
+                _mm_storeu_si128((__m128i *)(out + k + 4),
+                                 _mm_unpacklo_epi32(w32, zero));
+                _mm_storeu_si128((__m128i *)(out + k + 6),
+                                 _mm_unpackhi_epi32(w32, zero));
+                k += 8;
+            }
+            pos += 16;
+            continue;
+        }
+        used = decode_ends(p + pos, len - pos, ends, out, &k, squeeze_swar);
+        if (!used) {
+            break;
+        }
+        pos += used;
+    }
+    *count = k;
+    return pos;
+}
+
+__attribute__((target("bmi2"))) static inline uint64_t
+squeeze_bmi2(uint64_t x, size_t len) {
+    return _pext_u64(x, 0x7f7f7f7f7f7f7f7fULL >> (64 - 8 * len));
+}
+
+__attribute__((target("avx2,bmi2"))) static size_t
+decode_avx2(const uint8_t *p, size_t len, uint64_t *out, size_t n,
+            size_t *count) {
+    __m256i v;
+    size_t pos = 0, k = 0, used;
+    uint32_t ends;
+    int i;
+
+    while (len - pos >= 32 + 8 && n - k >= 32) {
+        v = _mm256_loadu_si256((const __m256i *)(p + pos));
+        ends = ~(uint32_t)_mm256_movemask_epi8(v);
+        if (ends == 0xffffffff) {
+            for (i = 0; i < 32; i += 4) {
+                uint32_t four;
+
+                memcpy(&four, p + pos + i, sizeof(four));
+                _mm256_storeu_si256(
+                    (__m256i *)(out + k + i),
+                    _mm256_cvtepu8_epi64(_mm_cvtsi32_si128((int)four)));
+            }
+            k += 32;
+            pos += 32;
+            continue;
+        }
+        used = decode_ends(p + pos, len - pos, ends, out, &k, squeeze_bmi2);
+        if (!used) {
+            break;
+        }
+        pos += used;
+    }
+    *count = k;
+    return pos;
+}
+
+#endif /* SER_HAVE_X86 */
+
+static decode_fn_t decode_select(void) {
+#ifdef SER_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2")) {
+        return decode_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return decode_sse2;
+    }
+#endif /* SER_HAVE_X86 */
+    return decode_scalar;
+}
+
+ssize_t varint_decode_n(const void *buf, size_t len, uint64_t *values,
+                        size_t n, size_t *used) {
+    static decode_fn_t impl;
+    const uint8_t *p = buf;
+    decode_fn_t fn = __atomic_load_n(&impl, __ATOMIC_RELAXED);
+    size_t pos, k;
+    int rv = 0;
+
+    if (UNLIKELY(!fn)) {
+        fn = decode_select();
+        __atomic_store_n(&impl, fn, __ATOMIC_RELAXED);
+    }
+    pos = fn(p, len, values, n, &k);
+    for (; k < n; k++, pos += rv) {
+        rv = varint_decode(p + pos, len - pos, &values[k]);
+        if (rv <= 0) {
+            break;
+        }
+    }
+    *used = pos;
+    return rv == -1 ? -1 : (ssize_t)k;
+}
+
+/*********************************************************************
+ * Bulk encode
+ *
+ * The inverse of squeeze_swar(): values below 2^56 are spread into 7-bit
+ * groups, one per byte, and the continuation bits are or'ed in from the
+ * length, so every value is one 8-byte store with no data-dependent
+ * branches. Bytes past the value's end are overwritten by the next one.
+ *********************************************************************/
+
+static inline uint64_t spread(uint64_t v) {
+    v = (v & 0x000000000fffffffULL) | ((v & 0x00fffffff0000000ULL) << 4);
+    v = (v & 0x00003fff00003fffULL) | ((v & 0x0fffc0000fffc000ULL) << 2);
+    return (v & 0x007f007f007f007fULL) | ((v & 0x3f803f803f803f80ULL) << 1);
+}
+
+size_t varint_encode_n(const uint64_t *values, size_t n, uint8_t *out) {
+    uint8_t *p = out;
+    uint64_t x;
+    size_t i, len;
+
+    for (i = 0; i < n; i++) {
+        if (values[i] < 0x80) {
+            *p++ = (uint8_t)values[i];
+            continue;
+        }
+        if (UNLIKELY(values[i] >> 56)) {
+            p += varint_encode(values[i], p);
+            continue;
+        }
+        len = varint_len(values[i]);
+        x = spread(values[i]) |
+            (0x8080808080808080ULL & ((1ULL << (8 * (len - 1))) - 1));
+        x = bo_le64(x);
+        memcpy(p, &x, sizeof(x));
+        p += len;
+    }
+    return p - out;
+}
@@ -0,0 +1,325 @@
+/**
+ * @brief Shared-memory message ring in a memfd, with futex wakeups
+ * @file shm_ring.c
+ */
+
+#define _GNU_SOURCE /* memfd_create() */
+
+#include "shm_ring.h"
+
+#include <errno.h>
+#include <string.h>
+
+size_t shm_ring_max_msg(const shm_ring_t *r) {
+    return r->size / 2 - 8;
+}
+
+#ifdef __linux__
+
+#    include <linux/futex.h>
+#    include <sched.h>
+#    include <stdbool.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <sys/syscall.h>
+#    include <time.h>
+#    include <unistd.h>
+#    include "instrument.h"
+#    include "utils.h"
+
+#    define MAGIC 0x474e4952 /* "RING" */
+#    define HEADER_SIZE 4096 /* the data starts a page in */
+#    define MIN_SIZE 4096
+#    define MAX_SIZE ((size_t)1 << 40)
+#    define PAD UINT32_MAX   /* length of the filler up to the end of the ring */
+#    define NO_DEADLINE UINT64_MAX
+
+/* a message: its length, 4 unused bytes, then the data, 8-byte aligned */
+#    define RECORD(len) (8 + (((len) + 7) & ~(size_t)7))
+
+/*
+ * Positions count bytes produced and consumed since the start, so the ring
+ * is empty when they are equal and full when they are size apart. Each side
+ * bumps a futex word after moving its position, and only wakes the other if
+ * it has said it is about to sleep.
+ */
+struct ShmRingHeader {
+    uint32_t magic;
+    uint32_t shutdown;
+    uint64_t size;
+    /* written by the consumer */
+    ALIGNED(64) uint64_t head;
+    uint32_t space_seq;        /* futex: bumped as head moves */
+    uint32_t producer_waiting;
+    /* written by the producer */
+    ALIGNED(64) uint64_t tail;
+    uint32_t data_seq;         /* futex: bumped as tail moves, or on shutdown */
+    uint32_t consumer_waiting;
+};
+
+static int map(shm_ring_t *r, int fd, size_t map_len) {
+    void *p = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (p == MAP_FAILED) {
+        return -1;
+    }
+    r->hdr = p;
+    r->data = (unsigned char *)p + HEADER_SIZE;
+    r->map_len = map_len;
+    r->fd = fd;
+    return 0;
+}
+
+int shm_ring_create(shm_ring_t *r, size_t size) {
+    size_t n = MIN_SIZE;
+    int fd;
+
+    if (!r || !size || size > MAX_SIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    while (n < size) {
+        n <<= 1;
+    }
+    if (-1 == (fd = memfd_create("shm_ring", MFD_CLOEXEC))) {
+        return -1;
+    }
+    if (-1 == ftruncate(fd, HEADER_SIZE + n) ||
+        -1 == map(r, fd, HEADER_SIZE + n)) {
+        close(fd);
+        return -1;
+    }
+    r->size = n;
+    r->hdr->size = n;
+    __atomic_store_n(&r->hdr->magic, MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int shm_ring_attach(shm_ring_t *r, int fd) {
+    struct stat st;
+    size_t size;
+
+    if (!r || -1 == fstat(fd, &st)) {
+        errno = r ? errno : EINVAL;
+        return -1;
+    }
+    if (st.st_size < HEADER_SIZE + MIN_SIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (-1 == map(r, fd, st.st_size)) {
+        return -1;
+    }
+    size = r->hdr->size;
+    if (__atomic_load_n(&r->hdr->magic, __ATOMIC_ACQUIRE) != MAGIC ||
+        size < MIN_SIZE || size & (size - 1) ||
+        HEADER_SIZE + size != (size_t)st.st_size) {
+        munmap(r->hdr, r->map_len);
+        memset(r, 0, sizeof(*r));
+        r->fd = -1;
+        errno = EINVAL;
+        return -1;
+    }
+    r->size = size;
+    return 0;
+}
+
+void shm_ring_close(shm_ring_t *r) {
+    if (!r || !r->hdr) {
+        return;
+    }
+    munmap(r->hdr, r->map_len);
+    close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+static void notify(uint32_t *seq, const uint32_t *waiting) {
+    /* the bump orders the position store before the load of *waiting */
+    __atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST)) {
+        syscall(SYS_futex, seq, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+/*
+ * Wait until *pos reaches target (or *shutdown is set, if given). The waiter
+ * reads *seq before checking, and sets *waiting before sleeping on *seq
+ * having that value: the other side moves its position, then bumps *seq,
+ * then reads *waiting, so either it sees the waiter and wakes it, or the
+ * waiter's FUTEX_WAIT sees the bump and returns straight away.
+ */
+static int wait_for(const uint64_t *pos, uint64_t target, uint32_t *seq,
+                    uint32_t *waiting, const uint32_t *shutdown,
+                    int timeout_ms) {
+    uint64_t deadline = 0, now;
+    struct timespec ts, *tsp;
+    uint32_t val;
+    int spins = 0;
+
+    for (;;) {
+        val = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        if (__atomic_load_n(pos, __ATOMIC_ACQUIRE) >= target ||
+            (shutdown && __atomic_load_n(shutdown, __ATOMIC_ACQUIRE))) {
+            return 0;
+        }
+        now = timeout_ms < 0 ? 0 : inst_now_ns();
+        if (!deadline) {
+            deadline = timeout_ms < 0 ? NO_DEADLINE
+                                      : now + (uint64_t)timeout_ms * 1000000;
+        }
+        if (now >= deadline) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        if (spins++ < SHM_RING_SPIN) {
+            sched_yield();
+            continue;
+        }
+        tsp = NULL;
+        if (deadline != NO_DEADLINE) {
+            ts.tv_sec = (deadline - now) / 1000000000;
+            ts.tv_nsec = (deadline - now) % 1000000000;
+            tsp = &ts;
+        }
+        __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+        /* EAGAIN (bumped already), EINTR and ETIMEDOUT all mean check again */
+        syscall(SYS_futex, seq, FUTEX_WAIT, val, tsp, NULL, 0);
+        __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+    }
+}
+
+int shm_ring_send(shm_ring_t *r, const void *msg, size_t len, int timeout_ms) {
+    shm_ring_header_t *h = r->hdr;
+    uint64_t tail, need;
+    size_t pos, room, rec = RECORD(len);
+    uint32_t n = len, pad = PAD;
+
+    if (!len || len > shm_ring_max_msg(r)) {
+        errno = len ? EMSGSIZE : EINVAL;
+        return -1;
+    }
+    if (__atomic_load_n(&h->shutdown, __ATOMIC_RELAXED)) {
+        errno = EPIPE;
+        return -1;
+    }
+    tail = __atomic_load_n(&h->tail, __ATOMIC_RELAXED); /* ours to write */
+    pos = tail & (r->size - 1);
+    room = r->size - pos;
+    /* a message doesn't wrap: if it won't fit before the end, pad to it */
+    need = rec <= room ? rec : room + rec;
+    if (-1 == wait_for(&h->head, tail + need > r->size ? tail + need - r->size : 0,
+                       &h->space_seq, &h->producer_waiting, NULL, timeout_ms)) {
+        return -1;
+    }
+    if (rec > room) {
+        memcpy(r->data + pos, &pad, sizeof(pad));
+        tail += room;
+        pos = 0;
+    }
+    memcpy(r->data + pos, &n, sizeof(n));
+    memcpy(r->data + pos + 8, msg, len);
+    __atomic_store_n(&h->tail, tail + rec, __ATOMIC_RELEASE);
+    notify(&h->data_seq, &h->consumer_waiting);
+    return 0;
+}
+
+ssize_t shm_ring_recv(shm_ring_t *r, void *buf, size_t len, int timeout_ms) {
+    shm_ring_header_t *h = r->hdr;
+    uint64_t head = __atomic_load_n(&h->head, __ATOMIC_RELAXED), avail;
+    size_t pos;
+    uint32_t n;
+
+    /*
+     * The peer shares the mapping, so don't trust what it wrote: each record,
+     * padding included, must lie within what was produced and within the
+     * ring, or the copy would read past the mapping.
+     */
+    for (;;) {
+        if (-1 == wait_for(&h->tail, head + 1, &h->data_seq,
+                           &h->consumer_waiting, &h->shutdown, timeout_ms)) {
+            return -1;
+        }
+        avail = __atomic_load_n(&h->tail, __ATOMIC_ACQUIRE) - head;
+        if (!avail) {
+            return 0; /* shut down, and every message read */
+        }
+        pos = head & (r->size - 1);
+        if (avail > r->size || avail < 8) {
+            errno = EBADMSG;
+            return -1;
+        }
+        memcpy(&n, r->data + pos, sizeof(n));
+        if (n != PAD) {
+            break;
+        }
+        if (r->size - pos > avail) {
+            errno = EBADMSG;
+            return -1;
+        }
+        head += r->size - pos;
+        __atomic_store_n(&h->head, head, __ATOMIC_RELEASE);
+        notify(&h->space_seq, &h->producer_waiting);
+    }
+    if (RECORD(n) > avail || pos + RECORD(n) > r->size) {
+        errno = EBADMSG;
+        return -1;
+    }
+    if (n > len) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    memcpy(buf, r->data + pos + 8, n);
+    __atomic_store_n(&h->head, head + RECORD(n), __ATOMIC_RELEASE);
+    notify(&h->space_seq, &h->producer_waiting);
+    return n;
+}
+
+void shm_ring_shutdown(shm_ring_t *r) {
+    __atomic_store_n(&r->hdr->shutdown, 1, __ATOMIC_RELEASE);
+    notify(&r->hdr->data_seq, &r->hdr->consumer_waiting);
+}
+
+#else /* !__linux__ */
+
+int shm_ring_create(shm_ring_t *r, size_t size) {
+    (void)r;
+    (void)size;
+    errno = ENOSYS;
+    return -1;
+}
+
+int shm_ring_attach(shm_ring_t *r, int fd) {
+    (void)r;
+    (void)fd;
+    errno = ENOSYS;
+    return -1;
+}
+
+void shm_ring_close(shm_ring_t *r) {
+    (void)r;
+}
+
+int shm_ring_send(shm_ring_t *r, const void *msg, size_t len, int timeout_ms) {
+    (void)r;
+    (void)msg;
+    (void)len;
+    (void)timeout_ms;
+    errno = ENOSYS;
+    return -1;
+}
+
+ssize_t shm_ring_recv(shm_ring_t *r, void *buf, size_t len, int timeout_ms) {
+    (void)r;
+    (void)buf;
+    (void)len;
+    (void)timeout_ms;
+    errno = ENOSYS;
+    return -1;
+}
+
+void shm_ring_shutdown(shm_ring_t *r) {
+    (void)r;
+}
+
+#endif /* __linux__ */
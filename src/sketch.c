@@ -0,0 +1,468 @@
+/**
+ * @brief HyperLogLog and Count-Min sketches with SIMD merges
+ * @file sketch.c
+ */
+
+#include "sketch.h"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include "radix.h"
+#include "utils.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    define SK_HAVE_X86 1
+#    include <immintrin.h>
+#endif
+
+/* the fewest entries worth keeping a sparse list for */
+#define SPARSE_MIN_CAP 64
+
+/*********************************************************************
+ * Merge kernels
+ *
+ * HyperLogLog registers merge by bytewise max, Count-Min counters by
+ * 64-bit addition, a vector at a time.
+ *********************************************************************/
+
+typedef void (*max_fn_t)(uint8_t *dst, const uint8_t *src, size_t n);
+typedef void (*add_fn_t)(uint64_t *dst, const uint64_t *src, size_t n);
+
+static void max_scalar(uint8_t *dst, const uint8_t *src, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = MAX(dst[i], src[i]);
+    }
+}
+
+static void add_scalar(uint64_t *dst, const uint64_t *src, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] += src[i];
+    }
+}
+
+#ifdef SK_HAVE_X86
+
+/* register counts are powers of two of at least 16 */
+__attribute__((target("sse2"))) static void
+max_sse2(uint8_t *dst, const uint8_t *src, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i += 16) {
+        _mm_storeu_si128(
+            (__m128i *)(dst + i),
+            _mm_max_epu8(_mm_loadu_si128((const __m128i *)(dst + i)),
+                         _mm_loadu_si128((const __m128i *)(src + i))));
+    }
+}
+
+__attribute__((target("avx2"))) static void
+max_avx2(uint8_t *dst, const uint8_t *src, size_t n) {
+    size_t i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        _mm256_storeu_si256(
+            (__m256i *)(dst + i),
+            _mm256_max_epu8(_mm256_loadu_si256((const __m256i *)(dst + i)),
+                            _mm256_loadu_si256((const __m256i *)(src + i))));
+    }
+    max_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+add_avx2(uint64_t *dst, const uint64_t *src, size_t n) {
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        _mm256_storeu_si256(
+            (__m256i *)(dst + i),
+            _mm256_add_epi64(_mm256_loadu_si256((const __m256i *)(dst + i)),
+                             _mm256_loadu_si256((const __m256i *)(src + i))));
+    }
+    add_scalar(dst + i, src + i, n - i);
+}
+
+#endif /* SK_HAVE_X86 */
+
+typedef struct {
+    max_fn_t max;
+    add_fn_t add;
+} kernels_t;
+
+static const kernels_t *kernels_select(void) {
+    static const kernels_t scalar = {max_scalar, add_scalar};
+#ifdef SK_HAVE_X86
+    static const kernels_t sse2 = {max_sse2, add_scalar};
+    static const kernels_t avx2 = {max_avx2, add_avx2};
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return &sse2;
+    }
+#endif /* SK_HAVE_X86 */
+    return &scalar;
+}
+
+static const kernels_t *kernels(void) {
+    static const kernels_t *impl;
+    const kernels_t *k = __atomic_load_n(&impl, __ATOMIC_RELAXED);
+
+    if (UNLIKELY(!k)) {
+        k = kernels_select();
+        __atomic_store_n(&impl, k, __ATOMIC_RELAXED);
+    }
+    return k;
+}
+
+/*********************************************************************
+ * HyperLogLog
+ *
+ * A hash's top p bits pick a register, and its rank is one more than the
+ * number of leading zeros in the rest; a register keeps the largest rank
+ * it sees. Sparse entries are the same at precision 25, packed as
+ * index << 6 | rank, so sorting them groups each index with its largest
+ * rank last, and each converts exactly to a dense register update.
+ *********************************************************************/
+
+static size_t nregs(const hll_t *h) {
+    return (size_t)1 << h->p;
+}
+
+static uint32_t sparse_entry(uint64_t hash) {
+    uint64_t w = hash << HLL_SPARSE_PRECISION;
+    uint32_t rank = w ? __builtin_clzll(w) + 1 : 64 - HLL_SPARSE_PRECISION + 1;
+
+    return (uint32_t)(hash >> (64 - HLL_SPARSE_PRECISION)) << 6 | rank;
+}
+
+static void dense_add(uint8_t *regs, unsigned p, uint64_t hash) {
+    uint64_t w = hash << p;
+    uint8_t rank = w ? (uint8_t)(__builtin_clzll(w) + 1) : (uint8_t)(65 - p);
+    size_t i = hash >> (64 - p);
+
+    regs[i] = MAX(regs[i], rank);
+}
+
+static void dense_add_entry(uint8_t *regs, unsigned p, uint32_t entry) {
+    unsigned extra = HLL_SPARSE_PRECISION - p;
+    uint32_t index = entry >> 6, mid = index & ((1u << extra) - 1);
+    uint8_t rank;
+
+    /* the bits between the two precisions count towards the dense rank */
+    if (mid) {
+        rank = __builtin_clz(mid) - (32 - extra) + 1;
+    } else {
+        rank = extra + (entry & 63);
+    }
+    index >>= extra;
+    regs[index] = MAX(regs[index], rank);
+}
+
+static int to_dense(hll_t *h) {
+    uint8_t *regs = al_calloc(h->alloc, nregs(h), 1);
+    size_t i;
+
+    if (!regs) {
+        return -1;
+    }
+    for (i = 0; i < h->nsparse; i++) {
+        dense_add_entry(regs, h->p, h->sparse[i]);
+    }
+    al_free(h->alloc, h->sparse, h->sparse_cap * sizeof(uint32_t));
+    h->sparse = NULL;
+    h->nsparse = h->nsorted = h->sparse_cap = 0;
+    h->regs = regs;
+    return 0;
+}
+
+/* sort the sparse list and keep the largest rank for each index */
+static int normalize(hll_t *h) {
+    size_t i, n = 0;
+
+    if (h->nsorted == h->nsparse) {
+        return 0;
+    }
+    if (radix_sort_u32(h->sparse, h->nsparse, NULL) == -1) {
+        return -1;
+    }
+    for (i = 0; i < h->nsparse; i++) {
+        if (n && h->sparse[n - 1] >> 6 == h->sparse[i] >> 6) {
+            n--;
+        }
+        h->sparse[n++] = h->sparse[i];
+    }
+    h->nsparse = h->nsorted = n;
+    return 0;
+}
+
+/* make room for one more sparse entry, or go dense */
+static int sparse_reserve(hll_t *h) {
+    uint32_t *sparse;
+    size_t cap;
+
+    if (h->nsparse < h->sparse_cap) {
+        return 0;
+    }
+    if (normalize(h) == -1) {
+        return -1;
+    }
+    if (h->nsparse <= h->sparse_cap / 2) {
+        return 0;
+    }
+    /* past the size of the dense registers, dense is smaller */
+    cap = 2 * h->sparse_cap;
+    if (cap * sizeof(uint32_t) > nregs(h)) {
+        return to_dense(h);
+    }
+    sparse = al_realloc(h->alloc, h->sparse, h->sparse_cap * sizeof(uint32_t),
+                        cap * sizeof(uint32_t));
+    if (!sparse) {
+        return -1;
+    }
+    h->sparse = sparse;
+    h->sparse_cap = cap;
+    return 0;
+}
+
+static int sparse_add(hll_t *h, uint32_t entry) {
+    if (sparse_reserve(h) == -1) {
+        return -1;
+    }
+    if (h->regs) {
+        dense_add_entry(h->regs, h->p, entry);
+    } else {
+        h->sparse[h->nsparse++] = entry;
+    }
+    return 0;
+}
+
+int hll_init(hll_t *h, unsigned p, allocator_t *alloc) {
+    if (!h || p < HLL_MIN_PRECISION || p > HLL_MAX_PRECISION) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(h, 0, sizeof(*h));
+    h->p = p;
+    h->alloc = alloc;
+    if (nregs(h) / sizeof(uint32_t) < SPARSE_MIN_CAP) {
+        h->regs = al_calloc(alloc, nregs(h), 1);
+        return h->regs ? 0 : -1;
+    }
+    h->sparse_cap = SPARSE_MIN_CAP;
+    h->sparse = al_alloc(alloc, h->sparse_cap * sizeof(uint32_t));
+    return h->sparse ? 0 : -1;
+}
+
+void hll_destroy(hll_t *h) {
+    if (h) {
+        al_free(h->alloc, h->regs, h->regs ? nregs(h) : 0);
+        al_free(h->alloc, h->sparse, h->sparse_cap * sizeof(uint32_t));
+        h->regs = NULL;
+        h->sparse = NULL;
+    }
+}
+
+void hll_clear(hll_t *h) {
+    if (h->regs) {
+        memset(h->regs, 0, nregs(h));
+    } else {
+        h->nsparse = h->nsorted = 0;
+    }
+}
+
+int hll_add(hll_t *h, uint64_t hash) {
+    if (h->regs) {
+        dense_add(h->regs, h->p, hash);
+        return 0;
+    }
+    return sparse_add(h, sparse_entry(hash));
+}
+
+/* Ertl, "New cardinality estimation algorithms for HyperLogLog sketches"
+ * (2017): the improved raw estimator */
+static double sigma(double x) {
+    double y = 1, z = x, prev;
+
+    if (x == 1) {
+        return INFINITY;
+    }
+    do {
+        x *= x;
+        prev = z;
+        z += x * y;
+        y += y;
+    } while (z != prev);
+    return z;
+}
+
+static double tau(double x) {
+    double y = 1, z = 1 - x, prev;
+
+    if (x == 0 || x == 1) {
+        return 0;
+    }
+    do {
+        x = sqrt(x);
+        prev = z;
+        y *= 0.5;
+        z -= (1 - x) * (1 - x) * y;
+    } while (z != prev);
+    return z / 3;
+}
+
+double hll_count(hll_t *h) {
+    double m = (double)nregs(h), sparse_m, z;
+    size_t hist[64] = {0}, i;
+    unsigned q = 64 - h->p;
+    int k;
+
+    if (!h->regs) {
+        /* linear counting over the 2^25 sparse registers */
+        if (normalize(h) == -1) {
+            return -1;
+        }
+        sparse_m = (double)((size_t)1 << HLL_SPARSE_PRECISION);
+        return sparse_m * log(sparse_m / (sparse_m - h->nsparse));
+    }
+    for (i = 0; i < nregs(h); i++) {
+        hist[h->regs[i]]++;
+    }
+    z = m * tau(1 - hist[q + 1] / m);
+    for (k = q; k >= 1; k--) {
+        z = 0.5 * (z + hist[k]);
+    }
+    z += m * sigma(hist[0] / m);
+    return m * m / (2 * log(2) * z);
+}
+
+int hll_merge(hll_t *dst, const hll_t *src) {
+    size_t i;
+
+    if (!dst || !src || dst->p != src->p) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (src->regs) {
+        if (!dst->regs && to_dense(dst) == -1) {
+            return -1;
+        }
+        kernels()->max(dst->regs, src->regs, nregs(dst));
+        return 0;
+    }
+    for (i = 0; i < src->nsparse; i++) {
+        if (sparse_add(dst, src->sparse[i]) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*********************************************************************
+ * Count-Min
+ *
+ * Row r's counter for a hash is (h1 + r * h2) mod width, from the two
+ * halves of the hash (Kirsch and Mitzenmacher's double hashing).
+ *********************************************************************/
+
+/* callers read the fields of c into locals first, as stores to the
+ * counters could alias them and force reloads */
+static inline size_t cms_index(uint64_t hash, unsigned row, size_t width) {
+    uint64_t h2 = (hash >> 32 | hash << 32) | 1;
+
+    return row * width + ((hash + row * h2) & (width - 1));
+}
+
+int cms_init_size(cms_t *c, size_t width, unsigned depth, allocator_t *alloc) {
+    size_t w = 1;
+
+    if (!c || !width || !depth) {
+        errno = EINVAL;
+        return -1;
+    }
+    while (w < width && w <= SIZE_MAX / 2) {
+        w *= 2;
+    }
+    if (w < width || w > SIZE_MAX / sizeof(uint64_t) / depth) {
+        errno = ENOMEM;
+        return -1;
+    }
+    c->counts = al_calloc(alloc, w * depth, sizeof(uint64_t));
+    if (!c->counts) {
+        return -1;
+    }
+    c->width = w;
+    c->depth = depth;
+    c->total = 0;
+    c->alloc = alloc;
+    return 0;
+}
+
+int cms_init(cms_t *c, double epsilon, double delta, allocator_t *alloc) {
+    if (!(epsilon > 0 && epsilon < 1 && delta > 0 && delta < 1)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return cms_init_size(c, (size_t)ceil(exp(1) / epsilon),
+                         (unsigned)ceil(log(1 / delta)), alloc);
+}
+
+void cms_destroy(cms_t *c) {
+    if (c) {
+        al_free(c->alloc, c->counts, c->width * c->depth * sizeof(uint64_t));
+        c->counts = NULL;
+    }
+}
+
+void cms_clear(cms_t *c) {
+    memset(c->counts, 0, c->width * c->depth * sizeof(uint64_t));
+    c->total = 0;
+}
+
+uint64_t cms_add(cms_t *c, uint64_t hash, uint64_t count) {
+    uint64_t *counts = c->counts, est = UINT64_MAX, *ctr;
+    size_t width = c->width;
+    unsigned row, depth = c->depth;
+
+    for (row = 0; row < depth; row++) {
+        est = MIN(est, counts[cms_index(hash, row, width)]);
+    }
+    /* conservative update: raise counters to the new estimate, no further;
+     * branch-free, as which counters are lowest is unpredictable */
+    est = est > UINT64_MAX - count ? UINT64_MAX : est + count;
+    for (row = 0; row < depth; row++) {
+        ctr = counts + cms_index(hash, row, width);
+        *ctr = MAX(*ctr, est);
+    }
+    c->total += count;
+    return est;
+}
+
+uint64_t cms_estimate(const cms_t *c, uint64_t hash) {
+    const uint64_t *counts = c->counts;
+    uint64_t est = UINT64_MAX;
+    size_t width = c->width;
+    unsigned row, depth = c->depth;
+
+    for (row = 0; row < depth; row++) {
+        est = MIN(est, counts[cms_index(hash, row, width)]);
+    }
+    return est;
+}
+
+int cms_merge(cms_t *dst, const cms_t *src) {
+    if (!dst || !src || dst->width != src->width ||
+        dst->depth != src->depth) {
+        errno = EINVAL;
+        return -1;
+    }
+    kernels()->add(dst->counts, src->counts, dst->width * dst->depth);
+    dst->total += src->total;
+    return 0;
+}
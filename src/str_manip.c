@@ -0,0 +1,574 @@
+/**
+ * @brief String slices, SIMD searching and case folding, and string builders
+ * @file str_manip.c
+ */
+
+#include "str_manip.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "utils.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    define STR_HAVE_X86 1
+#    include <immintrin.h>
+#endif
+
+/* below this a vector setup costs more than it saves */
+#define SIMD_MIN_LEN 32
+
+/* smallest buffer a builder allocates */
+#define SB_MIN_CAP 16
+
+static inline bool is_space(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline char ascii_lower(char c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+int str_cmp(str_t a, str_t b) {
+    int cmp = memcmp(a.ptr, b.ptr, MIN(a.len, b.len));
+
+    if (cmp) {
+        return cmp;
+    }
+    return (a.len > b.len) - (a.len < b.len);
+}
+
+ssize_t str_find_char(str_t s, char c) {
+    const char *p = s.len ? memchr(s.ptr, c, s.len) : NULL;
+
+    return p ? p - s.ptr : -1;
+}
+
+/*********************************************************************
+ * Substring search kernels
+ *
+ * The vector kernels compare a block of candidate positions against the
+ * needle's first and last bytes at once, and memcmp() only the middle of
+ * positions where both match (Mula's "generic SIMD" strstr). Real text
+ * rarely matches both, so the inner memcmp() seldom runs. Each kernel is
+ * called with 2 <= nlen <= len.
+ *********************************************************************/
+
+typedef ssize_t (*find_fn_t)(const char *s, size_t len, const char *n,
+                             size_t nlen);
+
+static ssize_t find_scalar(const char *s, size_t len, const char *n,
+                           size_t nlen) {
+    const char *p = s, *end = s + len - nlen + 1;
+
+    while ((p = memchr(p, n[0], end - p))) {
+        if (!memcmp(p + 1, n + 1, nlen - 1)) {
+            return p - s;
+        }
+        p++;
+    }
+    return -1;
+}
+
+/* finish a vector scan at position i with a narrower kernel */
+static ssize_t find_tail(find_fn_t fn, const char *s, size_t len,
+                         const char *n, size_t nlen, size_t i) {
+    ssize_t pos;
+
+    if (len - i < nlen) {
+        return -1;
+    }
+    pos = fn(s + i, len - i, n, nlen);
+    return pos < 0 ? -1 : pos + (ssize_t)i;
+}
+
+#ifdef STR_HAVE_X86
+
+static ssize_t find_sse2(const char *s, size_t len, const char *n,
+                         size_t nlen) {
+    const __m128i first = _mm_set1_epi8(n[0]);
+    const __m128i last = _mm_set1_epi8(n[nlen - 1]);
+    __m128i a, b;
+    unsigned mask;
+    size_t i;
+
+    /* positions i..i+15 while the last byte of each stays in bounds */
+    for (i = 0; i + nlen + 15 <= len; i += 16) {
+        a = _mm_loadu_si128((const __m128i *)(s + i));
+        b = _mm_loadu_si128((const __m128i *)(s + i + nlen - 1));
+        mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask) {
+            size_t at = i + __builtin_ctz(mask);
+            if (!memcmp(s + at + 1, n + 1, nlen - 2)) {
+                return at;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return find_tail(find_scalar, s, len, n, nlen, i);
+}
+
+/* 64 positions per iteration: two 32-byte blocks tested with one branch */
+__attribute__((target("avx2"))) static ssize_t
+find_avx2(const char *s, size_t len, const char *n, size_t nlen) {
+    const __m256i first = _mm256_set1_epi8(n[0]);
+    const __m256i last = _mm256_set1_epi8(n[nlen - 1]);
+    __m256i m0, m1;
+    uint64_t mask;
+    size_t i;
+
+    for (i = 0; i + nlen + 63 <= len; i += 64) {
+        m0 = _mm256_and_si256(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(s + i)),
+                              first),
+            _mm256_cmpeq_epi8(
+                _mm256_loadu_si256((const __m256i *)(s + i + nlen - 1)), last));
+        m1 = _mm256_and_si256(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(s + i + 32)),
+                              first),
+            _mm256_cmpeq_epi8(
+                _mm256_loadu_si256((const __m256i *)(s + i + nlen + 31)), last));
+        if (LIKELY(_mm256_testz_si256(_mm256_or_si256(m0, m1),
+                                      _mm256_or_si256(m0, m1)))) {
+            continue;
+        }
+        mask = (uint32_t)_mm256_movemask_epi8(m0) |
+               (uint64_t)(uint32_t)_mm256_movemask_epi8(m1) << 32;
+        while (mask) {
+            size_t at = i + __builtin_ctzll(mask);
+            if (!memcmp(s + at + 1, n + 1, nlen - 2)) {
+                return at;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return find_tail(find_sse2, s, len, n, nlen, i);
+}
+
+#endif /* STR_HAVE_X86 */
+
+/*********************************************************************
+ * ASCII case conversion kernels
+ *
+ * Case is flipped by XOR with 0x20 on the bytes in [lo, lo + 25], where lo
+ * is 'A' or 'a'. Adding 0x80 - lo moves that range to the bottom of the
+ * signed bytes, so one signed compare finds it and bytes >= 0x80 never match.
+ *********************************************************************/
+
+typedef void (*case_fn_t)(char *dst, const char *src, size_t len, char lo);
+typedef bool (*eq_nocase_fn_t)(const char *a, const char *b, size_t len);
+
+static void case_scalar(char *dst, const char *src, size_t len, char lo) {
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        dst[i] = (unsigned char)(src[i] - lo) < 26 ? src[i] ^ 0x20 : src[i];
+    }
+}
+
+static bool eq_nocase_scalar(const char *a, const char *b, size_t len) {
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (ascii_lower(a[i]) != ascii_lower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef STR_HAVE_X86
+
+static inline __m128i flip_case_sse2(__m128i v, char lo) {
+    const __m128i in = _mm_cmplt_epi8(_mm_add_epi8(v, _mm_set1_epi8(0x80 - lo)),
+                                      _mm_set1_epi8(-128 + 26));
+
+    return _mm_xor_si128(v, _mm_and_si128(in, _mm_set1_epi8(0x20)));
+}
+
+static void case_sse2(char *dst, const char *src, size_t len, char lo) {
+    __m128i v;
+
+    for (; len >= 16; src += 16, dst += 16, len -= 16) {
+        v = _mm_loadu_si128((const __m128i *)src);
+        _mm_storeu_si128((__m128i *)dst, flip_case_sse2(v, lo));
+    }
+    case_scalar(dst, src, len, lo);
+}
+
+static bool eq_nocase_sse2(const char *a, const char *b, size_t len) {
+    __m128i x, y;
+
+    for (; len >= 16; a += 16, b += 16, len -= 16) {
+        x = flip_case_sse2(_mm_loadu_si128((const __m128i *)a), 'A');
+        y = flip_case_sse2(_mm_loadu_si128((const __m128i *)b), 'A');
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff) {
+            return false;
+        }
+    }
+    return eq_nocase_scalar(a, b, len);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+flip_case_avx2(__m256i v, char lo) {
+    const __m256i in = _mm256_cmpgt_epi8(
+        _mm256_set1_epi8(-128 + 26),
+        _mm256_add_epi8(v, _mm256_set1_epi8(0x80 - lo)));
+
+    return _mm256_xor_si256(v, _mm256_and_si256(in, _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2"))) static void
+case_avx2(char *dst, const char *src, size_t len, char lo) {
+    __m256i v;
+
+    for (; len >= 32; src += 32, dst += 32, len -= 32) {
+        v = _mm256_loadu_si256((const __m256i *)src);
+        _mm256_storeu_si256((__m256i *)dst, flip_case_avx2(v, lo));
+    }
+    case_sse2(dst, src, len, lo);
+}
+
+/* equal bytes need no folding, so only blocks that differ are folded */
+__attribute__((target("avx2"))) static bool
+eq_nocase_avx2(const char *a, const char *b, size_t len) {
+    __m256i x, y;
+
+    for (; len >= 32; a += 32, b += 32, len -= 32) {
+        x = _mm256_loadu_si256((const __m256i *)a);
+        y = _mm256_loadu_si256((const __m256i *)b);
+        if (LIKELY(_mm256_testc_si256(_mm256_cmpeq_epi8(x, y),
+                                      _mm256_set1_epi8(-1)))) {
+            continue;
+        }
+        x = flip_case_avx2(x, 'A');
+        y = flip_case_avx2(y, 'A');
+        if (!_mm256_testc_si256(_mm256_cmpeq_epi8(x, y), _mm256_set1_epi8(-1))) {
+            return false;
+        }
+    }
+    return eq_nocase_sse2(a, b, len);
+}
+
+#endif /* STR_HAVE_X86 */
+
+/*********************************************************************
+ * Kernel selection
+ *********************************************************************/
+
+typedef struct StrKernels {
+    find_fn_t find;
+    case_fn_t convert_case;
+    eq_nocase_fn_t eq_nocase;
+} str_kernels_t;
+
+static const str_kernels_t scalar_kernels = {find_scalar, case_scalar,
+                                             eq_nocase_scalar};
+#ifdef STR_HAVE_X86
+static const str_kernels_t sse2_kernels = {find_sse2, case_sse2,
+                                           eq_nocase_sse2};
+static const str_kernels_t avx2_kernels = {find_avx2, case_avx2,
+                                           eq_nocase_avx2};
+#endif /* STR_HAVE_X86 */
+
+static const str_kernels_t *kernels_select(void) {
+#ifdef STR_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &avx2_kernels;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return &sse2_kernels;
+    }
+#endif /* STR_HAVE_X86 */
+    return &scalar_kernels;
+}
+
+static inline const str_kernels_t *kernels(void) {
+    static const str_kernels_t *impl;
+    const str_kernels_t *k = __atomic_load_n(&impl, __ATOMIC_RELAXED);
+
+    if (UNLIKELY(!k)) {
+        k = kernels_select();
+        __atomic_store_n(&impl, k, __ATOMIC_RELAXED);
+    }
+    return k;
+}
+
+ssize_t str_find(str_t s, str_t needle) {
+    if (needle.len == 0) {
+        return 0;
+    }
+    if (needle.len > s.len) {
+        return -1;
+    }
+    if (needle.len == 1) {
+        return str_find_char(s, needle.ptr[0]);
+    }
+    if (s.len < SIMD_MIN_LEN) {
+        return find_scalar(s.ptr, s.len, needle.ptr, needle.len);
+    }
+    return kernels()->find(s.ptr, s.len, needle.ptr, needle.len);
+}
+
+size_t str_count(str_t s, str_t needle) {
+    size_t count = 0;
+    ssize_t pos;
+
+    if (needle.len == 0) {
+        return 0;
+    }
+    while ((pos = str_find(s, needle)) >= 0) {
+        count++;
+        s = str_sub(s, pos + needle.len, s.len);
+    }
+    return count;
+}
+
+/*********************************************************************
+ * Trimming and tokenizing
+ *
+ * Whitespace runs are short, so rather than go through the kernel table
+ * trimming uses SSE2 directly when the compiler targets it (it is part of the
+ * x86-64 baseline), like hashmap.h does.
+ *********************************************************************/
+
+#ifdef __SSE2__
+
+/* bitmask of the whitespace bytes among the 16 at p */
+static inline unsigned space_mask(const char *p) {
+    const __m128i v = _mm_loadu_si128((const __m128i *)p);
+    const __m128i ctl = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)),
+                                      _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1)));
+
+    return _mm_movemask_epi8(
+        _mm_or_si128(ctl, _mm_cmpeq_epi8(v, _mm_set1_epi8(' '))));
+}
+
+#endif /* __SSE2__ */
+
+str_t str_ltrim(str_t s) {
+#ifdef __SSE2__
+    unsigned mask;
+
+    while (s.len >= 16) {
+        mask = space_mask(s.ptr) ^ 0xffff;
+        if (mask) {
+            return str_sub(s, __builtin_ctz(mask), s.len);
+        }
+        s = str_sub(s, 16, s.len);
+    }
+#endif /* __SSE2__ */
+    while (s.len && is_space(s.ptr[0])) {
+        s.ptr++;
+        s.len--;
+    }
+    return s;
+}
+
+str_t str_rtrim(str_t s) {
+#ifdef __SSE2__
+    unsigned mask;
+
+    while (s.len >= 16) {
+        mask = space_mask(s.ptr + s.len - 16) ^ 0xffff;
+        if (mask) {
+            /* keep up to the highest non-space byte */
+            s.len -= __builtin_clz(mask) - (sizeof(unsigned) * 8 - 16);
+            return s;
+        }
+        s.len -= 16;
+    }
+#endif /* __SSE2__ */
+    while (s.len && is_space(s.ptr[s.len - 1])) {
+        s.len--;
+    }
+    return s;
+}
+
+str_t str_trim(str_t s) {
+    return str_rtrim(str_ltrim(s));
+}
+
+bool str_split_next(str_t *rest, char delim, str_t *tok) {
+    ssize_t pos;
+
+    if (!rest->ptr) {
+        return false;
+    }
+    pos = str_find_char(*rest, delim);
+    if (pos < 0) {
+        *tok = *rest;
+        rest->ptr = NULL; /* the last token is gone, even if it was empty */
+        return true;
+    }
+    *tok = str_make(rest->ptr, pos);
+    *rest = str_sub(*rest, pos + 1, rest->len);
+    return true;
+}
+
+bool str_split_next_str(str_t *rest, str_t delim, str_t *tok) {
+    ssize_t pos;
+
+    if (!rest->ptr) {
+        return false;
+    }
+    pos = delim.len ? str_find(*rest, delim) : -1;
+    if (pos < 0) {
+        *tok = *rest;
+        rest->ptr = NULL;
+        return true;
+    }
+    *tok = str_make(rest->ptr, pos);
+    *rest = str_sub(*rest, pos + delim.len, rest->len);
+    return true;
+}
+
+void str_tolower(char *dst, str_t src) {
+    kernels()->convert_case(dst, src.ptr, src.len, 'A');
+}
+
+void str_toupper(char *dst, str_t src) {
+    kernels()->convert_case(dst, src.ptr, src.len, 'a');
+}
+
+bool str_eq_nocase(str_t a, str_t b) {
+    return a.len == b.len && kernels()->eq_nocase(a.ptr, b.ptr, a.len);
+}
+
+/*********************************************************************
+ * String builder
+ *********************************************************************/
+
+void sb_init(strbuf_t *sb, allocator_t *alloc) {
+    sb->data = NULL;
+    sb->len = 0;
+    sb->cap = 0;
+    sb->alloc = alloc;
+}
+
+void sb_free(strbuf_t *sb) {
+    al_free(sb->alloc, sb->data, sb->cap);
+    sb_init(sb, sb->alloc);
+}
+
+int sb_reserve(strbuf_t *sb, size_t n) {
+    size_t need, cap;
+    char *data;
+
+    if (n > SIZE_MAX - 1 - sb->len) {
+        errno = ENOMEM;
+        return -1;
+    }
+    need = sb->len + n + 1;
+    if (LIKELY(need <= sb->cap)) {
+        return 0;
+    }
+    cap = sb->cap > SIZE_MAX / 2 ? SIZE_MAX : MAX(sb->cap * 2, SB_MIN_CAP);
+    cap = MAX(cap, need);
+    if (!(data = al_realloc(sb->alloc, sb->data, sb->cap, cap))) {
+        return -1;
+    }
+    sb->data = data;
+    sb->cap = cap;
+    return 0;
+}
+
+int sb_append(strbuf_t *sb, str_t s) {
+    if (sb_reserve(sb, s.len) == -1) {
+        return -1;
+    }
+    memcpy(sb->data + sb->len, s.ptr, s.len);
+    sb->len += s.len;
+    sb->data[sb->len] = '\0';
+    return 0;
+}
+
+int sb_append_cstr(strbuf_t *sb, const char *cstr) {
+    return sb_append(sb, str_from(cstr));
+}
+
+int sb_append_char(strbuf_t *sb, char c) {
+    if (sb_reserve(sb, 1) == -1) {
+        return -1;
+    }
+    sb->data[sb->len++] = c;
+    sb->data[sb->len] = '\0';
+    return 0;
+}
+
+int sb_vprintf(strbuf_t *sb, const char *fmt, va_list ap) {
+    size_t avail = sb->cap ? sb->cap - sb->len : 0;
+    va_list copy;
+    int n;
+
+    /* format straight into the spare room, and again if it was too small */
+    va_copy(copy, ap);
+    n = vsnprintf(avail ? sb->data + sb->len : NULL, avail, fmt, copy);
+    va_end(copy);
+    if (n < 0) {
+        return -1;
+    }
+    if ((size_t)n >= avail) {
+        if (sb_reserve(sb, n) == -1) {
+            return -1;
+        }
+        vsnprintf(sb->data + sb->len, n + 1, fmt, ap);
+    }
+    sb->len += n;
+    return 0;
+}
+
+int sb_printf(strbuf_t *sb, const char *fmt, ...) {
+    va_list ap;
+    int rc;
+
+    va_start(ap, fmt);
+    rc = sb_vprintf(sb, fmt, ap);
+    va_end(ap);
+    return rc;
+}
+
+ssize_t sb_append_replace(strbuf_t *sb, str_t s, str_t from, str_t to) {
+    ssize_t pos, count = 0;
+
+    if (from.len == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (sb_reserve(sb, s.len) == -1) {
+        return -1;
+    }
+    while ((pos = str_find(s, from)) >= 0) {
+        if (sb_append(sb, str_make(s.ptr, pos)) == -1 ||
+            sb_append(sb, to) == -1) {
+            return -1;
+        }
+        s = str_sub(s, pos + from.len, s.len);
+        count++;
+    }
+    return sb_append(sb, s) == -1 ? -1 : count;
+}
+
+void sb_clear(strbuf_t *sb) {
+    sb->len = 0;
+    if (sb->data) {
+        sb->data[0] = '\0';
+    }
+}
+
+char *sb_detach(strbuf_t *sb, size_t *cap) {
+    char *data;
+
+    if (sb_reserve(sb, 0) == -1) {
+        return NULL;
+    }
+    data = sb->data;
+    data[sb->len] = '\0';
+    if (cap) {
+        *cap = sb->cap;
+    }
+    sb_init(sb, sb->alloc);
+    return data;
+}
@@ -0,0 +1,570 @@
+/**
+ * @brief Work-stealing thread pool with wait groups and parallel_for
+ * @file threadpool.c
+ */
+
+#define _GNU_SOURCE /* sysconf(), posix_memalign() */
+
+#include "threadpool.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "deque.h"
+#include "utils.h"
+
+#define CACHE_LINE 64
+#define CL_INITIAL_SIZE 256 /* slots in a new work-stealing deque */
+#define SPIN_ROUNDS 16      /* failed searches for work before sleeping */
+#define SPLITS_PER_WORKER 8 /* default parallel_for chunks per worker */
+#define HELP_WAIT_NS 1000000 /* recheck for work while waiting (1 ms) */
+
+typedef struct RangeCtx {
+    tp_range_fn_t fn;
+    void *arg;
+    size_t grain;
+    tp_waitgroup_t *wg;
+} range_ctx_t;
+
+typedef struct Task {
+    tp_task_fn_t fn;
+    void *arg;
+    tp_waitgroup_t *wg;
+    const range_ctx_t *range; /* non-NULL for parallel_for chunks */
+    size_t begin;
+    size_t end;
+} task_t;
+
+/* growable circular array backing a Chase-Lev deque */
+typedef struct CLArray {
+    size_t mask;
+    struct CLArray *retired_next;
+    task_t *slots[];
+} cl_array_t;
+
+/**
+ * Chase-Lev work-stealing deque, as formulated for weak memory models in
+ * Le, Pop, Cohen & Zappa Nardelli, "Correct and Efficient Work-Stealing for
+ * Weak Memory Models", PPoPP 2013. The owner pushes and takes at the bottom;
+ * thieves steal from the top.
+ */
+typedef struct CLDeque {
+    long top;
+    char pad[CACHE_LINE - sizeof(long)]; /* thieves write top, owner bottom */
+    long bottom;
+    cl_array_t *array;
+    cl_array_t *retired; /* outgrown arrays; thieves may still read them */
+} cl_deque_t;
+
+typedef struct Worker {
+    cl_deque_t dq;
+    tp_pool_t *pool;
+    pthread_t thread;
+    uint64_t rng;
+    int id;
+} ALIGNED(CACHE_LINE) worker_t;
+
+struct ThreadPool {
+    worker_t *workers;
+    size_t nworkers;
+    size_t started;
+    deque_t *inject; /* tasks submitted from outside the pool */
+    long injected;
+    pthread_mutex_t inject_lock;
+    long pending; /* tasks queued but not yet started */
+    long idle;    /* workers asleep on cond */
+    bool stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static __thread worker_t *tls_worker;
+
+/*********************************************************************
+ * Chase-Lev deque
+ *********************************************************************/
+
+static cl_array_t *cl_array_new(size_t size) {
+    cl_array_t *a = malloc(sizeof(*a) + size * sizeof(task_t *));
+    if (a) {
+        a->mask = size - 1;
+        a->retired_next = NULL;
+    }
+    return a;
+}
+
+static int cl_init(cl_deque_t *d) {
+    memset(d, 0, sizeof(*d));
+    d->array = cl_array_new(CL_INITIAL_SIZE);
+    return d->array ? 0 : -1;
+}
+
+static void cl_free(cl_deque_t *d) {
+    cl_array_t *a, *next;
+
+    free(d->array);
+    for (a = d->retired; a; a = next) {
+        next = a->retired_next;
+        free(a);
+    }
+    d->array = d->retired = NULL;
+}
+
+static int cl_push(cl_deque_t *d, task_t *t) {
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    long top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    cl_array_t *a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+    cl_array_t *grown;
+    long i;
+
+    if (b - top > (long)a->mask) {
+        grown = cl_array_new((a->mask + 1) * 2);
+        if (!grown) {
+            return -1;
+        }
+        for (i = top; i < b; i++) {
+            __atomic_store_n(&grown->slots[i & grown->mask],
+                             __atomic_load_n(&a->slots[i & a->mask],
+                                             __ATOMIC_RELAXED),
+                             __ATOMIC_RELAXED);
+        }
+        a->retired_next = d->retired;
+        d->retired = a;
+        __atomic_store_n(&d->array, grown, __ATOMIC_RELEASE);
+        a = grown;
+    }
+    __atomic_store_n(&a->slots[b & a->mask], t, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static task_t *cl_take(cl_deque_t *d) {
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    cl_array_t *a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+    task_t *t = NULL;
+    long top;
+
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    top = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    if (top <= b) {
+        t = __atomic_load_n(&a->slots[b & a->mask], __ATOMIC_RELAXED);
+        if (top == b) {
+            /* last item: race thieves for it */
+            if (!__atomic_compare_exchange_n(&d->top, &top, top + 1, false,
+                                             __ATOMIC_SEQ_CST,
+                                             __ATOMIC_RELAXED)) {
+                t = NULL;
+            }
+            __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return t;
+}
+
+static task_t *cl_steal(cl_deque_t *d) {
+    long top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    long b;
+    cl_array_t *a;
+    task_t *t;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (top >= b) {
+        return NULL;
+    }
+    a = __atomic_load_n(&d->array, __ATOMIC_ACQUIRE);
+    t = __atomic_load_n(&a->slots[top & a->mask], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&d->top, &top, top + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL; /* lost the race to another thief or the owner */
+    }
+    return t;
+}
+
+/*********************************************************************
+ * Scheduling
+ *********************************************************************/
+
+static inline uint64_t xorshift64(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static inline worker_t *current_worker(tp_pool_t *pool) {
+    return (tls_worker && tls_worker->pool == pool) ? tls_worker : NULL;
+}
+
+static int enqueue(tp_pool_t *pool, task_t *t) {
+    worker_t *self = current_worker(pool);
+    int rv;
+
+    /* count the task before it becomes visible, so a worker that sees
+     * pending == 0 can safely go to sleep */
+    __atomic_add_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+    if (self) {
+        rv = cl_push(&self->dq, t);
+    } else {
+        pthread_mutex_lock(&pool->inject_lock);
+        rv = dq_append(pool->inject, t) ? 0 : -1;
+        if (rv == 0) {
+            __atomic_add_fetch(&pool->injected, 1, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&pool->inject_lock);
+    }
+    if (rv == -1) {
+        __atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (__atomic_load_n(&pool->idle, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return 0;
+}
+
+/* Helpers waiting on a wait group skip the injection queue: running an
+ * unrelated root task inside a wait nests stacks without bound. */
+static task_t *find_task(tp_pool_t *pool, worker_t *self, bool use_inject) {
+    task_t *t = NULL;
+    size_t i, start;
+
+    if ((t = cl_take(&self->dq))) {
+        return t;
+    }
+
+    if (use_inject && __atomic_load_n(&pool->injected, __ATOMIC_RELAXED) > 0) {
+        pthread_mutex_lock(&pool->inject_lock);
+        t = dq_pop(pool->inject);
+        if (t) {
+            __atomic_sub_fetch(&pool->injected, 1, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&pool->inject_lock);
+        if (t) {
+            return t;
+        }
+    }
+
+    start = xorshift64(&self->rng) % pool->nworkers;
+    for (i = 0; i < pool->nworkers; i++) {
+        worker_t *victim = &pool->workers[(start + i) % pool->nworkers];
+        if (victim != self && (t = cl_steal(&victim->dq))) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+static void run_range(tp_pool_t *pool, const range_ctx_t *ctx, size_t begin,
+                      size_t end);
+
+static void run_task(tp_pool_t *pool, task_t *t) {
+    tp_waitgroup_t *wg = t->wg;
+
+    __atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+    if (t->range) {
+        run_range(pool, t->range, t->begin, t->end);
+    } else {
+        t->fn(t->arg);
+    }
+    free(t);
+    if (wg) {
+        tp_wg_done(wg);
+    }
+}
+
+static void *worker_main(void *arg) {
+    worker_t *self = arg;
+    tp_pool_t *pool = self->pool;
+    task_t *t;
+    bool stop;
+    int spins = 0;
+
+    tls_worker = self;
+    for (;;) {
+        if ((t = find_task(pool, self, true))) {
+            run_task(pool, t);
+            spins = 0;
+            continue;
+        }
+        if (++spins < SPIN_ROUNDS) {
+            sched_yield();
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        __atomic_add_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) <= 0 &&
+               !pool->stopping) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        __atomic_sub_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+        stop = pool->stopping &&
+               __atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) <= 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (stop) {
+            break;
+        }
+        spins = 0;
+    }
+    return NULL;
+}
+
+/*********************************************************************
+ * Public API
+ *********************************************************************/
+
+tp_pool_t *tp_create(size_t nthreads) {
+    tp_pool_t *pool;
+    void *mem;
+    long ncpu;
+    size_t i;
+
+    if (!nthreads) {
+        ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu > 0 ? (size_t)ncpu : 1;
+    }
+
+    pool = calloc(1, sizeof(*pool));
+    if (!pool) {
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_mutex_init(&pool->inject_lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    pool->nworkers = nthreads;
+    pool->inject = dq_create();
+    if (!pool->inject ||
+        posix_memalign(&mem, CACHE_LINE, nthreads * sizeof(worker_t))) {
+        goto error;
+    }
+    pool->workers = mem;
+    memset(pool->workers, 0, nthreads * sizeof(worker_t));
+
+    for (i = 0; i < nthreads; i++) {
+        worker_t *w = &pool->workers[i];
+        if (cl_init(&w->dq) == -1) {
+            goto error;
+        }
+        w->pool = pool;
+        w->id = (int)i;
+        w->rng = 0x9e3779b97f4a7c15ULL * (i + 1);
+    }
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(&pool->workers[i].thread, NULL, worker_main,
+                           &pool->workers[i])) {
+            goto error;
+        }
+        pool->started++;
+    }
+    return pool;
+
+error:
+    tp_destroy(pool);
+    errno = ENOMEM;
+    return NULL;
+}
+
+void tp_destroy(tp_pool_t *pool) {
+    size_t i;
+
+    if (!pool) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->started; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    if (pool->workers) {
+        for (i = 0; i < pool->nworkers; i++) {
+            cl_free(&pool->workers[i].dq);
+        }
+        free(pool->workers);
+    }
+    dq_destroy(pool->inject, free);
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->inject_lock);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+size_t tp_size(tp_pool_t *pool) {
+    return pool ? pool->nworkers : 0;
+}
+
+int tp_worker_id(tp_pool_t *pool) {
+    worker_t *self = current_worker(pool);
+    return self ? self->id : -1;
+}
+
+int tp_submit(tp_pool_t *pool, tp_task_fn_t fn, void *arg,
+              tp_waitgroup_t *wg) {
+    task_t *t;
+
+    if (!pool || !fn) {
+        errno = EINVAL;
+        return -1;
+    }
+    t = calloc(1, sizeof(*t));
+    if (!t) {
+        return -1;
+    }
+    t->fn = fn;
+    t->arg = arg;
+    t->wg = wg;
+    if (wg) {
+        tp_wg_add(wg, 1);
+    }
+    if (enqueue(pool, t) == -1) {
+        if (wg) {
+            tp_wg_done(wg);
+        }
+        free(t);
+        return -1;
+    }
+    return 0;
+}
+
+/* Split [begin, end) in halves, queueing the upper halves for thieves, and
+ * run what is left when it is no larger than the grain. */
+static void run_range(tp_pool_t *pool, const range_ctx_t *ctx, size_t begin,
+                      size_t end) {
+    task_t *t;
+    size_t mid;
+
+    while (end - begin > ctx->grain) {
+        mid = begin + (end - begin) / 2;
+        t = calloc(1, sizeof(*t));
+        if (!t) {
+            break; /* no memory: just do the rest here */
+        }
+        t->range = ctx;
+        t->wg = ctx->wg;
+        t->begin = mid;
+        t->end = end;
+        tp_wg_add(ctx->wg, 1);
+        if (enqueue(pool, t) == -1) {
+            tp_wg_done(ctx->wg);
+            free(t);
+            break;
+        }
+        end = mid;
+    }
+    ctx->fn(begin, end, ctx->arg);
+}
+
+int tp_parallel_for(tp_pool_t *pool, size_t begin, size_t end, size_t grain,
+                    tp_range_fn_t fn, void *arg) {
+    tp_waitgroup_t wg;
+    range_ctx_t ctx;
+
+    if (!pool || !fn) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (begin >= end) {
+        return 0;
+    }
+    if (!grain) {
+        grain = MAX((end - begin) / (pool->nworkers * SPLITS_PER_WORKER),
+                    (size_t)1);
+    }
+
+    tp_wg_init(&wg);
+    ctx.fn = fn;
+    ctx.arg = arg;
+    ctx.grain = grain;
+    ctx.wg = &wg;
+    run_range(pool, &ctx, begin, end);
+    tp_wg_wait(pool, &wg);
+    tp_wg_destroy(&wg);
+    return 0;
+}
+
+/*********************************************************************
+ * Wait groups
+ *********************************************************************/
+
+void tp_wg_init(tp_waitgroup_t *wg) {
+    wg->count = 0;
+    pthread_mutex_init(&wg->lock, NULL);
+    pthread_cond_init(&wg->cond, NULL);
+}
+
+void tp_wg_destroy(tp_waitgroup_t *wg) {
+    pthread_cond_destroy(&wg->cond);
+    pthread_mutex_destroy(&wg->lock);
+}
+
+void tp_wg_add(tp_waitgroup_t *wg, long n) {
+    long count = __atomic_load_n(&wg->count, __ATOMIC_RELAXED);
+
+    /* Only the transition to zero takes the lock. A waiter that sees zero
+     * locks before returning, so it cannot tear down the wait group while
+     * the final decrementer is still broadcasting. */
+    while (count + n > 0) {
+        if (__atomic_compare_exchange_n(&wg->count, &count, count + n, true,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            return;
+        }
+    }
+    pthread_mutex_lock(&wg->lock);
+    if (__atomic_add_fetch(&wg->count, n, __ATOMIC_ACQ_REL) <= 0) {
+        pthread_cond_broadcast(&wg->cond);
+    }
+    pthread_mutex_unlock(&wg->lock);
+}
+
+void tp_wg_done(tp_waitgroup_t *wg) {
+    tp_wg_add(wg, -1);
+}
+
+void tp_wg_wait(tp_pool_t *pool, tp_waitgroup_t *wg) {
+    worker_t *self = pool ? current_worker(pool) : NULL;
+    struct timespec deadline;
+    task_t *t;
+
+    while (__atomic_load_n(&wg->count, __ATOMIC_ACQUIRE) > 0) {
+        if (self && (t = find_task(pool, self, false))) {
+            run_task(pool, t);
+            continue;
+        }
+        pthread_mutex_lock(&wg->lock);
+        if (__atomic_load_n(&wg->count, __ATOMIC_ACQUIRE) > 0) {
+            if (self) {
+                /* a worker must keep helping: the tasks it waits for may
+                 * spawn more work that only it would otherwise find */
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                deadline.tv_nsec += HELP_WAIT_NS;
+                if (deadline.tv_nsec >= 1000000000L) {
+                    deadline.tv_sec++;
+                    deadline.tv_nsec -= 1000000000L;
+                }
+                pthread_cond_timedwait(&wg->cond, &wg->lock, &deadline);
+            } else {
+                pthread_cond_wait(&wg->cond, &wg->lock);
+            }
+        }
+        pthread_mutex_unlock(&wg->lock);
+    }
+    /* pairs with the lock taken by the final tp_wg_add() */
+    pthread_mutex_lock(&wg->lock);
+    pthread_mutex_unlock(&wg->lock);
+}
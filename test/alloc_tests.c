@@ -0,0 +1,268 @@
+#include "minunit.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "alloc.h"
+#include "base64.h"
+#include "deque.h"
+#include "utils.h"
+
+#define NTHREADS 4
+
+const char *test_arena(size_t chunk_size) {
+    arena_t arena;
+    arena_mark_t mark;
+    char *p, *q, *big;
+    size_t i;
+
+    arena_init(&arena, chunk_size);
+    for (i = 1; i < 1000; i++) {
+        p = arena_alloc(&arena, i);
+        mu_assert(p, "arena_alloc(%zu) failed", i);
+        mu_assert((uintptr_t)p % ARENA_ALIGN == 0, "Misaligned %p", (void *)p);
+        memset(p, 0xab, i);
+    }
+    p = arena_alloc_aligned(&arena, 10, 4096);
+    mu_assert(p && (uintptr_t)p % 4096 == 0, "arena_alloc_aligned failed");
+    mu_assert(!arena_alloc_aligned(&arena, 10, 24), "Accepted bad alignment");
+
+    /* allocations larger than a chunk get a chunk of their own */
+    big = arena_alloc(&arena, chunk_size * 3);
+    mu_assert(big, "Large arena_alloc failed");
+    memset(big, 0, chunk_size * 3);
+
+    mark = arena_mark(&arena);
+    p = arena_alloc(&arena, 64);
+    for (i = 0; i < 100; i++) {
+        arena_alloc(&arena, chunk_size / 2);
+    }
+    arena_reset_to(&arena, mark);
+    q = arena_alloc(&arena, 64);
+    mu_assert(p == q, "arena_reset_to did not roll back");
+
+    arena_reset(&arena);
+    p = arena_alloc(&arena, 64);
+    mu_assert(p, "arena_alloc after reset failed");
+    arena_destroy(&arena);
+    return NULL;
+}
+
+const char *test_arena_allocator() {
+    arena_t arena;
+    allocator_t *a;
+    char *p, *q;
+
+    arena_init(&arena, 4096);
+    a = arena_allocator(&arena);
+
+    /* the most recent allocation grows in place */
+    p = al_alloc(a, 100);
+    memset(p, 'x', 100);
+    q = al_realloc(a, p, 100, 1000);
+    mu_assert(p == q, "Last allocation not grown in place");
+
+    /* anything else is copied */
+    al_alloc(a, 16);
+    q = al_realloc(a, p, 1000, 2000);
+    mu_assert(q && q != p && q[0] == 'x' && q[99] == 'x',
+              "Realloc did not copy");
+
+    /* freeing the last allocation gives the space back */
+    p = al_alloc(a, 32);
+    al_free(a, p, 32);
+    q = al_alloc(a, 32);
+    mu_assert(p == q, "Free of last allocation not reused");
+
+    p = al_calloc(a, 10, 10);
+    mu_assert(p && !p[0] && !p[99], "al_calloc did not zero");
+
+    arena_destroy(&arena);
+    return NULL;
+}
+
+const char *test_pool(bool thread_cache) {
+    pool_t pool;
+    void *objs[1000];
+    size_t i, j;
+
+    mu_assert(pool_init(&pool, 40, 16, thread_cache) == 0, "pool_init failed");
+    for (i = 0; i < ARRAYLEN(objs); i++) {
+        objs[i] = pool_alloc(&pool);
+        mu_assert(objs[i], "pool_alloc failed");
+        memset(objs[i], (int)i, 40);
+    }
+    for (i = 0; i < ARRAYLEN(objs); i++) {
+        for (j = 0; j < 40; j++) {
+            mu_assert(((unsigned char *)objs[i])[j] == (unsigned char)i,
+                      "Object %zu overwritten", i);
+        }
+    }
+    for (i = 0; i < ARRAYLEN(objs); i++) {
+        pool_free(&pool, objs[i]);
+    }
+    /* freed objects are reused rather than new slabs allocated */
+    objs[0] = pool_alloc(&pool);
+    mu_assert(objs[0], "pool_alloc after free failed");
+    pool_free(&pool, objs[0]);
+    pool_destroy(&pool);
+    return NULL;
+}
+
+static void *pool_worker(void *arg) {
+    pool_t *pool = arg;
+    void *objs[100];
+    size_t i, round;
+
+    for (round = 0; round < 200; round++) {
+        for (i = 0; i < ARRAYLEN(objs); i++) {
+            if (!(objs[i] = pool_alloc(pool))) {
+                return (void *)"pool_alloc failed";
+            }
+            *(size_t *)objs[i] = i;
+        }
+        for (i = 0; i < ARRAYLEN(objs); i++) {
+            if (*(size_t *)objs[i] != i) {
+                return (void *)"Object shared between threads";
+            }
+            pool_free(pool, objs[i]);
+        }
+    }
+    return NULL;
+}
+
+const char *test_pool_threads() {
+    pthread_t threads[NTHREADS];
+    pool_t pool;
+    void *res;
+    int i;
+
+    mu_assert(pool_init(&pool, sizeof(size_t), 0, true) == 0,
+              "pool_init failed");
+    for (i = 0; i < NTHREADS; i++) {
+        pthread_create(&threads[i], NULL, pool_worker, &pool);
+    }
+    for (i = 0; i < NTHREADS; i++) {
+        pthread_join(threads[i], &res);
+        mu_assert(!res, "%s", (char *)res);
+    }
+    pool_destroy(&pool);
+    return NULL;
+}
+
+static size_t free_count(pool_t *pool) {
+    size_t n = 0;
+    void *obj;
+
+    for (obj = pool->free_list; obj; obj = *(void **)obj) {
+        n++;
+    }
+    return n;
+}
+
+static void *alloc_free(void *arg) {
+    pool_free(arg, pool_alloc(arg));
+    return NULL;
+}
+
+/* cached objects go back to the pool when evicted or when the thread exits */
+const char *test_pool_cache_flush() {
+    pool_t a, others[8], *b = NULL;
+    pthread_t thread;
+    size_t i;
+    void *obj;
+
+    mu_assert(pool_init(&a, 8, 64, true) == 0, "pool_init failed");
+    for (i = 0; i < ARRAYLEN(others); i++) {
+        mu_assert(pool_init(&others[i], 8, 64, true) == 0, "pool_init failed");
+        if (others[i].id % ARRAYLEN(others) == a.id % ARRAYLEN(others)) {
+            b = &others[i]; /* shares a's cache slot */
+        }
+    }
+    mu_assert(b, "No pool shares a cache slot");
+    mu_assert((obj = pool_alloc(&a)), "pool_alloc failed");
+    mu_assert(free_count(&a) == 64 - POOL_TLS_BATCH, "%zu free",
+              free_count(&a));
+    pool_free(&a, obj);
+    pool_free(b, pool_alloc(b));
+    mu_assert(free_count(&a) == 64, "Lost %zu evicted objects",
+              64 - free_count(&a));
+    pthread_create(&thread, NULL, alloc_free, &a);
+    pthread_join(thread, NULL);
+    mu_assert(free_count(&a) == 64, "Lost %zu objects at thread exit",
+              64 - free_count(&a));
+    /* objects of a destroyed pool are dropped, not handed back */
+    pool_free(&a, pool_alloc(&a));
+    pool_destroy(&a);
+    pool_free(b, pool_alloc(b));
+    for (i = 0; i < ARRAYLEN(others); i++) {
+        pool_destroy(&others[i]);
+    }
+    return NULL;
+}
+
+const char *test_deque_pool() {
+    pool_t pool;
+    deque_t *dq, *copy, *sorted;
+    long i;
+
+    mu_assert(pool_init(&pool, DQ_POOL_OBJ_SIZE, 0, true) == 0,
+              "pool_init failed");
+    dq = dq_create_with(pool_allocator(&pool));
+    mu_assert(dq, "dq_create_with failed");
+    for (i = 0; i < 1000; i++) {
+        dq_append(dq, (void *)((i * 7919) % 1000));
+    }
+    copy = dq_copy(dq);
+    mu_assert(copy && copy->alloc == dq->alloc, "dq_copy lost the allocator");
+    sorted = dq_sorted(copy);
+    mu_assert(dq_len(sorted) == 1000, "dq_sorted lost items");
+    for (i = 0; i < 1000; i++) {
+        mu_assert((long)dq_pop(sorted) == i, "dq_sorted out of order");
+    }
+    mu_assert(!dq_join(dq, sorted = dq_create()),
+              "Joined deques with different allocators");
+    dq_destroy(sorted, NULL);
+    dq_destroy(copy, NULL);
+    dq_destroy(dq, NULL);
+    pool_destroy(&pool);
+    return NULL;
+}
+
+const char *test_base64_arena() {
+    const char *msg = "Many hands make light work.";
+    arena_t arena;
+    char *enc, *dec;
+    size_t enclen, declen;
+
+    arena_init(&arena, 0);
+    enc = b64encode_with(msg, strlen(msg), B64_STANDARD, &enclen,
+                         arena_allocator(&arena));
+    mu_assert(enc && !strcmp(enc, "TWFueSBoYW5kcyBtYWtlIGxpZ2h0IHdvcmsu"),
+              "Bad encoding: %s", enc);
+    dec = b64decode_with(enc, enclen, B64_STANDARD, &declen,
+                         arena_allocator(&arena));
+    mu_assert(dec && declen == strlen(msg) && !memcmp(dec, msg, declen),
+              "Bad decoding");
+    arena_destroy(&arena);
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_arena, 256);
+    mu_run_test(test_arena, ARENA_DEFAULT_CHUNK);
+    mu_run_test(test_arena_allocator);
+    mu_run_test(test_pool, false);
+    mu_run_test(test_pool, true);
+    mu_run_test(test_pool_threads);
+    mu_run_test(test_pool_cache_flush);
+    mu_run_test(test_deque_pool);
+    mu_run_test(test_base64_arena);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,166 @@
+#define _GNU_SOURCE
+#define DBG_ASYNC
+#include "minunit.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "asynclog.h"
+
+#define NTHREADS 4
+#define PER_THREAD 5000
+
+static void *log_thread(void *arg) {
+    long id = (long)arg, i;
+
+    for (i = 0; i < PER_THREAD; i++) {
+        log_info("thread %ld seq %ld", id, i);
+    }
+    return NULL;
+}
+
+/* Check that every thread's records arrived once each and in order. */
+static const char *check_lines(FILE *f, long nthreads, long per_thread) {
+    long next[NTHREADS] = {0}, id, seq, lines = 0;
+    char line[256];
+
+    while (fgets(line, sizeof(line), f)) {
+        const char *p = strstr(line, "thread ");
+        mu_assert(p && sscanf(p, "thread %ld seq %ld", &id, &seq) == 2,
+                  "Garbled line: %s", line);
+        mu_assert(id >= 0 && id < nthreads, "Bad thread id %ld", id);
+        mu_assert(seq == next[id], "Thread %ld: expected seq %ld, got %ld", id,
+                  next[id], seq);
+        next[id]++;
+        lines++;
+    }
+    mu_assert(lines == nthreads * per_thread, "Expected %ld lines, got %ld",
+              nthreads * per_thread, lines);
+    return NULL;
+}
+
+const char *test_threads(alog_policy_t policy) {
+    pthread_t threads[NTHREADS];
+    alog_config_t cfg;
+    alog_stats_t stats;
+    FILE *f = tmpfile();
+    const char *err;
+    long i;
+
+    mu_assert(f, "tmpfile failed");
+    alog_config_init(&cfg);
+    cfg.policy = policy;
+    mu_assert(alog_start(fileno(f), &cfg) == 0, "alog_start failed");
+    mu_assert(alog_start(fileno(f), &cfg) == -1, "Started twice");
+    for (i = 0; i < NTHREADS; i++) {
+        pthread_create(&threads[i], NULL, log_thread, (void *)i);
+    }
+    for (i = 0; i < NTHREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    alog_flush();
+    alog_stats(&stats);
+    alog_stop();
+
+    if (policy == ALOG_BLOCK) {
+        mu_assert(stats.dropped == 0, "Dropped records while blocking");
+    }
+    mu_assert(stats.records + stats.dropped == NTHREADS * PER_THREAD,
+              "Records lost: %llu written, %llu dropped",
+              (unsigned long long)stats.records,
+              (unsigned long long)stats.dropped);
+    rewind(f);
+    if (stats.dropped == 0) {
+        if ((err = check_lines(f, NTHREADS, PER_THREAD))) {
+            fclose(f);
+            return err;
+        }
+    }
+    fclose(f);
+    return NULL;
+}
+
+static void *drain_pipe(void *arg) {
+    int fd = (long)arg;
+    char buf[4096];
+    long total = 0;
+    ssize_t n;
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        total += n;
+    }
+    return (void *)total;
+}
+
+/* With nobody reading the pipe the flusher stalls, so the ring fills up. */
+const char *test_backpressure(alog_policy_t policy) {
+    pthread_t reader;
+    alog_config_t cfg;
+    alog_stats_t stats;
+    int fds[2];
+    long i;
+
+    mu_assert(pipe(fds) == 0, "pipe failed");
+    alog_config_init(&cfg);
+    cfg.ring_size = 8192;
+    cfg.policy = policy;
+    mu_assert(alog_start(fds[1], &cfg) == 0, "alog_start failed");
+    if (policy == ALOG_BLOCK) {
+        /* a blocked writer needs someone to drain the pipe */
+        pthread_create(&reader, NULL, drain_pipe, (void *)(long)fds[0]);
+    }
+    for (i = 0; i < 100000; i++) {
+        alog_printf("record %ld padded out to a reasonable length\n", i);
+    }
+    if (policy == ALOG_DROP) {
+        alog_stats(&stats);
+        mu_assert(stats.dropped > 0, "Nothing dropped with a stalled pipe");
+        pthread_create(&reader, NULL, drain_pipe, (void *)(long)fds[0]);
+    }
+    alog_flush();
+    alog_stats(&stats);
+    alog_stop();
+    close(fds[1]);
+    pthread_join(reader, NULL);
+    close(fds[0]);
+    mu_assert(stats.records + stats.dropped == 100000, "Records lost");
+    if (policy == ALOG_BLOCK) {
+        mu_assert(stats.dropped == 0, "Dropped records while blocking");
+    }
+    return NULL;
+}
+
+const char *test_truncate() {
+    char big[3000], line[4096];
+    FILE *f = tmpfile();
+
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    mu_assert(alog_start(fileno(f), NULL) == 0, "alog_start failed");
+    log_info("%s", big);
+    alog_flush();
+    alog_stop();
+    rewind(f);
+    mu_assert(fgets(line, sizeof(line), f), "Nothing written");
+    mu_assert(strlen(line) == ALOG_MAX_RECORD - 1,
+              "Expected %d bytes, got %zu", ALOG_MAX_RECORD - 1, strlen(line));
+    mu_assert(line[strlen(line) - 1] == '\n', "Truncated line not terminated");
+    fclose(f);
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_threads, ALOG_DROP);
+    mu_run_test(test_threads, ALOG_BLOCK);
+    mu_run_test(test_backpressure, ALOG_DROP);
+    mu_run_test(test_backpressure, ALOG_BLOCK);
+    mu_run_test(test_truncate);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
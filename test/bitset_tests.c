@@ -0,0 +1,197 @@
+#include "minunit.h"
+
+#include <pthread.h>
+#include "bitset.h"
+#include "prng.h"
+
+#define NTHREADS 4
+
+/* sizes around word and cache line boundaries */
+static const size_t sizes[] = {0, 1, 63, 64, 65, 511, 512, 513, 1000, 70000};
+
+const char *test_single_bits() {
+    bitset_t bs;
+    size_t s, i, n;
+
+    for (s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+        n = sizes[s];
+        mu_assert(bs_init(&bs, n, NULL) == 0, "bs_init(%zu)", n);
+        mu_assert(bs.nwords % BS_LINE_WORDS == 0 &&
+                      bs.nwords * BS_WORD_BITS >= n &&
+                      (uintptr_t)bs.words % 64 == 0,
+                  "Bad layout for %zu bits", n);
+        mu_assert(bs_count(&bs) == 0, "Not clear after init");
+        for (i = 0; i < n; i += 3) {
+            bs_set(&bs, i);
+        }
+        for (i = 0; i < n; i++) {
+            mu_assert(bs_test(&bs, i) == (i % 3 == 0), "Bit %zu of %zu", i, n);
+        }
+        mu_assert(bs_count(&bs) == (n + 2) / 3, "Count %zu of %zu bits",
+                  bs_count(&bs), n);
+        for (i = 0; i < n; i += 6) {
+            bs_clear(&bs, i);
+        }
+        mu_assert(bs_count(&bs) == (n + 2) / 3 - (n + 5) / 6, "Count after clear");
+
+        /* bits past nbits stay zero */
+        bs_set_all(&bs);
+        mu_assert(bs_count(&bs) == n, "Set all %zu bits counts %zu", n,
+                  bs_count(&bs));
+        mu_assert(bs_next_clear(&bs, 0) == BS_NONE, "Clear bit after set all");
+        bs_clear_all(&bs);
+        mu_assert(bs_next_set(&bs, 0) == BS_NONE, "Set bit after clear all");
+        bs_destroy(&bs);
+    }
+    return NULL;
+}
+
+const char *test_scan() {
+    bitset_t bs;
+    size_t i, j, n = 5000;
+    prng_t r;
+
+    mu_assert(bs_init(&bs, n, NULL) == 0, "bs_init");
+    prng_seed(&r, 1);
+    for (i = 0; i < 200; i++) {
+        bs_set(&bs, prng_bounded(&r, n));
+    }
+    bs_set(&bs, n - 1);
+    /* every set bit, in order, and nothing else */
+    for (i = bs_next_set(&bs, 0), j = 0; i != BS_NONE;
+         i = bs_next_set(&bs, i + 1)) {
+        for (; j < i; j++) {
+            mu_assert(!bs_test(&bs, j), "Skipped set bit %zu", j);
+        }
+        mu_assert(bs_test(&bs, i), "Found clear bit %zu", i);
+        j = i + 1;
+    }
+    mu_assert(j == n, "Scan stopped at %zu", j);
+    for (i = bs_next_clear(&bs, 0); i != BS_NONE;
+         i = bs_next_clear(&bs, i + 1)) {
+        mu_assert(!bs_test(&bs, i), "Found set bit %zu", i);
+    }
+    mu_assert(bs_next_set(&bs, n) == BS_NONE, "Scan past the end");
+    mu_assert(bs_next_clear(&bs, n - 1) == BS_NONE, "Last bit is set");
+    bs_destroy(&bs);
+    return NULL;
+}
+
+const char *test_bulk() {
+    bitset_t a, b, c;
+    size_t i, n = 3000;
+    prng_t r;
+
+    mu_assert(bs_init(&a, n, NULL) == 0 && bs_init(&b, n, NULL) == 0 &&
+                  bs_init(&c, n, NULL) == 0,
+              "bs_init");
+    prng_seed(&r, 2);
+    for (i = 0; i < n; i++) {
+        if (prng_bounded(&r, 2)) {
+            bs_set(&a, i);
+        }
+        if (prng_bounded(&r, 3) == 0) {
+            bs_set(&b, i);
+        }
+    }
+
+    memcpy(c.words, a.words, a.nwords * sizeof(uint64_t));
+    mu_assert(bs_and(&c, &b) == 0, "bs_and");
+    for (i = 0; i < n; i++) {
+        mu_assert(bs_test(&c, i) == (bs_test(&a, i) && bs_test(&b, i)),
+                  "AND bit %zu", i);
+    }
+    memcpy(c.words, a.words, a.nwords * sizeof(uint64_t));
+    mu_assert(bs_or(&c, &b) == 0, "bs_or");
+    for (i = 0; i < n; i++) {
+        mu_assert(bs_test(&c, i) == (bs_test(&a, i) || bs_test(&b, i)),
+                  "OR bit %zu", i);
+    }
+    memcpy(c.words, a.words, a.nwords * sizeof(uint64_t));
+    mu_assert(bs_andnot(&c, &b) == 0, "bs_andnot");
+    for (i = 0; i < n; i++) {
+        mu_assert(bs_test(&c, i) == (bs_test(&a, i) && !bs_test(&b, i)),
+                  "ANDNOT bit %zu", i);
+    }
+    bs_destroy(&c);
+
+    mu_assert(bs_init(&c, n + 1, NULL) == 0, "bs_init");
+    mu_assert(bs_or(&c, &a) == -1 && errno == EINVAL, "Sizes differ");
+    bs_destroy(&a);
+    bs_destroy(&b);
+    bs_destroy(&c);
+    return NULL;
+}
+
+typedef struct {
+    bitset_t *bs;
+    size_t t;
+    size_t got_first; /* set_atomic(0) returned false to this thread */
+} worker_t;
+
+static void *set_bits(void *arg) {
+    worker_t *w = arg;
+    size_t i;
+
+    w->got_first = !bs_set_atomic(w->bs, 0);
+    /* neighbouring bits, so threads contend for the same words */
+    for (i = 1 + w->t; i < w->bs->nbits; i += NTHREADS) {
+        bs_set_atomic(w->bs, i);
+    }
+    return NULL;
+}
+
+const char *test_atomic() {
+    pthread_t threads[NTHREADS];
+    worker_t workers[NTHREADS];
+    size_t t, first = 0;
+    bitset_t bs;
+
+    mu_assert(bs_init(&bs, 100001, NULL) == 0, "bs_init");
+    for (t = 0; t < NTHREADS; t++) {
+        workers[t].bs = &bs;
+        workers[t].t = t;
+        pthread_create(&threads[t], NULL, set_bits, &workers[t]);
+    }
+    for (t = 0; t < NTHREADS; t++) {
+        pthread_join(threads[t], NULL);
+        first += workers[t].got_first;
+    }
+    mu_assert(first == 1, "%zu threads set bit 0 first", first);
+    mu_assert(bs_count(&bs) == bs.nbits, "Lost updates: %zu of %zu set",
+              bs_count(&bs), bs.nbits);
+    mu_assert(bs_test_atomic(&bs, 500), "bs_test_atomic");
+    mu_assert(bs_clear_atomic(&bs, 500) && !bs_test_atomic(&bs, 500) &&
+                  !bs_clear_atomic(&bs, 500),
+              "bs_clear_atomic");
+    bs_destroy(&bs);
+    return NULL;
+}
+
+const char *test_allocator() {
+    arena_t arena;
+    bitset_t bs;
+
+    arena_init(&arena, 0);
+    mu_assert(bs_init(&bs, 4096, arena_allocator(&arena)) == 0, "bs_init");
+    mu_assert((uintptr_t)bs.words % 64 == 0, "Words not line-aligned");
+    bs_set_all(&bs);
+    mu_assert(bs_count(&bs) == 4096, "Count");
+    bs_destroy(&bs);
+    arena_destroy(&arena);
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_single_bits);
+    mu_run_test(test_scan);
+    mu_run_test(test_bulk);
+    mu_run_test(test_atomic);
+    mu_run_test(test_allocator);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,190 @@
+#include "minunit.h"
+
+#include <math.h>
+#include <pthread.h>
+#include "bloom.h"
+#include "hashmap.h"
+
+#define NKEYS 100000
+#define NPROBES 200000
+#define NTHREADS 4
+
+/* keys 0..n-1 are added; probes come from n up, so none were */
+static const char *check_fp_rate(double target) {
+    bloom_t bf;
+    size_t i, fp = 0;
+    double measured, estimate, bits_per_key;
+
+    mu_assert(bloom_init(&bf, NKEYS, target, NULL) == 0, "bloom_init");
+    for (i = 0; i < NKEYS; i++) {
+        bloom_add(&bf, hm_hash_u64(i));
+    }
+    for (i = 0; i < NKEYS; i++) {
+        mu_assert(bloom_contains(&bf, hm_hash_u64(i)), "False negative %zu", i);
+    }
+    for (i = 0; i < NPROBES; i++) {
+        fp += bloom_contains(&bf, hm_hash_u64(NKEYS + i));
+    }
+    measured = (double)fp / NPROBES;
+    estimate = bloom_fp_rate(bf.nblocks * BLOOM_BLOCK_BITS, bf.k, NKEYS);
+    bits_per_key = (double)bf.nblocks * BLOOM_BLOCK_BITS / NKEYS;
+    mu_assert(estimate <= target, "Estimate %g above target %g", estimate,
+              target);
+    /* the estimate is a model, and the measurement a sample: allow both
+     * some slack */
+    mu_assert(measured <= 1.25 * target + 3.0 / NPROBES,
+              "Measured %g for target %g (k %u, %.1f bits/key)", measured,
+              target, bf.k, bits_per_key);
+    mu_assert(fabs(measured - estimate) <= 0.25 * estimate + 5.0 / NPROBES,
+              "Measured %g, estimated %g", measured, estimate);
+    /* blocking costs a little memory over an ideal filter, not a lot */
+    mu_assert(bits_per_key <= 1.35 * -log(target) / (log(2) * log(2)),
+              "%.1f bits/key for %g", bits_per_key, target);
+    bloom_destroy(&bf);
+    return NULL;
+}
+
+const char *test_fp_rate() {
+    const char *err;
+
+    if ((err = check_fp_rate(0.1)) || (err = check_fp_rate(0.01)) ||
+        (err = check_fp_rate(0.001))) {
+        return err;
+    }
+    return NULL;
+}
+
+const char *test_add() {
+    size_t i, again = 0;
+    bloom_t bf;
+
+    mu_assert(bloom_init(&bf, 1000, 0.001, NULL) == 0, "bloom_init");
+    for (i = 0; i < 1000; i++) {
+        again += bloom_add(&bf, hm_hash_u64(i));
+    }
+    /* a new key only looks old if it is a false positive */
+    mu_assert(again <= 5, "%zu new keys reported present", again);
+    for (i = 0; i < 1000; i++) {
+        mu_assert(bloom_add(&bf, hm_hash_u64(i)), "Key %zu added twice", i);
+    }
+    bloom_clear(&bf);
+    mu_assert(!bloom_contains(&bf, hm_hash_u64(1)), "Present after clear");
+    bloom_destroy(&bf);
+    return NULL;
+}
+
+const char *test_contains_n() {
+    uint64_t hashes[1000];
+    bool found[1000];
+    size_t i, count;
+    bloom_t bf;
+
+    mu_assert(bloom_init_size(&bf, 1 << 16, 7, NULL) == 0, "bloom_init_size");
+    for (i = 0; i < 1000; i++) {
+        hashes[i] = hm_hash_u64(i);
+        if (i % 2) {
+            bloom_add(&bf, hashes[i]);
+        }
+    }
+    count = bloom_contains_n(&bf, hashes, 1000, found);
+    for (i = 0; i < 1000; i++) {
+        mu_assert(found[i] == bloom_contains(&bf, hashes[i]),
+                  "Batch and single lookups differ at %zu", i);
+    }
+    mu_assert(count >= 500 && count < 520, "Found %zu", count);
+    bloom_destroy(&bf);
+    return NULL;
+}
+
+typedef struct {
+    bloom_t *bf;
+    size_t t;
+} worker_t;
+
+static void *add_keys(void *arg) {
+    worker_t *w = arg;
+    size_t i;
+
+    for (i = w->t; i < NKEYS; i += NTHREADS) {
+        bloom_add_atomic(w->bf, hm_hash_u64(i));
+    }
+    return NULL;
+}
+
+const char *test_concurrent() {
+    pthread_t threads[NTHREADS];
+    worker_t workers[NTHREADS];
+    bloom_t bf;
+    size_t i;
+
+    mu_assert(bloom_init(&bf, NKEYS, 0.01, NULL) == 0, "bloom_init");
+    for (i = 0; i < NTHREADS; i++) {
+        workers[i].bf = &bf;
+        workers[i].t = i;
+        pthread_create(&threads[i], NULL, add_keys, &workers[i]);
+    }
+    for (i = 0; i < NTHREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (i = 0; i < NKEYS; i++) {
+        mu_assert(bloom_contains(&bf, hm_hash_u64(i)), "Lost key %zu", i);
+    }
+    bloom_destroy(&bf);
+    return NULL;
+}
+
+const char *test_union() {
+    bloom_t a, b, c;
+    size_t i;
+
+    mu_assert(bloom_init_size(&a, 1 << 14, 6, NULL) == 0 &&
+                  bloom_init_size(&b, 1 << 14, 6, NULL) == 0 &&
+                  bloom_init_size(&c, 1 << 14, 5, NULL) == 0,
+              "bloom_init_size");
+    for (i = 0; i < 500; i++) {
+        bloom_add(i % 2 ? &a : &b, hm_hash_u64(i));
+    }
+    mu_assert(bloom_union(&a, &b) == 0, "bloom_union");
+    for (i = 0; i < 500; i++) {
+        mu_assert(bloom_contains(&a, hm_hash_u64(i)), "Key %zu missing", i);
+    }
+    mu_assert(bloom_union(&a, &c) == -1 && errno == EINVAL, "Different k");
+    bloom_destroy(&a);
+    bloom_destroy(&b);
+    bloom_destroy(&c);
+    return NULL;
+}
+
+const char *test_errors() {
+    bloom_t bf;
+
+    mu_assert(bloom_init(&bf, 0, 0.01, NULL) == -1 && errno == EINVAL,
+              "No keys");
+    mu_assert(bloom_init(&bf, 10, 0, NULL) == -1 && errno == EINVAL,
+              "Zero rate");
+    mu_assert(bloom_init(&bf, 10, 1, NULL) == -1 && errno == EINVAL,
+              "Rate of 1");
+    mu_assert(bloom_init_size(&bf, 1024, 0, NULL) == -1 && errno == EINVAL,
+              "k of 0");
+    mu_assert(bloom_init_size(&bf, 1024, BLOOM_MAX_K + 1, NULL) == -1 &&
+                  errno == EINVAL,
+              "k too large");
+    mu_assert(bloom_fp_rate(1 << 20, 7, 0) == 0, "Empty filter");
+    mu_assert(bloom_fp_rate(1 << 10, 7, 1 << 20) > 0.99, "Overfull filter");
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_fp_rate);
+    mu_run_test(test_add);
+    mu_run_test(test_contains_n);
+    mu_run_test(test_concurrent);
+    mu_run_test(test_union);
+    mu_run_test(test_errors);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,102 @@
+#include "minunit.h"
+
+#include <string.h>
+#include "byteorder.h"
+
+#define MAXLEN 1100
+
+const char *test_single() {
+    const uint8_t wire[8] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08};
+    uint8_t out[9] = {0};
+
+    mu_assert(bo_bswap16(0x0102) == 0x0201, "bswap16");
+    mu_assert(bo_bswap32(0x01020304) == 0x04030201, "bswap32");
+    mu_assert(bo_bswap64(0x0102030405060708ULL) == 0x0807060504030201ULL,
+              "bswap64");
+
+    mu_assert(bo_load_be16(wire) == 0x0102, "load_be16");
+    mu_assert(bo_load_be32(wire) == 0x01020304, "load_be32");
+    mu_assert(bo_load_be64(wire) == 0x0102030405060708ULL, "load_be64");
+    mu_assert(bo_load_be32(wire + 1) == 0x02030405, "Unaligned load_be32");
+
+    bo_store_be64(out + 1, 0x0102030405060708ULL);
+    mu_assert(!memcmp(out + 1, wire, 8), "store_be64");
+    bo_store_be32(out + 1, 0x01020304);
+    bo_store_be16(out + 5, 0x0506);
+    mu_assert(!memcmp(out + 1, wire, 6), "store_be32/16");
+
+    /* round trips; exactly one of be/le is the identity */
+    mu_assert(bo_be32(bo_be32(0xdeadbeef)) == 0xdeadbeef, "be32 round trip");
+    mu_assert(bo_le64(bo_le64(42)) == 42, "le64 round trip");
+    mu_assert((bo_be16(0x0102) == 0x0102) != (bo_le16(0x0102) == 0x0102),
+              "be16 and le16 both swap or both don't");
+    mu_assert(BO_LITTLE_ENDIAN != BO_BIG_ENDIAN, "Byte order undetermined");
+    return NULL;
+}
+
+/* swapping every width-byte element reverses each group of width bytes */
+static bool swapped(const uint8_t *dst, const uint8_t *src, size_t n,
+                    size_t width) {
+    size_t i;
+
+    for (i = 0; i < n * width; i++) {
+        if (dst[i] != src[(i / width) * width + width - 1 - i % width]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const char *test_bulk(size_t width) {
+    static uint8_t src[MAXLEN * 8 + 1], dst[MAXLEN * 8 + 1], copy[MAXLEN * 8];
+    void (*swap)(void *, const void *, size_t) =
+        width == 2 ? bo_bswap16_n : width == 4 ? bo_bswap32_n : bo_bswap64_n;
+    size_t i, n, off;
+
+    for (i = 0; i < sizeof(src); i++) {
+        src[i] = (uint8_t)(i * 131 + 7);
+    }
+    /* every tail length around the 16/32/64-byte vector steps */
+    for (n = 0; n < MAXLEN; n = n < 70 ? n + 1 : n * 2 + 3) {
+        for (off = 0; off < 2; off++) {
+            memset(dst, 0xaa, sizeof(dst));
+            swap(dst + off, src + off, n);
+            mu_assert(swapped(dst + off, src + off, n, width),
+                      "%zu-byte swap of %zu values at offset %zu", width, n, off);
+            mu_assert(dst[off + n * width] == 0xaa, "Wrote past %zu values", n);
+        }
+        /* in place */
+        memcpy(copy, src, n * width);
+        swap(copy, copy, n);
+        mu_assert(swapped(copy, src, n, width), "In-place swap of %zu values",
+                  n);
+    }
+    return NULL;
+}
+
+const char *test_be_n() {
+    const uint8_t wire[] = {0, 1, 0, 2, 0, 3};
+    uint16_t host[3];
+    uint8_t back[6];
+
+    bo_be16_n(host, wire, 3);
+    mu_assert(host[0] == 1 && host[1] == 2 && host[2] == 3, "be16_n: %u %u %u",
+              host[0], host[1], host[2]);
+    bo_be16_n(back, host, 3);
+    mu_assert(!memcmp(back, wire, sizeof(wire)), "be16_n round trip");
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_single);
+    mu_run_test(test_bulk, 2);
+    mu_run_test(test_bulk, 4);
+    mu_run_test(test_bulk, 8);
+    mu_run_test(test_be_n);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
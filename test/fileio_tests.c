@@ -0,0 +1,209 @@
+/* mkstemp() */
+#define _GNU_SOURCE
+#include "minunit.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "fileio.h"
+
+#define LONG_LINE 3000
+
+static char path[64];
+
+/* Create a temp file holding len bytes of data; its name goes in path. */
+static const char *make_file(const void *data, size_t len) {
+    int fd;
+
+    strcpy(path, "/tmp/fileio_tests.XXXXXX");
+    fd = mkstemp(path);
+    mu_assert(fd != -1, "mkstemp failed: %s", strerror(errno));
+    mu_assert(write(fd, data, len) == (ssize_t)len, "write failed");
+    close(fd);
+    return NULL;
+}
+
+/* deterministic bytes, different for each offset */
+static void fill(char *buf, size_t len, size_t offset) {
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        buf[i] = (char)((offset + i) * 2654435761u >> 13);
+    }
+}
+
+const char *test_map() {
+    const int flags[] = {0, FIO_SEQUENTIAL | FIO_WILLNEED, FIO_POPULATE,
+                         FIO_HUGEPAGES | FIO_SEQUENTIAL};
+    size_t len = 3 * 1024 * 1024 + 17, i;
+    char *data = malloc(len);
+    const char *err;
+    file_map_t m;
+
+    mu_assert(data, "Out of memory");
+    fill(data, len, 0);
+    if ((err = make_file(data, len))) {
+        return err;
+    }
+    for (i = 0; i < ARRAYLEN(flags); i++) {
+        mu_assert(fio_map(&m, path, flags[i]) == 0, "fio_map(%d) failed: %s",
+                  flags[i], strerror(errno));
+        mu_assert(m.len == len && !memcmp(m.data, data, len),
+                  "Mapping with flags %d differs", flags[i]);
+        if (flags[i] & FIO_HUGEPAGES) {
+            mu_assert((uintptr_t)m.data % (2 * 1024 * 1024) == 0,
+                      "Huge page mapping not aligned: %p", (void *)m.data);
+        }
+        mu_assert(str_ends_with(fio_map_str(&m), str_make(data + len - 5, 5)),
+                  "fio_map_str() wrong");
+        fio_unmap(&m);
+        mu_assert(m.data == NULL, "fio_unmap() did not reset the map");
+    }
+    unlink(path);
+    free(data);
+
+    if ((err = make_file("", 0))) {
+        return err;
+    }
+    mu_assert(fio_map(&m, path, FIO_SEQUENTIAL) == 0 && m.len == 0,
+              "Empty file not mapped");
+    fio_unmap(&m);
+    unlink(path);
+    mu_assert(fio_map(&m, path, 0) == -1 && errno == ENOENT,
+              "Missing file mapped");
+    return NULL;
+}
+
+const char *test_lines() {
+    char text[LONG_LINE + 64], *p = text;
+    const char *err;
+    file_reader_t r;
+    ssize_t n;
+    str_t line;
+
+    p += sprintf(p, "first\n\n\r\n");
+    memset(p, 'x', LONG_LINE);
+    p += LONG_LINE;
+    p += sprintf(p, "\nlast");
+    if ((err = make_file(text, p - text))) {
+        return err;
+    }
+
+    /* a 64-byte buffer forces refills, compaction and growth */
+    mu_assert(fio_reader_open(&r, path, 64) == 0, "fio_reader_open failed");
+    n = fio_next_line(&r, &line);
+    mu_assert(n == 5 && str_eq(line, STR_LIT("first")), "Line 1: %zd", n);
+    n = fio_next_line(&r, &line);
+    mu_assert(n == 0 && line.len == 0, "Line 2: %zd", n);
+    n = fio_next_line(&r, &line);
+    mu_assert(n == 1 && line.ptr[0] == '\r', "Line 3: %zd", n);
+    n = fio_next_line(&r, &line);
+    mu_assert(n == LONG_LINE && line.ptr[0] == 'x' &&
+              line.ptr[LONG_LINE - 1] == 'x', "Long line: %zd", n);
+    n = fio_next_line(&r, &line);
+    mu_assert(n == 4 && str_eq(line, STR_LIT("last")), "Unterminated line");
+    mu_assert(fio_next_line(&r, &line) == FIO_EOF, "No EOF");
+    mu_assert(fio_next_line(&r, &line) == FIO_EOF, "No EOF after EOF");
+    fio_reader_close(&r);
+    unlink(path);
+    return NULL;
+}
+
+const char *test_read() {
+    size_t len = 100000, got = 0;
+    char *data = malloc(len), *out = malloc(len);
+    const char *err;
+    file_reader_t r;
+    ssize_t n;
+    str_t line;
+
+    mu_assert(data && out, "Out of memory");
+    fill(data, len, 0);
+    data[10] = '\n';
+    if ((err = make_file(data, len))) {
+        return err;
+    }
+    mu_assert(fio_reader_open(&r, path, 4096) == 0, "fio_reader_open failed");
+    mu_assert(fio_next_line(&r, &line) == 10, "First line");
+    memcpy(out, data, 11);
+    got = 11;
+    /* small reads drain the buffer, large ones then bypass it */
+    while ((n = fio_read(&r, out + got, got < 20000 ? 100 : len - got)) > 0) {
+        got += n;
+    }
+    mu_assert(n == 0 && got == len, "Read %zu of %zu bytes", got, len);
+    mu_assert(!memcmp(out, data, len), "Read data differs");
+    fio_reader_close(&r);
+    unlink(path);
+    free(data);
+    free(out);
+    return NULL;
+}
+
+const char *test_writer(int flags) {
+    size_t total = 0, len, i;
+    char *data = malloc(1 << 20);
+    const char *err;
+    file_writer_t w;
+    struct iovec iov[3];
+    file_map_t m;
+
+    mu_assert(data, "Out of memory");
+    if ((err = make_file("", 0))) {
+        return err;
+    }
+    mu_assert(fio_writer_open(&w, path, flags, 10000) == 0,
+              "fio_writer_open failed: %s", strerror(errno));
+    mu_assert(w.cap % FIO_DIRECT_ALIGN == 0, "cap %zu not rounded", w.cap);
+    for (i = 0; i < 200; i++) {
+        /* small, medium and larger-than-buffer writes, some gathered */
+        len = i % 7 == 0 ? 30000 : i % 3 == 0 ? 4000 : 1 + i;
+        fill(data, len, total);
+        if (i % 5 == 0) {
+            iov[0].iov_base = data;
+            iov[0].iov_len = len / 3;
+            iov[1].iov_base = data + len / 3;
+            iov[1].iov_len = 0;
+            iov[2].iov_base = data + len / 3;
+            iov[2].iov_len = len - len / 3;
+            mu_assert(fio_writev(&w, iov, 3) == 0, "fio_writev failed");
+        } else {
+            mu_assert(fio_write(&w, data, len) == 0, "fio_write failed: %s",
+                      strerror(errno));
+        }
+        total += len;
+        if (i % 50 == 0) {
+            mu_assert(fio_flush(&w) == 0, "fio_flush failed");
+        }
+    }
+    mu_assert(fio_writer_close(&w) == 0, "fio_writer_close failed: %s",
+              strerror(errno));
+
+    mu_assert(fio_map(&m, path, 0) == 0, "fio_map failed");
+    mu_assert(m.len == total, "Wrote %zu bytes, file has %zu", total, m.len);
+    for (i = 0; i < total; i += len) {
+        len = MIN(total - i, (size_t)1 << 20);
+        fill(data, len, i);
+        mu_assert(!memcmp(m.data + i, data, len), "Contents differ near %zu", i);
+    }
+    fio_unmap(&m);
+    unlink(path);
+    free(data);
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_map);
+    mu_run_test(test_lines);
+    mu_run_test(test_read);
+    mu_run_test(test_writer, 0);
+    mu_run_test(test_writer, FIO_DIRECT);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
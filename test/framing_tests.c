@@ -0,0 +1,255 @@
+#include "minunit.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "framing.h"
+
+#define NB_MSGS 2000
+#define BIG_LEN (1 << 16)
+
+/* message i of the non-blocking test: every tenth is written directly */
+static size_t nb_len(int i) {
+    return i % 10 == 9 ? 900 : 1 + i % 50;
+}
+
+const char *test_prefixed(frame_prefix_t kind) {
+    int sv[2];
+    frame_reader_t fr;
+    frame_writer_t fw;
+    const void *msg;
+    char big[3000];
+    ssize_t len;
+    int i;
+
+    mu_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "socketpair");
+    mu_assert(fw_init(&fw, sv[0], NULL, 256) == 0, "fw_init failed");
+    /* small reader buffer forces compaction and partial frames */
+    mu_assert(fr_init(&fr, sv[1], NULL, 4096) == 0, "fr_init failed");
+
+    memset(big, 'x', sizeof(big));
+    for (i = 0; i < 100; i++) {
+        mu_assert(fw_write_prefixed(&fw, kind, "hello", 5) == 0, "write");
+        mu_assert(fw_write_prefixed(&fw, kind, "", 0) == 0, "empty write");
+    }
+    mu_assert(fw_write_prefixed(&fw, kind, big, sizeof(big)) == 0, "big");
+    mu_assert(fw_flush(&fw) == 0, "flush");
+    close(sv[0]);
+
+    for (i = 0; i < 100; i++) {
+        len = fr_next_prefixed(&fr, kind, &msg);
+        mu_assert(len == 5 && !memcmp(msg, "hello", 5),
+                  "Wrong message %d, len %zd", i, len);
+        len = fr_next_prefixed(&fr, kind, &msg);
+        mu_assert(len == 0, "Expected empty message, got len %zd", len);
+    }
+    len = fr_next_prefixed(&fr, kind, &msg);
+    mu_assert(len == (ssize_t)sizeof(big) && !memcmp(msg, big, sizeof(big)),
+              "Wrong big message, len %zd", len);
+    len = fr_next_prefixed(&fr, kind, &msg);
+    mu_assert(len == FRAME_EOF, "Expected FRAME_EOF, got %zd", len);
+
+    fw_destroy(&fw);
+    fr_destroy(&fr);
+    close(sv[1]);
+    return NULL;
+}
+
+const char *test_delim() {
+    int sv[2];
+    frame_reader_t fr;
+    char rbuf[64];
+    const void *msg;
+    ssize_t len;
+    const char *stream = "GET / HTTP/1.1\r\nHost: x\r\n\r\npartial";
+
+    mu_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "socketpair");
+    mu_assert(fr_init(&fr, sv[1], rbuf, sizeof(rbuf)) == 0, "fr_init failed");
+
+    /* split the delimiter across two writes */
+    mu_assert(write(sv[0], stream, 15) == 15, "write");
+    mu_assert(write(sv[0], stream + 15, strlen(stream) - 15) ==
+                  (ssize_t)(strlen(stream) - 15),
+              "write");
+    close(sv[0]);
+
+    len = fr_next_delim(&fr, "\r\n", 2, &msg);
+    mu_assert(len == 14 && !memcmp(msg, "GET / HTTP/1.1", 14),
+              "Wrong first line, len %zd", len);
+    len = fr_next_delim(&fr, "\r\n", 2, &msg);
+    mu_assert(len == 7 && !memcmp(msg, "Host: x", 7), "Wrong second line");
+    len = fr_next_delim(&fr, "\r\n", 2, &msg);
+    mu_assert(len == 0, "Expected empty line, got len %zd", len);
+    len = fr_next_delim(&fr, "\r\n", 2, &msg);
+    mu_assert(len == -1 && errno == ECONNRESET,
+              "Expected truncated message error, got %zd", len);
+
+    fr_destroy(&fr);
+    close(sv[1]);
+    return NULL;
+}
+
+const char *test_oversized() {
+    int sv[2];
+    frame_reader_t fr;
+    frame_writer_t fw;
+    char payload[100] = {0};
+    const void *msg;
+
+    mu_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "socketpair");
+    mu_assert(fw_init(&fw, sv[0], NULL, 0) == 0, "fw_init failed");
+    mu_assert(fr_init(&fr, sv[1], NULL, 64) == 0, "fr_init failed");
+
+    mu_assert(fw_write_prefixed(&fw, FRAME_LEN32, payload, sizeof(payload)) ==
+                  0,
+              "write");
+    mu_assert(fw_flush(&fw) == 0, "flush");
+    mu_assert(fr_next_prefixed(&fr, FRAME_LEN32, &msg) == -1 &&
+                  errno == EMSGSIZE,
+              "Expected EMSGSIZE for message larger than buffer");
+
+    fw_destroy(&fw);
+    fr_destroy(&fr);
+    close(sv[0]);
+    close(sv[1]);
+    return NULL;
+}
+
+/* read messages 0, 1, ... to end of file: how many, or -1 at a wrong one */
+static void *nb_reader(void *arg) {
+    frame_reader_t fr;
+    const void *msg;
+    char want[900];
+    ssize_t len;
+    intptr_t i;
+
+    if (fr_init(&fr, *(int *)arg, NULL, 4096) == -1) {
+        return (void *)-1;
+    }
+    for (i = 0; (len = fr_next_prefixed(&fr, FRAME_LEN32, &msg)) >= 0; i++) {
+        memset(want, (int)i, nb_len(i));
+        if ((size_t)len != nb_len(i) || memcmp(msg, want, len)) {
+            break;
+        }
+    }
+    fr_destroy(&fr);
+    return (void *)(len == FRAME_EOF ? i : -1);
+}
+
+/* a full socket buffer: nothing buffered may be lost on EAGAIN */
+const char *test_nonblocking() {
+    struct pollfd pfd;
+    frame_writer_t fw;
+    pthread_t thread;
+    char msg[900];
+    int sv[2], i, sndbuf = 4096;
+    bool reading = false;
+    void *n;
+
+    mu_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "socketpair");
+    mu_assert(fcntl(sv[0], F_SETFL, O_NONBLOCK) == 0, "fcntl");
+    setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    mu_assert(fw_init(&fw, sv[0], NULL, 1024) == 0, "fw_init failed");
+    pfd.fd = sv[0];
+    pfd.events = POLLOUT;
+    for (i = 0; i < NB_MSGS; i++) {
+        memset(msg, i, nb_len(i));
+        while (fw_write_prefixed(&fw, FRAME_LEN32, msg, nb_len(i)) == -1) {
+            mu_assert(errno == EAGAIN || errno == EWOULDBLOCK, "write %d", i);
+            if (!reading) {
+                /* the socket is full: only now start draining it */
+                mu_assert(pthread_create(&thread, NULL, nb_reader, &sv[1]) == 0,
+                          "pthread_create");
+                reading = true;
+            }
+            mu_assert(poll(&pfd, 1, 5000) == 1, "poll");
+        }
+    }
+    mu_assert(reading, "The socket buffer never filled up");
+    while (fw_flush(&fw) == -1) {
+        mu_assert(errno == EAGAIN || errno == EWOULDBLOCK, "flush");
+        mu_assert(poll(&pfd, 1, 5000) == 1, "poll");
+    }
+    close(sv[0]);
+    pthread_join(thread, &n);
+    mu_assert((intptr_t)n == NB_MSGS, "Reader got %ld", (long)(intptr_t)n);
+    fw_destroy(&fw);
+    close(sv[1]);
+    return NULL;
+}
+
+static void *big_reader(void *arg) {
+    frame_reader_t fr;
+    const void *msg;
+    intptr_t ok;
+
+    if (fr_init(&fr, *(int *)arg, NULL, 2 * BIG_LEN) == -1) {
+        return (void *)0;
+    }
+    ok = fr_next_prefixed(&fr, FRAME_LEN32, &msg) == BIG_LEN &&
+         ((const char *)msg)[BIG_LEN - 1] == 'b' &&
+         fr_next_prefixed(&fr, FRAME_LEN32, &msg) == 1 &&
+         *(const char *)msg == 's' &&
+         fr_next_prefixed(&fr, FRAME_LEN32, &msg) == FRAME_EOF;
+    fr_destroy(&fr);
+    return (void *)ok;
+}
+
+/* a frame larger than the buffer, cut short by a full socket, is queued */
+const char *test_partial_frame() {
+    struct pollfd pfd;
+    frame_writer_t fw;
+    pthread_t thread;
+    int sv[2], sndbuf = 4096;
+    char *big;
+    void *ok;
+
+    mu_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "socketpair");
+    mu_assert(fcntl(sv[0], F_SETFL, O_NONBLOCK) == 0, "fcntl");
+    setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    mu_assert(fw_init(&fw, sv[0], NULL, 1024) == 0, "fw_init failed");
+    mu_assert((big = malloc(BIG_LEN)), "malloc");
+    memset(big, 'b', BIG_LEN);
+    /* nobody reads: this must not wait for the socket to drain */
+    mu_assert(fw_write_prefixed(&fw, FRAME_LEN32, big, BIG_LEN) == 0,
+              "Partly written frame not queued");
+    mu_assert(fw.pending && fw.pending_len > fw.cap, "Rest not kept");
+    free(big);
+    mu_assert(fw_write_prefixed(&fw, FRAME_LEN32, "s", 1) == 0, "small");
+    mu_assert(fw_flush(&fw) == -1 && (errno == EAGAIN || errno == EWOULDBLOCK),
+              "Flushed a full socket");
+    mu_assert(pthread_create(&thread, NULL, big_reader, &sv[1]) == 0,
+              "pthread_create");
+    pfd.fd = sv[0];
+    pfd.events = POLLOUT;
+    while (fw_flush(&fw) == -1) {
+        mu_assert(errno == EAGAIN || errno == EWOULDBLOCK, "flush");
+        mu_assert(poll(&pfd, 1, 5000) == 1, "poll");
+    }
+    mu_assert(!fw.pending && !fw.len, "Flushed with bytes left");
+    close(sv[0]);
+    pthread_join(thread, &ok);
+    mu_assert(ok, "Frames garbled");
+    fw_destroy(&fw);
+    close(sv[1]);
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_prefixed, FRAME_LEN32);
+    mu_run_test(test_prefixed, FRAME_VARINT);
+    mu_run_test(test_delim);
+    mu_run_test(test_oversized);
+    mu_run_test(test_nonblocking);
+    mu_run_test(test_partial_frame);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,218 @@
+#include "minunit.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "alloc.h"
+#include "hashmap.h"
+
+HM_DEFINE(u64map, uint64_t, uint64_t, hm_hash_u64, HM_EQ_VALUE)
+
+#define NKEYS 5000
+#define KEY_SPACE 4096
+#define CHURN_OPS 200000
+
+static char *copy_str(const char *s) {
+    char *c = malloc(strlen(s) + 1);
+    return c ? strcpy(c, s) : NULL;
+}
+
+const char *test_strings() {
+    hashmap_t *hm = hm_create(hm_hash_str, hm_eq_str);
+    char key[32], *old_key;
+    void *old_val;
+    bool inserted;
+    intptr_t i;
+
+    mu_assert(hm, "hm_create failed");
+    for (i = 0; i < NKEYS; i++) {
+        snprintf(key, sizeof(key), "key%ld", (long)i);
+        mu_assert(hm_put(hm, copy_str(key), (void *)i) == 0, "hm_put failed");
+    }
+    mu_assert(hm_len(hm) == NKEYS, "Expected %d entries, got %zu", NKEYS,
+              hm_len(hm));
+    for (i = 0; i < NKEYS; i++) {
+        snprintf(key, sizeof(key), "key%ld", (long)i);
+        mu_assert(hm_get(hm, key) == (void *)i, "Wrong value for %s", key);
+    }
+    mu_assert(!hm_find(hm, "nope"), "Found a missing key");
+
+    /* replacing keeps the original key */
+    mu_assert(*hm_insert(hm, "key7", &inserted) == (void *)7 && !inserted,
+              "hm_insert of an existing key");
+    mu_assert(hm_put(hm, "key7", (void *)70) == 0 &&
+                  hm_get(hm, "key7") == (void *)70 && hm_len(hm) == NKEYS,
+              "Replace failed");
+
+    for (i = 0; i < NKEYS; i += 2) {
+        snprintf(key, sizeof(key), "key%ld", (long)i);
+        mu_assert(hm_erase(hm, key, (void **)&old_key, &old_val) == 0,
+                  "hm_erase(%s) failed", key);
+        mu_assert(!strcmp(old_key, key), "Erase returned the wrong key");
+        free(old_key);
+    }
+    mu_assert(hm_erase(hm, "key0", NULL, NULL) == -1 && errno == ENOENT,
+              "Erased a missing key");
+    mu_assert(hm_len(hm) == NKEYS / 2, "Wrong length after erase");
+    for (i = 0; i < NKEYS; i++) {
+        snprintf(key, sizeof(key), "key%ld", (long)i);
+        mu_assert(!hm_find(hm, key) == !(i % 2), "%s %s after erase", key,
+                  i % 2 ? "missing" : "present");
+    }
+    hm_destroy(hm, free, NULL);
+    return NULL;
+}
+
+/* NULL hash and eq: keys are compared by address */
+const char *test_identity() {
+    hashmap_t *hm = hm_create(NULL, NULL);
+    char a[] = "same", b[] = "same";
+    hm_entry_t *e;
+    size_t iter = 0, n = 0;
+
+    mu_assert(hm, "hm_create failed");
+    hm_put(hm, a, "a");
+    hm_put(hm, b, "b");
+    mu_assert(hm_len(hm) == 2, "Equal strings at different addresses merged");
+    mu_assert(!strcmp(hm_get(hm, b), "b"), "Wrong value");
+    while ((e = hm_next(hm, &iter))) {
+        mu_assert(e->key == a || e->key == b, "Unknown key iterated");
+        n++;
+    }
+    mu_assert(n == 2, "Iterated %zu entries", n);
+    hm_clear(hm);
+    mu_assert(hm_len(hm) == 0 && !hm_find(hm, a), "hm_clear left entries");
+    hm_destroy(hm, NULL, NULL);
+    return NULL;
+}
+
+/* Random inserts and erases against a reference table. Under steady churn
+ * the table must recycle its slots instead of growing. */
+const char *test_churn() {
+    static bool present[KEY_SPACE];
+    uint64_t x = 12345, key, *v, sum = 0, expect = 0;
+    u64map_t m;
+    u64map_entry_t *e;
+    size_t i, iter = 0, n = 0, max_cap = 0;
+    bool inserted;
+
+    u64map_init(&m, NULL);
+    for (i = 0; i < CHURN_OPS; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        key = x % KEY_SPACE;
+        if (x & (1 << 20)) {
+            v = u64map_insert(&m, key, &inserted);
+            mu_assert(v && inserted == !present[key], "insert(%lu) wrong",
+                      (unsigned long)key);
+            *v = key * 3;
+            n += inserted;
+            present[key] = true;
+        } else {
+            mu_assert((u64map_erase(&m, key, NULL, NULL) == 0) == present[key],
+                      "erase(%lu) wrong", (unsigned long)key);
+            n -= present[key];
+            present[key] = false;
+        }
+        mu_assert(u64map_len(&m) == n, "Length %zu, expected %zu",
+                  u64map_len(&m), n);
+        max_cap = MAX(max_cap, m.cap);
+    }
+    for (key = 0; key < KEY_SPACE; key++) {
+        v = u64map_find(&m, key);
+        mu_assert(!v == !present[key], "find(%lu) wrong", (unsigned long)key);
+        mu_assert(!v || *v == key * 3, "Wrong value for %lu",
+                  (unsigned long)key);
+        expect += present[key] ? key : 0;
+    }
+    while ((e = u64map_next(&m, &iter))) {
+        sum += e->key;
+    }
+    mu_assert(sum == expect, "Iteration missed entries");
+    mu_assert(max_cap <= 2 * hm__capacity_for(KEY_SPACE),
+              "Table grew to %zu slots for %d keys", max_cap, KEY_SPACE);
+    u64map_destroy(&m);
+    return NULL;
+}
+
+/* Erasing from a sparse table leaves no tombstones: the slots are reused
+ * without a rehash. */
+const char *test_no_tombstones() {
+    u64map_t m;
+    int8_t *ctrl;
+    uint64_t k;
+    size_t round, i;
+
+    u64map_init(&m, NULL);
+    mu_assert(u64map_reserve(&m, 1000) == 0, "reserve failed");
+    ctrl = m.ctrl;
+    for (round = 0; round < 100; round++) {
+        for (i = 0; i < 100; i++) {
+            k = round * 100 + i;
+            mu_assert(u64map_put(&m, k, k) == 0, "put failed");
+        }
+        for (i = 0; i < 100; i++) {
+            k = round * 100 + i;
+            mu_assert(u64map_erase(&m, k, NULL, NULL) == 0, "erase failed");
+        }
+    }
+    mu_assert(m.ctrl == ctrl, "Table was rehashed");
+    mu_assert(m.growth_left == hm__max_load(m.cap),
+              "%zu slots left as tombstones",
+              hm__max_load(m.cap) - m.growth_left);
+    u64map_destroy(&m);
+    return NULL;
+}
+
+const char *test_arena() {
+    arena_t arena;
+    hashmap_t *hm;
+    uintptr_t i;
+
+    arena_init(&arena, 0);
+    hm = hm_create_with(hm_hash_ptr, NULL, arena_allocator(&arena));
+    mu_assert(hm, "hm_create_with failed");
+    for (i = 1; i <= NKEYS; i++) {
+        mu_assert(hm_put(hm, (void *)i, (void *)(i * 2)) == 0,
+                  "hm_put failed");
+    }
+    for (i = 1; i <= NKEYS; i++) {
+        mu_assert(hm_get(hm, (void *)i) == (void *)(i * 2), "Wrong value");
+    }
+    hm_destroy(hm, NULL, NULL);
+    arena_destroy(&arena);
+    return NULL;
+}
+
+const char *test_hash_bytes() {
+    char zeros[64] = {0};
+    uint64_t h[64];
+    size_t i, j;
+
+    for (i = 0; i < 64; i++) {
+        h[i] = hm_hash_bytes(zeros, i);
+        for (j = 0; j < i; j++) {
+            mu_assert(h[i] != h[j], "Lengths %zu and %zu collide", i, j);
+        }
+    }
+    mu_assert(hm_hash_str("abc") == hm_hash_bytes("abc", 3),
+              "hm_hash_str differs from hm_hash_bytes");
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_strings);
+    mu_run_test(test_identity);
+    mu_run_test(test_churn);
+    mu_run_test(test_no_tombstones);
+    mu_run_test(test_arena);
+    mu_run_test(test_hash_bytes);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,151 @@
+#define INSTRUMENT
+/* test_report() checks the regions recorded by the tests before it */
+#define MU_NO_FORK
+#include "minunit.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "instrument.h"
+
+#define NTHREADS 4
+#define PER_THREAD 10000
+
+static inst_site_t values_site = {"values", 0};
+
+const char *test_percentiles() {
+    inst_stats_t s;
+    uint64_t i;
+    double expect;
+
+    for (i = 1; i <= 100000; i++) {
+        inst_record(&values_site, i);
+    }
+    mu_assert(inst_region_stats("values", &s) == 0, "Region not found");
+    mu_assert(s.count == 100000, "Expected 100000 samples, got %llu",
+              (unsigned long long)s.count);
+    mu_assert(s.min == inst_ticks_to_ns(1), "Wrong min %f", s.min);
+    mu_assert(s.max == inst_ticks_to_ns(100000), "Wrong max %f", s.max);
+
+    /* log-linear buckets are accurate to 1 / INST_SUB_BUCKETS */
+    expect = inst_ticks_to_ns(50000);
+    mu_assert(s.p50 > expect * 0.96 && s.p50 < expect * 1.04,
+              "p50 %f, expected about %f", s.p50, expect);
+    expect = inst_ticks_to_ns(99000);
+    mu_assert(s.p99 > expect * 0.96 && s.p99 < expect * 1.04,
+              "p99 %f, expected about %f", s.p99, expect);
+    expect = inst_ticks_to_ns(99900);
+    mu_assert(s.p999 > expect * 0.96 && s.p999 <= s.max,
+              "p999 %f, expected about %f", s.p999, expect);
+    mu_assert(inst_region_stats("no such region", &s) == -1,
+              "Found a region that was never recorded");
+    return NULL;
+}
+
+static void *count_thread(void *arg) {
+    int i;
+
+    (void)arg;
+    for (i = 0; i < PER_THREAD; i++) {
+        INST_COUNT("test.count", 1);
+        INST_TIME("test.time", (void)0);
+    }
+    return NULL;
+}
+
+const char *test_threads() {
+    pthread_t threads[NTHREADS];
+    inst_stats_t s;
+    int i, round;
+
+    /* the second round reuses the first round's records */
+    for (round = 1; round <= 2; round++) {
+        for (i = 0; i < NTHREADS; i++) {
+            pthread_create(&threads[i], NULL, count_thread, NULL);
+        }
+        for (i = 0; i < NTHREADS; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        /* exited threads' data is kept */
+        mu_assert(inst_counter_value("test.count") ==
+                      (uint64_t)round * NTHREADS * PER_THREAD,
+                  "Wrong counter total %llu",
+                  (unsigned long long)inst_counter_value("test.count"));
+        mu_assert(inst_region_stats("test.time", &s) == 0 &&
+                      s.count == (uint64_t)round * NTHREADS * PER_THREAD,
+                  "Wrong sample count");
+    }
+    return NULL;
+}
+
+static void scoped(int n) {
+    INST_SCOPE("test.scope");
+    while (n--) {
+        __asm__ __volatile__("");
+    }
+}
+
+const char *test_scope_and_enable() {
+    inst_stats_t s;
+
+    scoped(1000);
+    scoped(1000);
+    mu_assert(inst_region_stats("test.scope", &s) == 0 && s.count == 2,
+              "Expected 2 scoped samples");
+    mu_assert(s.min > 0, "Scope took no time");
+
+    inst_enable(false);
+    scoped(1000);
+    INST_COUNT("test.disabled", 1);
+    inst_enable(true);
+    mu_assert(inst_region_stats("test.scope", &s) == 0 && s.count == 2,
+              "Recorded while disabled");
+    mu_assert(inst_counter_value("test.disabled") == 0,
+              "Counted while disabled");
+    return NULL;
+}
+
+const char *test_report() {
+    char line[256];
+    FILE *f = tmpfile();
+    int rows = 0;
+
+    mu_assert(f, "tmpfile failed");
+    inst_report(f);
+    mu_assert(ftell(f) > 0, "Empty report");
+    fclose(f);
+
+    f = tmpfile();
+    mu_assert(f, "tmpfile failed");
+    inst_dump_csv(f);
+    rewind(f);
+    while (fgets(line, sizeof(line), f)) {
+        rows++;
+    }
+    fclose(f);
+    /* header, 3 regions, 1 counter (test.disabled was never registered) */
+    mu_assert(rows == 5, "Expected 5 CSV rows, got %d", rows);
+
+    inst_reset();
+    mu_assert(inst_counter_value("test.count") == 0, "Counter not reset");
+    return NULL;
+}
+
+const char *test_log_time() {
+    log_time(scoped, 100000);
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_percentiles);
+    mu_run_test(test_threads);
+    mu_run_test(test_scope_and_enable);
+    mu_run_test(test_report);
+    mu_run_test(test_log_time);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
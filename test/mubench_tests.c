@@ -0,0 +1,99 @@
+#include "mubench.h"
+
+/* Takes about ns nanoseconds per iteration. */
+const char *bench_spin(mu_bench_t *b, uint64_t ns) {
+    uint64_t until;
+    size_t i;
+
+    mu_bench_resume(b);
+    for (i = 0; i < b->iters; i++) {
+        until = inst_now_ns() + ns;
+        while (inst_now_ns() < until) {
+        }
+    }
+    mu_bench_pause(b);
+    return NULL;
+}
+
+const char *test_calibration() {
+    mu_bench_t b;
+    int runs = 0;
+
+    __mb_reps = 5;
+    __mb_sample_ns = 2000000;
+    mu_assert(__mb_begin(&b, "spin"), "Unfiltered bench skipped");
+    while (__mb_next(&b)) {
+        bench_spin(&b, 1000);
+        runs++;
+    }
+    mu_assert(b.nsamples == 5, "Expected 5 samples, got %d", b.nsamples);
+    mu_assert(b.iters * 1000 >= __mb_sample_ns / 2,
+              "Calibrated to only %zu iterations", b.iters);
+    mu_assert(b.iters < 100 * 2000, "Calibrated to %zu iterations", b.iters);
+    mu_assert(runs > 5, "No calibration runs");
+    for (runs = 0; runs < b.nsamples; runs++) {
+        mu_assert(b.samples[runs] >= 1000 && b.samples[runs] < 100000,
+                  "Sample %d: %.1f ns per iteration", runs, b.samples[runs]);
+    }
+
+    __mb_filter = "other";
+    mu_assert(!__mb_begin(&b, "spin"), "Filtered bench not skipped");
+    __mb_filter = NULL;
+    return NULL;
+}
+
+/* Run two benches through mu_run_bench() and check the JSON they produce. */
+const char *run_json(void) {
+    mu_suite_start();
+
+    mu_run_bench(bench_spin, 100);
+    mu_run_bench(bench_spin, 2000);
+    return message;
+}
+
+const char *test_json() {
+    char buf[4096];
+    size_t len;
+    double m1, m2;
+    const char *p;
+
+    __mb_out = tmpfile();
+    mu_assert(__mb_out, "tmpfile failed");
+    __mb_format = MB_JSON;
+    __mb_reported = 0;
+    __mb_header();
+    mu_assert(run_json() == NULL, "Bench failed");
+    fprintf(__mb_out, "\n]\n");
+    rewind(__mb_out);
+    len = fread(buf, 1, sizeof(buf) - 1, __mb_out);
+    buf[len] = '\0';
+    fclose(__mb_out);
+    __mb_out = stdout;
+
+    mu_assert(buf[0] == '[' && strstr(buf, "\n]\n"), "Not a JSON list");
+    p = strstr(buf, "\"name\": \"bench_spin(100)\"");
+    mu_assert(p, "First bench missing");
+    mu_assert((p = strstr(p, "\"median_ns\": ")) &&
+                  sscanf(p, "\"median_ns\": %lf", &m1) == 1,
+              "No median");
+    p = strstr(p, "\"name\": \"bench_spin(2000)\"");
+    mu_assert(p, "Second bench missing");
+    mu_assert((p = strstr(p, "\"median_ns\": ")) &&
+                  sscanf(p, "\"median_ns\": %lf", &m2) == 1,
+              "No median");
+    mu_assert(m1 >= 100 && m2 >= 2000 && m2 > m1,
+              "Medians out of order: %.1f, %.1f", m1, m2);
+    mu_assert(strstr(buf, "\"samples_ns\": ["), "No samples");
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_calibration);
+    mu_run_test(test_json);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
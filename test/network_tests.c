@@ -0,0 +1,139 @@
+#define _GNU_SOURCE
+#include "minunit.h"
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "instrument.h"
+#include "network.h"
+
+#define TIMEOUT_MS 100
+#define SLACK_MS 400 /* how late a timeout may fire on a loaded machine */
+#define DRIP_MS 10
+
+static uint64_t elapsed_ms(uint64_t start) {
+    return (inst_now_ns() - start) / 1000000;
+}
+
+/* a slow peer: one byte every DRIP_MS, for far longer than TIMEOUT_MS, or
+ * until the other end closes */
+static void *drip(void *arg) {
+    int fd = *(int *)arg, i;
+
+    for (i = 0; i < 100 && send(fd, "x", 1, MSG_NOSIGNAL) == 1; i++) {
+        usleep(DRIP_MS * 1000);
+    }
+    shutdown(fd, SHUT_WR);
+    return NULL;
+}
+
+const char *test_recv_timeout() {
+    char buf[16];
+    uint64_t start;
+    int sv[2];
+
+    mu_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "socketpair");
+    start = inst_now_ns();
+    mu_assert(recv_deadline(sv[0], buf, sizeof(buf),
+                            net_deadline(TIMEOUT_MS)) == -1 &&
+                  errno == ETIMEDOUT,
+              "No timeout from a silent peer");
+    mu_assert(elapsed_ms(start) >= TIMEOUT_MS, "Timed out after %llu ms",
+              (unsigned long long)elapsed_ms(start));
+    mu_assert(elapsed_ms(start) < TIMEOUT_MS + SLACK_MS,
+              "Timed out after %llu ms", (unsigned long long)elapsed_ms(start));
+    /* a deadline already passed still takes data that is there */
+    mu_assert(send(sv[1], "ab", 2, 0) == 2, "send");
+    mu_assert(recv_deadline(sv[0], buf, sizeof(buf), net_deadline(0)) == 2,
+              "Ready data not received");
+    close(sv[0]);
+    close(sv[1]);
+    return NULL;
+}
+
+/* what arrived before the deadline is reported in *len */
+const char *test_partial() {
+    char buf[16];
+    size_t len = sizeof(buf);
+    char *big;
+    int sv[2];
+
+    mu_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "socketpair");
+    mu_assert(send(sv[1], "hello", 5, 0) == 5, "send");
+    mu_assert(recvall_deadline(sv[0], buf, &len, net_deadline(TIMEOUT_MS)) ==
+                      -1 &&
+                  errno == ETIMEDOUT,
+              "No timeout");
+    mu_assert(len == 5 && !memcmp(buf, "hello", 5), "Received %zu", len);
+
+    /* the peer never reads: the send buffer fills up */
+    len = 1 << 22;
+    mu_assert((big = calloc(1, len)), "calloc");
+    mu_assert(sendall_deadline(sv[0], big, &len, net_deadline(TIMEOUT_MS)) ==
+                      -1 &&
+                  errno == ETIMEDOUT,
+              "No timeout");
+    mu_assert(len > 0 && len < 1 << 22, "Sent %zu", len);
+    free(big);
+    close(sv[0]);
+    close(sv[1]);
+    return NULL;
+}
+
+/* a peer that closes early gives a short count, not an error */
+const char *test_eof() {
+    char buf[16];
+    size_t len = sizeof(buf);
+    int sv[2];
+
+    mu_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "socketpair");
+    mu_assert(send(sv[1], "abc", 3, 0) == 3, "send");
+    close(sv[1]);
+    mu_assert(recvall_deadline(sv[0], buf, &len, net_deadline(TIMEOUT_MS)) ==
+                  3,
+              "Expected 3 bytes");
+    mu_assert(len == 3, "Received %zu", len);
+    mu_assert(recv_deadline(sv[0], buf, sizeof(buf), NET_NO_DEADLINE) == 0,
+              "No end of file");
+    close(sv[0]);
+    return NULL;
+}
+
+/* a byte every DRIP_MS can't hold recv_timeout() past its timeout */
+const char *test_overall_deadline() {
+    pthread_t thread;
+    void *buf = NULL;
+    size_t len = 0;
+    uint64_t start;
+    ssize_t n;
+    int sv[2];
+
+    mu_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "socketpair");
+    pthread_create(&thread, NULL, drip, &sv[1]);
+    start = inst_now_ns();
+    n = recv_timeout(sv[0], &buf, &len, TIMEOUT_MS);
+    mu_assert(elapsed_ms(start) >= TIMEOUT_MS, "Returned after %llu ms",
+              (unsigned long long)elapsed_ms(start));
+    mu_assert(elapsed_ms(start) < TIMEOUT_MS + SLACK_MS,
+              "Returned after %llu ms", (unsigned long long)elapsed_ms(start));
+    close(sv[0]);
+    pthread_join(thread, NULL);
+    mu_assert(n > 0 && (size_t)n == len, "Received %zd, len %zu", n, len);
+    mu_assert(((char *)buf)[len] == '\0', "Not terminated");
+    free(buf);
+    close(sv[1]);
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_recv_timeout);
+    mu_run_test(test_partial);
+    mu_run_test(test_eof);
+    mu_run_test(test_overall_deadline);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
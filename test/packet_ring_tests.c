@@ -0,0 +1,150 @@
+#define _GNU_SOURCE
+#include "minunit.h"
+
+#include <fcntl.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "packet_ring.h"
+
+#define TEST_ETHERTYPE 0x88b5 /* IEEE 802 local experimental */
+#define NFRAMES 100
+#define FRAME_LEN 64
+
+/* small rings: a few pages, so the tx ring wraps */
+static void small_config(pr_config_t *cfg) {
+    pr_config_init(cfg, "lo");
+    cfg->block_size = 4096;
+    cfg->block_count = 4;
+    cfg->frame_size = 1024;
+    cfg->retire_tov_ms = 10;
+}
+
+const char *test_config() {
+    pr_config_t cfg;
+    pr_ring_t ring;
+    pr_packet_t pkt;
+
+    pr_config_init(&cfg, "eth0");
+    mu_assert(!strcmp(cfg.ifname, "eth0") &&
+                  cfg.block_size == PR_DEFAULT_BLOCK_SIZE &&
+                  cfg.block_count == PR_DEFAULT_BLOCK_COUNT &&
+                  cfg.frame_size == PR_DEFAULT_FRAME_SIZE &&
+                  !cfg.fanout_group,
+              "Bad defaults");
+    /* the geometry is checked before any socket is opened */
+    small_config(&cfg);
+    cfg.frame_size = 1000;
+    mu_assert(pr_rx_open(&ring, &cfg) == -1 && errno == EINVAL,
+              "Unaligned frame size");
+    cfg.frame_size = 3 * TPACKET_ALIGNMENT * 16;
+    mu_assert(pr_tx_open(&ring, &cfg) == -1 && errno == EINVAL,
+              "Frames don't tile a block");
+    cfg.frame_size = 1024;
+    cfg.ifname = NULL;
+    mu_assert(pr_tx_open(&ring, &cfg) == -1 && errno == EINVAL,
+              "tx without an interface");
+    mu_assert(ring.fd == -1 && !ring.map, "Failed open left a ring");
+    mu_assert(pr_rx_next(&ring, &pkt, 0) == -1 && errno == EINVAL,
+              "rx on a closed ring");
+    mu_assert(!pr_tx_frame(&ring, NULL) && errno == EINVAL,
+              "tx on a closed ring");
+    return NULL;
+}
+
+/* frames that could not be kicked stay queued for the next flush */
+const char *test_flush_again() {
+    unsigned char map[1];
+    pr_ring_t ring;
+    int sv[2];
+    char c = 0;
+
+    /* stand in for the packet socket with one that is full */
+    mu_assert(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) == 0, "socketpair");
+    mu_assert(fcntl(sv[0], F_SETFL, O_NONBLOCK) == 0, "fcntl");
+    while (send(sv[0], &c, 1, 0) == 1) {
+    }
+    mu_assert(errno == EAGAIN || errno == EWOULDBLOCK, "Filling failed");
+    memset(&ring, 0, sizeof(ring));
+    ring.fd = sv[0];
+    ring.map = map;
+    ring.tx_queued = 3;
+    mu_assert(pr_tx_flush(&ring, false) == -1 &&
+                  (errno == EAGAIN || errno == EWOULDBLOCK),
+              "Flush succeeded");
+    mu_assert(ring.tx_queued == 3, "Queued frames forgotten");
+    while (recv(sv[1], &c, 1, MSG_DONTWAIT) == 1) {
+    }
+    mu_assert(pr_tx_flush(&ring, false) == 0 && ring.tx_queued == 0,
+              "Flush after draining");
+    close(sv[0]);
+    close(sv[1]);
+    return NULL;
+}
+
+/* inject frames on the loopback interface and capture them again */
+const char *test_loopback() {
+    unsigned char *frame;
+    pr_config_t cfg;
+    pr_ring_t rx, tx;
+    pr_packet_t pkt;
+    size_t maxlen;
+    int i, got = 0, rv;
+
+    small_config(&cfg);
+    cfg.ignore_outgoing = true;
+    if (pr_rx_open(&rx, &cfg) == -1 && errno == EPERM) {
+        log_warn("no CAP_NET_RAW: loopback test not run");
+        return NULL;
+    }
+    mu_assert(rx.fd != -1, "pr_rx_open");
+    mu_assert(pr_tx_open(&tx, &cfg) == 0, "pr_tx_open");
+    /* more frames than the tx ring holds: flush as it fills */
+    for (i = 0; i < NFRAMES; i++) {
+        while (!(frame = pr_tx_frame(&tx, &maxlen))) {
+            mu_assert(errno == ENOBUFS, "pr_tx_frame");
+            mu_assert(pr_tx_flush(&tx, true) == 0, "pr_tx_flush");
+        }
+        mu_assert(maxlen >= FRAME_LEN, "Frame of %zu bytes", maxlen);
+        memset(frame, 0xff, ETH_ALEN);
+        memset(frame + ETH_ALEN, 0x02, ETH_ALEN);
+        frame[12] = TEST_ETHERTYPE >> 8;
+        frame[13] = TEST_ETHERTYPE & 0xff;
+        memset(frame + ETH_HLEN, i, FRAME_LEN - ETH_HLEN);
+        mu_assert(pr_tx_commit(&tx, FRAME_LEN) == 0, "pr_tx_commit");
+    }
+    mu_assert(pr_tx_commit(&tx, maxlen + 1) == -1 && errno == EINVAL,
+              "Committed an oversized frame");
+    mu_assert(pr_tx_flush(&tx, true) == 0 && tx.tx_queued == 0, "Last flush");
+
+    /* other traffic on lo may be captured too: count ours, in order */
+    while (got < NFRAMES && (rv = pr_rx_next(&rx, &pkt, 1000)) == 1) {
+        if (pkt.pkttype == PACKET_OUTGOING || pkt.caplen != FRAME_LEN ||
+            pkt.data[12] != TEST_ETHERTYPE >> 8 ||
+            pkt.data[13] != (TEST_ETHERTYPE & 0xff)) {
+            continue;
+        }
+        mu_assert(pkt.data[ETH_HLEN] == (unsigned char)got &&
+                      pkt.data[FRAME_LEN - 1] == (unsigned char)got,
+                  "Frame %d out of order", got);
+        got++;
+    }
+    mu_assert(got == NFRAMES, "Captured %d of %d frames", got, NFRAMES);
+    pr_close(&tx);
+    pr_close(&rx);
+    mu_assert(rx.fd == -1 && !rx.map, "pr_close");
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_config);
+    mu_run_test(test_flush_again);
+    mu_run_test(test_loopback);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
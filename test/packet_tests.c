@@ -0,0 +1,189 @@
+#include "minunit.h"
+
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include "packet.h"
+
+/* straightforward RFC 1071 reference */
+static uint16_t ref_checksum(const uint8_t *p, size_t len) {
+    uint32_t sum = 0;
+    size_t i;
+
+    for (i = 0; i + 1 < len; i += 2) {
+        sum += (p[i] << 8) | p[i + 1];
+    }
+    if (len & 1) {
+        sum += p[len - 1] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+/* checksum as stored in a header -> host byte order */
+static uint16_t ntoh_csum(uint16_t csum) {
+    uint8_t b[2];
+    memcpy(b, &csum, sizeof(b));
+    return (uint16_t)((b[0] << 8) | b[1]);
+}
+
+/* IPv4/UDP packet 10.0.0.1:1234 -> 10.0.0.2:80 with a 6-byte payload */
+static size_t build_udp4(uint8_t *p) {
+    static const uint8_t hdr[] = {
+        0x45, 0x00, 0x00, 0x22, 0x12, 0x34, 0x40, 0x00, 0x40, 0x11, 0, 0,
+        10,   0,    0,    1,    10,   0,    0,    2,                      /* ip */
+        0x04, 0xd2, 0x00, 0x50, 0x00, 0x0e, 0,    0,                      /* udp */
+        'h',  'e',  'l',  'l',  'o',  '!'};
+    memcpy(p, hdr, sizeof(hdr));
+    return sizeof(hdr);
+}
+
+const char *test_checksum_kernels() {
+    static const uint8_t rfc1071[] = {0x00, 0x01, 0xf2, 0x03,
+                                      0xf4, 0xf5, 0xf6, 0xf7};
+    uint8_t *buf;
+    size_t len, off;
+    uint16_t got, want;
+
+    got = ntoh_csum(pkt_checksum(rfc1071, sizeof(rfc1071)));
+    mu_assert(got == 0x220d, "RFC 1071 example: expected 0x220d, got 0x%04x",
+              got);
+
+    /* exercise the vector paths with odd lengths and alignments */
+    buf = malloc(70000);
+    mu_assert(buf, "Out of memory");
+    for (len = 0; len < 70000; len++) {
+        buf[len] = (uint8_t)(len * 131 + 7);
+    }
+    for (off = 0; off < 4; off++) {
+        for (len = 0; len < 300; len++) {
+            got = ntoh_csum(pkt_checksum(buf + off, len));
+            want = ref_checksum(buf + off, len);
+            mu_assert(got == want, "len %zu off %zu: 0x%04x != 0x%04x", len,
+                      off, got, want);
+        }
+        got = ntoh_csum(pkt_checksum(buf + off, 69990));
+        want = ref_checksum(buf + off, 69990);
+        mu_assert(got == want, "large buffer: 0x%04x != 0x%04x", got, want);
+    }
+
+    /* chained partial sums match a single pass */
+    got = pkt_csum_finish(
+        pkt_csum_partial(buf + 1000, 999, pkt_csum_partial(buf, 1000, 0)));
+    want = pkt_checksum(buf, 1999);
+    mu_assert(got == want, "chained sum mismatch");
+
+    free(buf);
+    return NULL;
+}
+
+const char *test_parse_udp4() {
+    uint8_t pkt[64] = {0};
+    pkt_view_t v;
+    size_t len = build_udp4(pkt);
+
+    /* trailing link-layer padding must be ignored */
+    mu_assert(pkt_parse(&v, pkt, len + 10) == 0, "parse failed");
+    mu_assert(v.version == 4 && v.proto == IPPROTO_UDP, "wrong version/proto");
+    mu_assert(v.len == len, "wrong length %zu", v.len);
+    mu_assert(v.sport == 1234 && v.dport == 80, "wrong ports %u %u", v.sport,
+              v.dport);
+    mu_assert(v.payload_len == 6 && !memcmp(v.payload, "hello!", 6),
+              "wrong payload");
+    mu_assert(v.src[3] == 1 && v.dst[3] == 2, "wrong addresses");
+    mu_assert(!pkt_verify(&v), "zeroed IPv4 header checksum verified");
+
+    mu_assert(pkt_set_checksums(pkt, len) == 0, "set checksums failed");
+    mu_assert(pkt_parse(&v, pkt, len) == 0, "reparse failed");
+    mu_assert(pkt_verify(&v), "checksums don't verify");
+    mu_assert(ntoh_csum(pkt_checksum(pkt, PKT_IPV4_HLEN)) == 0,
+              "IPv4 header checksum wrong");
+
+    pkt[29]++; /* corrupt payload */
+    mu_assert(!pkt_verify(&v), "corrupted payload verified");
+
+    pkt[3] = 0x40; /* total length past end of buffer */
+    mu_assert(pkt_parse(&v, pkt, len) == -1 && errno == EBADMSG,
+              "accepted truncated packet");
+    return NULL;
+}
+
+const char *test_parse_tcp6_eth() {
+    uint8_t frame[128] = {0};
+    uint8_t *ip = frame + PKT_ETH_HLEN + 4; /* one VLAN tag */
+    uint8_t *tcp = ip + PKT_IPV6_HLEN + 8;  /* one hop-by-hop header */
+    pkt_view_t v;
+    size_t len;
+
+    frame[12] = 0x81; /* VLAN */
+    frame[16] = 0x86; /* IPv6 */
+    frame[17] = 0xdd;
+
+    ip[0] = 0x60;
+    ip[5] = 8 + PKT_TCP_HLEN + 4; /* payload length */
+    ip[6] = IPPROTO_HOPOPTS;
+    ip[7] = 64;
+    ip[23] = 1;  /* ::1 */
+    ip[39] = 2;  /* ::2 */
+    ip[40] = IPPROTO_TCP; /* next header after hop-by-hop */
+
+    tcp[0] = 0xc3, tcp[1] = 0x50;  /* 50000 */
+    tcp[2] = 0x01, tcp[3] = 0xbb;  /* 443 */
+    tcp[12] = (PKT_TCP_HLEN / 4) << 4;
+    tcp[13] = PKT_TCP_SYN | PKT_TCP_ACK;
+    memcpy(tcp + PKT_TCP_HLEN, "data", 4);
+    len = tcp + PKT_TCP_HLEN + 4 - frame;
+
+    mu_assert(pkt_parse_eth(&v, frame, len) == 0, "parse failed: %s",
+              strerror(errno));
+    mu_assert(v.l2 == frame && v.l3 == ip && v.l4 == tcp, "wrong offsets");
+    mu_assert(v.version == 6 && v.proto == IPPROTO_TCP, "wrong version/proto");
+    mu_assert(v.sport == 50000 && v.dport == 443, "wrong ports");
+    mu_assert(v.tcp_flags == (PKT_TCP_SYN | PKT_TCP_ACK), "wrong flags");
+    mu_assert(v.payload_len == 4, "wrong payload len %zu", v.payload_len);
+
+    mu_assert(pkt_set_checksums(ip, len - (ip - frame)) == 0, "set failed");
+    mu_assert(pkt_verify(&v), "checksum doesn't verify");
+    return NULL;
+}
+
+const char *test_csum_adjust() {
+    uint8_t pkt[64] = {0};
+    uint8_t new_addr[4] = {192, 168, 1, 77};
+    uint8_t new_port[2] = {0x1f, 0x90};
+    uint16_t ipsum, udpsum;
+    pkt_view_t v;
+    size_t len = build_udp4(pkt);
+
+    pkt_set_checksums(pkt, len);
+    memcpy(&ipsum, pkt + 10, 2);
+    memcpy(&udpsum, pkt + PKT_IPV4_HLEN + 6, 2);
+
+    /* NAT rewrite of the source address and port */
+    ipsum = pkt_csum_adjust(ipsum, pkt + 12, new_addr, 4);
+    udpsum = pkt_csum_adjust(udpsum, pkt + 12, new_addr, 4);
+    udpsum = pkt_csum_adjust(udpsum, pkt + PKT_IPV4_HLEN, new_port, 2);
+    memcpy(pkt + 12, new_addr, 4);
+    memcpy(pkt + PKT_IPV4_HLEN, new_port, 2);
+    memcpy(pkt + 10, &ipsum, 2);
+    memcpy(pkt + PKT_IPV4_HLEN + 6, &udpsum, 2);
+
+    mu_assert(pkt_parse(&v, pkt, len) == 0, "parse failed");
+    mu_assert(pkt_verify(&v), "incrementally updated checksums don't verify");
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_checksum_kernels);
+    mu_run_test(test_parse_udp4);
+    mu_run_test(test_parse_tcp6_eth);
+    mu_run_test(test_csum_adjust);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,206 @@
+#include "minunit.h"
+
+#include "alloc.h"
+#include "pqueue.h"
+#include "prng.h"
+
+#define NITEMS 2000
+
+typedef struct {
+    int64_t key;
+    pq_handle_t handle;
+} item_t;
+
+static int cmp_key(const void *a, const void *b, void *ctx) {
+    const item_t *x = a, *y = b;
+    int sign = ctx ? *(int *)ctx : 1;
+
+    return sign * ((x->key > y->key) - (x->key < y->key));
+}
+
+/* pop everything, checking that keys come out in order */
+static const char *drain(pqueue_t *pq, size_t want, int sign) {
+    item_t *it, *prev = NULL;
+    size_t n = 0;
+
+    while ((it = pq_pop(pq))) {
+        mu_assert(!prev || sign * (it->key - prev->key) >= 0,
+                  "%lld popped after %lld", (long long)it->key,
+                  (long long)prev->key);
+        prev = it;
+        n++;
+    }
+    mu_assert(n == want, "Popped %zu of %zu items", n, want);
+    mu_assert(pq_len(pq) == 0 && !pq_peek(pq), "Not empty after draining");
+    return NULL;
+}
+
+const char *test_push_pop(unsigned arity) {
+    static item_t items[NITEMS];
+    pqueue_t *pq = pq_create(arity, cmp_key, NULL);
+    const char *err;
+    item_t *top;
+    prng_t r;
+    size_t i;
+
+    mu_assert(pq, "pq_create(%u) failed", arity);
+    prng_seed(&r, arity);
+    for (i = 0; i < NITEMS; i++) {
+        items[i].key = prng_range(&r, -500, 500); /* plenty of duplicates */
+        items[i].handle = pq_push(pq, &items[i]);
+        mu_assert(items[i].handle != PQ_INVALID, "pq_push failed");
+        top = pq_peek(pq);
+        mu_assert(top->key <= items[i].key, "Peek is not the minimum");
+    }
+    mu_assert(pq_len(pq) == NITEMS, "Length %zu", pq_len(pq));
+    if ((err = drain(pq, NITEMS, 1))) {
+        return err;
+    }
+    mu_assert(pq_pop(pq) == NULL, "Popped from an empty queue");
+    pq_destroy(pq, NULL);
+    return NULL;
+}
+
+/* random priority changes and removals, checked against a full drain */
+const char *test_update_remove(unsigned arity) {
+    static item_t items[NITEMS];
+    pqueue_t *pq = pq_create(arity, cmp_key, NULL);
+    size_t i, j, live = NITEMS;
+    const char *err;
+    prng_t r;
+
+    mu_assert(pq, "pq_create(%u) failed", arity);
+    prng_seed(&r, 100 + arity);
+    for (i = 0; i < NITEMS; i++) {
+        items[i].key = prng_range(&r, 0, 1 << 20);
+        items[i].handle = pq_push(pq, &items[i]);
+    }
+    for (i = 0; i < 4 * NITEMS; i++) {
+        j = prng_bounded(&r, NITEMS);
+        if (!pq_contains(pq, items[j].handle)) {
+            continue;
+        }
+        mu_assert(pq_get(pq, items[j].handle) == &items[j], "Handle %zu moved",
+                  items[j].handle);
+        switch (prng_bounded(&r, 3)) {
+        case 0:
+            items[j].key -= prng_bounded(&r, 1 << 20);
+            mu_assert(pq_decrease(pq, items[j].handle) == 0, "pq_decrease");
+            break;
+        case 1:
+            items[j].key = prng_range(&r, -(1 << 20), 1 << 21);
+            mu_assert(pq_update(pq, items[j].handle) == 0, "pq_update");
+            break;
+        default:
+            mu_assert(pq_remove(pq, items[j].handle) == &items[j],
+                      "pq_remove returned the wrong item");
+            mu_assert(!pq_contains(pq, items[j].handle), "Removed but there");
+            live--;
+        }
+    }
+    err = drain(pq, live, 1);
+    pq_destroy(pq, NULL);
+    return err;
+}
+
+const char *test_handles() {
+    item_t a = {1, 0}, b = {2, 0}, c = {3, 0};
+    pqueue_t *pq = pq_create(0, cmp_key, NULL);
+    pq_handle_t ha, hb, hc;
+
+    mu_assert(pq && pq->arity == PQ_DEFAULT_ARITY, "Default arity");
+    ha = pq_push(pq, &a);
+    hb = pq_push(pq, &b);
+    mu_assert(pq_pop(pq) == &a, "Wrong first item");
+    mu_assert(pq_update(pq, ha) == -1 && errno == EINVAL,
+              "Updated a popped item");
+    mu_assert(pq_remove(pq, ha) == NULL && errno == EINVAL,
+              "Removed a popped item");
+    mu_assert(pq_decrease(pq, 12345) == -1 && errno == EINVAL,
+              "Decreased an unknown handle");
+
+    /* freed handles are reused, and still refer to the right item */
+    hc = pq_push(pq, &c);
+    mu_assert(hc == ha, "Handle %zu not reused (got %zu)", ha, hc);
+    mu_assert(pq_get(pq, hc) == &c && pq_get(pq, hb) == &b, "Wrong items");
+    c.key = 0;
+    pq_decrease(pq, hc);
+    mu_assert(pq_peek(pq) == &c, "Decrease-key did not move c first");
+    pq_destroy(pq, NULL);
+
+    mu_assert(!pq_create(1, cmp_key, NULL) && errno == EINVAL, "Arity 1");
+    mu_assert(!pq_create(PQ_MAX_ARITY + 1, cmp_key, NULL), "Arity too large");
+    mu_assert(!pq_create(2, NULL, NULL), "NULL comparator");
+    return NULL;
+}
+
+/* the context pointer reaches the comparator: -1 makes a max-heap */
+const char *test_ctx() {
+    static item_t items[NITEMS];
+    int sign = -1;
+    pqueue_t *pq = pq_create(3, cmp_key, &sign);
+    const char *err;
+    size_t i;
+
+    for (i = 0; i < NITEMS; i++) {
+        items[i].key = (int64_t)(i * 7919 % NITEMS);
+        pq_push(pq, &items[i]);
+    }
+    mu_assert(((item_t *)pq_peek(pq))->key == NITEMS - 1, "Not a max-heap");
+    err = drain(pq, NITEMS, -1);
+    pq_destroy(pq, NULL);
+    return err;
+}
+
+const char *test_allocator() {
+    arena_t arena;
+    pqueue_t *pq;
+    item_t *items;
+    size_t i;
+
+    arena_init(&arena, 0);
+    pq = pq_create_with(8, cmp_key, NULL, arena_allocator(&arena));
+    items = malloc(NITEMS * sizeof(*items));
+    mu_assert(pq && items, "Out of memory");
+    mu_assert(pq_reserve(pq, NITEMS) == 0 && pq->cap >= NITEMS, "Reserve");
+    for (i = 0; i < NITEMS; i++) {
+        items[i].key = NITEMS - i;
+        pq_push(pq, &items[i]);
+    }
+    pq_destroy(pq, NULL);
+    arena_destroy(&arena);
+
+    /* free_func sees every remaining item */
+    pq = pq_create(2, cmp_key, NULL);
+    for (i = 0; i < 10; i++) {
+        item_t *it = malloc(sizeof(*it));
+
+        mu_assert(it, "Out of memory");
+        it->key = i;
+        pq_push(pq, it);
+    }
+    free(pq_pop(pq));
+    pq_destroy(pq, free);
+    free(items);
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_push_pop, 2);
+    mu_run_test(test_push_pop, 3);
+    mu_run_test(test_push_pop, 4);
+    mu_run_test(test_push_pop, 8);
+    mu_run_test(test_push_pop, PQ_MAX_ARITY);
+    mu_run_test(test_update_remove, 2);
+    mu_run_test(test_update_remove, 4);
+    mu_run_test(test_update_remove, 7);
+    mu_run_test(test_handles);
+    mu_run_test(test_ctx);
+    mu_run_test(test_allocator);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
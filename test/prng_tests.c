@@ -0,0 +1,209 @@
+#include "minunit.h"
+
+#include <pthread.h>
+#include <string.h>
+#include "prng.h"
+
+#define DRAWS 1000000
+#define BUCKETS 10
+
+/* Pearson's chi-squared statistic of counts against a uniform expectation */
+static double chi_squared(const size_t *counts, int buckets, size_t total) {
+    double expected = (double)total / buckets, chi = 0, d;
+    int i;
+
+    for (i = 0; i < buckets; i++) {
+        d = counts[i] - expected;
+        chi += d * d / expected;
+    }
+    return chi;
+}
+
+const char *test_reference() {
+    /* published xoshiro256** outputs for the state {1, 2, 3, 4} */
+    const uint64_t want[] = {11520, 0, 1509978240, 1215971899390074240ULL};
+    prng_t r = {{1, 2, 3, 4}}, a, b;
+    size_t i;
+
+    for (i = 0; i < ARRAYLEN(want); i++) {
+        uint64_t got = prng_next(&r);
+        mu_assert(got == want[i], "Output %zu: %llu", i, (unsigned long long)got);
+    }
+
+    prng_seed(&a, 42);
+    prng_seed(&b, 42);
+    mu_assert(!memcmp(&a, &b, sizeof(a)), "Equal seeds, different states");
+    prng_seed(&b, 43);
+    mu_assert(prng_next(&a) != prng_next(&b), "Seeds 42 and 43 agree");
+    prng_seed(&b, 42);
+    prng_next(&b);
+    prng_jump(&b);
+    mu_assert(prng_next(&a) != prng_next(&b), "Jump did not move the state");
+    return NULL;
+}
+
+const char *test_bounded() {
+    size_t counts[BUCKETS] = {0};
+    uint64_t big = (1ULL << 63) + 1;
+    bool seen_min = false, seen_max = false;
+    prng_t r;
+    double chi;
+    int64_t v;
+    size_t i;
+
+    prng_seed(&r, 1);
+    for (i = 0; i < DRAWS; i++) {
+        counts[prng_bounded(&r, BUCKETS)]++;
+    }
+    /* 9 degrees of freedom: 27.9 is the 0.1% critical value */
+    chi = chi_squared(counts, BUCKETS, DRAWS);
+    mu_assert(chi < 27.9, "prng_bounded() chi-squared %.1f", chi);
+
+    memset(counts, 0, sizeof(counts));
+    for (i = 0; i < DRAWS; i++) {
+        counts[prng_bounded32(&r, BUCKETS)]++;
+    }
+    chi = chi_squared(counts, BUCKETS, DRAWS);
+    mu_assert(chi < 27.9, "prng_bounded32() chi-squared %.1f", chi);
+
+    /* bound just past 2^63 rejects almost half of all draws */
+    for (i = 0; i < 1000; i++) {
+        mu_assert(prng_bounded(&r, big) < big, "Out of bounds");
+        mu_assert(prng_bounded(&r, 1) == 0, "bound 1 gave nonzero");
+        mu_assert(prng_bounded32(&r, 3) < 3, "Out of bounds");
+    }
+
+    for (i = 0; i < 1000; i++) {
+        v = prng_range(&r, -3, 3);
+        mu_assert(v >= -3 && v <= 3, "prng_range gave %lld", (long long)v);
+        seen_min |= v == -3;
+        seen_max |= v == 3;
+        v = RAND_INT(5, 7);
+        mu_assert(v >= 5 && v <= 7, "RAND_INT(5, 7) gave %lld", (long long)v);
+    }
+    mu_assert(seen_min && seen_max, "prng_range never hit an end");
+    prng_range(&r, INT64_MIN, INT64_MAX);
+    return NULL;
+}
+
+const char *test_floats() {
+    double sum = 0, d;
+    prng_t r;
+    float f;
+    size_t i;
+
+    prng_seed(&r, 2);
+    for (i = 0; i < DRAWS; i++) {
+        d = prng_double(&r);
+        f = prng_float(&r);
+        mu_assert(d >= 0 && d < 1 && f >= 0 && f < 1, "Out of [0, 1)");
+        sum += d;
+    }
+    /* standard error of the mean is 0.29 / sqrt(DRAWS) = 0.0003 */
+    mu_assert(sum / DRAWS > 0.498 && sum / DRAWS < 0.502, "Mean %f",
+              sum / DRAWS);
+    return NULL;
+}
+
+const char *test_fill(size_t n) {
+    uint64_t *out = malloc(n * sizeof(uint64_t)), or_all = 0;
+    double *d = malloc(n * sizeof(double));
+    size_t i, ones[64] = {0};
+    prng_t r, lane0;
+    int b;
+
+    mu_assert(out && d, "Out of memory");
+    prng_seed(&r, 3);
+    lane0 = r;
+    prng_fill(&r, out, n);
+    for (i = 0; i < n; i++) {
+        or_all |= out[i];
+        for (b = 0; b < 64; b++) {
+            ones[b] += out[i] >> b & 1;
+        }
+    }
+    mu_assert(n < 100 || or_all == UINT64_MAX, "Some bit never set");
+    for (b = 0; b < 64 && n >= 10000; b++) {
+        mu_assert(ones[b] > n * 0.48 && ones[b] < n * 0.52,
+                  "Bit %d set %zu of %zu times", b, ones[b], n);
+    }
+
+    /* the first lane is the caller's generator after seeding the other
+     * three with 12 outputs; it must match the scalar generator */
+    if (n >= 1000) {
+        for (i = 0; i < 12; i++) {
+            prng_next(&lane0);
+        }
+        for (i = 0; i < n / 4; i++) {
+            mu_assert(out[4 * i] == prng_next(&lane0), "Lane 0 diverged at %zu",
+                      i);
+        }
+    }
+
+    prng_fill_double(&r, d, n);
+    for (i = 0; i < n; i++) {
+        mu_assert(d[i] >= 0 && d[i] < 1, "Double %zu out of [0, 1)", i);
+    }
+    free(out);
+    free(d);
+    return NULL;
+}
+
+static void *thread_draw(void *arg) {
+    *(uint64_t *)arg = prng_next(prng_thread());
+    return NULL;
+}
+
+const char *test_threads() {
+    uint64_t draws[4];
+    pthread_t threads[4];
+    int i, j;
+
+    mu_assert(prng_thread() == prng_thread(), "Per-thread generator moved");
+    for (i = 0; i < 4; i++) {
+        pthread_create(&threads[i], NULL, thread_draw, &draws[i]);
+    }
+    for (i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (i = 0; i < 4; i++) {
+        for (j = i + 1; j < 4; j++) {
+            mu_assert(draws[i] != draws[j], "Threads %d and %d agree", i, j);
+        }
+    }
+    return NULL;
+}
+
+const char *test_pcg64() {
+    size_t counts[BUCKETS] = {0};
+    pcg64_t a, b;
+    double chi;
+    size_t i;
+
+    pcg64_seed(&a, 7, 0);
+    pcg64_seed(&b, 7, 1);
+    mu_assert(pcg64_next(&a) != pcg64_next(&b), "Streams 0 and 1 agree");
+    for (i = 0; i < DRAWS; i++) {
+        counts[pcg64_next(&a) % BUCKETS]++;
+    }
+    chi = chi_squared(counts, BUCKETS, DRAWS);
+    mu_assert(chi < 27.9, "pcg64 chi-squared %.1f", chi);
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_reference);
+    mu_run_test(test_bounded);
+    mu_run_test(test_floats);
+    mu_run_test(test_fill, 3);
+    mu_run_test(test_fill, 1001);
+    mu_run_test(test_fill, 100000);
+    mu_run_test(test_threads);
+    mu_run_test(test_pcg64);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,215 @@
+#include "minunit.h"
+
+#include <stddef.h>
+#include "prng.h"
+#include "radix.h"
+#include "utils.h"
+
+#define NSMALL 1000
+#define NLARGE 300000
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int cmp_i32(const void *a, const void *b) {
+    int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* random keys below 2^bits, so high digits are trivial for small bits */
+static void fill(void *keys, size_t n, size_t width, unsigned bits,
+                 uint64_t seed) {
+    uint64_t mask = bits >= 64 ? ~0ULL : (1ULL << bits) - 1, v;
+    prng_t r;
+    size_t i;
+
+    prng_seed(&r, seed);
+    for (i = 0; i < n; i++) {
+        v = prng_next(&r) & mask;
+        if (width == 4) {
+            ((uint32_t *)keys)[i] = (uint32_t)v;
+        } else {
+            ((uint64_t *)keys)[i] = v;
+        }
+    }
+}
+
+/* sort with radix and with qsort, and compare */
+const char *test_keys(size_t n, unsigned bits, size_t nthreads) {
+    tp_pool_t *pool = nthreads ? tp_create(nthreads) : NULL;
+    uint64_t *a = malloc(n * sizeof(*a)), *b = malloc(n * sizeof(*b));
+    int (*cmps[])(const void *, const void *) = {cmp_u32, cmp_u64, cmp_i32,
+                                                 cmp_i64};
+    size_t t, width;
+    int rv = -1;
+
+    mu_assert(a && b && (pool || !nthreads), "Out of memory");
+    for (t = 0; t < ARRAYLEN(cmps); t++) {
+        width = t % 2 ? 8 : 4;
+        fill(a, n, width, MIN(bits, 8 * width), n + bits + t);
+        memcpy(b, a, n * width);
+        switch (t) {
+        case 0:
+            rv = radix_sort_u32((uint32_t *)a, n, pool);
+            break;
+        case 1:
+            rv = radix_sort_u64(a, n, pool);
+            break;
+        case 2:
+            rv = radix_sort_i32((int32_t *)a, n, pool);
+            break;
+        case 3:
+            rv = radix_sort_i64((int64_t *)a, n, pool);
+        }
+        qsort(b, n, width, cmps[t]);
+        mu_assert(rv == 0, "Sort %zu failed", t);
+        mu_assert(memcmp(a, b, n * width) == 0,
+                  "Sort %zu of %zu %u-bit keys differs from qsort", t, n, bits);
+    }
+    tp_destroy(pool);
+    free(a);
+    free(b);
+    return NULL;
+}
+
+typedef struct {
+    uint32_t seq;
+    int16_t key;
+    uint8_t pad[3];
+} rec_t;
+
+/* records with few distinct keys must keep their input order per key */
+const char *test_stable(size_t n, size_t nthreads) {
+    tp_pool_t *pool = nthreads ? tp_create(nthreads) : NULL;
+    rec_t *recs = malloc(n * sizeof(*recs));
+    prng_t r;
+    size_t i;
+
+    mu_assert(recs && (pool || !nthreads), "Out of memory");
+    prng_seed(&r, n);
+    for (i = 0; i < n; i++) {
+        recs[i].seq = i;
+        recs[i].key = prng_range(&r, -300, 300);
+    }
+    mu_assert(radix_sort_records(recs, n, sizeof(rec_t), offsetof(rec_t, key),
+                                 sizeof(int16_t), RADIX_SIGNED, pool) == 0,
+              "radix_sort_records failed");
+    for (i = 1; i < n; i++) {
+        mu_assert(recs[i - 1].key < recs[i].key ||
+                      (recs[i - 1].key == recs[i].key &&
+                       recs[i - 1].seq < recs[i].seq),
+                  "Records %zu and %zu out of order", i - 1, i);
+    }
+    tp_destroy(pool);
+    free(recs);
+    return NULL;
+}
+
+static uint64_t neg_key(const void *data) {
+    return ~(uint64_t)(uintptr_t)data;
+}
+
+const char *test_deque() {
+    deque_t *dq = dq_create(), *sorted;
+    node_t *a, *b;
+    uintptr_t v;
+    prng_t r;
+    size_t i;
+
+    mu_assert(dq, "dq_create failed");
+    prng_seed(&r, 7);
+    for (i = 0; i < NSMALL; i++) {
+        dq_append(dq, (void *)(uintptr_t)prng_range(&r, 1, 5000));
+    }
+
+    /* a NULL key gives dq_sorted()'s order */
+    sorted = dq_sorted(dq);
+    mu_assert(radix_sort_deque(dq, NULL, NULL) == 0, "radix_sort_deque");
+    mu_assert(dq_len(dq) == NSMALL, "Length changed");
+    for (a = dq->head, b = sorted->head; a && b; a = a->next, b = b->next) {
+        mu_assert(a->data == b->data, "Differs from dq_sorted()");
+    }
+    mu_assert(!a && !b, "Different lengths");
+
+    /* and a key function reorders by it */
+    mu_assert(radix_sort_deque(dq, neg_key, NULL) == 0, "radix_sort_deque");
+    for (a = dq->head, v = UINTPTR_MAX; a; a = a->next) {
+        mu_assert((uintptr_t)a->data <= v, "Not in descending order");
+        v = (uintptr_t)a->data;
+    }
+    dq_destroy(sorted, NULL);
+    dq_destroy(dq, NULL);
+
+    dq = dq_create();
+    mu_assert(radix_sort_deque(dq, NULL, NULL) == 0, "Empty deque");
+    dq_destroy(dq, NULL);
+    return NULL;
+}
+
+const char *test_edges() {
+    uint32_t one = 5, same[100];
+    rec_t rec;
+    size_t i;
+
+    mu_assert(radix_sort_u32(NULL, 0, NULL) == 0, "Empty array");
+    mu_assert(radix_sort_u32(&one, 1, NULL) == 0 && one == 5, "One key");
+    for (i = 0; i < ARRAYLEN(same); i++) {
+        same[i] = 0xdeadbeef;
+    }
+    mu_assert(radix_sort_u32(same, ARRAYLEN(same), NULL) == 0 &&
+                  same[0] == 0xdeadbeef && same[99] == 0xdeadbeef,
+              "Equal keys");
+
+    mu_assert(radix_sort_records(&rec, 1, sizeof(rec), 0, 3, 0, NULL) == -1 &&
+                  errno == EINVAL,
+              "Key size 3");
+    mu_assert(radix_sort_records(&rec, 1, sizeof(rec), sizeof(rec) - 2, 4, 0,
+                                 NULL) == -1 &&
+                  errno == EINVAL,
+              "Key past the end of the record");
+    mu_assert(radix_sort_records(NULL, 1, sizeof(rec), 0, 4, 0, NULL) == -1 &&
+                  errno == EINVAL,
+              "NULL records");
+    mu_assert(radix_sort_deque(NULL, NULL, NULL) == -1 && errno == EINVAL,
+              "NULL deque");
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_keys, 10, 64, 0);
+    mu_run_test(test_keys, NSMALL, 64, 0);
+    mu_run_test(test_keys, NSMALL, 12, 0);
+    mu_run_test(test_keys, NLARGE, 64, 0);
+    mu_run_test(test_keys, NLARGE, 20, 0);
+    mu_run_test(test_keys, NLARGE, 4, 0);
+    mu_run_test(test_keys, NSMALL, 64, 2);
+    mu_run_test(test_keys, NLARGE, 64, 3);
+    mu_run_test(test_keys, NLARGE, 40, 3);
+    mu_run_test(test_stable, NSMALL, 0);
+    mu_run_test(test_stable, NLARGE, 0);
+    mu_run_test(test_stable, NLARGE, 4);
+    mu_run_test(test_deque);
+    mu_run_test(test_edges);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
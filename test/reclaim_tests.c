@@ -0,0 +1,303 @@
+#include "minunit.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include "reclaim.h"
+
+#define NTHREADS 4
+#define NOPS 200000
+
+typedef struct Node {
+    reclaim_node_t reclaim;
+    struct Node *next;
+    size_t value;
+} node_t;
+
+static size_t nfreed;
+
+static void free_node(reclaim_node_t *r) {
+    node_t *node = (node_t *)r;
+
+    node->value = (size_t)-1; /* a reader seeing this read freed memory */
+    free(node);
+    __atomic_add_fetch(&nfreed, 1, __ATOMIC_RELAXED);
+}
+
+static node_t *new_node(size_t value) {
+    node_t *node = calloc(1, sizeof(*node));
+
+    node->value = value;
+    return node;
+}
+
+const char *test_ebr_protects() {
+    ebr_thread_t *reader, *writer;
+    size_t i;
+    ebr_t d;
+
+    nfreed = 0;
+    mu_assert(ebr_init(&d) == 0, "ebr_init");
+    mu_assert((reader = ebr_register(&d)) && (writer = ebr_register(&d)),
+              "ebr_register");
+    /* nested sections: the outer one still protects after the inner ends */
+    ebr_enter(reader);
+    ebr_enter(reader);
+    ebr_exit(reader);
+    for (i = 0; i < 10 * EBR_BATCH; i++) {
+        ebr_retire(writer, &new_node(i)->reclaim, free_node);
+        ebr_collect(writer);
+    }
+    mu_assert(nfreed == 0, "%zu freed inside a critical section", nfreed);
+    ebr_exit(reader);
+    ebr_synchronize(writer);
+    mu_assert(nfreed == 10 * EBR_BATCH, "%zu freed after it", nfreed);
+    /* a reader that enters later doesn't hold back nodes retired before */
+    ebr_retire(writer, &new_node(0)->reclaim, free_node);
+    ebr_collect(writer);
+    ebr_enter(reader);
+    ebr_synchronize(writer);
+    ebr_exit(reader);
+    mu_assert(nfreed == 10 * EBR_BATCH + 1, "Held back by a later reader");
+    ebr_destroy(&d);
+    return NULL;
+}
+
+const char *test_ebr_unregister() {
+    ebr_thread_t *reader, *writer, *again;
+    ebr_t d;
+
+    nfreed = 0;
+    mu_assert(ebr_init(&d) == 0, "ebr_init");
+    mu_assert((reader = ebr_register(&d)) && (writer = ebr_register(&d)),
+              "ebr_register");
+    ebr_enter(reader);
+    ebr_retire(writer, &new_node(1)->reclaim, free_node);
+    ebr_unregister(writer);
+    mu_assert(nfreed == 0, "Freed while a reader is inside");
+    again = ebr_register(&d);
+    mu_assert(again == writer, "Handle not reused");
+    ebr_exit(reader);
+    /* the orphan is adopted and freed by whoever collects next */
+    ebr_synchronize(reader);
+    mu_assert(nfreed == 1, "Orphan not freed");
+    ebr_retire(again, &new_node(2)->reclaim, free_node);
+    ebr_destroy(&d);
+    mu_assert(nfreed == 2, "Not freed by ebr_destroy");
+    return NULL;
+}
+
+const char *test_hp_protects() {
+    hp_thread_t *reader, *writer;
+    node_t *shared = new_node(7), *p;
+    hp_t d;
+
+    nfreed = 0;
+    mu_assert(hp_init(&d, 2) == 0, "hp_init");
+    mu_assert((reader = hp_register(&d)) && (writer = hp_register(&d)),
+              "hp_register");
+    p = hp_protect(reader, 1, (void *const *)&shared);
+    mu_assert(p == shared, "hp_protect");
+    shared = NULL; /* unlinked */
+    hp_retire(writer, &p->reclaim, free_node);
+    mu_assert(hp_collect(writer) == 0 && nfreed == 0, "Freed while protected");
+    mu_assert(p->value == 7, "Value changed");
+    hp_clear(reader, 1);
+    mu_assert(hp_collect(writer) == 1 && nfreed == 1, "Not freed once clear");
+    hp_unregister(reader);
+    hp_unregister(writer);
+    hp_destroy(&d);
+    mu_assert(hp_init(&d, 0) == -1 && errno == EINVAL, "No slots");
+    return NULL;
+}
+
+/*********************************************************************
+ * Stress: a Treiber stack popped and pushed by every thread at once
+ *
+ * A node freed while another thread still reads it shows up as a
+ * use-after-free under the sanitizers, or as a poisoned value. Readers
+ * sometimes yield while holding a node, so that the others run in that
+ * window even on a single CPU.
+ *********************************************************************/
+
+typedef struct {
+    node_t *top;
+    ebr_t ebr;
+    hp_t hp;
+    size_t pushed[NTHREADS], popped[NTHREADS];
+    int bad;
+} lf_stack_t;
+
+typedef struct {
+    lf_stack_t *s;
+    size_t t;
+} worker_t;
+
+static void push(lf_stack_t *s, node_t *node) {
+    node->next = __atomic_load_n(&s->top, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&s->top, &node->next, node, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+}
+
+static node_t *pop_ebr(lf_stack_t *s, ebr_thread_t *t, bool yield) {
+    node_t *top, *next;
+
+    ebr_enter(t);
+    top = __atomic_load_n(&s->top, __ATOMIC_ACQUIRE);
+    do {
+        if (!top) {
+            break;
+        }
+        if (yield) {
+            sched_yield();
+        }
+        next = top->next;
+        if (top->value == (size_t)-1) {
+            __atomic_store_n(&s->bad, 1, __ATOMIC_RELAXED);
+        }
+    } while (!__atomic_compare_exchange_n(&s->top, &top, next, true,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    ebr_exit(t);
+    return top;
+}
+
+static node_t *pop_hp(lf_stack_t *s, hp_thread_t *t, bool yield) {
+    node_t *top, *next;
+
+    for (;;) {
+        top = hp_protect(t, 0, (void *const *)&s->top);
+        if (!top) {
+            break;
+        }
+        if (yield) {
+            sched_yield();
+        }
+        next = top->next;
+        if (top->value == (size_t)-1) {
+            __atomic_store_n(&s->bad, 1, __ATOMIC_RELAXED);
+        }
+        if (__atomic_compare_exchange_n(&s->top, &top, next, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    hp_clear(t, 0);
+    return top;
+}
+
+static void *ebr_worker(void *arg) {
+    worker_t *w = arg;
+    ebr_thread_t *t = ebr_register(&w->s->ebr);
+    node_t *node;
+    size_t i;
+
+    for (i = 0; t && i < NOPS; i++) {
+        if (i % 2 == 0) {
+            push(w->s, new_node(i));
+            w->s->pushed[w->t]++;
+        } else if ((node = pop_ebr(w->s, t, i % 64 == 1))) {
+            ebr_retire(t, &node->reclaim, free_node);
+            w->s->popped[w->t]++;
+        }
+    }
+    ebr_unregister(t);
+    return NULL;
+}
+
+static void *hp_worker(void *arg) {
+    worker_t *w = arg;
+    hp_thread_t *t = hp_register(&w->s->hp);
+    node_t *node;
+    size_t i;
+
+    for (i = 0; t && i < NOPS; i++) {
+        if (i % 2 == 0) {
+            push(w->s, new_node(i));
+            w->s->pushed[w->t]++;
+        } else if ((node = pop_hp(w->s, t, i % 64 == 1))) {
+            hp_retire(t, &node->reclaim, free_node);
+            w->s->popped[w->t]++;
+        }
+    }
+    hp_unregister(t);
+    return NULL;
+}
+
+static const char *stress(void *(*worker)(void *), lf_stack_t *s) {
+    pthread_t threads[NTHREADS];
+    worker_t workers[NTHREADS];
+    size_t i, pushed = 0, popped = 0, left = 0;
+    node_t *node, *next;
+
+    nfreed = 0;
+    for (i = 0; i < NTHREADS; i++) {
+        workers[i].s = s;
+        workers[i].t = i;
+        pthread_create(&threads[i], NULL, worker, &workers[i]);
+    }
+    for (i = 0; i < NTHREADS; i++) {
+        pthread_join(threads[i], NULL);
+        pushed += s->pushed[i];
+        popped += s->popped[i];
+    }
+    mu_assert(!s->bad, "A popped node had been freed");
+    for (node = s->top; node; node = next) {
+        next = node->next;
+        free(node);
+        left++;
+    }
+    mu_assert(pushed == popped + left, "%zu pushed, %zu popped, %zu left",
+              pushed, popped, left);
+    mu_assert(nfreed <= popped, "%zu freed of %zu popped", nfreed, popped);
+    return NULL;
+}
+
+static size_t total_popped(const lf_stack_t *s) {
+    size_t i, n = 0;
+
+    for (i = 0; i < NTHREADS; i++) {
+        n += s->popped[i];
+    }
+    return n;
+}
+
+const char *test_ebr_stress() {
+    lf_stack_t s = {0};
+    const char *err;
+
+    mu_assert(ebr_init(&s.ebr) == 0, "ebr_init");
+    if ((err = stress(ebr_worker, &s))) {
+        return err;
+    }
+    ebr_destroy(&s.ebr);
+    mu_assert(nfreed == total_popped(&s), "%zu freed", nfreed);
+    return NULL;
+}
+
+const char *test_hp_stress() {
+    lf_stack_t s = {0};
+    const char *err;
+
+    mu_assert(hp_init(&s.hp, 1) == 0, "hp_init");
+    if ((err = stress(hp_worker, &s))) {
+        return err;
+    }
+    hp_destroy(&s.hp);
+    mu_assert(nfreed == total_popped(&s), "%zu freed", nfreed);
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_ebr_protects);
+    mu_run_test(test_ebr_unregister);
+    mu_run_test(test_hp_protects);
+    mu_run_test(test_ebr_stress);
+    mu_run_test(test_hp_stress);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,229 @@
+#define _GNU_SOURCE
+#include "minunit.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "relay.h"
+
+#ifdef __linux__
+#    include <sys/epoll.h>
+#    define SPLICED(flags) !((flags)&RELAY_COPY)
+#else
+#    define SPLICED(flags) false
+#endif
+
+#define NBYTES (1 << 20) /* far more than the socket and relay buffers */
+#define NRELAYS 3
+
+/* client <-> relay.a, relayed to relay.b <-> server, over socketpairs */
+typedef struct {
+    int client, server;
+    relay_t relay;
+} conn_t;
+
+static int conn_open(conn_t *c, int flags) {
+    int x[2], y[2];
+
+    if (-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, x) ||
+        -1 == socketpair(AF_UNIX, SOCK_STREAM, 0, y)) {
+        return -1;
+    }
+    c->client = x[0];
+    c->server = y[1];
+    return relay_init(&c->relay, x[1], y[0], flags);
+}
+
+static unsigned char pattern(size_t i) {
+    return (unsigned char)(i * 7 + i / 251);
+}
+
+/* send NBYTES of the pattern, then shut down for writing */
+static void *client_send(void *arg) {
+    conn_t *c = arg;
+    unsigned char buf[4096];
+    size_t i, j;
+    ssize_t n;
+
+    for (i = 0; i < NBYTES; i += n) {
+        for (j = 0; j < sizeof(buf); j++) {
+            buf[j] = pattern(i + j);
+        }
+        if ((n = send(c->client, buf, sizeof(buf), 0)) <= 0) {
+            break;
+        }
+    }
+    shutdown(c->client, SHUT_WR);
+    return NULL;
+}
+
+/* receive up to end of file, counting bytes that don't match the pattern */
+static size_t recv_check(int fd, size_t *bad) {
+    unsigned char buf[8192];
+    size_t total = 0;
+    ssize_t n, j;
+
+    *bad = 0;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        for (j = 0; j < n; j++) {
+            *bad += buf[j] != pattern(total + j);
+        }
+        total += n;
+    }
+    return total;
+}
+
+/*
+ * The client sends NBYTES and shuts down; the server reads them to end of
+ * file, then replies on its still open half, which the client reads.
+ */
+static const char *exchange(conn_t *c) {
+    pthread_t thread;
+    char reply[8];
+    size_t n, bad;
+
+    pthread_create(&thread, NULL, client_send, c);
+    n = recv_check(c->server, &bad);
+    pthread_join(thread, NULL);
+    mu_assert(n == NBYTES && bad == 0, "%zu bytes, %zu bad", n, bad);
+    mu_assert(send(c->server, "reply", 5, 0) == 5, "send failed");
+    shutdown(c->server, SHUT_WR);
+    mu_assert(recv(c->client, reply, sizeof(reply), MSG_WAITALL) == 5 &&
+                  !memcmp(reply, "reply", 5),
+              "No reply through the half-closed relay");
+    close(c->client);
+    close(c->server);
+    return NULL;
+}
+
+static void *run(void *arg) {
+    conn_t *c = arg;
+
+    return (void *)(long)relay_run(&c->relay);
+}
+
+static const char *relay_one(int flags) {
+    pthread_t thread;
+    const char *err;
+    void *rv;
+    conn_t c;
+
+    mu_assert(conn_open(&c, flags) == 0, "conn_open");
+    mu_assert(relay_spliced(&c.relay) == SPLICED(flags), "Wrong transfer mode");
+    pthread_create(&thread, NULL, run, &c);
+    err = exchange(&c);
+    pthread_join(thread, &rv);
+    if (err) {
+        return err;
+    }
+    mu_assert(rv == 0 && relay_done(&c.relay), "relay_run failed");
+    mu_assert(c.relay.half[0].bytes == NBYTES && c.relay.half[1].bytes == 5,
+              "Counted %llu and %llu bytes",
+              (unsigned long long)c.relay.half[0].bytes,
+              (unsigned long long)c.relay.half[1].bytes);
+    relay_destroy(&c.relay);
+    return NULL;
+}
+
+const char *test_splice() {
+    return relay_one(0);
+}
+
+const char *test_copy() {
+    return relay_one(RELAY_COPY);
+}
+
+#ifdef __linux__
+typedef struct {
+    int epfd;
+    conn_t conns[NRELAYS];
+    int failed;
+} loop_t;
+
+/* one thread relays every connection, destroying each as it finishes */
+static void *epoll_loop(void *arg) {
+    loop_t *l = arg;
+    struct epoll_event events[8];
+    int i, n, left = NRELAYS;
+    relay_t *r;
+
+    while (left > 0 && (n = epoll_wait(l->epfd, events, 8, -1)) != -1) {
+        for (i = 0; i < n; i++) {
+            r = events[i].data.ptr;
+            if (r->a == -1) {
+                continue; /* destroyed earlier in this batch */
+            }
+            if (relay_pump(r) == -1) {
+                l->failed = 1;
+            } else if (!relay_done(r)) {
+                continue;
+            }
+            relay_destroy(r);
+            left--;
+        }
+    }
+    return NULL;
+}
+
+const char *test_epoll() {
+    pthread_t loop, senders[NRELAYS];
+    size_t i, n, bad;
+    loop_t l;
+
+    memset(&l, 0, sizeof(l));
+    mu_assert((l.epfd = epoll_create1(0)) != -1, "epoll_create1");
+    for (i = 0; i < NRELAYS; i++) {
+        mu_assert(conn_open(&l.conns[i], i == 1 ? RELAY_COPY : 0) == 0,
+                  "conn_open");
+        mu_assert(relay_epoll_add(&l.conns[i].relay, l.epfd) == 0,
+                  "relay_epoll_add");
+    }
+    pthread_create(&loop, NULL, epoll_loop, &l);
+    for (i = 0; i < NRELAYS; i++) {
+        pthread_create(&senders[i], NULL, client_send, &l.conns[i]);
+    }
+    /* read the connections in turn: the others' relays fill up meanwhile */
+    for (i = 0; i < NRELAYS; i++) {
+        n = recv_check(l.conns[i].server, &bad);
+        mu_assert(n == NBYTES && bad == 0, "%zu bytes, %zu bad", n, bad);
+        pthread_join(senders[i], NULL);
+        close(l.conns[i].client);
+        close(l.conns[i].server);
+    }
+    pthread_join(loop, NULL);
+    mu_assert(!l.failed, "relay_pump failed");
+    close(l.epfd);
+    return NULL;
+}
+#endif
+
+const char *test_peer_gone() {
+    conn_t c;
+
+    signal(SIGPIPE, SIG_IGN);
+    mu_assert(conn_open(&c, 0) == 0, "conn_open");
+    close(c.server);
+    mu_assert(send(c.client, "lost", 4, 0) == 4, "send failed");
+    mu_assert(relay_run(&c.relay) == -1 && errno == EPIPE, "Not reported");
+    relay_destroy(&c.relay);
+    close(c.client);
+    mu_assert(relay_init(&c.relay, 0, 0, 0) == -1 && errno == EINVAL,
+              "Same socket twice");
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_splice);
+    mu_run_test(test_copy);
+#ifdef __linux__
+    mu_run_test(test_epoll);
+#endif
+    mu_run_test(test_peer_gone);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
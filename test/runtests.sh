@@ -3,27 +3,75 @@
 # Assumes test binaries are in a "tests/" subfolder
 # Adapted from Zed Shaw's "Learn C the Hard Way"
 # url: http://c.learncodethehardway.org/book/ex28.html
+#
+# usage: sh runtests.sh [-j jobs] [-t timeout_s] [-f text|tap|junit] [filter]
+#
+# Test binaries run one after another, each forking up to jobs tests at a
+# time (default: one per core), so no more than jobs tests run at once; the
+# options are passed on to every binary (see minunit.h). With -f tap each
+# binary's results are written to <name>.tap; with -f junit all of them are
+# combined into tests.xml.
 ##########################################################
 
 ATTR_BOLD=$(tput bold)
 ATTR_RESET=$(tput sgr0)
 COLOR_RED=$(tput setaf 1)
 
+JOBS=$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)
+TIMEOUT=60
+FORMAT=text
+while getopts j:t:f: opt; do
+	case $opt in
+	j) JOBS=$OPTARG ;;
+	t) TIMEOUT=$OPTARG ;;
+	f) FORMAT=$OPTARG ;;
+	*) exit 2 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
 echo "${ATTR_BOLD}>>> Running unit tests:${ATTR_RESET}"
 
+start=$(date +%s)
 for test in *_tests; do
 	if [ -f "$test" ]; then
 		VALGRIND=
 		# VALGRIND="valgrind --leak-check=full --show-leak-kinds=all --log-file=valgrind-${test}.log"
-		if $VALGRIND "./$test" 2>> tests.log; then
+		# text output goes straight to the terminal; tap and junit are collected
+		if [ "$FORMAT" = text ]; then
+			$VALGRIND "./$test" -j "$JOBS" -t "$TIMEOUT" -f "$FORMAT" "$@" \
+				2> "$test.log"
+		else
+			$VALGRIND "./$test" -j "$JOBS" -t "$TIMEOUT" -f "$FORMAT" "$@" \
+				> "$test.out" 2> "$test.log"
+		fi
+		echo $? > "$test.status"
+	fi
+done
+
+failed=0
+rm -f *.tap tests.xml
+[ "$FORMAT" = junit ] && echo '<?xml version="1.0" encoding="UTF-8"?>' > tests.xml && echo '<testsuites>' >> tests.xml
+for test in *_tests; do
+	if [ -f "$test.status" ]; then
+		cat "$test.log" >> tests.log
+		case $FORMAT in
+		tap) cp "$test.out" "$test.tap" ;;
+		junit) cat "$test.out" >> tests.xml ;;
+		esac
+		if [ "$(cat "$test.status")" = 0 ]; then
 			echo "${ATTR_BOLD}+++ $test PASS${ATTR_RESET}"
 		else
-			echo "${COLOR_RED}${ATTR_BOLD}>>> ERROR in test '$test':${ATTR_RESET} here's the tail of tests.log:"
+			echo "${COLOR_RED}${ATTR_BOLD}>>> ERROR in test '$test':${ATTR_RESET} here's the tail of its log:"
 			echo "--------------"
-			tail tests.log
-			exit 1
+			tail "$test.log"
+			failed=1
 		fi
+		rm -f "$test.out" "$test.log" "$test.status"
 	fi
 done
+[ "$FORMAT" = junit ] && echo '</testsuites>' >> tests.xml
 
+echo "${ATTR_BOLD}>>> Finished in $(($(date +%s) - start)) s${ATTR_RESET}"
 echo
+exit $failed
@@ -0,0 +1,198 @@
+#include "minunit.h"
+
+#include <string.h>
+#include "prng.h"
+#include "serial.h"
+
+#define NVALUES 5000
+
+const char *test_zigzag() {
+    const int64_t in[] = {0, -1, 1, -2, 2, INT64_MAX, INT64_MIN};
+    const uint64_t want[] = {0, 1, 2, 3, 4, UINT64_MAX - 1, UINT64_MAX};
+    size_t i;
+
+    for (i = 0; i < ARRAYLEN(in); i++) {
+        mu_assert(zigzag_encode(in[i]) == want[i], "zigzag(%lld)",
+                  (long long)in[i]);
+        mu_assert(zigzag_decode(want[i]) == in[i], "unzigzag(%llu)",
+                  (unsigned long long)want[i]);
+    }
+    return NULL;
+}
+
+const char *test_varint() {
+    const uint8_t overlong[11] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+                                  0x80, 0x80, 0x80, 0x80, 0x00};
+    uint8_t buf[VARINT_MAXLEN];
+    uint64_t v, got;
+    size_t len;
+    int b, d;
+
+    len = varint_encode(300, buf);
+    mu_assert(len == 2 && buf[0] == 0xac && buf[1] == 0x02, "300 encoded wrong");
+
+    /* every bit length, and one either side of each power of two */
+    for (b = 0; b < 64; b++) {
+        for (d = -1; d <= 1; d++) {
+            v = (1ULL << b) + d;
+            len = varint_encode(v, buf);
+            mu_assert(len == varint_len(v), "varint_len(%llu) = %zu, want %zu",
+                      (unsigned long long)v, varint_len(v), len);
+            mu_assert(varint_decode(buf, len, &got) == (int)len && got == v,
+                      "Round trip of %llu", (unsigned long long)v);
+            mu_assert(varint_decode(buf, len - 1, &got) == 0,
+                      "Truncated %llu decoded", (unsigned long long)v);
+        }
+    }
+    mu_assert(varint_len(UINT64_MAX) == VARINT_MAXLEN, "UINT64_MAX length");
+    mu_assert(varint_decode(overlong, sizeof(overlong), &got) == -1 &&
+                  errno == EBADMSG,
+              "Accepted an 11-byte varint");
+    return NULL;
+}
+
+/* values of 1 byte, of mixed lengths, or up to the full 64 bits */
+static uint64_t draw(prng_t *r, int mix) {
+    int bits;
+
+    switch (mix) {
+    case 0:
+        return prng_bounded(r, 128);
+    case 1:
+        bits = 1 + prng_bounded(r, 28);
+        return prng_next(r) >> (64 - bits);
+    default:
+        bits = 1 + prng_bounded(r, 64);
+        return prng_next(r) >> (64 - bits);
+    }
+}
+
+const char *test_bulk(int mix) {
+    uint64_t *in = malloc(NVALUES * sizeof(uint64_t));
+    uint64_t *out = malloc(NVALUES * sizeof(uint64_t));
+    uint8_t *enc = malloc(NVALUES * VARINT_MAXLEN);
+    size_t i, len, used, done, chunk;
+    ssize_t n;
+    prng_t r;
+
+    mu_assert(in && out && enc, "Out of memory");
+    prng_seed(&r, mix);
+    for (i = 0; i < NVALUES; i++) {
+        in[i] = draw(&r, mix);
+    }
+    len = varint_encode_n(in, NVALUES, enc);
+
+    n = varint_decode_n(enc, len, out, NVALUES, &used);
+    mu_assert(n == NVALUES && used == len, "Decoded %zd values from %zu of %zu",
+              n, used, len);
+    mu_assert(!memcmp(in, out, NVALUES * sizeof(uint64_t)), "Values differ");
+
+    /* in pieces: odd value counts, and input cut in the middle of values */
+    memset(out, 0, NVALUES * sizeof(uint64_t));
+    for (done = 0, i = 0; done < NVALUES; i += used) {
+        chunk = 1 + prng_bounded(&r, 100);
+        n = varint_decode_n(enc + i, MIN(len - i, 7 * chunk + 3), out + done,
+                            chunk, &used);
+        mu_assert(n >= 0, "Decode failed at value %zu", done);
+        done += n;
+    }
+    mu_assert(i == len, "Consumed %zu of %zu bytes", i, len);
+    mu_assert(!memcmp(in, out, NVALUES * sizeof(uint64_t)),
+              "Values differ when decoded in pieces");
+
+    free(in);
+    free(out);
+    free(enc);
+    return NULL;
+}
+
+const char *test_bulk_overlong() {
+    uint8_t buf[200];
+    uint64_t out[200];
+    size_t used;
+    ssize_t n;
+
+    /* 100 one-byte values, then 11 continuation bytes */
+    memset(buf, 1, sizeof(buf));
+    memset(buf + 100, 0x80, 11);
+    n = varint_decode_n(buf, sizeof(buf), out, ARRAYLEN(out), &used);
+    mu_assert(n == -1 && errno == EBADMSG, "Accepted an overlong varint");
+    mu_assert(used == 100 && out[99] == 1, "Consumed %zu bytes before it",
+              used);
+    return NULL;
+}
+
+const char *test_cursors() {
+    uint8_t buf[64], small[5], raw[4];
+    const uint8_t *view;
+    ser_writer_t w;
+    ser_reader_t r;
+    uint64_t u64;
+    uint32_t u32;
+    uint16_t u16;
+    uint8_t u8;
+    int64_t s64;
+
+    ser_writer_init(&w, buf, sizeof(buf));
+    ser_put_u8(&w, 0xab);
+    ser_put_u16(&w, 0x0102);
+    ser_put_u32(&w, 0x03040506);
+    ser_put_u64(&w, 0x0708090a0b0c0d0eULL);
+    ser_put_varint(&w, 300);
+    ser_put_svarint(&w, -5);
+    ser_put_bytes(&w, "abcd", 4);
+    mu_assert(!w.err && w.len == 1 + 2 + 4 + 8 + 2 + 1 + 4, "Wrote %zu bytes",
+              w.len);
+    mu_assert(buf[1] == 0x01 && buf[2] == 0x02, "u16 not big-endian");
+
+    ser_reader_init(&r, buf, w.len);
+    ser_get_u8(&r, &u8);
+    ser_get_u16(&r, &u16);
+    ser_get_u32(&r, &u32);
+    ser_get_u64(&r, &u64);
+    mu_assert(u8 == 0xab && u16 == 0x0102 && u32 == 0x03040506 &&
+                  u64 == 0x0708090a0b0c0d0eULL,
+              "Fixed-width fields differ");
+    ser_get_varint(&r, &u64);
+    ser_get_svarint(&r, &s64);
+    mu_assert(u64 == 300 && s64 == -5, "Varints differ");
+    view = ser_get_view(&r, 2);
+    ser_get_bytes(&r, raw, 2);
+    mu_assert(view && !memcmp(view, "ab", 2) && !memcmp(raw, "cd", 2),
+              "Bytes differ");
+    mu_assert(!r.err && r.pos == r.len, "Read %zu of %zu", r.pos, r.len);
+
+    /* errors stick */
+    mu_assert(ser_get_u8(&r, &u8) == -1 && r.err == EBADMSG, "Read past end");
+    mu_assert(ser_get_view(&r, 0) == NULL, "Read after an error");
+
+    ser_writer_init(&w, small, sizeof(small));
+    mu_assert(ser_put_u32(&w, 1) == 0, "u32 did not fit");
+    mu_assert(ser_put_u16(&w, 1) == -1 && errno == EMSGSIZE, "u16 fit");
+    mu_assert(ser_put_u8(&w, 1) == -1 && w.len == 4, "Wrote after an error");
+
+    /* a varint that fits exactly, with less than VARINT_MAXLEN free */
+    ser_writer_init(&w, small, sizeof(small));
+    mu_assert(ser_put_varint(&w, 1ULL << 34) == 0 && w.len == 5,
+              "5-byte varint did not fit in 5 bytes");
+    ser_reader_init(&r, small, 4);
+    mu_assert(ser_get_varint(&r, &u64) == -1 && r.pos == 0,
+              "Decoded a truncated varint");
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_zigzag);
+    mu_run_test(test_varint);
+    mu_run_test(test_bulk, 0);
+    mu_run_test(test_bulk, 1);
+    mu_run_test(test_bulk, 2);
+    mu_run_test(test_bulk_overlong);
+    mu_run_test(test_cursors);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,278 @@
+#define _GNU_SOURCE
+#include "minunit.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "instrument.h"
+#include "network.h"
+#include "shm_ring.h"
+
+#define NMSGS 200000
+#define MAXLEN 300
+#define PAUSE_EVERY 4000 /* messages between pauses, with paused set */
+
+/* pause each side now and then, so the other has to sleep on its futex */
+static bool paused;
+
+/* message i: its length and contents follow from i */
+static size_t msg_len(size_t i) {
+    return 1 + (i * 37) % MAXLEN;
+}
+
+static void fill(unsigned char *buf, size_t i) {
+    size_t j;
+
+    for (j = 0; j < msg_len(i); j++) {
+        buf[j] = (unsigned char)(i + j);
+    }
+}
+
+const char *test_send_recv() {
+    unsigned char msg[4096], buf[4096];
+    uint64_t start;
+    shm_ring_t r;
+    size_t i;
+
+    mu_assert(shm_ring_create(&r, 1000) == 0, "shm_ring_create");
+    mu_assert(r.size == 4096 && shm_ring_max_msg(&r) == 2040, "Size %zu",
+              r.size);
+    /* many times round the ring, through the padding at its end */
+    for (i = 0; i < 1000; i++) {
+        fill(msg, i);
+        mu_assert(shm_ring_send(&r, msg, msg_len(i), 0) == 0, "send %zu", i);
+        mu_assert(shm_ring_recv(&r, buf, sizeof(buf), 0) == (ssize_t)msg_len(i),
+                  "recv %zu", i);
+        mu_assert(!memcmp(msg, buf, msg_len(i)), "Message %zu differs", i);
+    }
+    mu_assert(shm_ring_send(&r, msg, 2041, 0) == -1 && errno == EMSGSIZE,
+              "Too large");
+    mu_assert(shm_ring_send(&r, msg, 0, 0) == -1 && errno == EINVAL, "Empty");
+    /* a fresh ring is full after two of the largest messages */
+    shm_ring_close(&r);
+    mu_assert(shm_ring_create(&r, 4096) == 0, "shm_ring_create");
+    mu_assert(shm_ring_send(&r, msg, 2040, 0) == 0 &&
+                  shm_ring_send(&r, msg, 2040, 0) == 0,
+              "Two largest");
+    mu_assert(shm_ring_send(&r, msg, 1, 0) == -1 && errno == ETIMEDOUT, "Full");
+    mu_assert(shm_ring_recv(&r, buf, 100, 0) == -1 && errno == EMSGSIZE,
+              "Short buffer");
+    mu_assert(shm_ring_recv(&r, buf, sizeof(buf), 0) == 2040 &&
+                  shm_ring_recv(&r, buf, sizeof(buf), 0) == 2040,
+              "Message lost after EMSGSIZE");
+    start = inst_now_ns();
+    mu_assert(shm_ring_recv(&r, buf, sizeof(buf), 20) == -1 &&
+                  errno == ETIMEDOUT,
+              "Empty");
+    mu_assert(inst_now_ns() - start >= 20000000, "Timed out early");
+    mu_assert(shm_ring_send(&r, "last", 4, 0) == 0, "send");
+    shm_ring_shutdown(&r);
+    mu_assert(shm_ring_send(&r, "more", 4, 0) == -1 && errno == EPIPE,
+              "Sent after shutdown");
+    mu_assert(shm_ring_recv(&r, buf, sizeof(buf), -1) == 4, "Last lost");
+    mu_assert(shm_ring_recv(&r, buf, sizeof(buf), -1) == 0, "No end of file");
+    shm_ring_close(&r);
+    return NULL;
+}
+
+/* set the length word of the record at pos, as a bad peer might */
+static void corrupt(shm_ring_t *r, size_t pos, uint32_t n) {
+    memcpy(r->data + pos, &n, sizeof(n));
+}
+
+const char *test_corrupt() {
+    unsigned char msg[4096] = {0}, buf[4096];
+    shm_ring_t r;
+
+    mu_assert(shm_ring_create(&r, 4096) == 0, "shm_ring_create");
+    mu_assert(shm_ring_send(&r, "hello", 5, 0) == 0, "send");
+    corrupt(&r, 0, 100);
+    mu_assert(shm_ring_recv(&r, buf, sizeof(buf), 0) == -1 && errno == EBADMSG,
+              "Read past the tail");
+    corrupt(&r, 0, UINT32_MAX);
+    mu_assert(shm_ring_recv(&r, buf, sizeof(buf), 0) == -1 && errno == EBADMSG,
+              "Padding past the tail");
+    corrupt(&r, 0, 5);
+    mu_assert(shm_ring_recv(&r, buf, sizeof(buf), 0) == 5, "recv");
+    /* 16 bytes left before the end, then a message at the start */
+    mu_assert(shm_ring_send(&r, msg, 2016, 0) == 0 &&
+                  shm_ring_recv(&r, buf, sizeof(buf), 0) == 2016 &&
+                  shm_ring_send(&r, msg, 2032, 0) == 0 &&
+                  shm_ring_recv(&r, buf, sizeof(buf), 0) == 2032,
+              "Fill");
+    mu_assert(shm_ring_send(&r, msg, 8, 0) == 0 &&
+                  shm_ring_send(&r, msg, 1000, 0) == 0,
+              "send");
+    corrupt(&r, 4080, 500);
+    mu_assert(shm_ring_recv(&r, buf, sizeof(buf), 0) == -1 && errno == EBADMSG,
+              "Read past the end of the ring");
+    corrupt(&r, 4080, 8);
+    mu_assert(shm_ring_recv(&r, buf, sizeof(buf), 0) == 8 &&
+                  shm_ring_recv(&r, buf, sizeof(buf), 0) == 1000,
+              "recv");
+    shm_ring_close(&r);
+    return NULL;
+}
+
+/* receive messages 0, 1, ... to end of file; the first wrong one, or NMSGS */
+static size_t recv_all(shm_ring_t *r) {
+    unsigned char msg[MAXLEN], buf[MAXLEN];
+    size_t i;
+    ssize_t n;
+
+    for (i = 0; (n = shm_ring_recv(r, buf, sizeof(buf), 5000)) > 0; i++) {
+        if (paused && i % PAUSE_EVERY == PAUSE_EVERY / 2) {
+            usleep(1000);
+        }
+        fill(msg, i);
+        if ((size_t)n != msg_len(i) || memcmp(msg, buf, n)) {
+            break;
+        }
+    }
+    return n == 0 ? i : (size_t)-1;
+}
+
+static void *producer(void *arg) {
+    unsigned char msg[MAXLEN];
+    shm_ring_t *r = arg;
+    size_t i;
+
+    for (i = 0; i < NMSGS; i++) {
+        if (paused && i % PAUSE_EVERY == 0) {
+            usleep(1000);
+        }
+        fill(msg, i);
+        if (shm_ring_send(r, msg, msg_len(i), 5000) == -1) {
+            break;
+        }
+    }
+    shm_ring_shutdown(r);
+    return NULL;
+}
+
+/* a ring much smaller than the stream, so both sides wait on each other */
+static const char *threads(bool pause) {
+    pthread_t thread;
+    shm_ring_t r;
+    size_t n;
+
+    paused = pause;
+    mu_assert(shm_ring_create(&r, 4096) == 0, "shm_ring_create");
+    pthread_create(&thread, NULL, producer, &r);
+    n = recv_all(&r);
+    pthread_join(thread, NULL);
+    mu_assert(n == NMSGS, "Received %zu", n);
+    shm_ring_close(&r);
+    return NULL;
+}
+
+const char *test_threads() {
+    return threads(false);
+}
+
+const char *test_sleep_wake() {
+    return threads(true);
+}
+
+/*
+ * A child process gets the ring's memfd over a Unix socket, receives the
+ * stream through it, and reports back how many messages it checked.
+ */
+const char *test_processes() {
+    char path[64], ok;
+    int listener, fd, fds[2];
+    size_t nfds, n;
+    shm_ring_t r, child;
+    pthread_t thread;
+    pid_t pid;
+
+    snprintf(path, sizeof(path), "/tmp/shm_ring_tests.%d", (int)getpid());
+    mu_assert((listener = unix_server_listen(path, SOCK_SEQPACKET)) != -1,
+              "unix_server_listen");
+    mu_assert(shm_ring_create(&r, 1 << 16) == 0, "shm_ring_create");
+    if ((pid = fork()) == 0) {
+        fd = unix_client_connect(path, SOCK_SEQPACKET);
+        nfds = 1;
+        if (fd == -1 || recv_fds(fd, &ok, 1, fds, &nfds) != 1 || nfds != 1 ||
+            shm_ring_attach(&child, fds[0]) == -1) {
+            _exit(1);
+        }
+        n = recv_all(&child);
+        shm_ring_close(&child);
+        _exit(send(fd, &n, sizeof(n), 0) == sizeof(n) ? 0 : 1);
+    }
+    mu_assert(pid != -1, "fork");
+    mu_assert((fd = accept(listener, NULL, NULL)) != -1, "accept");
+    mu_assert(send_fds(fd, "y", 1, &r.fd, 1) == 1, "send_fds");
+    pthread_create(&thread, NULL, producer, &r);
+    mu_assert(recv(fd, &n, sizeof(n), 0) == sizeof(n), "No report");
+    pthread_join(thread, NULL);
+    mu_assert(n == NMSGS, "Child received %zu", n);
+    mu_assert(waitpid(pid, NULL, 0) == pid, "waitpid");
+    shm_ring_close(&r);
+    close(fd);
+    close(listener);
+    unlink(path);
+    return NULL;
+}
+
+/* room for one descriptor of the two sent: both are closed */
+const char *test_fd_truncation() {
+    int sv[2], fds[2], got[1];
+    size_t nfds = 1;
+    char c;
+
+    mu_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "socketpair");
+    fds[0] = fds[1] = sv[0];
+    mu_assert(send_fds(sv[0], "a", 1, fds, 2) == 1, "send_fds");
+    mu_assert(recv_fds(sv[1], &c, 1, got, &nfds) == -1 && errno == EMSGSIZE &&
+                  nfds == 0,
+              "Not truncated");
+    mu_assert(send_fds(sv[0], "", 0, fds, 1) == -1 && errno == EINVAL,
+              "No data");
+    mu_assert(unix_server_listen("", SOCK_STREAM) == -1 && errno == EINVAL,
+              "Empty path");
+    close(sv[0]);
+    close(sv[1]);
+    return NULL;
+}
+
+/* a live server's socket is left alone, a dead one's replaced */
+const char *test_stale_socket() {
+    int listener, fd;
+    char path[64];
+
+    snprintf(path, sizeof(path), "/tmp/shm_ring_tests.%d", (int)getpid());
+    mu_assert((listener = unix_server_listen(path, SOCK_STREAM)) != -1,
+              "unix_server_listen");
+    mu_assert(unix_server_listen(path, SOCK_STREAM) == -1 &&
+                  errno == EADDRINUSE,
+              "Took over a live server's socket");
+    mu_assert((fd = unix_client_connect(path, SOCK_STREAM)) != -1,
+              "Live server's socket removed");
+    close(fd);
+    close(listener); /* leaves the socket file behind */
+    mu_assert((listener = unix_server_listen(path, SOCK_STREAM)) != -1,
+              "Stale socket not replaced");
+    close(listener);
+    unlink(path);
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_send_recv);
+    mu_run_test(test_corrupt);
+    mu_run_test(test_threads);
+    mu_run_test(test_sleep_wake);
+    mu_run_test(test_processes);
+    mu_run_test(test_fd_truncation);
+    mu_run_test(test_stale_socket);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,332 @@
+#include "minunit.h"
+
+#include <math.h>
+#include <pthread.h>
+#include "hashmap.h"
+#include "sketch.h"
+
+#define NKEYS 100000
+#define NTHREADS 4
+
+/* the registers of a sketch built densely from the start */
+static void reference_regs(uint8_t *regs, unsigned p, uint64_t from,
+                           uint64_t to) {
+    uint64_t i, hash, w;
+    size_t index;
+    uint8_t rank;
+
+    memset(regs, 0, (size_t)1 << p);
+    for (i = from; i < to; i++) {
+        hash = hm_hash_u64(i);
+        w = hash << p;
+        rank = w ? (uint8_t)(__builtin_clzll(w) + 1) : (uint8_t)(65 - p);
+        index = hash >> (64 - p);
+        regs[index] = MAX(regs[index], rank);
+    }
+}
+
+static const char *check_count(unsigned p, size_t n) {
+    double est, err, sigma = 1.04 / sqrt((double)((size_t)1 << p));
+    size_t i;
+    hll_t h;
+
+    mu_assert(hll_init(&h, p, NULL) == 0, "hll_init");
+    for (i = 0; i < n; i++) {
+        /* each key twice: duplicates must not count */
+        mu_assert(hll_add(&h, hm_hash_u64(i)) == 0, "hll_add");
+        mu_assert(hll_add(&h, hm_hash_u64(i / 2)) == 0, "hll_add");
+    }
+    est = hll_count(&h);
+    err = fabs(est - (double)n) / (double)n;
+    /* 4 standard errors, and small sets are counted almost exactly */
+    mu_assert(err <= 4 * sigma || fabs(est - (double)n) <= 1,
+              "p %u: estimated %.1f for %zu (sparse %d)", p, est, n, !h.regs);
+    hll_destroy(&h);
+    return NULL;
+}
+
+const char *test_hll_count() {
+    static const unsigned ps[] = {4, 10, 14, 18};
+    static const size_t ns[] = {0, 1, 10, 100, 1000, 10000, 100000, 1000000};
+    const char *err;
+    size_t i, j;
+
+    for (i = 0; i < ARRAYLEN(ps); i++) {
+        for (j = 0; j < ARRAYLEN(ns); j++) {
+            if ((err = check_count(ps[i], ns[j]))) {
+                return err;
+            }
+        }
+    }
+    return NULL;
+}
+
+const char *test_hll_sparse() {
+    size_t i;
+    hll_t h;
+
+    mu_assert(hll_init(&h, 14, NULL) == 0, "hll_init");
+    for (i = 0; i < 1000; i++) {
+        hll_add(&h, hm_hash_u64(i));
+    }
+    mu_assert(!h.regs, "Dense after 1000 keys");
+    mu_assert(fabs(hll_count(&h) - 1000) < 1, "Sparse estimate %.2f",
+              hll_count(&h));
+    for (i = 1000; i < 10000; i++) {
+        hll_add(&h, hm_hash_u64(i));
+    }
+    mu_assert(h.regs && !h.sparse, "Sparse after 10000 keys");
+    hll_clear(&h);
+    mu_assert(h.regs && hll_count(&h) == 0, "Not empty after clear");
+    hll_destroy(&h);
+    return NULL;
+}
+
+/* converting a sparse list must give exactly the dense registers */
+const char *test_hll_to_dense() {
+    static const unsigned ps[] = {8, 12, 16, 18};
+    uint8_t *want = malloc((size_t)1 << HLL_MAX_PRECISION);
+    size_t i, j, n;
+    hll_t h;
+
+    mu_assert(want, "Out of memory");
+    for (i = 0; i < ARRAYLEN(ps); i++) {
+        n = (size_t)1 << ps[i];
+        mu_assert(hll_init(&h, ps[i], NULL) == 0, "hll_init");
+        for (j = 0; j < n; j++) {
+            hll_add(&h, hm_hash_u64(j));
+        }
+        mu_assert(h.regs, "Still sparse after %zu keys", n);
+        reference_regs(want, ps[i], 0, n);
+        mu_assert(memcmp(h.regs, want, n) == 0, "p %u: registers differ",
+                  ps[i]);
+        hll_destroy(&h);
+    }
+    free(want);
+    return NULL;
+}
+
+static const char *check_merge(unsigned p, size_t na, size_t nb) {
+    uint8_t *want = malloc((size_t)1 << p);
+    hll_t a, b, u;
+    double est;
+    size_t i;
+
+    mu_assert(want, "Out of memory");
+    mu_assert(hll_init(&a, p, NULL) == 0 && hll_init(&b, p, NULL) == 0 &&
+                  hll_init(&u, p, NULL) == 0,
+              "hll_init");
+    /* the key ranges overlap by half of b */
+    for (i = 0; i < na; i++) {
+        hll_add(&a, hm_hash_u64(i));
+        hll_add(&u, hm_hash_u64(i));
+    }
+    for (i = na - nb / 2; i < na - nb / 2 + nb; i++) {
+        hll_add(&b, hm_hash_u64(i));
+        hll_add(&u, hm_hash_u64(i));
+    }
+    mu_assert(hll_merge(&a, &b) == 0, "hll_merge");
+    est = hll_count(&a);
+    mu_assert(fabs(est - hll_count(&u)) < 1e-9 * est,
+              "p %u, %zu + %zu: merged %.2f, union %.2f", p, na, nb, est,
+              hll_count(&u));
+    if (a.regs && u.regs) {
+        reference_regs(want, p, 0, na - nb / 2 + nb);
+        mu_assert(memcmp(a.regs, want, (size_t)1 << p) == 0,
+                  "p %u, %zu + %zu: registers differ", p, na, nb);
+    }
+    hll_destroy(&a);
+    hll_destroy(&b);
+    hll_destroy(&u);
+    free(want);
+    return NULL;
+}
+
+const char *test_hll_merge() {
+    const char *err;
+    hll_t a, b;
+
+    /* sparse into sparse, sparse into dense, dense into sparse, dense */
+    if ((err = check_merge(14, 100, 100)) ||
+        (err = check_merge(14, 50000, 100)) ||
+        (err = check_merge(14, 100, 50000)) ||
+        (err = check_merge(14, 50000, 50000)) ||
+        (err = check_merge(4, 1000, 1000)) ||
+        (err = check_merge(18, 3000, 3000))) {
+        return err;
+    }
+    mu_assert(hll_init(&a, 10, NULL) == 0 && hll_init(&b, 11, NULL) == 0,
+              "hll_init");
+    mu_assert(hll_merge(&a, &b) == -1 && errno == EINVAL,
+              "Different precision");
+    hll_destroy(&a);
+    hll_destroy(&b);
+    mu_assert(hll_init(&a, HLL_MIN_PRECISION - 1, NULL) == -1 &&
+                  errno == EINVAL,
+              "Precision too small");
+    mu_assert(hll_init(&a, HLL_MAX_PRECISION + 1, NULL) == -1 &&
+                  errno == EINVAL,
+              "Precision too large");
+    return NULL;
+}
+
+/* key k occurs about NKEYS / (k + 1) times, Zipf-like */
+static size_t zipf_count(size_t k) {
+    return NKEYS / (k + 1);
+}
+
+static const char *check_cms(double epsilon, double delta) {
+    uint64_t est, total = 0;
+    size_t k, bad = 0, nkeys = 10000;
+    cms_t c;
+
+    mu_assert(cms_init(&c, epsilon, delta, NULL) == 0, "cms_init");
+    /* interleave the keys so that counts grow together */
+    for (k = 0; k < nkeys; k++) {
+        cms_add(&c, hm_hash_u64(k), zipf_count(k) / 2);
+        total += zipf_count(k) / 2;
+    }
+    for (k = 0; k < nkeys; k++) {
+        est = cms_add(&c, hm_hash_u64(k), zipf_count(k) - zipf_count(k) / 2);
+        total += zipf_count(k) - zipf_count(k) / 2;
+        mu_assert(est == cms_estimate(&c, hm_hash_u64(k)),
+                  "cms_add returned %llu", (unsigned long long)est);
+    }
+    mu_assert(c.total == total, "Total %llu, want %llu",
+              (unsigned long long)c.total, (unsigned long long)total);
+    for (k = 0; k < nkeys; k++) {
+        est = cms_estimate(&c, hm_hash_u64(k));
+        mu_assert(est >= zipf_count(k), "Key %zu: %llu < %zu", k,
+                  (unsigned long long)est, zipf_count(k));
+        bad += est - zipf_count(k) > epsilon * (double)total;
+    }
+    mu_assert(bad <= delta * (double)nkeys,
+              "%zu of %zu keys overestimated by more than %g of %llu", bad,
+              nkeys, epsilon, (unsigned long long)total);
+    cms_destroy(&c);
+    return NULL;
+}
+
+const char *test_cms() {
+    const char *err;
+    cms_t c;
+
+    if ((err = check_cms(0.001, 0.01)) || (err = check_cms(0.0001, 0.01)) ||
+        (err = check_cms(0.01, 0.001))) {
+        return err;
+    }
+    mu_assert(cms_init(&c, 0.01, 0.01, NULL) == 0, "cms_init");
+    mu_assert(c.width == 512 && c.depth == 5, "Size %zu x %u", c.width,
+              c.depth);
+    mu_assert(cms_add(&c, 1, UINT64_MAX) == UINT64_MAX, "cms_add");
+    mu_assert(cms_add(&c, 1, 1) == UINT64_MAX, "No saturation");
+    cms_clear(&c);
+    mu_assert(cms_estimate(&c, 1) == 0 && c.total == 0, "Not empty");
+    cms_destroy(&c);
+    return NULL;
+}
+
+const char *test_cms_merge() {
+    cms_t a, b, c;
+    size_t k;
+
+    mu_assert(cms_init_size(&a, 1000, 4, NULL) == 0 &&
+                  cms_init_size(&b, 1000, 4, NULL) == 0 &&
+                  cms_init_size(&c, 1000, 3, NULL) == 0,
+              "cms_init_size");
+    mu_assert(a.width == 1024, "Width %zu", a.width);
+    for (k = 0; k < 5000; k++) {
+        cms_add(k % 2 ? &a : &b, hm_hash_u64(k % 100), 1);
+    }
+    mu_assert(cms_merge(&a, &b) == 0, "cms_merge");
+    mu_assert(a.total == 5000, "Total %llu", (unsigned long long)a.total);
+    for (k = 0; k < 100; k++) {
+        mu_assert(cms_estimate(&a, hm_hash_u64(k)) >= 50,
+                  "Key %zu: %llu", k,
+                  (unsigned long long)cms_estimate(&a, hm_hash_u64(k)));
+    }
+    mu_assert(cms_merge(&a, &c) == -1 && errno == EINVAL, "Different depth");
+    cms_destroy(&c);
+    mu_assert(cms_init(&c, 0, 0.01, NULL) == -1 && errno == EINVAL,
+              "Zero epsilon");
+    mu_assert(cms_init(&c, 0.01, 1, NULL) == -1 && errno == EINVAL,
+              "Delta of 1");
+    mu_assert(cms_init_size(&c, 0, 4, NULL) == -1 && errno == EINVAL,
+              "Zero width");
+    cms_destroy(&a);
+    cms_destroy(&b);
+    return NULL;
+}
+
+typedef struct {
+    hll_t h;
+    cms_t c;
+    size_t t;
+} worker_t;
+
+/* each thread sketches every NTHREADS-th key of its own */
+static void *sketch_keys(void *arg) {
+    worker_t *w = arg;
+    size_t i;
+
+    for (i = w->t; i < NKEYS; i += NTHREADS) {
+        hll_add(&w->h, hm_hash_u64(i));
+        cms_add(&w->c, hm_hash_u64(i % 1000), 1);
+    }
+    return NULL;
+}
+
+const char *test_threads() {
+    pthread_t threads[NTHREADS];
+    worker_t workers[NTHREADS];
+    hll_t all;
+    size_t i;
+
+    mu_assert(hll_init(&all, 14, NULL) == 0, "hll_init");
+    for (i = 0; i < NTHREADS; i++) {
+        mu_assert(hll_init(&workers[i].h, 14, NULL) == 0 &&
+                      cms_init_size(&workers[i].c, 4096, 4, NULL) == 0,
+                  "init");
+        workers[i].t = i;
+        pthread_create(&threads[i], NULL, sketch_keys, &workers[i]);
+    }
+    for (i = 0; i < NKEYS; i++) {
+        hll_add(&all, hm_hash_u64(i));
+    }
+    for (i = 0; i < NTHREADS; i++) {
+        pthread_join(threads[i], NULL);
+        if (i) {
+            mu_assert(hll_merge(&workers[0].h, &workers[i].h) == 0 &&
+                          cms_merge(&workers[0].c, &workers[i].c) == 0,
+                      "merge");
+        }
+    }
+    mu_assert(memcmp(workers[0].h.regs, all.regs, (size_t)1 << 14) == 0,
+              "Merged registers differ from one sketch of all keys");
+    for (i = 0; i < 1000; i++) {
+        mu_assert(cms_estimate(&workers[0].c, hm_hash_u64(i)) >= NKEYS / 1000,
+                  "Key %zu underestimated", i);
+    }
+    for (i = 0; i < NTHREADS; i++) {
+        hll_destroy(&workers[i].h);
+        cms_destroy(&workers[i].c);
+    }
+    hll_destroy(&all);
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_hll_count);
+    mu_run_test(test_hll_sparse);
+    mu_run_test(test_hll_to_dense);
+    mu_run_test(test_hll_merge);
+    mu_run_test(test_cms);
+    mu_run_test(test_cms_merge);
+    mu_run_test(test_threads);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
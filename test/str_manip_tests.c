@@ -0,0 +1,223 @@
+#include "minunit.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <string.h>
+#include "str_manip.h"
+
+/* reference implementation for str_find() */
+static ssize_t naive_find(str_t s, str_t n) {
+    size_t i;
+
+    for (i = 0; i + n.len <= s.len; i++) {
+        if (!memcmp(s.ptr + i, n.ptr, n.len)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *test_slices() {
+    str_t s = STR_LIT("hello, world");
+
+    mu_assert(s.len == 12, "STR_LIT length %zu", s.len);
+    mu_assert(str_eq(str_sub(s, 7, 100), STR_LIT("world")), "sub not clamped");
+    mu_assert(str_sub(s, 50, 2).len == 0, "sub past end not empty");
+    mu_assert(str_starts_with(s, STR_LIT("hello")), "starts_with");
+    mu_assert(str_ends_with(s, STR_LIT("world")), "ends_with");
+    mu_assert(!str_ends_with(STR_LIT("d"), s), "ends_with longer suffix");
+    mu_assert(str_cmp(STR_LIT("abc"), STR_LIT("abd")) < 0, "cmp order");
+    mu_assert(str_cmp(STR_LIT("ab"), STR_LIT("abc")) < 0, "cmp prefix");
+    mu_assert(str_cmp(STR_LIT("abc"), str_from("abc")) == 0, "cmp equal");
+    mu_assert(str_from(NULL).len == 0, "str_from(NULL) not empty");
+    return NULL;
+}
+
+const char *test_find() {
+    char hay[300];
+    str_t s, n;
+    size_t len, nlen, at, i;
+    ssize_t want, got;
+
+    mu_assert(str_find(STR_LIT("abc"), STR_LIT("")) == 0, "empty needle");
+    mu_assert(str_find(STR_LIT("ab"), STR_LIT("abc")) == -1, "long needle");
+    mu_assert(str_find_char(STR_LIT("abc"), 'c') == 2, "find_char");
+    mu_assert(str_find_char(str_make(NULL, 0), 'c') == -1, "find_char empty");
+
+    /* needles planted at every offset of haystacks around the vector
+     * widths, with near misses (same first and last byte) everywhere */
+    for (len = 0; len < sizeof(hay); len += 7) {
+        for (nlen = 2; nlen <= 40 && nlen <= len; nlen += 3) {
+            for (at = 0; at + nlen <= len; at += 5) {
+                memset(hay, 'a', len);
+                for (i = 0; i + nlen <= len; i += nlen) {
+                    hay[i + nlen - 1] = 'z';
+                }
+                memset(hay + at, 'x', nlen);
+                hay[at] = 'a';
+                hay[at + nlen - 1] = 'z';
+                s = str_make(hay, len);
+                n = str_make(hay + at, nlen);
+                want = naive_find(s, n);
+                got = str_find(s, n);
+                mu_assert(got == want, "len %zu nlen %zu at %zu: got %zd want %zd",
+                          len, nlen, at, got, want);
+            }
+        }
+    }
+    mu_assert(str_count(STR_LIT("aaaaa"), STR_LIT("aa")) == 2, "count overlaps");
+    mu_assert(str_count(STR_LIT("abc"), STR_LIT("")) == 0, "count empty");
+    return NULL;
+}
+
+const char *test_trim() {
+    const char *cases[][2] = {
+        {"", ""},
+        {"   ", ""},
+        {"x", "x"},
+        {" \t\r\n x y \v\f", "x y"},
+        {"                    long  middle                      ", "long  middle"},
+        {"                                                  ", ""},
+        {"x                                               x", "x                                               x"},
+    };
+    size_t i;
+    str_t got;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        got = str_trim(str_from(cases[i][0]));
+        mu_assert(str_eq(got, str_from(cases[i][1])), "trim '%s' gave '%.*s'",
+                  cases[i][0], STR_FMT(got));
+    }
+    got = str_ltrim(STR_LIT("                   \xa0 x  "));
+    mu_assert(got.ptr[0] == '\xa0', "non-ASCII byte trimmed");
+    return NULL;
+}
+
+const char *test_split() {
+    const char *want[] = {"a", "", "bc", ""};
+    str_t rest = STR_LIT("a,,bc,"), tok;
+    size_t n = 0;
+
+    while (str_split_next(&rest, ',', &tok)) {
+        mu_assert(n < 4, "too many tokens");
+        mu_assert(str_eq(tok, str_from(want[n])), "token %zu is '%.*s'", n,
+                  STR_FMT(tok));
+        n++;
+    }
+    mu_assert(n == 4, "expected 4 tokens, got %zu", n);
+
+    rest = STR_LIT("");
+    mu_assert(str_split_next(&rest, ',', &tok) && tok.len == 0,
+              "empty string gave no token");
+    mu_assert(!str_split_next(&rest, ',', &tok), "token after the last");
+
+    n = 0;
+    rest = STR_LIT("k1 => v1 => v2");
+    while (str_split_next_str(&rest, STR_LIT(" => "), &tok)) {
+        n++;
+    }
+    mu_assert(n == 3, "expected 3 tokens, got %zu", n);
+    mu_assert(str_eq(tok, STR_LIT("v2")), "last token '%.*s'", STR_FMT(tok));
+    return NULL;
+}
+
+const char *test_case() {
+    char src[256], lower[256], upper[256];
+    size_t i, len;
+
+    for (i = 0; i < sizeof(src); i++) {
+        src[i] = (char)i;
+    }
+    for (len = 0; len <= sizeof(src); len += 17) {
+        str_tolower(lower, str_make(src, len));
+        str_toupper(upper, str_make(src, len));
+        for (i = 0; i < len; i++) {
+            unsigned char c = src[i];
+            mu_assert(lower[i] == (char)(c < 128 ? tolower(c) : c),
+                      "tolower(%u) gave %u", c, (unsigned char)lower[i]);
+            mu_assert(upper[i] == (char)(c < 128 ? toupper(c) : c),
+                      "toupper(%u) gave %u", c, (unsigned char)upper[i]);
+        }
+        mu_assert(str_eq_nocase(str_make(lower, len), str_make(upper, len)),
+                  "eq_nocase false at len %zu", len);
+    }
+
+    memcpy(lower, "Mixed Case In Place, Forty Bytes Long..", 40);
+    str_toupper(lower, str_make(lower, 40));
+    mu_assert(!memcmp(lower, "MIXED CASE IN PLACE, FORTY BYTES LONG..", 40),
+              "in-place toupper");
+    mu_assert(!str_eq_nocase(STR_LIT("@"), STR_LIT("`")), "'@' == '`'");
+    mu_assert(!str_eq_nocase(STR_LIT("abcdefghijklmnopq["),
+                             STR_LIT("ABCDEFGHIJKLMNOPQ{")), "'[' == '{'");
+    return NULL;
+}
+
+const char *test_builder() {
+    strbuf_t sb;
+    size_t i, cap;
+    char *buf;
+
+    sb_init(&sb, NULL);
+    mu_assert(sb_str(&sb).len == 0 && sb_str(&sb).ptr, "empty builder");
+    for (i = 0; i < 1000; i++) {
+        mu_assert(sb_append_char(&sb, 'a' + i % 26) == 0, "append_char failed");
+        mu_assert(sb.cap >= sb.len + 1, "no room for the NUL");
+    }
+    mu_assert(sb.data[1000] == '\0' && strlen(sb.data) == 1000, "not terminated");
+    sb_clear(&sb);
+    mu_assert(sb_printf(&sb, "%s=%d", "x", 42) == 0, "printf failed");
+    mu_assert(sb_printf(&sb, "%0200d", 7) == 0, "long printf failed");
+    mu_assert(sb.len == 204 && !memcmp(sb.data, "x=4200", 6),
+              "printf output '%.10s' len %zu", sb.data, sb.len);
+    mu_assert(sb.data[203] == '7', "printf tail");
+    sb_free(&sb);
+
+    mu_assert(sb_append_replace(&sb, STR_LIT("a-b--c"), STR_LIT("-"),
+                                STR_LIT("<>")) == 3, "replace count");
+    mu_assert(!strcmp(sb.data, "a<>b<><>c"), "replace gave %s", sb.data);
+    sb_clear(&sb);
+    mu_assert(sb_append_replace(&sb, STR_LIT("xx"), STR_LIT("xxx"),
+                                STR_LIT("")) == 0, "no replacements");
+    mu_assert(!strcmp(sb.data, "xx"), "replace gave %s", sb.data);
+    mu_assert(sb_append_replace(&sb, STR_LIT("x"), STR_LIT(""),
+                                STR_LIT("y")) == -1 && errno == EINVAL,
+              "empty pattern accepted");
+    buf = sb_detach(&sb, &cap);
+    mu_assert(buf && !strcmp(buf, "xx") && cap >= 3, "detach");
+    mu_assert(sb.data == NULL && sb.len == 0, "builder not reset");
+    free(buf);
+    return NULL;
+}
+
+const char *test_builder_arena() {
+    arena_t arena;
+    strbuf_t sb;
+    int i;
+
+    arena_init(&arena, 0);
+    sb_init(&sb, arena_allocator(&arena));
+    for (i = 0; i < 500; i++) {
+        mu_assert(sb_printf(&sb, "%d,", i) == 0, "printf failed");
+    }
+    mu_assert(!strncmp(sb.data, "0,1,2,", 6) &&
+              str_ends_with(str_make(sb.data, sb.len), STR_LIT("498,499,")),
+              "arena contents");
+    arena_destroy(&arena);
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    mu_run_test(test_slices);
+    mu_run_test(test_find);
+    mu_run_test(test_trim);
+    mu_run_test(test_split);
+    mu_run_test(test_case);
+    mu_run_test(test_builder);
+    mu_run_test(test_builder_arena);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,112 @@
+/* the pool is shared by all tests, and its workers would not survive fork() */
+#define MU_NO_FORK
+#include "minunit.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "threadpool.h"
+
+static tp_pool_t *pool;
+
+static void count_task(void *arg) {
+    __atomic_add_fetch((long *)arg, 1, __ATOMIC_RELAXED);
+}
+
+const char *test_submit(size_t ntasks) {
+    tp_waitgroup_t wg;
+    long counter = 0;
+    size_t i;
+
+    tp_wg_init(&wg);
+    for (i = 0; i < ntasks; i++) {
+        mu_assert(tp_submit(pool, count_task, &counter, &wg) == 0,
+                  "tp_submit failed");
+    }
+    tp_wg_wait(pool, &wg);
+    tp_wg_destroy(&wg);
+    mu_assert(counter == (long)ntasks, "Expected %zu tasks run, got %ld",
+              ntasks, counter);
+    return NULL;
+}
+
+typedef struct {
+    int depth;
+    long *leaves;
+} tree_arg_t;
+
+/* every task spawns two children from inside the pool and waits for them */
+static void tree_task(void *arg) {
+    tree_arg_t *t = arg, children[2];
+    tp_waitgroup_t wg;
+    int i;
+
+    if (t->depth == 0) {
+        __atomic_add_fetch(t->leaves, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    tp_wg_init(&wg);
+    for (i = 0; i < 2; i++) {
+        children[i].depth = t->depth - 1;
+        children[i].leaves = t->leaves;
+        tp_submit(pool, tree_task, &children[i], &wg);
+    }
+    tp_wg_wait(pool, &wg);
+    tp_wg_destroy(&wg);
+}
+
+const char *test_nested(int depth) {
+    long leaves = 0;
+    tree_arg_t root = {depth, &leaves};
+    tp_waitgroup_t wg;
+
+    tp_wg_init(&wg);
+    mu_assert(tp_submit(pool, tree_task, &root, &wg) == 0, "tp_submit failed");
+    tp_wg_wait(pool, &wg);
+    tp_wg_destroy(&wg);
+    mu_assert(leaves == 1L << depth, "Expected %ld leaves, got %ld",
+              1L << depth, leaves);
+    return NULL;
+}
+
+static void fill_range(size_t begin, size_t end, void *arg) {
+    unsigned char *hits = arg;
+    size_t i;
+    for (i = begin; i < end; i++) {
+        hits[i]++;
+    }
+}
+
+const char *test_parallel_for(size_t n, size_t grain) {
+    unsigned char *hits = calloc(n, 1);
+    size_t i;
+
+    mu_assert(hits, "Out of memory");
+    mu_assert(tp_parallel_for(pool, 0, n, grain, fill_range, hits) == 0,
+              "tp_parallel_for failed");
+    for (i = 0; i < n; i++) {
+        mu_assert(hits[i] == 1, "Index %zu visited %d times", i, hits[i]);
+    }
+    free(hits);
+    return NULL;
+}
+
+const char *all_tests() {
+    mu_suite_start();
+
+    pool = tp_create(4);
+    mu_assert(pool, "tp_create failed");
+    mu_assert(tp_size(pool) == 4, "Wrong pool size");
+    mu_assert(tp_worker_id(pool) == -1, "Main thread is not a worker");
+
+    mu_run_test(test_submit, 1);
+    mu_run_test(test_submit, 10000);
+    mu_run_test(test_nested, 12);
+    mu_run_test(test_parallel_for, 1, 0);
+    mu_run_test(test_parallel_for, 1000003, 0);
+    mu_run_test(test_parallel_for, 5000, 1);
+
+    tp_destroy(pool);
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -2,8 +2,13 @@
 #include "utils.h"
 
 const char *test_endian() {
-    mu_assert(is_little_endian() == __LITTLE_ENDIAN__, "Expected: %d, got: %d",
-              __LITTLE_ENDIAN__, is_little_endian());
+    const union {
+        uint16_t u16;
+        uint8_t first;
+    } probe = {.u16 = 1};
+
+    mu_assert(is_little_endian() == probe.first, "Expected: %d, got: %d",
+              probe.first, is_little_endian());
     return NULL;
 }
 